@@ -1306,6 +1306,20 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	if (error_code & X86_PF_INSTR)
 		flags |= FAULT_FLAG_INSTRUCTION;
 
+	/*
+	 * Try to resolve the fault without mmap_sem first. Protection key
+	 * and read protection faults are errors, which, like anything else
+	 * the speculative path doesn't handle, are sorted out below.
+	 */
+	if (!(error_code & X86_PF_PK) &&
+	    (error_code & (X86_PF_PROT | X86_PF_WRITE)) != X86_PF_PROT) {
+		fault = handle_speculative_fault(mm, address, flags);
+		if (!(fault & VM_FAULT_RETRY)) {
+			major |= fault & VM_FAULT_MAJOR;
+			goto done;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1425,6 +1439,7 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 		return;
 	}
 
+done:
 	/*
 	 * Major/minor page fault accounting. If any of the events
 	 * returned VM_FAULT_MAJOR, we account it as a major fault.
@@ -34,6 +34,8 @@
 
 #include <linux/reservation.h>
 #include <linux/export.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 /**
  * DOC: Reservation Object Overview
@@ -44,8 +46,18 @@
  * write operations) or N shared fences (read operations).  The RCU
  * mechanism is used to protect read access to fences from locked
  * write-side updates.
+ *
+ * Shared fences are kept in a flat RCU protected array, so readers can walk
+ * them without any locking. Only one fence per fence context is kept, and
+ * the update side finds the slot of a context through a small hash index
+ * stored behind the array instead of scanning it. Signaled fences are pruned
+ * a few slots at a time whenever a fence is added, and all at once whenever
+ * the array has to grow.
  */
 
+/* Number of slots checked for a signaled fence on each add */
+#define RESERVATION_PRUNE_BATCH 2
+
 DEFINE_WW_CLASS(reservation_ww_class);
 EXPORT_SYMBOL(reservation_ww_class);
 
@@ -55,6 +67,130 @@ EXPORT_SYMBOL(reservation_seqcount_class);
 const char reservation_seqcount_string[] = "reservation_seqcount";
 EXPORT_SYMBOL(reservation_seqcount_string);
 
+/**
+ * reservation_object_list_alloc - allocate a shared fence list
+ * @shared_max: number of fence slots
+ *
+ * Allocate a list with room for @shared_max fences plus the context index.
+ * The list starts empty and can be freed with kfree() or kfree_rcu().
+ *
+ * RETURNS
+ * The new list or NULL on allocation failure.
+ */
+struct reservation_object_list *
+reservation_object_list_alloc(unsigned int shared_max)
+{
+	struct reservation_object_list *list;
+	unsigned int bits = order_base_2(max(shared_max, 2u) * 2);
+	size_t size;
+
+	size = offsetof(typeof(*list), shared[shared_max]);
+	size = ALIGN(size, sizeof(u32));
+	list = kmalloc(size + (sizeof(u32) << bits), GFP_KERNEL);
+	if (!list)
+		return NULL;
+
+	list->shared_count = 0;
+	list->shared_max = shared_max;
+	list->index = (u32 *)((u8 *)list + size);
+	list->index_bits = bits;
+	list->index_valid = false;
+	list->prune_cursor = 0;
+
+	return list;
+}
+EXPORT_SYMBOL(reservation_object_list_alloc);
+
+/*
+ * The index is an open addressed hash table with linear probing. Each bucket
+ * holds a slot number plus one, zero marks an empty bucket. It is only used
+ * by the update side and always has at least twice as many buckets as slots.
+ */
+static inline u32 reservation_index_hash(struct reservation_object_list *list,
+					 u64 context)
+{
+	return hash_64(context, list->index_bits);
+}
+
+static inline struct dma_fence *
+reservation_list_fence(struct reservation_object *obj,
+		       struct reservation_object_list *list, u32 slot)
+{
+	return rcu_dereference_protected(list->shared[slot],
+					 reservation_object_held(obj));
+}
+
+static void reservation_index_insert(struct reservation_object *obj,
+				     struct reservation_object_list *list,
+				     u32 slot)
+{
+	u32 mask = (1u << list->index_bits) - 1;
+	u32 i = reservation_index_hash(list,
+				       reservation_list_fence(obj, list,
+							      slot)->context);
+
+	while (list->index[i])
+		i = (i + 1) & mask;
+	list->index[i] = slot + 1;
+}
+
+static void reservation_index_remove(struct reservation_object *obj,
+				     struct reservation_object_list *list,
+				     u32 slot)
+{
+	u32 mask = (1u << list->index_bits) - 1;
+	u32 i, j, h;
+
+	i = reservation_index_hash(list,
+				   reservation_list_fence(obj, list,
+							  slot)->context);
+	while (list->index[i] != slot + 1) {
+		if (WARN_ON(!list->index[i]))
+			return;
+		i = (i + 1) & mask;
+	}
+
+	/* Shift back following entries so probe sequences stay unbroken */
+	for (j = (i + 1) & mask; list->index[j]; j = (j + 1) & mask) {
+		h = reservation_index_hash(list,
+					   reservation_list_fence(obj, list,
+								  list->index[j] - 1)->context);
+		if (((j - h) & mask) >= ((j - i) & mask)) {
+			list->index[i] = list->index[j];
+			i = j;
+		}
+	}
+	list->index[i] = 0;
+}
+
+static int reservation_index_find(struct reservation_object *obj,
+				  struct reservation_object_list *list,
+				  u64 context)
+{
+	u32 mask = (1u << list->index_bits) - 1;
+	u32 i = reservation_index_hash(list, context);
+
+	for (; list->index[i]; i = (i + 1) & mask) {
+		u32 slot = list->index[i] - 1;
+
+		if (reservation_list_fence(obj, list, slot)->context == context)
+			return slot;
+	}
+
+	return -1;
+}
+
+static void reservation_index_rebuild(struct reservation_object *obj,
+				      struct reservation_object_list *list)
+{
+	u32 i;
+
+	memset(list->index, 0, sizeof(u32) << list->index_bits);
+	for (i = 0; i < list->shared_count; ++i)
+		reservation_index_insert(obj, list, i);
+	list->index_valid = true;
+}
+
 /**
  * reservation_object_reserve_shared - Reserve space to add shared fences to
  * a reservation_object.
@@ -85,7 +221,7 @@ int reservation_object_reserve_shared(struct reservation_object *obj,
 		max = 4;
 	}
 
-	new = kmalloc(offsetof(typeof(*new), shared[max]), GFP_KERNEL);
+	new = reservation_object_list_alloc(max);
 	if (!new)
 		return -ENOMEM;
 
@@ -106,7 +242,7 @@ int reservation_object_reserve_shared(struct reservation_object *obj,
 			RCU_INIT_POINTER(new->shared[j++], fence);
 	}
 	new->shared_count = j;
-	new->shared_max = max;
+	reservation_index_rebuild(obj, new);
 
 	preempt_disable();
 	write_seqcount_begin(&obj->seq);
@@ -147,38 +283,51 @@ void reservation_object_add_shared_fence(struct reservation_object *obj,
 					 struct dma_fence *fence)
 {
 	struct reservation_object_list *fobj;
-	unsigned int i, count;
+	struct dma_fence *old_fence = NULL;
+	unsigned int count, n;
+	int i;
 
 	dma_fence_get(fence);
 
 	fobj = reservation_object_get_list(obj);
 	count = fobj->shared_count;
 
-	preempt_disable();
-	write_seqcount_begin(&obj->seq);
+	if (!fobj->index_valid)
+		reservation_index_rebuild(obj, fobj);
 
-	for (i = 0; i < count; ++i) {
-		struct dma_fence *old_fence;
+	/* Replace the fence from the same context, or failing that a few
+	 * signaled ones. The slots are checked round robin, so over time all
+	 * of them get visited without scanning the whole array on every add.
+	 */
+	i = reservation_index_find(obj, fobj, fence->context);
+	for (n = 0; i < 0 && n < min(count, RESERVATION_PRUNE_BATCH); ++n) {
+		u32 slot = fobj->prune_cursor++ % count;
 
-		old_fence = rcu_dereference_protected(fobj->shared[i],
-						      reservation_object_held(obj));
-		if (old_fence->context == fence->context ||
-		    dma_fence_is_signaled(old_fence)) {
-			dma_fence_put(old_fence);
-			goto replace;
-		}
+		if (dma_fence_is_signaled(reservation_list_fence(obj, fobj,
+								 slot)))
+			i = slot;
 	}
 
-	BUG_ON(fobj->shared_count >= fobj->shared_max);
-	count++;
+	if (i >= 0) {
+		old_fence = reservation_list_fence(obj, fobj, i);
+		reservation_index_remove(obj, fobj, i);
+	} else {
+		BUG_ON(fobj->shared_count >= fobj->shared_max);
+		i = count++;
+	}
+
+	preempt_disable();
+	write_seqcount_begin(&obj->seq);
 
-replace:
 	RCU_INIT_POINTER(fobj->shared[i], fence);
 	/* pointer update must be visible before we extend the shared_count */
 	smp_store_mb(fobj->shared_count, count);
 
 	write_seqcount_end(&obj->seq);
 	preempt_enable();
+
+	reservation_index_insert(obj, fobj, i);
+	dma_fence_put(old_fence);
 }
 EXPORT_SYMBOL(reservation_object_add_shared_fence);
 
@@ -207,8 +356,10 @@ void reservation_object_add_excl_fence(struct reservation_object *obj,
 	write_seqcount_begin(&obj->seq);
 	/* write_seqcount_begin provides the necessary memory barrier */
 	RCU_INIT_POINTER(obj->fence_excl, fence);
-	if (old)
+	if (old) {
 		old->shared_count = 0;
+		old->index_valid = false;
+	}
 	write_seqcount_end(&obj->seq);
 	preempt_enable();
 
@@ -233,7 +384,6 @@ int reservation_object_copy_fences(struct reservation_object *dst,
 {
 	struct reservation_object_list *src_list, *dst_list;
 	struct dma_fence *old, *new;
-	size_t size;
 	unsigned i;
 
 	rcu_read_lock();
@@ -243,10 +393,9 @@ int reservation_object_copy_fences(struct reservation_object *dst,
 	if (src_list) {
 		unsigned shared_count = src_list->shared_count;
 
-		size = offsetof(typeof(*src_list), shared[shared_count]);
 		rcu_read_unlock();
 
-		dst_list = kmalloc(size, GFP_KERNEL);
+		dst_list = reservation_object_list_alloc(shared_count);
 		if (!dst_list)
 			return -ENOMEM;
 
@@ -257,8 +406,6 @@ int reservation_object_copy_fences(struct reservation_object *dst,
 			goto retry;
 		}
 
-		dst_list->shared_count = 0;
-		dst_list->shared_max = shared_count;
 		for (i = 0; i < src_list->shared_count; ++i) {
 			struct dma_fence *fence;
 
@@ -315,9 +462,10 @@ EXPORT_SYMBOL(reservation_object_copy_fences);
  * @pshared: the array of shared fence ptrs returned (array is krealloc'd to
  * the required size, and must be freed by caller)
  *
- * Retrieve all fences from the reservation object. If the pointer for the
- * exclusive fence is not specified the fence is put into the array of the
- * shared fences as well. Returns either zero or -ENOMEM.
+ * Retrieve all fences from the reservation object. Shared fences which are
+ * already signaled are left out. If the pointer for the exclusive fence is
+ * not specified the fence is put into the array of the shared fences as
+ * well. Returns either zero or -ENOMEM.
  */
 int reservation_object_get_fences_rcu(struct reservation_object *obj,
 				      struct dma_fence **pfence_excl,
@@ -326,15 +474,15 @@ int reservation_object_get_fences_rcu(struct reservation_object *obj,
 {
 	struct dma_fence **shared = NULL;
 	struct dma_fence *fence_excl;
-	unsigned int shared_count;
+	unsigned int shared_count, shared_size = 0;
 	int ret = 1;
 
 	do {
 		struct reservation_object_list *fobj;
-		unsigned int i, seq;
-		size_t sz = 0;
+		unsigned int i, j, count, seq;
+		size_t sz;
 
-		shared_count = i = 0;
+		shared_count = i = j = 0;
 
 		rcu_read_lock();
 		seq = read_seqcount_begin(&obj->seq);
@@ -343,23 +491,29 @@ int reservation_object_get_fences_rcu(struct reservation_object *obj,
 		if (fence_excl && !dma_fence_get_rcu(fence_excl))
 			goto unlock;
 
+		/* Size the snapshot by the fences actually present, not by the
+		 * capacity of the list, and keep the buffer across retries.
+		 */
 		fobj = rcu_dereference(obj->fence);
-		if (fobj)
-			sz += sizeof(*shared) * fobj->shared_max;
-
+		count = fobj ? READ_ONCE(fobj->shared_count) : 0;
+		sz = count;
 		if (!pfence_excl && fence_excl)
-			sz += sizeof(*shared);
+			++sz;
 
-		if (sz) {
+		if (sz > shared_size) {
 			struct dma_fence **nshared;
 
-			nshared = krealloc(shared, sz,
+			nshared = krealloc(shared, sizeof(*shared) * sz,
 					   GFP_NOWAIT | __GFP_NOWARN);
 			if (!nshared) {
 				rcu_read_unlock();
-				nshared = krealloc(shared, sz, GFP_KERNEL);
+				dma_fence_put(fence_excl);
+				fence_excl = NULL;
+				nshared = krealloc(shared, sizeof(*shared) * sz,
+						   GFP_KERNEL);
 				if (nshared) {
 					shared = nshared;
+					shared_size = sz;
 					continue;
 				}
 
@@ -367,28 +521,37 @@ int reservation_object_get_fences_rcu(struct reservation_object *obj,
 				break;
 			}
 			shared = nshared;
-			shared_count = fobj ? fobj->shared_count : 0;
-			for (i = 0; i < shared_count; ++i) {
-				shared[i] = rcu_dereference(fobj->shared[i]);
-				if (!dma_fence_get_rcu(shared[i]))
-					break;
-			}
+			shared_size = sz;
+		}
 
-			if (!pfence_excl && fence_excl) {
-				shared[i] = fence_excl;
-				fence_excl = NULL;
-				++i;
-				++shared_count;
-			}
+		/* Already signaled fences are skipped, callers only use the
+		 * snapshot to wait for or depend on the remaining ones.
+		 */
+		for (i = 0; i < count; ++i) {
+			struct dma_fence *fence;
+
+			fence = rcu_dereference(fobj->shared[i]);
+			if (test_bit(DMA_FENCE_FLAG_SIGNALED_BIT, &fence->flags))
+				continue;
+
+			if (!dma_fence_get_rcu(fence))
+				break;
+			shared[j++] = fence;
 		}
 
-		if (i != shared_count || read_seqcount_retry(&obj->seq, seq)) {
-			while (i--)
-				dma_fence_put(shared[i]);
+		if (i != count || read_seqcount_retry(&obj->seq, seq)) {
+			while (j--)
+				dma_fence_put(shared[j]);
 			dma_fence_put(fence_excl);
 			goto unlock;
 		}
 
+		if (!pfence_excl && fence_excl) {
+			shared[j++] = fence_excl;
+			fence_excl = NULL;
+		}
+
+		shared_count = j;
 		ret = 0;
 unlock:
 		rcu_read_unlock();
@@ -16,6 +16,9 @@
 
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/reservation.h>
+#include <linux/sched.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
 #include <linux/sync_file.h>
@@ -422,3 +425,160 @@ const struct file_operations sw_sync_debugfs_fops = {
 	.unlocked_ioctl = sw_sync_ioctl,
 	.compat_ioctl	= sw_sync_ioctl,
 };
+
+/*
+ * Reservation object benchmark
+ *
+ * Writing "<contexts> <rounds>" to <debugfs>/sync/resv_bench creates one
+ * timeline per context and, for every round, adds a new fence of each
+ * timeline as shared fence to a single reservation object and takes an RCU
+ * snapshot of it. Half of the timelines are signaled after each round so the
+ * object always holds a mix of busy and idle fences. Reading the file returns
+ * the result of the last run.
+ */
+#define RESV_BENCH_MAX_CONTEXTS	65536
+#define RESV_BENCH_MAX_ROUNDS	100000
+
+static DEFINE_MUTEX(resv_bench_lock);
+static char resv_bench_result[128];
+
+static int resv_bench_run(unsigned int contexts, unsigned int rounds)
+{
+	struct reservation_object resv;
+	struct sync_timeline **timelines;
+	struct reservation_object_list *fobj;
+	u64 add_ns = 0, snapshot_ns = 0;
+	unsigned int c, r, shared_left = 0;
+	int ret = 0;
+
+	timelines = kcalloc(contexts, sizeof(*timelines), GFP_KERNEL);
+	if (!timelines)
+		return -ENOMEM;
+
+	for (c = 0; c < contexts; c++) {
+		timelines[c] = sync_timeline_create("resv_bench");
+		if (!timelines[c]) {
+			ret = -ENOMEM;
+			goto out_timelines;
+		}
+	}
+
+	reservation_object_init(&resv);
+
+	for (r = 1; r <= rounds && !ret; r++) {
+		struct dma_fence *excl, **shared;
+		unsigned int count, i;
+		ktime_t start;
+
+		for (c = 0; c < contexts; c++) {
+			struct sync_pt *pt;
+
+			pt = sync_pt_create(timelines[c], r);
+			if (!pt) {
+				ret = -ENOMEM;
+				break;
+			}
+
+			start = ktime_get();
+			ww_mutex_lock(&resv.lock, NULL);
+			ret = reservation_object_reserve_shared(&resv, 1);
+			if (!ret)
+				reservation_object_add_shared_fence(&resv,
+								    &pt->base);
+			ww_mutex_unlock(&resv.lock);
+			add_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+			dma_fence_put(&pt->base);
+			if (ret)
+				break;
+		}
+
+		start = ktime_get();
+		ret = ret ?: reservation_object_get_fences_rcu(&resv, &excl,
+							       &count, &shared);
+		snapshot_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		if (ret)
+			break;
+
+		for (i = 0; i < count; i++)
+			dma_fence_put(shared[i]);
+		kfree(shared);
+		dma_fence_put(excl);
+
+		for (c = r & 1; c < contexts; c += 2)
+			sync_timeline_signal(timelines[c],
+					     r - timelines[c]->value);
+
+		/* Runs as long as debugfs asks for, outside the timed parts */
+		cond_resched();
+	}
+
+	ww_mutex_lock(&resv.lock, NULL);
+	fobj = reservation_object_get_list(&resv);
+	if (fobj)
+		shared_left = fobj->shared_count;
+	ww_mutex_unlock(&resv.lock);
+
+	if (!ret) {
+		snprintf(resv_bench_result, sizeof(resv_bench_result),
+			 "contexts %u rounds %u: add %llu ns, snapshot %llu ns, %u shared left\n",
+			 contexts, rounds,
+			 div64_u64(add_ns, (u64)contexts * rounds),
+			 div_u64(snapshot_ns, rounds), shared_left);
+	}
+
+	reservation_object_fini(&resv);
+
+out_timelines:
+	for (c = 0; c < contexts && timelines[c]; c++) {
+		sync_timeline_signal(timelines[c], rounds - timelines[c]->value);
+		sync_timeline_put(timelines[c]);
+	}
+	kfree(timelines);
+
+	return ret;
+}
+
+static ssize_t resv_bench_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	unsigned int contexts, rounds;
+	char tmp[32];
+	int ret;
+
+	if (count >= sizeof(tmp))
+		return -EINVAL;
+	if (copy_from_user(tmp, buf, count))
+		return -EFAULT;
+	tmp[count] = '\0';
+
+	if (sscanf(tmp, "%u %u", &contexts, &rounds) != 2 ||
+	    !contexts || contexts > RESV_BENCH_MAX_CONTEXTS ||
+	    !rounds || rounds > RESV_BENCH_MAX_ROUNDS)
+		return -EINVAL;
+
+	mutex_lock(&resv_bench_lock);
+	ret = resv_bench_run(contexts, rounds);
+	mutex_unlock(&resv_bench_lock);
+
+	return ret ?: count;
+}
+
+static ssize_t resv_bench_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&resv_bench_lock);
+	ret = simple_read_from_buffer(buf, count, ppos, resv_bench_result,
+				      strlen(resv_bench_result));
+	mutex_unlock(&resv_bench_lock);
+
+	return ret;
+}
+
+const struct file_operations sw_sync_resv_bench_fops = {
+	.read		= resv_bench_read,
+	.write		= resv_bench_write,
+	.llseek		= default_llseek,
+};
@@ -203,6 +203,8 @@ static __init int sync_debugfs_init(void)
 				   &sync_info_debugfs_fops);
 	debugfs_create_file_unsafe("sw_sync", 0644, dbgfs, NULL,
 				   &sw_sync_debugfs_fops);
+	debugfs_create_file_unsafe("resv_bench", 0600, dbgfs, NULL,
+				   &sw_sync_resv_bench_fops);
 
 	return 0;
 }
@@ -63,6 +63,7 @@ struct sync_pt {
 };
 
 extern const struct file_operations sw_sync_debugfs_fops;
+extern const struct file_operations sw_sync_resv_bench_fops;
 
 void sync_timeline_debug_add(struct sync_timeline *obj);
 void sync_timeline_debug_remove(struct sync_timeline *obj);
@@ -142,6 +142,9 @@ extern uint amdgpu_pcie_lane_cap;
 extern uint amdgpu_cg_mask;
 extern uint amdgpu_pg_mask;
 extern uint amdgpu_sdma_phase_quantum;
+extern uint amdgpu_sdma_stripe_size;
+extern uint amdgpu_kfd_vm_pool_size;
+extern int amdgpu_vram_clear_pool;
 extern char *amdgpu_disable_cu;
 extern char *amdgpu_virtual_display;
 extern uint amdgpu_pp_feature_mask;
@@ -445,6 +448,14 @@ struct amdgpu_cs_chunk {
 	void			*kdata;
 };
 
+#if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
+struct amdgpu_cs_post_dep {
+	struct drm_syncobj *syncobj;
+	struct dma_fence_chain *chain;
+	u64 point;
+};
+#endif
+
 struct amdgpu_cs_parser {
 	struct amdgpu_device	*adev;
 	struct drm_file		*filp;
@@ -475,8 +486,8 @@ struct amdgpu_cs_parser {
 	struct amdgpu_bo_list_entry	uf_entry;
 
 #if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
-	unsigned num_post_dep_syncobjs;
-	struct drm_syncobj **post_dep_syncobjs;
+	unsigned			num_post_deps;
+	struct amdgpu_cs_post_dep	*post_deps;
 #endif
 };
 
@@ -513,6 +524,9 @@ void amdgpu_device_wb_free(struct amdgpu_device *adev, u32 wb);
  * Benchmarking
  */
 void amdgpu_benchmark(struct amdgpu_device *adev, int test_number);
+#if defined(CONFIG_DEBUG_FS)
+int amdgpu_benchmark_suite(struct amdgpu_device *adev);
+#endif
 
 
 /*
@@ -781,6 +795,10 @@ struct amdgpu_device {
 	unsigned			debugfs_count;
 #if defined(CONFIG_DEBUG_FS)
 	struct dentry			*debugfs_regs[AMDGPU_DEBUGFS_MAX_COMPONENTS];
+	/* results of the last amdgpu_benchmark_suite run */
+	struct mutex			benchmark_lock;
+	char				*benchmark_report;
+	size_t				benchmark_report_len;
 #endif
 	struct amdgpu_atif		*atif;
 	struct amdgpu_atcs		atcs;
@@ -1112,7 +1130,8 @@ int amdgpu_device_gpu_recover(struct amdgpu_device *adev,
 void amdgpu_device_pci_config_reset(struct amdgpu_device *adev);
 bool amdgpu_device_need_post(struct amdgpu_device *adev);
 
-void amdgpu_cs_report_moved_bytes(struct amdgpu_device *adev, u64 num_bytes,
+void amdgpu_cs_report_moved_bytes(struct amdgpu_device *adev,
+				  struct amdgpu_ctx *ctx, u64 num_bytes,
 				  u64 num_vis_bytes);
 #if !defined(BUILD_AS_DKMS) || LINUX_VERSION_CODE >= KERNEL_VERSION(4, 15, 0)
 int amdgpu_device_resize_fb_bar(struct amdgpu_device *adev);
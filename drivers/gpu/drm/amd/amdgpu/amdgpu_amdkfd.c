@@ -28,6 +28,7 @@
 #include <drm/drmP.h>
 #include "amdgpu.h"
 #include "amdgpu_gfx.h"
+#include "amdgpu_xgmi.h"
 #include <linux/module.h>
 
 static unsigned int compute_vmid_bitmap = 0xFF00;
@@ -54,8 +55,10 @@ int amdgpu_amdkfd_init(void)
 	amdgpu_amdkfd_total_mem_size *= si.mem_unit;
 
 #ifdef CONFIG_HSA_AMD
+	ret = amdgpu_amdkfd_gpuvm_init_mem_limits();
+	if (ret)
+		return ret;
 	ret = kgd2kfd_init();
-	amdgpu_amdkfd_gpuvm_init_mem_limits();
 #else
 	ret = -ENOENT;
 #endif
@@ -66,12 +69,20 @@ int amdgpu_amdkfd_init(void)
 void amdgpu_amdkfd_fini(void)
 {
 	kgd2kfd_exit();
+#ifdef CONFIG_HSA_AMD
+	amdgpu_amdkfd_gpuvm_fini_mem_limits();
+#endif
 }
 
 void amdgpu_amdkfd_device_probe(struct amdgpu_device *adev)
 {
 	const struct kfd2kgd_calls *kfd2kgd;
 
+	amdgpu_amdkfd_gpuvm_vm_pool_init(adev);
+
+	if (percpu_counter_init(&adev->kfd.vram_used, 0, GFP_KERNEL))
+		return;
+
 	switch (adev->asic_type) {
 #ifdef CONFIG_DRM_AMDGPU_CIK
 	case CHIP_KAVERI:
@@ -189,6 +200,8 @@ void amdgpu_amdkfd_device_init(struct amdgpu_device *adev)
 				&gpu_resources.doorbell_aperture_size,
 				&gpu_resources.doorbell_start_offset);
 
+		amdgpu_amdkfd_gpuvm_vm_pool_start(adev);
+
 		if (adev->asic_type < CHIP_VEGA10) {
 			kgd2kfd_device_init(adev->kfd.dev, adev->ddev, &gpu_resources);
 			return;
@@ -225,10 +238,16 @@ void amdgpu_amdkfd_device_init(struct amdgpu_device *adev)
 
 void amdgpu_amdkfd_device_fini(struct amdgpu_device *adev)
 {
+	amdgpu_amdkfd_gpuvm_vm_pool_fini(adev);
+
 	if (adev->kfd.dev) {
 		kgd2kfd_device_exit(adev->kfd.dev);
 		adev->kfd.dev = NULL;
+		WARN_ONCE(percpu_counter_sum(&adev->kfd.vram_used),
+			  "kfd VRAM memory accounting unbalanced");
 	}
+
+	percpu_counter_destroy(&adev->kfd.vram_used);
 }
 
 void amdgpu_amdkfd_interrupt(struct amdgpu_device *adev,
@@ -526,6 +545,15 @@ uint64_t amdgpu_amdkfd_get_hive_id(struct kgd_dev *kgd)
 	return adev->gmc.xgmi.hive_id;
 }
 
+uint8_t amdgpu_amdkfd_get_xgmi_hops_count(struct kgd_dev *dst,
+					  struct kgd_dev *src)
+{
+	struct amdgpu_device *adev = (struct amdgpu_device *)dst;
+	struct amdgpu_device *peer_adev = (struct amdgpu_device *)src;
+
+	return amdgpu_xgmi_get_hops_count(adev, peer_adev);
+}
+
 int amdgpu_amdkfd_submit_ib(struct kgd_dev *kgd, enum kgd_engine_type engine,
 				uint32_t vmid, uint64_t gpu_addr,
 				uint32_t *ib_cmd, uint32_t ib_len)
@@ -623,6 +651,28 @@ void amdgpu_amdkfd_gpuvm_destroy_cb(struct amdgpu_device *adev,
 {
 }
 
+void amdgpu_amdkfd_gpuvm_vm_pool_init(struct amdgpu_device *adev)
+{
+}
+
+void amdgpu_amdkfd_gpuvm_vm_pool_start(struct amdgpu_device *adev)
+{
+}
+
+void amdgpu_amdkfd_gpuvm_vm_pool_fini(struct amdgpu_device *adev)
+{
+}
+
+int amdgpu_debugfs_kfd_vm_pool_init(struct amdgpu_device *adev)
+{
+	return 0;
+}
+
+int amdgpu_debugfs_kfd_mem_limit_init(struct amdgpu_device *adev)
+{
+	return 0;
+}
+
 struct amdgpu_amdkfd_fence *to_amdgpu_amdkfd_fence(struct dma_fence *f)
 {
 	return NULL;
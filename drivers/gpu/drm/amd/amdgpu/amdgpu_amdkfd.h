@@ -28,6 +28,7 @@
 #include <linux/types.h>
 #include <linux/mm.h>
 #include <linux/workqueue.h>
+#include <linux/percpu_counter.h>
 #include <kgd_kfd_interface.h>
 #include <drm/ttm/ttm_execbuf_util.h>
 #include "amdgpu_sync.h"
@@ -61,6 +62,8 @@ struct kgd_mem {
 
 	atomic_t invalid;
 	struct amdkfd_process_info *process_info;
+	/* per-process usage counter this BO is charged to, NULL if none */
+	atomic64_t *process_usage;
 	struct page **user_pages;
 
 	struct amdgpu_sync sync;
@@ -76,9 +79,29 @@ struct amdgpu_amdkfd_fence {
 	char timeline_name[TASK_COMM_LEN];
 };
 
+/* Pool of compute VMs with an allocated and cleared page directory, but
+ * without a PASID or process, refilled in the background.
+ */
+struct amdgpu_amdkfd_vm_pool {
+	struct mutex lock;
+	struct list_head vms;
+	unsigned int count;
+	bool active;
+	struct work_struct refill_work;
+
+	/* statistics, protected by lock */
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t refills;
+	uint64_t refill_failures;
+	uint64_t refill_us_total;
+	uint64_t refill_us_max;
+};
+
 struct amdgpu_kfd_dev {
 	struct kfd_dev *dev;
-	uint64_t vram_used;
+	struct percpu_counter vram_used;
+	struct amdgpu_amdkfd_vm_pool vm_pool;
 };
 
 struct amdgpu_amdkfd_fence *amdgpu_amdkfd_fence_create(u64 context,
@@ -106,6 +129,25 @@ struct amdkfd_process_info {
 	atomic_t evicted_bos;
 	struct delayed_work restore_userptr_work;
 	struct pid *pid;
+
+	/* Memory allocated by this process, in bytes, across all GPUs */
+	atomic64_t vram_used;
+	atomic64_t gtt_used;
+	atomic64_t userptr_used;
+	/* Entry in the global list of KFD processes, for debugfs */
+	struct list_head info_list;
+
+	/* Performance counters, exported per process by KFD */
+	atomic64_t userptr_invalidations;
+	atomic64_t bytes_migrated;
+	atomic64_t pt_updates;
+};
+
+/* Snapshot of the amdkfd_process_info performance counters */
+struct amdgpu_amdkfd_process_counters {
+	uint64_t userptr_invalidations;
+	uint64_t bytes_migrated;
+	uint64_t pt_updates;
 };
 
 int amdgpu_amdkfd_init(void);
@@ -158,6 +200,8 @@ uint32_t amdgpu_amdkfd_get_max_engine_clock_in_mhz(struct kgd_dev *kgd);
 void amdgpu_amdkfd_get_cu_info(struct kgd_dev *kgd, struct kfd_cu_info *cu_info);
 uint64_t amdgpu_amdkfd_get_vram_usage(struct kgd_dev *kgd);
 uint64_t amdgpu_amdkfd_get_hive_id(struct kgd_dev *kgd);
+uint8_t amdgpu_amdkfd_get_xgmi_hops_count(struct kgd_dev *dst,
+					  struct kgd_dev *src);
 
 #define read_user_wptr(mmptr, wptr, dst)				\
 	({								\
@@ -221,8 +265,23 @@ int amdgpu_amdkfd_gpuvm_import_dmabuf(struct kgd_dev *kgd,
 int amdgpu_amdkfd_gpuvm_export_dmabuf(struct kgd_dev *kgd, void *vm,
 				      struct kgd_mem *mem,
 				      struct dma_buf **dmabuf);
-
-void amdgpu_amdkfd_gpuvm_init_mem_limits(void);
+void amdgpu_amdkfd_gpuvm_set_mem_readonly(struct kgd_mem *mem);
+int amdgpu_amdkfd_gpuvm_svm_map(struct kgd_dev *kgd, void *vm,
+				uint64_t start_page, uint64_t npages,
+				dma_addr_t *dma_addr, bool writable,
+				bool executable);
+int amdgpu_amdkfd_gpuvm_svm_unmap(struct kgd_dev *kgd, void *vm,
+				  uint64_t start_page, uint64_t npages);
+void amdgpu_amdkfd_gpuvm_clear_retry_fault(struct kgd_dev *kgd,
+					   unsigned int pasid, uint64_t addr);
+void amdgpu_amdkfd_gpuvm_get_process_counters(void *process_info,
+		struct amdgpu_amdkfd_process_counters *counters);
+
+int amdgpu_amdkfd_gpuvm_init_mem_limits(void);
+void amdgpu_amdkfd_gpuvm_fini_mem_limits(void);
+void amdgpu_amdkfd_gpuvm_vm_pool_init(struct amdgpu_device *adev);
+void amdgpu_amdkfd_gpuvm_vm_pool_start(struct amdgpu_device *adev);
+void amdgpu_amdkfd_gpuvm_vm_pool_fini(struct amdgpu_device *adev);
 void amdgpu_amdkfd_unreserve_memory_limit(struct amdgpu_bo *bo);
 void amdgpu_amdkfd_debug_mem_fence(struct kgd_dev *kgd);
 
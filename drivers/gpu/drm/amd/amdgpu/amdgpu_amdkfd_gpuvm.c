@@ -26,7 +26,9 @@
 #include <linux/list.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0)
 #include <linux/sched/mm.h>
+#include <linux/sched/task.h>
 #endif
+#include <linux/cgroup.h>
 #include <drm/drmP.h>
 #include "amdgpu_object.h"
 #include "amdgpu_vm.h"
@@ -45,15 +47,26 @@
  */
 #define AMDGPU_USERPTR_RESTORE_DELAY_MS 1
 
-/* Impose limit on how much memory KFD can use */
+/* Impose limit on how much memory KFD can use.
+ *
+ * Usage is tracked in percpu counters, which are only summed precisely
+ * when the approximate value is within the counter error of the limit.
+ */
 static struct {
 	uint64_t max_system_mem_limit;
 	uint64_t max_ttm_mem_limit;
-	int64_t system_mem_used;
-	int64_t ttm_mem_used;
-	spinlock_t mem_limit_lock;
+	struct percpu_counter system_mem_used;
+	struct percpu_counter ttm_mem_used;
+	bool initialized;
 } kfd_mem_limit;
 
+/* Per-CPU slack of the usage counters, in bytes */
+#define AMDGPU_AMDKFD_MEM_LIMIT_BATCH (16 << 20)
+
+/* All KFD processes, for the per-process usage breakdown */
+static LIST_HEAD(kfd_process_info_list);
+static DEFINE_MUTEX(kfd_process_info_list_lock);
+
 /* Struct used for amdgpu_amdkfd_bo_validate */
 struct amdgpu_vm_parser {
 	uint32_t        domain;
@@ -95,21 +108,79 @@ static bool check_if_add_bo_to_vm(struct amdgpu_vm *avm,
  *  System (TTM + userptr) memory - 29/32th System RAM
  *  TTM memory - 29/32th System RAM
  */
-void amdgpu_amdkfd_gpuvm_init_mem_limits(void)
+int amdgpu_amdkfd_gpuvm_init_mem_limits(void)
 {
 	struct sysinfo si;
 	uint64_t mem;
+	int ret;
 
 	si_meminfo(&si);
 	mem = si.totalram - si.totalhigh;
 	mem *= si.mem_unit;
 
-	spin_lock_init(&kfd_mem_limit.mem_limit_lock);
+	ret = percpu_counter_init(&kfd_mem_limit.system_mem_used, 0, GFP_KERNEL);
+	if (ret)
+		return ret;
+	ret = percpu_counter_init(&kfd_mem_limit.ttm_mem_used, 0, GFP_KERNEL);
+	if (ret) {
+		percpu_counter_destroy(&kfd_mem_limit.system_mem_used);
+		return ret;
+	}
+
 	kfd_mem_limit.max_system_mem_limit = mem - (3 * (mem >> 5)); /* 29/32 */
 	kfd_mem_limit.max_ttm_mem_limit = mem - (3 * (mem >> 5)); /* 29/32 */
+	kfd_mem_limit.initialized = true;
 	pr_debug("Kernel memory limit %lluM, TTM limit %lluM\n",
 		(kfd_mem_limit.max_system_mem_limit >> 20),
 		(kfd_mem_limit.max_ttm_mem_limit >> 20));
+
+	return 0;
+}
+
+void amdgpu_amdkfd_gpuvm_fini_mem_limits(void)
+{
+	if (!kfd_mem_limit.initialized)
+		return;
+
+	WARN_ONCE(percpu_counter_sum(&kfd_mem_limit.system_mem_used),
+		  "kfd system memory accounting unbalanced");
+	WARN_ONCE(percpu_counter_sum(&kfd_mem_limit.ttm_mem_used),
+		  "kfd TTM memory accounting unbalanced");
+
+	percpu_counter_destroy(&kfd_mem_limit.system_mem_used);
+	percpu_counter_destroy(&kfd_mem_limit.ttm_mem_used);
+	kfd_mem_limit.initialized = false;
+}
+
+static void mem_limit_add(struct percpu_counter *counter, s64 amount)
+{
+#if defined(BUILD_AS_DKMS) && DRM_VERSION_CODE < DRM_VERSION(4, 13, 0)
+	__percpu_counter_add(counter, amount, AMDGPU_AMDKFD_MEM_LIMIT_BATCH);
+#else
+	percpu_counter_add_batch(counter, amount,
+				 AMDGPU_AMDKFD_MEM_LIMIT_BATCH);
+#endif
+}
+
+/* Charge @amount to @counter unless that takes it over @limit. The
+ * charge is added before the check, so concurrent callers near the
+ * limit can only fail spuriously, never overshoot.
+ */
+static bool mem_limit_charge(struct percpu_counter *counter, s64 amount,
+			     s64 limit)
+{
+	mem_limit_add(counter, amount);
+	if (__percpu_counter_compare(counter, limit,
+				     AMDGPU_AMDKFD_MEM_LIMIT_BATCH) > 0) {
+		mem_limit_add(counter, -amount);
+		return false;
+	}
+	return true;
+}
+
+static void mem_limit_uncharge(struct percpu_counter *counter, s64 amount)
+{
+	mem_limit_add(counter, -amount);
 }
 
 static int amdgpu_amdkfd_reserve_mem_limit(struct amdgpu_device *adev,
@@ -117,7 +188,6 @@ static int amdgpu_amdkfd_reserve_mem_limit(struct amdgpu_device *adev,
 {
 	size_t acc_size, system_mem_needed, ttm_mem_needed, vram_needed;
 	uint64_t reserved_for_pt = amdgpu_amdkfd_total_mem_size >> 9;
-	int ret = 0;
 
 	acc_size = ttm_bo_dma_acc_size(&adev->mman.bdev, size,
 				       sizeof(struct amdgpu_bo));
@@ -139,23 +209,26 @@ static int amdgpu_amdkfd_reserve_mem_limit(struct amdgpu_device *adev,
 			vram_needed = size;
 	}
 
-	spin_lock(&kfd_mem_limit.mem_limit_lock);
+	if (!mem_limit_charge(&kfd_mem_limit.system_mem_used,
+			      system_mem_needed,
+			      kfd_mem_limit.max_system_mem_limit))
+		goto err_system;
+	if (!mem_limit_charge(&kfd_mem_limit.ttm_mem_used, ttm_mem_needed,
+			      kfd_mem_limit.max_ttm_mem_limit))
+		goto err_ttm;
+	if (vram_needed &&
+	    !mem_limit_charge(&adev->kfd.vram_used, vram_needed,
+			      adev->gmc.real_vram_size - reserved_for_pt))
+		goto err_vram;
 
-	if ((kfd_mem_limit.system_mem_used + system_mem_needed >
-	     kfd_mem_limit.max_system_mem_limit) ||
-	    (kfd_mem_limit.ttm_mem_used + ttm_mem_needed >
-	     kfd_mem_limit.max_ttm_mem_limit) ||
-	    (adev->kfd.vram_used + vram_needed >
-	     adev->gmc.real_vram_size - reserved_for_pt)) {
-		ret = -ENOMEM;
-	} else {
-		kfd_mem_limit.system_mem_used += system_mem_needed;
-		kfd_mem_limit.ttm_mem_used += ttm_mem_needed;
-		adev->kfd.vram_used += vram_needed;
-	}
+	return 0;
 
-	spin_unlock(&kfd_mem_limit.mem_limit_lock);
-	return ret;
+err_vram:
+	mem_limit_uncharge(&kfd_mem_limit.ttm_mem_used, ttm_mem_needed);
+err_ttm:
+	mem_limit_uncharge(&kfd_mem_limit.system_mem_used, system_mem_needed);
+err_system:
+	return -ENOMEM;
 }
 
 static void unreserve_mem_limit(struct amdgpu_device *adev,
@@ -166,28 +239,51 @@ static void unreserve_mem_limit(struct amdgpu_device *adev,
 	acc_size = ttm_bo_dma_acc_size(&adev->mman.bdev, size,
 				       sizeof(struct amdgpu_bo));
 
-	spin_lock(&kfd_mem_limit.mem_limit_lock);
 	if (domain == AMDGPU_GEM_DOMAIN_GTT) {
-		kfd_mem_limit.system_mem_used -= (acc_size + size);
-		kfd_mem_limit.ttm_mem_used -= (acc_size + size);
+		mem_limit_uncharge(&kfd_mem_limit.system_mem_used,
+				   acc_size + size);
+		mem_limit_uncharge(&kfd_mem_limit.ttm_mem_used,
+				   acc_size + size);
 	} else if (domain == AMDGPU_GEM_DOMAIN_CPU && !sg) {
-		kfd_mem_limit.system_mem_used -= (acc_size + size);
-		kfd_mem_limit.ttm_mem_used -= acc_size;
+		mem_limit_uncharge(&kfd_mem_limit.system_mem_used,
+				   acc_size + size);
+		mem_limit_uncharge(&kfd_mem_limit.ttm_mem_used, acc_size);
 	} else {
-		kfd_mem_limit.system_mem_used -= acc_size;
-		kfd_mem_limit.ttm_mem_used -= acc_size;
-		if (domain == AMDGPU_GEM_DOMAIN_VRAM) {
-			adev->kfd.vram_used -= size;
-			WARN_ONCE(adev->kfd.vram_used < 0,
-				  "kfd VRAM memory accounting unbalanced");
-		}
+		mem_limit_uncharge(&kfd_mem_limit.system_mem_used, acc_size);
+		mem_limit_uncharge(&kfd_mem_limit.ttm_mem_used, acc_size);
+		if (domain == AMDGPU_GEM_DOMAIN_VRAM)
+			mem_limit_uncharge(&adev->kfd.vram_used, size);
 	}
-	WARN_ONCE(kfd_mem_limit.system_mem_used < 0,
-		  "kfd system memory accounting unbalanced");
-	WARN_ONCE(kfd_mem_limit.ttm_mem_used < 0,
-		  "kfd TTM memory accounting unbalanced");
+}
 
-	spin_unlock(&kfd_mem_limit.mem_limit_lock);
+/* Per-process usage is tracked separately from the limits above, so
+ * that it can be released while the process info is still alive even if
+ * the BO itself outlives the process.
+ */
+static void process_usage_charge(struct kgd_mem *mem, u32 alloc_domain,
+				 bool sg)
+{
+	struct amdkfd_process_info *info = mem->process_info;
+
+	if (alloc_domain == AMDGPU_GEM_DOMAIN_VRAM)
+		mem->process_usage = &info->vram_used;
+	else if (alloc_domain == AMDGPU_GEM_DOMAIN_GTT)
+		mem->process_usage = &info->gtt_used;
+	else if (alloc_domain == AMDGPU_GEM_DOMAIN_CPU && !sg)
+		mem->process_usage = &info->userptr_used;
+	else
+		return;
+
+	atomic64_add(amdgpu_bo_size(mem->bo), mem->process_usage);
+}
+
+static void process_usage_uncharge(struct kgd_mem *mem)
+{
+	if (!mem->process_usage)
+		return;
+
+	atomic64_sub(amdgpu_bo_size(mem->bo), mem->process_usage);
+	mem->process_usage = NULL;
 }
 
 void amdgpu_amdkfd_unreserve_memory_limit(struct amdgpu_bo *bo)
@@ -241,8 +337,12 @@ static int amdgpu_amdkfd_remove_eviction_fence(struct amdgpu_bo *bo,
 	if (!old)
 		return 0;
 
+#if defined(BUILD_AS_DKMS)
 	new = kmalloc(offsetof(typeof(*new), shared[old->shared_max]),
 		      GFP_KERNEL);
+#else
+	new = reservation_object_list_alloc(old->shared_max);
+#endif
 	if (!new)
 		return -ENOMEM;
 
@@ -336,6 +436,7 @@ static int amdgpu_amdkfd_bo_validate(struct amdgpu_bo *bo, uint32_t domain,
 				     bool wait)
 {
 	struct ttm_operation_ctx ctx = { false, false };
+	uint32_t old_mem_type = bo->tbo.mem.mem_type;
 	int ret;
 
 	if (WARN(amdgpu_ttm_tt_get_usermm(bo->tbo.ttm),
@@ -347,6 +448,9 @@ static int amdgpu_amdkfd_bo_validate(struct amdgpu_bo *bo, uint32_t domain,
 	ret = ttm_bo_validate(&bo->tbo, &bo->placement, &ctx);
 	if (ret)
 		goto validate_fail;
+	if (bo->kfd_bo && bo->tbo.mem.mem_type != old_mem_type)
+		atomic64_add(amdgpu_bo_size(bo),
+			     &bo->kfd_bo->process_info->bytes_migrated);
 	if (wait) {
 		struct amdgpu_amdkfd_fence **ef_list;
 		unsigned int ef_count;
@@ -423,6 +527,7 @@ static int vm_update_pds(struct amdgpu_vm *vm, struct amdgpu_sync *sync)
 	ret = amdgpu_vm_update_directories(adev, vm);
 	if (ret)
 		return ret;
+	atomic64_inc(&vm->process_info->pt_updates);
 
 	return amdgpu_sync_fence(NULL, sync, vm->last_update, false);
 }
@@ -838,6 +943,7 @@ static int unmap_bo_from_gpuvm(struct amdgpu_device *adev,
 	amdgpu_vm_bo_unmap(adev, bo_va, entry->va);
 
 	amdgpu_vm_clear_freed(adev, vm, &bo_va->last_pt_update);
+	atomic64_inc(&vm->process_info->pt_updates);
 
 	/* Add the eviction fence back */
 	amdgpu_bo_fence(pd, &vm->process_info->eviction_fence->base, true);
@@ -866,6 +972,7 @@ static int update_gpuvm_pte(struct amdgpu_device *adev,
 		pr_err("amdgpu_vm_bo_update failed\n");
 		return ret;
 	}
+	atomic64_inc(&vm->process_info->pt_updates);
 
 	return amdgpu_sync_fence(NULL, sync, bo_va->last_pt_update, false);
 }
@@ -1013,6 +1120,10 @@ static int init_kfd_vm(struct amdgpu_vm *vm, void **process_info,
 		INIT_DELAYED_WORK(&info->restore_userptr_work,
 				  amdgpu_amdkfd_restore_userptr_worker);
 
+		mutex_lock(&kfd_process_info_list_lock);
+		list_add_tail(&info->info_list, &kfd_process_info_list);
+		mutex_unlock(&kfd_process_info_list_lock);
+
 		*process_info = info;
 		*ef = dma_fence_get(&info->eviction_fence->base);
 	}
@@ -1055,6 +1166,9 @@ static int init_kfd_vm(struct amdgpu_vm *vm, void **process_info,
 		dma_fence_put(*ef);
 		*ef = NULL;
 		*process_info = NULL;
+		mutex_lock(&kfd_process_info_list_lock);
+		list_del(&info->info_list);
+		mutex_unlock(&kfd_process_info_list_lock);
 		put_pid(info->pid);
 create_evict_fence_fail:
 		mutex_destroy(&info->lock);
@@ -1063,6 +1177,295 @@ static int init_kfd_vm(struct amdgpu_vm *vm, void **process_info,
 	return ret;
 }
 
+/* Compute VM pool
+ *
+ * Creating a compute VM allocates and clears the root page directory,
+ * which has to wait for an SDMA job and is a noticeable part of KFD
+ * process creation. Keep a few VMs initialized without a PASID and bind
+ * the PASID when a process takes one. Taking a VM kicks a worker that
+ * tops the pool back up to amdgpu_kfd_vm_pool_size.
+ *
+ * Only amdgpu_amdkfd_gpuvm_create_process_vm takes VMs from the pool.
+ * amdgpu_amdkfd_gpuvm_acquire_process_vm converts the VM embedded in the
+ * render node's file private data in place, so there is nothing to swap
+ * a pooled VM into; that path already has its root PD cleared when the
+ * render node was opened.
+ */
+struct amdgpu_amdkfd_pooled_vm {
+	struct list_head list;
+	struct amdgpu_vm *vm;
+	unsigned int vram_lost_counter;
+};
+
+static void vm_pool_free_entry(struct amdgpu_device *adev,
+			       struct amdgpu_amdkfd_pooled_vm *entry)
+{
+	amdgpu_vm_fini(adev, entry->vm);
+	kfree(entry->vm);
+	kfree(entry);
+}
+
+static void vm_pool_refill_worker(struct work_struct *work)
+{
+	struct amdgpu_amdkfd_vm_pool *pool =
+		container_of(work, struct amdgpu_amdkfd_vm_pool, refill_work);
+	struct amdgpu_device *adev =
+		container_of(pool, struct amdgpu_device, kfd.vm_pool);
+	struct amdgpu_amdkfd_pooled_vm *entry;
+	ktime_t start;
+	uint64_t us;
+	int ret;
+
+	for (;;) {
+		mutex_lock(&pool->lock);
+		if (!pool->active || pool->count >= amdgpu_kfd_vm_pool_size) {
+			mutex_unlock(&pool->lock);
+			return;
+		}
+		mutex_unlock(&pool->lock);
+
+		start = ktime_get();
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry)
+			goto fail;
+		entry->vm = kzalloc(sizeof(*entry->vm), GFP_KERNEL);
+		if (!entry->vm)
+			goto fail_free_entry;
+
+		entry->vram_lost_counter = atomic_read(&adev->vram_lost_counter);
+		ret = amdgpu_vm_init(adev, entry->vm,
+				     AMDGPU_VM_CONTEXT_COMPUTE, 0);
+		if (ret) {
+			pr_debug("Failed to pre-initialize vm ret %d\n", ret);
+			goto fail_free_vm;
+		}
+		us = ktime_us_delta(ktime_get(), start);
+
+		mutex_lock(&pool->lock);
+		if (!pool->active) {
+			mutex_unlock(&pool->lock);
+			vm_pool_free_entry(adev, entry);
+			return;
+		}
+		list_add_tail(&entry->list, &pool->vms);
+		pool->count++;
+		pool->refills++;
+		pool->refill_us_total += us;
+		pool->refill_us_max = max(pool->refill_us_max, us);
+		mutex_unlock(&pool->lock);
+	}
+
+fail_free_vm:
+	kfree(entry->vm);
+fail_free_entry:
+	kfree(entry);
+fail:
+	mutex_lock(&pool->lock);
+	pool->refill_failures++;
+	mutex_unlock(&pool->lock);
+}
+
+/* Take a pre-initialized VM from the pool. Returns NULL if the pool is
+ * empty or disabled; the caller then creates a VM the slow way.
+ */
+static struct amdgpu_vm *vm_pool_get(struct amdgpu_device *adev)
+{
+	struct amdgpu_amdkfd_vm_pool *pool = &adev->kfd.vm_pool;
+	struct amdgpu_amdkfd_pooled_vm *entry, *tmp;
+	struct amdgpu_vm *vm = NULL;
+	LIST_HEAD(stale);
+	bool active;
+
+	mutex_lock(&pool->lock);
+	while (!list_empty(&pool->vms)) {
+		entry = list_first_entry(&pool->vms,
+					 struct amdgpu_amdkfd_pooled_vm, list);
+		list_del(&entry->list);
+		pool->count--;
+
+		/* Page tables created before a VRAM loss are garbage */
+		if (entry->vram_lost_counter !=
+		    atomic_read(&adev->vram_lost_counter)) {
+			list_add_tail(&entry->list, &stale);
+			continue;
+		}
+
+		vm = entry->vm;
+		kfree(entry);
+		break;
+	}
+	active = pool->active;
+	if (active) {
+		if (vm)
+			pool->hits++;
+		else
+			pool->misses++;
+	}
+	mutex_unlock(&pool->lock);
+
+	list_for_each_entry_safe(entry, tmp, &stale, list)
+		vm_pool_free_entry(adev, entry);
+
+	if (active)
+		schedule_work(&pool->refill_work);
+
+	return vm;
+}
+
+void amdgpu_amdkfd_gpuvm_vm_pool_init(struct amdgpu_device *adev)
+{
+	struct amdgpu_amdkfd_vm_pool *pool = &adev->kfd.vm_pool;
+
+	mutex_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->vms);
+	INIT_WORK(&pool->refill_work, vm_pool_refill_worker);
+}
+
+void amdgpu_amdkfd_gpuvm_vm_pool_start(struct amdgpu_device *adev)
+{
+	struct amdgpu_amdkfd_vm_pool *pool = &adev->kfd.vm_pool;
+
+	mutex_lock(&pool->lock);
+	pool->active = true;
+	mutex_unlock(&pool->lock);
+
+	schedule_work(&pool->refill_work);
+}
+
+void amdgpu_amdkfd_gpuvm_vm_pool_fini(struct amdgpu_device *adev)
+{
+	struct amdgpu_amdkfd_vm_pool *pool = &adev->kfd.vm_pool;
+	struct amdgpu_amdkfd_pooled_vm *entry, *tmp;
+
+	mutex_lock(&pool->lock);
+	pool->active = false;
+	mutex_unlock(&pool->lock);
+
+	cancel_work_sync(&pool->refill_work);
+
+	/* The worker is gone and nothing can add to the list any more */
+	list_for_each_entry_safe(entry, tmp, &pool->vms, list) {
+		list_del(&entry->list);
+		vm_pool_free_entry(adev, entry);
+	}
+	pool->count = 0;
+}
+
+#if defined(CONFIG_DEBUG_FS)
+static int amdgpu_debugfs_kfd_vm_pool_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	struct amdgpu_amdkfd_vm_pool *pool = &adev->kfd.vm_pool;
+
+	mutex_lock(&pool->lock);
+	seq_printf(m, "active          %d\n", pool->active);
+	seq_printf(m, "target          %u\n", amdgpu_kfd_vm_pool_size);
+	seq_printf(m, "count           %u\n", pool->count);
+	seq_printf(m, "hits            %llu\n", pool->hits);
+	seq_printf(m, "misses          %llu\n", pool->misses);
+	seq_printf(m, "refills         %llu\n", pool->refills);
+	seq_printf(m, "refill failures %llu\n", pool->refill_failures);
+	seq_printf(m, "refill avg us   %llu\n", pool->refills ?
+		   div64_u64(pool->refill_us_total, pool->refills) : 0);
+	seq_printf(m, "refill max us   %llu\n", pool->refill_us_max);
+	mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_kfd_vm_pool_list[] = {
+	{"amdgpu_kfd_vm_pool", &amdgpu_debugfs_kfd_vm_pool_info, 0, NULL},
+};
+#endif
+
+int amdgpu_debugfs_kfd_vm_pool_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_kfd_vm_pool_list, 1);
+#else
+	return 0;
+#endif
+}
+
+#if defined(CONFIG_DEBUG_FS)
+static void kfd_process_cgroup_path(struct amdkfd_process_info *info,
+				    char *buf, size_t buflen)
+{
+#ifdef CONFIG_CGROUPS
+	struct task_struct *task;
+
+	task = get_pid_task(info->pid, PIDTYPE_PID);
+	if (task) {
+		int ret = task_cgroup_path(task, buf, buflen);
+
+		put_task_struct(task);
+		if (ret >= 0)
+			return;
+	}
+#endif
+	strlcpy(buf, "-", buflen);
+}
+
+/* Global and per-device limits, followed by one line per KFD process.
+ * There is no GPU memory cgroup controller, so each process is listed
+ * with its cgroup path for aggregation in user space.
+ */
+static int amdgpu_debugfs_kfd_mem_limit_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	uint64_t reserved_for_pt = amdgpu_amdkfd_total_mem_size >> 9;
+	struct amdkfd_process_info *info;
+	char *path;
+
+	seq_printf(m, "system %lld / %llu\n",
+		   percpu_counter_sum(&kfd_mem_limit.system_mem_used),
+		   kfd_mem_limit.max_system_mem_limit);
+	seq_printf(m, "ttm    %lld / %llu\n",
+		   percpu_counter_sum(&kfd_mem_limit.ttm_mem_used),
+		   kfd_mem_limit.max_ttm_mem_limit);
+	seq_printf(m, "vram   %lld / %llu\n",
+		   percpu_counter_sum(&adev->kfd.vram_used),
+		   adev->gmc.real_vram_size - reserved_for_pt);
+
+	path = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+
+	seq_puts(m, "\n     pid         vram          gtt      userptr cgroup\n");
+	mutex_lock(&kfd_process_info_list_lock);
+	list_for_each_entry(info, &kfd_process_info_list, info_list) {
+		kfd_process_cgroup_path(info, path, PATH_MAX);
+		seq_printf(m, "%8d %12lld %12lld %12lld %s\n",
+			   pid_nr(info->pid),
+			   (long long)atomic64_read(&info->vram_used),
+			   (long long)atomic64_read(&info->gtt_used),
+			   (long long)atomic64_read(&info->userptr_used),
+			   path);
+	}
+	mutex_unlock(&kfd_process_info_list_lock);
+
+	kfree(path);
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_kfd_mem_limit_list[] = {
+	{"amdgpu_kfd_mem_limit", &amdgpu_debugfs_kfd_mem_limit_info, 0, NULL},
+};
+#endif
+
+int amdgpu_debugfs_kfd_mem_limit_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_kfd_mem_limit_list, 1);
+#else
+	return 0;
+#endif
+}
+
 int amdgpu_amdkfd_gpuvm_create_process_vm(struct kgd_dev *kgd, unsigned int pasid,
 					  void **vm, void **process_info,
 					  struct dma_fence **ef)
@@ -1071,6 +1474,16 @@ int amdgpu_amdkfd_gpuvm_create_process_vm(struct kgd_dev *kgd, unsigned int pasi
 	struct amdgpu_vm *new_vm;
 	int ret;
 
+	new_vm = vm_pool_get(adev);
+	if (new_vm) {
+		ret = amdgpu_vm_set_pasid(adev, new_vm, pasid);
+		if (ret) {
+			pr_err("Failed to set pasid of pooled vm ret %d\n", ret);
+			goto init_kfd_vm_fail;
+		}
+		goto init_kfd_part;
+	}
+
 	new_vm = kzalloc(sizeof(*new_vm), GFP_KERNEL);
 	if (!new_vm)
 		return -ENOMEM;
@@ -1082,6 +1495,8 @@ int amdgpu_amdkfd_gpuvm_create_process_vm(struct kgd_dev *kgd, unsigned int pasi
 		goto amdgpu_vm_init_fail;
 	}
 
+init_kfd_part:
+
 	/* Initialize KFD part of the VM and process info */
 	ret = init_kfd_vm(new_vm, process_info, ef);
 	if (ret)
@@ -1113,7 +1528,9 @@ int amdgpu_amdkfd_gpuvm_acquire_process_vm(struct kgd_dev *kgd,
 	if (avm->process_info)
 		return -EINVAL;
 
-	/* Convert VM into a compute VM */
+	/* Convert VM into a compute VM. This VM is embedded in drv_priv,
+	 * so it can't come from the compute VM pool.
+	 */
 	ret = amdgpu_vm_make_compute(adev, avm, pasid);
 	if (ret)
 		return ret;
@@ -1154,6 +1571,10 @@ void amdgpu_amdkfd_gpuvm_destroy_cb(struct amdgpu_device *adev,
 		WARN_ON(!list_empty(&process_info->userptr_valid_list));
 		WARN_ON(!list_empty(&process_info->userptr_inval_list));
 
+		mutex_lock(&kfd_process_info_list_lock);
+		list_del(&process_info->info_list);
+		mutex_unlock(&kfd_process_info_list_lock);
+
 		dma_fence_put(&process_info->eviction_fence->base);
 		cancel_delayed_work_sync(&process_info->restore_userptr_work);
 		put_pid(process_info->pid);
@@ -1349,6 +1770,8 @@ int amdgpu_amdkfd_gpuvm_alloc_memory_of_gpu(
 		}
 	}
 
+	process_usage_charge(*mem, alloc_domain, !!sg);
+
 	if (offset)
 		*offset = amdgpu_bo_mmap_offset(bo);
 
@@ -1444,6 +1867,8 @@ int amdgpu_amdkfd_gpuvm_free_memory_of_gpu(
 
 	ret = unreserve_bo_and_vms(&ctx, false, false);
 
+	process_usage_uncharge(mem);
+
 	/* Free the sync object */
 	amdgpu_sync_free(&mem->sync);
 
@@ -1785,97 +2210,160 @@ static void unpin_bo_wo_map(struct kgd_mem *mem)
 	amdgpu_bo_unreserve(bo);
 }
 
-#define AMD_GPU_PAGE_SHIFT	PAGE_SHIFT
-#define AMD_GPU_PAGE_SIZE (_AC(1, UL) << AMD_GPU_PAGE_SHIFT)
+/* Upper limit for a single DMA segment of a peer sg_table. Keeps segment
+ * lengths well inside the unsigned int of struct scatterlist.
+ */
+#define AMD_GPU_SG_MAX_SEGMENT	(1ULL << 30)
 
-static int get_sg_table(struct amdgpu_device *adev,
-		struct kgd_mem *mem, uint64_t offset,
-		uint64_t size, struct sg_table **ret_sg)
+static struct scatterlist *sg_add_dma_segment(struct scatterlist *s,
+					      uint64_t addr, uint64_t len)
 {
-	struct amdgpu_bo *bo = mem->bo;
-	struct sg_table *sg = NULL;
-	unsigned long bus_addr, aper_limit;
-	unsigned int chunks;
-	unsigned int i;
-	struct scatterlist *s;
-	uint64_t offset_in_page;
-	unsigned int page_size;
-	int ret;
+	if (!s)
+		return NULL;
 
-	if (size + offset > amdgpu_bo_size(bo))
-		return -EFAULT;
-	sg = kmalloc(sizeof(*sg), GFP_KERNEL);
-	if (!sg) {
-		ret = -ENOMEM;
-		goto out;
-	}
+	sg_set_page(s, NULL, len, 0);
+	s->dma_address = addr;
+	sg_dma_len(s) = len;
 
-	if (bo->preferred_domains == AMDGPU_GEM_DOMAIN_VRAM)
-		page_size = AMD_GPU_PAGE_SIZE;
-	else
-		page_size = PAGE_SIZE;
+	return sg_next(s);
+}
 
+/* Walk the VRAM nodes backing [offset, offset + size) of a pinned BO.
+ * Nodes that are adjacent in VRAM are merged into segments of up to
+ * AMD_GPU_SG_MAX_SEGMENT bytes. Fills in sg if it is not NULL.
+ *
+ * Returns the number of segments or a negative error code.
+ */
+static int vram_sg_walk(struct amdgpu_device *adev, struct amdgpu_bo *bo,
+			uint64_t offset, uint64_t size, struct sg_table *sg)
+{
+	struct drm_mm_node *node = bo->tbo.mem.mm_node;
+	uint64_t aper_limit = adev->gmc.aper_base + adev->gmc.aper_size;
+	struct scatterlist *s = sg ? sg->sgl : NULL;
+	uint64_t seg_addr = 0, seg_len = 0;
+	int nents = 0;
 
-	offset_in_page = offset & (page_size - 1);
-	chunks = (size  + offset_in_page + page_size - 1)
-			/ page_size;
+	while (offset >= (node->size << PAGE_SHIFT)) {
+		offset -= node->size << PAGE_SHIFT;
+		node++;
+	}
 
-	ret = sg_alloc_table(sg, chunks, GFP_KERNEL);
-	if (unlikely(ret))
-		goto out;
+	while (size) {
+		uint64_t addr = adev->gmc.aper_base +
+			(node->start << PAGE_SHIFT) + offset;
+		uint64_t len = min(size, (node->size << PAGE_SHIFT) - offset);
 
-	if (bo->preferred_domains == AMDGPU_GEM_DOMAIN_VRAM) {
-		bus_addr = amdgpu_bo_gpu_offset(bo) - adev->gmc.vram_start
-			   + adev->gmc.aper_base + offset;
-		aper_limit = adev->gmc.aper_base + adev->gmc.aper_size;
-		if (bus_addr + (chunks * page_size) > aper_limit) {
+		if (addr + len > aper_limit) {
 			pr_err("sg: bus addr not inside pci aperture\n");
-			ret = -EFAULT;
-			goto out_of_range;
+			return -EFAULT;
 		}
+		size -= len;
 
-		for_each_sg(sg->sgl, s, sg->orig_nents, i) {
-			uint64_t chunk_size, length;
+		while (len) {
+			uint64_t chunk;
 
-			chunk_size = page_size - offset_in_page;
-			length = min(size, chunk_size);
+			if (seg_len && addr == seg_addr + seg_len &&
+			    seg_len < AMD_GPU_SG_MAX_SEGMENT) {
+				chunk = min(len, AMD_GPU_SG_MAX_SEGMENT - seg_len);
+				seg_len += chunk;
+			} else {
+				if (seg_len) {
+					s = sg_add_dma_segment(s, seg_addr,
+							       seg_len);
+					nents++;
+				}
+				chunk = min(len, AMD_GPU_SG_MAX_SEGMENT);
+				seg_addr = addr;
+				seg_len = chunk;
+			}
+			addr += chunk;
+			len -= chunk;
+		}
 
-			sg_set_page(s, NULL, length, offset_in_page);
-			s->dma_address = bus_addr;
-			s->dma_length = length;
+		offset = 0;
+		node++;
+	}
 
-			size -= length;
-			offset_in_page = 0;
-			bus_addr += length;
-		}
-	} else {
-		struct page **pages;
-		unsigned int cur_page;
+	if (seg_len) {
+		sg_add_dma_segment(s, seg_addr, seg_len);
+		nents++;
+	}
 
-		pages = bo->tbo.ttm->pages;
+	return nents;
+}
 
-		cur_page = offset / page_size;
-		for_each_sg(sg->sgl, s, sg->orig_nents, i) {
-			uint64_t chunk_size, length;
+static int get_vram_sg_table(struct amdgpu_device *adev,
+			     struct amdgpu_bo *bo, uint64_t offset,
+			     uint64_t size, struct sg_table *sg)
+{
+	int nents, ret;
 
-			chunk_size = page_size - offset_in_page;
-			length = min(size, chunk_size);
+	nents = vram_sg_walk(adev, bo, offset, size, NULL);
+	if (nents <= 0)
+		return nents ? nents : -EINVAL;
 
-			sg_set_page(s, pages[cur_page], length, offset_in_page);
-			s->dma_address = page_to_phys(pages[cur_page]);
-			s->dma_length = length;
+	ret = sg_alloc_table(sg, nents, GFP_KERNEL);
+	if (unlikely(ret))
+		return ret;
 
-			size -= length;
-			offset_in_page = 0;
-			cur_page++;
-		}
+	vram_sg_walk(adev, bo, offset, size, sg);
+
+	return 0;
+}
+
+/* System pages are coalesced by sg_alloc_table_from_pages wherever they
+ * are physically contiguous, e.g. when backed by huge pages.
+ */
+static int get_gtt_sg_table(struct amdgpu_bo *bo, uint64_t offset,
+			    uint64_t size, struct sg_table *sg)
+{
+	struct page **pages = bo->tbo.ttm->pages + (offset >> PAGE_SHIFT);
+	unsigned int offset_in_page = offset & ~PAGE_MASK;
+	unsigned int n_pages = (offset_in_page + size + PAGE_SIZE - 1) >>
+		PAGE_SHIFT;
+	struct scatterlist *s;
+	unsigned int i;
+	int ret;
+
+	ret = sg_alloc_table_from_pages(sg, pages, n_pages, offset_in_page,
+					size, GFP_KERNEL);
+	if (unlikely(ret))
+		return ret;
+
+	for_each_sg(sg->sgl, s, sg->orig_nents, i) {
+		s->dma_address = sg_phys(s);
+		sg_dma_len(s) = s->length;
+	}
+
+	return 0;
+}
+
+static int get_sg_table(struct amdgpu_device *adev,
+		struct kgd_mem *mem, uint64_t offset,
+		uint64_t size, struct sg_table **ret_sg)
+{
+	struct amdgpu_bo *bo = mem->bo;
+	struct sg_table *sg = NULL;
+	int ret;
+
+	if (size + offset > amdgpu_bo_size(bo))
+		return -EFAULT;
+	sg = kzalloc(sizeof(*sg), GFP_KERNEL);
+	if (!sg) {
+		ret = -ENOMEM;
+		goto out;
 	}
 
+	if (bo->tbo.mem.mem_type == TTM_PL_VRAM)
+		ret = get_vram_sg_table(adev, bo, offset, size, sg);
+	else
+		ret = get_gtt_sg_table(bo, offset, size, sg);
+	if (ret)
+		goto out;
+
 	*ret_sg = sg;
 	return 0;
 
-out_of_range:
-	sg_free_table(sg);
 out:
 	kfree(sg);
 	*ret_sg = NULL;
@@ -1985,6 +2473,169 @@ int amdgpu_amdkfd_gpuvm_export_dmabuf(struct kgd_dev *kgd, void *vm,
 	return 0;
 }
 
+/* Drop write access from future GPU mappings of an imported BO. Must be
+ * called before the BO is mapped.
+ */
+void amdgpu_amdkfd_gpuvm_set_mem_readonly(struct kgd_mem *mem)
+{
+	mem->mapping_flags &= ~AMDGPU_VM_PAGE_WRITEABLE;
+}
+
+/* Update the GPU page table for a range of system pages that is not
+ * backed by a BO (SVM). start and npages are in CPU pages. Clears the
+ * range if dma_addr is NULL.
+ *
+ * Waits for the page table update to complete, so that the caller can
+ * flush the TLB or let the faulting wave retry right away.
+ */
+static int svm_update_range(struct amdgpu_device *adev, struct amdgpu_vm *vm,
+			    uint64_t start, uint64_t npages, uint64_t flags,
+			    dma_addr_t *dma_addr)
+{
+	struct amdgpu_bo *pd = vm->root.base.bo;
+	struct dma_fence *fence = NULL;
+	struct dma_fence *pd_fence = NULL;
+	int ret;
+
+	ret = amdgpu_bo_reserve(pd, false);
+	if (ret)
+		return ret;
+
+	/* Evicted page tables are restored together with the process
+	 * BOs. Let the caller retry once that has happened.
+	 */
+	if (!amdgpu_vm_ready(vm)) {
+		ret = -EAGAIN;
+		goto unreserve_out;
+	}
+
+	/* Page table allocation and update jobs must not trigger the
+	 * eviction fence, see unmap_bo_from_gpuvm
+	 */
+	amdgpu_amdkfd_remove_eviction_fence(pd,
+					    vm->process_info->eviction_fence,
+					    NULL, NULL);
+
+	if (dma_addr) {
+		ret = amdgpu_vm_alloc_pts(adev, vm, start << PAGE_SHIFT,
+					  npages << PAGE_SHIFT);
+		if (ret) {
+			pr_err("Failed to allocate pts, err=%d\n", ret);
+			goto fence_out;
+		}
+		ret = vm_validate_pt_pd_bos(vm);
+		if (ret)
+			goto fence_out;
+	}
+
+	ret = amdgpu_vm_update_range(adev, vm,
+				     start * AMDGPU_GPU_PAGES_IN_CPU_PAGE,
+				     (start + npages) *
+				     AMDGPU_GPU_PAGES_IN_CPU_PAGE - 1,
+				     flags, dma_addr, &fence);
+	if (ret)
+		goto fence_out;
+	atomic64_inc(&vm->process_info->pt_updates);
+
+	ret = amdgpu_vm_update_directories(adev, vm);
+	if (!ret)
+		pd_fence = dma_fence_get(vm->last_update);
+
+fence_out:
+	amdgpu_bo_fence(pd, &vm->process_info->eviction_fence->base, true);
+unreserve_out:
+	amdgpu_bo_unreserve(pd);
+
+	if (fence) {
+		if (!ret)
+			ret = dma_fence_wait(fence, false);
+		dma_fence_put(fence);
+	}
+	if (pd_fence) {
+		if (!ret)
+			ret = dma_fence_wait(pd_fence, false);
+		dma_fence_put(pd_fence);
+	}
+
+	return ret;
+}
+
+/* Map npages system pages at CPU page start_page of a KFD VM */
+int amdgpu_amdkfd_gpuvm_svm_map(struct kgd_dev *kgd, void *vm,
+				uint64_t start_page, uint64_t npages,
+				dma_addr_t *dma_addr, bool writable,
+				bool executable)
+{
+	struct amdgpu_device *adev = get_amdgpu_device(kgd);
+	uint32_t mapping_flags = AMDGPU_VM_PAGE_READABLE |
+				 AMDGPU_VM_MTYPE_DEFAULT;
+	uint64_t flags;
+
+	if (!vm || !dma_addr || !npages)
+		return -EINVAL;
+
+	if (writable)
+		mapping_flags |= AMDGPU_VM_PAGE_WRITEABLE;
+	if (executable)
+		mapping_flags |= AMDGPU_VM_PAGE_EXECUTABLE;
+
+	flags = amdgpu_gmc_get_pte_flags(adev, mapping_flags);
+	flags |= AMDGPU_PTE_VALID | AMDGPU_PTE_SYSTEM | AMDGPU_PTE_SNOOPED;
+
+	return svm_update_range(adev, vm, start_page, npages, flags, dma_addr);
+}
+
+/* Clear the GPU page table for npages at CPU page start_page. The
+ * caller is responsible for flushing the TLB.
+ */
+int amdgpu_amdkfd_gpuvm_svm_unmap(struct kgd_dev *kgd, void *vm,
+				  uint64_t start_page, uint64_t npages)
+{
+	struct amdgpu_device *adev = get_amdgpu_device(kgd);
+
+	if (!vm || !npages)
+		return -EINVAL;
+
+	return svm_update_range(adev, vm, start_page, npages, 0, NULL);
+}
+
+/* Forget a handled retry fault, so that the next fault on the same
+ * address is delivered again instead of being filtered by the
+ * prescreen. Faults are handled in order, so entries ahead of this one
+ * in the FIFO have been handled already.
+ */
+void amdgpu_amdkfd_gpuvm_clear_retry_fault(struct kgd_dev *kgd,
+					   unsigned int pasid, uint64_t addr)
+{
+	struct amdgpu_device *adev = get_amdgpu_device(kgd);
+	u64 key = AMDGPU_VM_FAULT(pasid, addr);
+	struct amdgpu_vm *vm;
+	unsigned long flags;
+	u64 fault;
+
+	spin_lock_irqsave(&adev->vm_manager.pasid_lock, flags);
+	vm = idr_find(&adev->vm_manager.pasid_idr, pasid);
+	if (vm) {
+		while (kfifo_get(&vm->faults, &fault)) {
+			amdgpu_vm_clear_fault(vm->fault_hash, fault);
+			if (fault == key)
+				break;
+		}
+	}
+	spin_unlock_irqrestore(&adev->vm_manager.pasid_lock, flags);
+}
+
+void amdgpu_amdkfd_gpuvm_get_process_counters(void *process_info,
+		struct amdgpu_amdkfd_process_counters *counters)
+{
+	struct amdkfd_process_info *info = process_info;
+
+	counters->userptr_invalidations =
+		atomic64_read(&info->userptr_invalidations);
+	counters->bytes_migrated = atomic64_read(&info->bytes_migrated);
+	counters->pt_updates = atomic64_read(&info->pt_updates);
+}
+
 /* Evict a userptr BO by stopping the queues if necessary
  *
  * Runs in MMU notifier, may be in RECLAIM_FS context. This means it
@@ -2003,6 +2654,7 @@ int amdgpu_amdkfd_evict_userptr(struct kgd_mem *mem,
 	int invalid, evicted_bos;
 	int r = 0;
 
+	atomic64_inc(&process_info->userptr_invalidations);
 	invalid = atomic_inc_return(&mem->invalid);
 	evicted_bos = atomic_inc_return(&process_info->evicted_bos);
 	if (evicted_bos == 1) {
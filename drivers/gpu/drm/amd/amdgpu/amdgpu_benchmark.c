@@ -21,35 +21,51 @@
  *
  * Authors: Jerome Glisse
  */
+#include <linux/ktime.h>
 #include <drm/drmP.h>
 #include <drm/amdgpu_drm.h>
 #include "amdgpu.h"
+#include "amdgpu_amdkfd.h"
 
 #define AMDGPU_BENCHMARK_ITERATIONS 1024
 #define AMDGPU_BENCHMARK_COMMON_MODES_N 17
 
-static int amdgpu_benchmark_do_move(struct amdgpu_device *adev, unsigned size,
-				    uint64_t saddr, uint64_t daddr, int n)
+/* bytes moved per copy matrix entry of the benchmark suite */
+#define AMDGPU_BENCHMARK_SUITE_BYTES	(256ULL << 20)
+#define AMDGPU_BENCHMARK_SUITE_BO_ITERATIONS 256
+#define AMDGPU_BENCHMARK_SUITE_EVICT_SIZE (64 << 20)
+#define AMDGPU_BENCHMARK_SUITE_EVICT_ITERATIONS 8
+#define AMDGPU_BENCHMARK_SUITE_MAP_ITERATIONS 64
+#define AMDGPU_BENCHMARK_SUITE_MAP_VA	(1ULL << 32)
+
+static s64 amdgpu_benchmark_do_move(struct amdgpu_device *adev, unsigned size,
+				    uint64_t saddr, uint64_t daddr, int n,
+				    bool striped)
 {
-	unsigned long start_jiffies;
-	unsigned long end_jiffies;
 	struct dma_fence *fence = NULL;
-	int i, r;
+	ktime_t start;
+	s64 r = 0;
+	int i;
 
-	start_jiffies = jiffies;
+	start = ktime_get();
 	for (i = 0; i < n; i++) {
 		struct amdgpu_ring *ring = adev->mman.buffer_funcs_ring;
-		r = amdgpu_copy_buffer(ring, saddr, daddr, size, NULL, &fence,
-				       false, false);
+
+		if (striped)
+			r = amdgpu_copy_buffer_striped(adev, saddr, daddr, size,
+						       NULL, &fence);
+		else
+			r = amdgpu_copy_buffer(ring, saddr, daddr, size, NULL,
+					       &fence, false, false);
 		if (r)
 			goto exit_do_move;
 		r = dma_fence_wait(fence, false);
 		if (r)
 			goto exit_do_move;
 		dma_fence_put(fence);
+		fence = NULL;
 	}
-	end_jiffies = jiffies;
-	r = jiffies_to_msecs(end_jiffies - start_jiffies);
+	r = ktime_us_delta(ktime_get(), start);
 
 exit_do_move:
 	if (fence)
@@ -59,10 +75,11 @@ static int amdgpu_benchmark_do_move(struct amdgpu_device *adev, unsigned size,
 
 
 static void amdgpu_benchmark_log_results(int n, unsigned size,
-					 unsigned int time,
+					 s64 usecs,
 					 unsigned sdomain, unsigned ddomain,
 					 char *kind)
 {
+	unsigned int time = max_t(s64, usecs / 1000, 1);
 	unsigned int throughput = (n * (size >> 10)) / time;
 	DRM_INFO("amdgpu: %s %u bo moves of %u kB from"
 		 " %d to %d in %u ms, throughput: %u Mb/s or %u MB/s\n",
@@ -70,64 +87,81 @@ static void amdgpu_benchmark_log_results(int n, unsigned size,
 		 throughput * 8, throughput);
 }
 
-static void amdgpu_benchmark_move(struct amdgpu_device *adev, unsigned size,
-				  unsigned sdomain, unsigned ddomain)
+static void amdgpu_benchmark_free_bo(struct amdgpu_bo **bo)
+{
+	int r;
+
+	if (!*bo)
+		return;
+
+	r = amdgpu_bo_reserve(*bo, true);
+	if (likely(r == 0)) {
+		amdgpu_bo_unpin(*bo);
+		amdgpu_bo_unreserve(*bo);
+	}
+	amdgpu_bo_unref(bo);
+}
+
+static int amdgpu_benchmark_create_bo(struct amdgpu_device *adev,
+				      unsigned size, unsigned domain,
+				      struct amdgpu_bo **bo, uint64_t *addr)
 {
-	struct amdgpu_bo *dobj = NULL;
-	struct amdgpu_bo *sobj = NULL;
 	struct amdgpu_bo_param bp;
-	uint64_t saddr, daddr;
-	int r, n;
-	int time;
+	int r;
 
 	memset(&bp, 0, sizeof(bp));
 	bp.size = size;
 	bp.byte_align = PAGE_SIZE;
-	bp.domain = sdomain;
+	bp.domain = domain;
 	bp.flags = 0;
 	bp.type = ttm_bo_type_kernel;
 	bp.resv = NULL;
-	n = AMDGPU_BENCHMARK_ITERATIONS;
-	r = amdgpu_bo_create(adev, &bp, &sobj);
-	if (r) {
-		goto out_cleanup;
-	}
-	r = amdgpu_bo_reserve(sobj, false);
+	r = amdgpu_bo_create(adev, &bp, bo);
+	if (r)
+		return r;
+
+	r = amdgpu_bo_reserve(*bo, false);
 	if (unlikely(r != 0))
-		goto out_cleanup;
-	r = amdgpu_bo_pin(sobj, sdomain);
+		goto error_unref;
+	r = amdgpu_bo_pin(*bo, domain);
 	if (r) {
-		amdgpu_bo_unreserve(sobj);
-		goto out_cleanup;
-	}
-	r = amdgpu_ttm_alloc_gart(&sobj->tbo);
-	amdgpu_bo_unreserve(sobj);
-	if (r) {
-		goto out_cleanup;
+		amdgpu_bo_unreserve(*bo);
+		goto error_unref;
 	}
-	saddr = amdgpu_bo_gpu_offset(sobj);
-	bp.domain = ddomain;
-	r = amdgpu_bo_create(adev, &bp, &dobj);
+	r = amdgpu_ttm_alloc_gart(&(*bo)->tbo);
+	amdgpu_bo_unreserve(*bo);
 	if (r) {
-		goto out_cleanup;
+		amdgpu_benchmark_free_bo(bo);
+		return r;
 	}
-	r = amdgpu_bo_reserve(dobj, false);
-	if (unlikely(r != 0))
-		goto out_cleanup;
-	r = amdgpu_bo_pin(dobj, ddomain);
-	if (r) {
-		amdgpu_bo_unreserve(sobj);
+	*addr = amdgpu_bo_gpu_offset(*bo);
+	return 0;
+
+error_unref:
+	amdgpu_bo_unref(bo);
+	return r;
+}
+
+static void amdgpu_benchmark_move(struct amdgpu_device *adev, unsigned size,
+				  unsigned sdomain, unsigned ddomain)
+{
+	struct amdgpu_bo *dobj = NULL;
+	struct amdgpu_bo *sobj = NULL;
+	uint64_t saddr, daddr;
+	int r, n;
+	s64 time;
+
+	n = AMDGPU_BENCHMARK_ITERATIONS;
+	r = amdgpu_benchmark_create_bo(adev, size, sdomain, &sobj, &saddr);
+	if (r)
 		goto out_cleanup;
-	}
-	r = amdgpu_ttm_alloc_gart(&dobj->tbo);
-	amdgpu_bo_unreserve(dobj);
-	if (r) {
+	r = amdgpu_benchmark_create_bo(adev, size, ddomain, &dobj, &daddr);
+	if (r)
 		goto out_cleanup;
-	}
-	daddr = amdgpu_bo_gpu_offset(dobj);
 
 	if (adev->mman.buffer_funcs) {
-		time = amdgpu_benchmark_do_move(adev, size, saddr, daddr, n);
+		time = amdgpu_benchmark_do_move(adev, size, saddr, daddr, n,
+						false);
 		if (time < 0)
 			goto out_cleanup;
 		if (time > 0)
@@ -135,29 +169,408 @@ static void amdgpu_benchmark_move(struct amdgpu_device *adev, unsigned size,
 						     sdomain, ddomain, "dma");
 	}
 
+	if (adev->mman.buffer_funcs && adev->mman.num_stripes > 1) {
+		time = amdgpu_benchmark_do_move(adev, size, saddr, daddr, n,
+						true);
+		if (time < 0)
+			goto out_cleanup;
+		if (time > 0)
+			amdgpu_benchmark_log_results(n, size, time,
+						     sdomain, ddomain,
+						     "striped dma");
+	}
+
 out_cleanup:
 	/* Check error value now. The value can be overwritten when clean up.*/
 	if (r) {
 		DRM_ERROR("Error while benchmarking BO move.\n");
 	}
 
-	if (sobj) {
-		r = amdgpu_bo_reserve(sobj, true);
-		if (likely(r == 0)) {
-			amdgpu_bo_unpin(sobj);
-			amdgpu_bo_unreserve(sobj);
+	amdgpu_benchmark_free_bo(&sobj);
+	amdgpu_benchmark_free_bo(&dobj);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+/*
+ * Benchmark suite
+ *
+ * Triggered by writing to the amdgpu_benchmark debugfs file, reading the
+ * file returns the results of the last run. Every result is a single line
+ * of space separated key=value pairs starting with the name of the test,
+ * times are in microseconds.
+ */
+struct amdgpu_benchmark_log {
+	char *buf;
+	size_t len;
+	size_t size;
+	int error;
+};
+
+static __printf(2, 3)
+void amdgpu_benchmark_printf(struct amdgpu_benchmark_log *log,
+			     const char *fmt, ...)
+{
+	va_list args;
+	size_t avail;
+	char *buf;
+	int n;
+
+	while (!log->error) {
+		avail = log->size - log->len;
+		va_start(args, fmt);
+		n = vsnprintf(log->buf + log->len, avail, fmt, args);
+		va_end(args);
+		if (n < avail) {
+			log->len += n;
+			return;
+		}
+
+		avail = max_t(size_t, 2 * log->size, PAGE_SIZE);
+		buf = krealloc(log->buf, avail, GFP_KERNEL);
+		if (!buf) {
+			log->error = -ENOMEM;
+			return;
+		}
+		log->buf = buf;
+		log->size = avail;
+	}
+}
+
+static const char *amdgpu_benchmark_domain_name(unsigned domain)
+{
+	switch (domain) {
+	case AMDGPU_GEM_DOMAIN_VRAM:
+		return "vram";
+	case AMDGPU_GEM_DOMAIN_GTT:
+		return "gtt";
+	default:
+		return "cpu";
+	}
+}
+
+static u64 amdgpu_benchmark_rate(u64 count, s64 usecs)
+{
+	return div64_u64(count * USEC_PER_SEC, max_t(s64, usecs, 1));
+}
+
+static void amdgpu_benchmark_suite_copy(struct amdgpu_device *adev,
+					struct amdgpu_benchmark_log *log)
+{
+	static const unsigned sizes[] = {
+		4096, 64 << 10, 1 << 20, 16 << 20, 64 << 20
+	};
+	static const unsigned domains[][2] = {
+		{ AMDGPU_GEM_DOMAIN_GTT, AMDGPU_GEM_DOMAIN_VRAM },
+		{ AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_GTT },
+		{ AMDGPU_GEM_DOMAIN_VRAM, AMDGPU_GEM_DOMAIN_VRAM },
+		{ AMDGPU_GEM_DOMAIN_GTT, AMDGPU_GEM_DOMAIN_GTT },
+	};
+	unsigned i, j, striped;
+
+	for (i = 0; i < ARRAY_SIZE(domains); ++i) {
+		for (j = 0; j < ARRAY_SIZE(sizes); ++j) {
+			struct amdgpu_bo *sobj = NULL, *dobj = NULL;
+			uint64_t saddr, daddr;
+			unsigned size = sizes[j];
+			int n, r;
+
+			n = clamp_t(u64, div_u64(AMDGPU_BENCHMARK_SUITE_BYTES,
+						 size),
+				    4, AMDGPU_BENCHMARK_ITERATIONS);
+
+			r = amdgpu_benchmark_create_bo(adev, size,
+						       domains[i][0],
+						       &sobj, &saddr);
+			if (!r)
+				r = amdgpu_benchmark_create_bo(adev, size,
+							       domains[i][1],
+							       &dobj, &daddr);
+
+			for (striped = 0; !r && striped < 2; ++striped) {
+				s64 time;
+
+				if (striped && adev->mman.num_stripes < 2)
+					break;
+
+				time = amdgpu_benchmark_do_move(adev, size,
+								saddr, daddr,
+								n, striped);
+				if (time < 0) {
+					r = time;
+					break;
+				}
+				amdgpu_benchmark_printf(log, "copy src=%s dst=%s engine=%s size=%u iterations=%d usecs=%lld MBps=%llu\n",
+							amdgpu_benchmark_domain_name(domains[i][0]),
+							amdgpu_benchmark_domain_name(domains[i][1]),
+							striped ? "striped" : "single",
+							size, n, time,
+							amdgpu_benchmark_rate((u64)n * size,
+									      time) >> 20);
+			}
+
+			if (r)
+				amdgpu_benchmark_printf(log, "copy src=%s dst=%s size=%u error=%d\n",
+							amdgpu_benchmark_domain_name(domains[i][0]),
+							amdgpu_benchmark_domain_name(domains[i][1]),
+							size, r);
+
+			amdgpu_benchmark_free_bo(&sobj);
+			amdgpu_benchmark_free_bo(&dobj);
+		}
+	}
+}
+
+static void amdgpu_benchmark_suite_bo_create(struct amdgpu_device *adev,
+					     struct amdgpu_benchmark_log *log)
+{
+	static const unsigned sizes[] = { 4096, 64 << 10, 2 << 20 };
+	static const unsigned domains[] = {
+		AMDGPU_GEM_DOMAIN_GTT, AMDGPU_GEM_DOMAIN_VRAM
+	};
+	unsigned i, j, k;
+
+	for (i = 0; i < ARRAY_SIZE(domains); ++i) {
+		for (j = 0; j < ARRAY_SIZE(sizes); ++j) {
+			struct amdgpu_bo_param bp;
+			ktime_t start;
+			s64 time;
+			int r = 0;
+
+			memset(&bp, 0, sizeof(bp));
+			bp.size = sizes[j];
+			bp.byte_align = PAGE_SIZE;
+			bp.domain = domains[i];
+			bp.flags = 0;
+			bp.type = ttm_bo_type_device;
+			bp.resv = NULL;
+
+			start = ktime_get();
+			for (k = 0; k < AMDGPU_BENCHMARK_SUITE_BO_ITERATIONS;
+			     ++k) {
+				struct amdgpu_bo *bo;
+
+				r = amdgpu_bo_create(adev, &bp, &bo);
+				if (r)
+					break;
+				amdgpu_bo_unref(&bo);
+			}
+			time = ktime_us_delta(ktime_get(), start);
+
+			if (r) {
+				amdgpu_benchmark_printf(log, "bo_create domain=%s size=%u error=%d\n",
+							amdgpu_benchmark_domain_name(domains[i]),
+							sizes[j], r);
+				continue;
+			}
+			amdgpu_benchmark_printf(log, "bo_create domain=%s size=%u iterations=%u usecs=%lld ops=%llu\n",
+						amdgpu_benchmark_domain_name(domains[i]),
+						sizes[j], k, time,
+						amdgpu_benchmark_rate(k, time));
 		}
-		amdgpu_bo_unref(&sobj);
 	}
-	if (dobj) {
-		r = amdgpu_bo_reserve(dobj, true);
-		if (likely(r == 0)) {
-			amdgpu_bo_unpin(dobj);
-			amdgpu_bo_unreserve(dobj);
+}
+
+static int amdgpu_benchmark_bo_move_domain(struct amdgpu_bo *bo,
+					   unsigned domain)
+{
+	struct ttm_operation_ctx ctx = { false, false };
+	int r;
+
+	r = amdgpu_bo_reserve(bo, false);
+	if (r)
+		return r;
+
+	amdgpu_bo_placement_from_domain(bo, domain);
+	r = ttm_bo_validate(&bo->tbo, &bo->placement, &ctx);
+	if (!r)
+		r = ttm_bo_wait(&bo->tbo, false, false);
+	amdgpu_bo_unreserve(bo);
+	return r;
+}
+
+static void amdgpu_benchmark_suite_evict(struct amdgpu_device *adev,
+					 struct amdgpu_benchmark_log *log)
+{
+	unsigned size = AMDGPU_BENCHMARK_SUITE_EVICT_SIZE;
+	s64 evict_time = 0, restore_time = 0;
+	struct amdgpu_bo_param bp;
+	struct amdgpu_bo *bo;
+	unsigned i;
+	int r;
+
+	memset(&bp, 0, sizeof(bp));
+	bp.size = size;
+	bp.byte_align = PAGE_SIZE;
+	bp.domain = AMDGPU_GEM_DOMAIN_VRAM;
+	bp.flags = AMDGPU_GEM_CREATE_NO_CPU_ACCESS;
+	bp.type = ttm_bo_type_device;
+	bp.resv = NULL;
+	r = amdgpu_bo_create(adev, &bp, &bo);
+	if (r)
+		goto out;
+
+	/* Same path as an eviction under memory pressure, VRAM -> GTT and
+	 * back through the buffer move functions
+	 */
+	for (i = 0; i < AMDGPU_BENCHMARK_SUITE_EVICT_ITERATIONS; ++i) {
+		ktime_t start;
+
+		start = ktime_get();
+		r = amdgpu_benchmark_bo_move_domain(bo, AMDGPU_GEM_DOMAIN_GTT);
+		if (r)
+			break;
+		evict_time += ktime_us_delta(ktime_get(), start);
+
+		start = ktime_get();
+		r = amdgpu_benchmark_bo_move_domain(bo, AMDGPU_GEM_DOMAIN_VRAM);
+		if (r)
+			break;
+		restore_time += ktime_us_delta(ktime_get(), start);
+	}
+	amdgpu_bo_unref(&bo);
+
+out:
+	if (r) {
+		amdgpu_benchmark_printf(log, "evict size=%u error=%d\n", size, r);
+		return;
+	}
+	amdgpu_benchmark_printf(log, "evict size=%u iterations=%u usecs=%lld MBps=%llu\n",
+				size, i, evict_time,
+				amdgpu_benchmark_rate((u64)i * size,
+						      evict_time) >> 20);
+	amdgpu_benchmark_printf(log, "restore size=%u iterations=%u usecs=%lld MBps=%llu\n",
+				size, i, restore_time,
+				amdgpu_benchmark_rate((u64)i * size,
+						      restore_time) >> 20);
+}
+
+#ifdef CONFIG_HSA_AMD
+static void amdgpu_benchmark_suite_kfd_map(struct amdgpu_device *adev,
+					   struct amdgpu_benchmark_log *log)
+{
+	static const uint64_t sizes[] = { 4096, 2 << 20, 256 << 20 };
+	struct kgd_dev *kgd = (struct kgd_dev *)adev;
+	void *vm, *process_info = NULL;
+	struct dma_fence *ef = NULL;
+	unsigned i, j;
+	int r;
+
+	r = amdgpu_amdkfd_gpuvm_create_process_vm(kgd, 0, &vm, &process_info,
+						  &ef);
+	if (r) {
+		amdgpu_benchmark_printf(log, "kfd_map error=%d\n", r);
+		return;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(sizes); ++i) {
+		s64 map_time = 0, unmap_time = 0;
+		struct kgd_mem *mem;
+
+		r = amdgpu_amdkfd_gpuvm_alloc_memory_of_gpu(kgd,
+				AMDGPU_BENCHMARK_SUITE_MAP_VA, sizes[i], vm,
+				NULL, &mem, NULL,
+				ALLOC_MEM_FLAGS_VRAM | ALLOC_MEM_FLAGS_WRITABLE);
+		if (r)
+			goto error;
+
+		for (j = 0; j < AMDGPU_BENCHMARK_SUITE_MAP_ITERATIONS; ++j) {
+			ktime_t start;
+
+			start = ktime_get();
+			r = amdgpu_amdkfd_gpuvm_map_memory_to_gpu(kgd, mem, vm);
+			if (!r)
+				r = amdgpu_amdkfd_gpuvm_sync_memory(kgd, mem,
+								    false);
+			if (r)
+				break;
+			map_time += ktime_us_delta(ktime_get(), start);
+
+			start = ktime_get();
+			r = amdgpu_amdkfd_gpuvm_unmap_memory_from_gpu(kgd, mem,
+								      vm);
+			if (!r)
+				r = amdgpu_amdkfd_gpuvm_sync_memory(kgd, mem,
+								    false);
+			if (r)
+				break;
+			unmap_time += ktime_us_delta(ktime_get(), start);
 		}
-		amdgpu_bo_unref(&dobj);
+		amdgpu_amdkfd_gpuvm_free_memory_of_gpu(kgd, mem);
+		if (r)
+			goto error;
+
+		/* The mapped bytes per second of the big buffers are the page
+		 * table update throughput
+		 */
+		amdgpu_benchmark_printf(log, "kfd_map size=%llu iterations=%u usecs=%lld ops=%llu MBps=%llu\n",
+					sizes[i], j, map_time,
+					amdgpu_benchmark_rate(j, map_time),
+					amdgpu_benchmark_rate(j * sizes[i],
+							      map_time) >> 20);
+		amdgpu_benchmark_printf(log, "kfd_unmap size=%llu iterations=%u usecs=%lld ops=%llu MBps=%llu\n",
+					sizes[i], j, unmap_time,
+					amdgpu_benchmark_rate(j, unmap_time),
+					amdgpu_benchmark_rate(j * sizes[i],
+							      unmap_time) >> 20);
+		continue;
+
+error:
+		amdgpu_benchmark_printf(log, "kfd_map size=%llu error=%d\n",
+					sizes[i], r);
+	}
+
+	amdgpu_amdkfd_gpuvm_destroy_process_vm(kgd, vm);
+	dma_fence_put(ef);
+}
+#else
+static void amdgpu_benchmark_suite_kfd_map(struct amdgpu_device *adev,
+					   struct amdgpu_benchmark_log *log)
+{
+}
+#endif
+
+/**
+ * amdgpu_benchmark_suite - run all benchmarks
+ *
+ * @adev: amdgpu_device pointer
+ *
+ * Measure copy bandwidth for a matrix of sizes, domains and SDMA engine
+ * usage, BO create/free rate, eviction bandwidth and KFD map/unmap rate
+ * including page table update throughput. The results replace those of
+ * the last run in adev->benchmark_report.
+ *
+ * Returns 0 on success, negative error code otherwise.
+ */
+int amdgpu_benchmark_suite(struct amdgpu_device *adev)
+{
+	struct amdgpu_benchmark_log log = {};
+	int r;
+
+	if (!adev->mman.buffer_funcs_enabled)
+		return -ENODEV;
+
+	r = mutex_lock_interruptible(&adev->benchmark_lock);
+	if (r)
+		return r;
+
+	amdgpu_benchmark_suite_copy(adev, &log);
+	amdgpu_benchmark_suite_bo_create(adev, &log);
+	amdgpu_benchmark_suite_evict(adev, &log);
+	amdgpu_benchmark_suite_kfd_map(adev, &log);
+
+	r = log.error;
+	if (r) {
+		kfree(log.buf);
+	} else {
+		kfree(adev->benchmark_report);
+		adev->benchmark_report = log.buf;
+		adev->benchmark_report_len = log.len;
 	}
+	mutex_unlock(&adev->benchmark_lock);
+
+	return r;
 }
+#endif
 
 void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
 {
@@ -237,6 +650,20 @@ void amdgpu_benchmark(struct amdgpu_device *adev, int test_number)
 					      AMDGPU_GEM_DOMAIN_VRAM,
 					      AMDGPU_GEM_DOMAIN_VRAM);
 		break;
+	case 9:
+		/* large moves in all directions, single and striped SDMA */
+		for (i = 16; i <= 256; i <<= 1) {
+			amdgpu_benchmark_move(adev, i << 20,
+					      AMDGPU_GEM_DOMAIN_GTT,
+					      AMDGPU_GEM_DOMAIN_VRAM);
+			amdgpu_benchmark_move(adev, i << 20,
+					      AMDGPU_GEM_DOMAIN_VRAM,
+					      AMDGPU_GEM_DOMAIN_GTT);
+			amdgpu_benchmark_move(adev, i << 20,
+					      AMDGPU_GEM_DOMAIN_VRAM,
+					      AMDGPU_GEM_DOMAIN_VRAM);
+		}
+		break;
 
 	default:
 		DRM_ERROR("Unknown benchmark\n");
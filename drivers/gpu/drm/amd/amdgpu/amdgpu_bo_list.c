@@ -34,6 +34,8 @@
 
 #define AMDGPU_BO_LIST_MAX_PRIORITY	32u
 #define AMDGPU_BO_LIST_NUM_BUCKETS	(AMDGPU_BO_LIST_MAX_PRIORITY + 1)
+/* BOs validated by a submission within this window are considered hot */
+#define AMDGPU_BO_LIST_HOT_MS		100
 
 static void amdgpu_bo_list_free_rcu(struct rcu_head *rcu)
 {
@@ -193,13 +195,21 @@ void amdgpu_bo_list_get_list(struct amdgpu_bo_list *list,
 	/* This is based on the bucket sort with O(n) time complexity.
 	 * An item with priority "i" is added to bucket[i]. The lists are then
 	 * concatenated in descending order.
+	 *
+	 * Within a priority, BOs used by a recent submission come first so
+	 * that they get the migration budget before cold ones do.
 	 */
 	struct list_head bucket[AMDGPU_BO_LIST_NUM_BUCKETS];
+	struct list_head hot[AMDGPU_BO_LIST_NUM_BUCKETS];
+	unsigned long hot_since = jiffies -
+		msecs_to_jiffies(AMDGPU_BO_LIST_HOT_MS);
 	struct amdgpu_bo_list_entry *e;
 	unsigned i;
 
-	for (i = 0; i < AMDGPU_BO_LIST_NUM_BUCKETS; i++)
+	for (i = 0; i < AMDGPU_BO_LIST_NUM_BUCKETS; i++) {
 		INIT_LIST_HEAD(&bucket[i]);
+		INIT_LIST_HEAD(&hot[i]);
+	}
 
 	/* Since buffers which appear sooner in the relocation list are
 	 * likely to be used more often than buffers which appear later
@@ -210,15 +220,22 @@ void amdgpu_bo_list_get_list(struct amdgpu_bo_list *list,
 		struct amdgpu_bo *bo = ttm_to_amdgpu_bo(e->tv.bo);
 		unsigned priority = e->priority;
 
-		if (!bo->parent)
-			list_add_tail(&e->tv.head, &bucket[priority]);
-
 		e->user_pages = NULL;
+
+		if (bo->parent)
+			continue;
+
+		if (time_after(READ_ONCE(bo->last_cs_use), hot_since))
+			list_add_tail(&e->tv.head, &hot[priority]);
+		else
+			list_add_tail(&e->tv.head, &bucket[priority]);
 	}
 
 	/* Connect the sorted buckets in the output list. */
-	for (i = 0; i < AMDGPU_BO_LIST_NUM_BUCKETS; i++)
+	for (i = 0; i < AMDGPU_BO_LIST_NUM_BUCKETS; i++) {
 		list_splice(&bucket[i], validated);
+		list_splice(&hot[i], validated);
+	}
 }
 
 void amdgpu_bo_list_put(struct amdgpu_bo_list *list)
@@ -224,6 +224,10 @@ static int amdgpu_cs_parser_init(struct amdgpu_cs_parser *p, union drm_amdgpu_cs
 #if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
 		case AMDGPU_CHUNK_ID_SYNCOBJ_IN:
 		case AMDGPU_CHUNK_ID_SYNCOBJ_OUT:
+#endif
+#if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0) && !defined(BUILD_AS_DKMS)
+		case AMDGPU_CHUNK_ID_SYNCOBJ_TIMELINE_WAIT:
+		case AMDGPU_CHUNK_ID_SYNCOBJ_TIMELINE_SIGNAL:
 #endif
 			break;
 
@@ -289,6 +293,25 @@ static s64 bytes_to_us(struct amdgpu_device *adev, u64 bytes)
 	return bytes >> adev->mm_stats.log2_max_MBps;
 }
 
+/* Each context can only accumulate a share of the device-wide migration
+ * budget, so that one thrashing client can't starve everybody else.
+ * Returned as a right shift: high priority contexts get the full
+ * budget, normal ones half of it and low priority ones a quarter.
+ */
+static unsigned amdgpu_cs_ctx_budget_shift(struct amdgpu_ctx *ctx)
+{
+	enum drm_sched_priority priority;
+
+	priority = (ctx->override_priority == DRM_SCHED_PRIORITY_UNSET) ?
+			ctx->init_priority : ctx->override_priority;
+
+	if (priority >= DRM_SCHED_PRIORITY_HIGH_SW)
+		return 0;
+	if (priority == DRM_SCHED_PRIORITY_NORMAL)
+		return 1;
+	return 2;
+}
+
 /* Returns how many bytes TTM can move right now. If no bytes can be moved,
  * it returns 0. If it returns non-zero, it's OK to move at least one buffer,
  * which means it can go over the threshold once. If that happens, the driver
@@ -301,12 +324,19 @@ static s64 bytes_to_us(struct amdgpu_device *adev, u64 bytes)
  * The currency is simply time in microseconds and it increases as the clock
  * ticks. The accumulated microseconds (us) are converted to bytes and
  * returned.
+ *
+ * The submitting context keeps its own account which fills at a rate and
+ * up to a limit scaled by its priority. The threshold is the smaller of
+ * the device and the context allowance. Must be called with ctx->lock
+ * held.
  */
 static void amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev,
+					      struct amdgpu_ctx *ctx,
 					      u64 *max_bytes,
 					      u64 *max_vis_bytes)
 {
-	s64 time_us, increment_us;
+	unsigned shift = amdgpu_cs_ctx_budget_shift(ctx);
+	s64 time_us, increment_us, ctx_increment_us;
 	u64 free_vram, total_vram, used_vram;
 
 	/* Allow a maximum of 200 accumulated ms. This is basically per-IB
@@ -337,6 +367,12 @@ static void amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev,
 	adev->mm_stats.accum_us = min(adev->mm_stats.accum_us + increment_us,
                                       us_upper_bound);
 
+	ctx_increment_us = time_us - ctx->mm_stats.last_update_us;
+	ctx->mm_stats.last_update_us = time_us;
+	ctx->mm_stats.accum_us = min(ctx->mm_stats.accum_us +
+				     (ctx_increment_us >> shift),
+				     us_upper_bound >> shift);
+
 	/* This prevents the short period of low performance when the VRAM
 	 * usage is low and the driver is in debt or doesn't have enough
 	 * accumulated us to fill VRAM quickly.
@@ -361,12 +397,15 @@ static void amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev,
 			min_us = 0; /* Reset accum_us on APUs. */
 
 		adev->mm_stats.accum_us = max(min_us, adev->mm_stats.accum_us);
+		ctx->mm_stats.accum_us = max(min_us >> shift,
+					     ctx->mm_stats.accum_us);
 	}
 
-	/* This is set to 0 if the driver is in debt to disallow (optional)
-	 * buffer moves.
+	/* This is set to 0 if the driver or the context is in debt to
+	 * disallow (optional) buffer moves.
 	 */
-	*max_bytes = us_to_bytes(adev, adev->mm_stats.accum_us);
+	*max_bytes = us_to_bytes(adev, min(adev->mm_stats.accum_us,
+					   ctx->mm_stats.accum_us));
 
 	/* Do the same for visible VRAM if half of it is free */
 	if (!amdgpu_gmc_vram_full_visible(&adev->gmc)) {
@@ -378,14 +417,26 @@ static void amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev,
 			u64 free_vis_vram = total_vis_vram - used_vis_vram;
 			adev->mm_stats.accum_us_vis = min(adev->mm_stats.accum_us_vis +
 							  increment_us, us_upper_bound);
+			ctx->mm_stats.accum_us_vis =
+				min(ctx->mm_stats.accum_us_vis +
+				    (ctx_increment_us >> shift),
+				    us_upper_bound >> shift);
+
+			if (free_vis_vram >= total_vis_vram / 2) {
+				s64 min_us = bytes_to_us(adev,
+							 free_vis_vram / 2);
 
-			if (free_vis_vram >= total_vis_vram / 2)
 				adev->mm_stats.accum_us_vis =
-					max(bytes_to_us(adev, free_vis_vram / 2),
-					    adev->mm_stats.accum_us_vis);
+					max(min_us, adev->mm_stats.accum_us_vis);
+				ctx->mm_stats.accum_us_vis =
+					max(min_us >> shift,
+					    ctx->mm_stats.accum_us_vis);
+			}
 		}
 
-		*max_vis_bytes = us_to_bytes(adev, adev->mm_stats.accum_us_vis);
+		*max_vis_bytes = us_to_bytes(adev,
+					     min(adev->mm_stats.accum_us_vis,
+						 ctx->mm_stats.accum_us_vis));
 	} else {
 		*max_vis_bytes = 0;
 	}
@@ -395,15 +446,22 @@ static void amdgpu_cs_get_threshold_for_moves(struct amdgpu_device *adev,
 
 /* Report how many bytes have really been moved for the last command
  * submission. This can result in a debt that can stop buffer migrations
- * temporarily.
+ * temporarily. The moves are also charged to ctx if it is not NULL, which
+ * must be locked by the caller.
  */
-void amdgpu_cs_report_moved_bytes(struct amdgpu_device *adev, u64 num_bytes,
+void amdgpu_cs_report_moved_bytes(struct amdgpu_device *adev,
+				  struct amdgpu_ctx *ctx, u64 num_bytes,
 				  u64 num_vis_bytes)
 {
 	spin_lock(&adev->mm_stats.lock);
 	adev->mm_stats.accum_us -= bytes_to_us(adev, num_bytes);
 	adev->mm_stats.accum_us_vis -= bytes_to_us(adev, num_vis_bytes);
 	spin_unlock(&adev->mm_stats.lock);
+
+	if (ctx) {
+		ctx->mm_stats.accum_us -= bytes_to_us(adev, num_bytes);
+		ctx->mm_stats.accum_us_vis -= bytes_to_us(adev, num_vis_bytes);
+	}
 }
 
 static int amdgpu_cs_bo_validate(struct amdgpu_cs_parser *p,
@@ -419,6 +477,8 @@ static int amdgpu_cs_bo_validate(struct amdgpu_cs_parser *p,
 	uint32_t domain;
 	int r;
 
+	WRITE_ONCE(bo->last_cs_use, jiffies);
+
 	if (bo->pin_count)
 		return 0;
 
@@ -727,7 +787,8 @@ static int amdgpu_cs_parser_bos(struct amdgpu_cs_parser *p,
 		list_splice(&need_pages, &p->validated);
 	}
 
-	amdgpu_cs_get_threshold_for_moves(p->adev, &p->bytes_moved_threshold,
+	amdgpu_cs_get_threshold_for_moves(p->adev, p->ctx,
+					  &p->bytes_moved_threshold,
 					  &p->bytes_moved_vis_threshold);
 	p->bytes_moved = 0;
 	p->bytes_moved_vis = 0;
@@ -754,7 +815,7 @@ static int amdgpu_cs_parser_bos(struct amdgpu_cs_parser *p,
 		goto error_validate;
 	}
 
-	amdgpu_cs_report_moved_bytes(p->adev, p->bytes_moved,
+	amdgpu_cs_report_moved_bytes(p->adev, p->ctx, p->bytes_moved,
 				     p->bytes_moved_vis);
 
 	gds = p->bo_list->gds_obj;
@@ -855,9 +916,11 @@ static void amdgpu_cs_parser_fini(struct amdgpu_cs_parser *parser, int error,
 					   &parser->validated);
 
 #if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
-	for (i = 0; i < parser->num_post_dep_syncobjs; i++)
-		drm_syncobj_put(parser->post_dep_syncobjs[i]);
-	kfree(parser->post_dep_syncobjs);
+	for (i = 0; i < parser->num_post_deps; i++) {
+		drm_syncobj_put(parser->post_deps[i].syncobj);
+		kfree(parser->post_deps[i].chain);
+	}
+	kfree(parser->post_deps);
 #endif
 
 	dma_fence_put(parser->fence);
@@ -1165,18 +1228,24 @@ static int amdgpu_cs_process_fence_dep(struct amdgpu_cs_parser *p,
 
 #if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
 static int amdgpu_syncobj_lookup_and_add_to_sync(struct amdgpu_cs_parser *p,
-						 uint32_t handle)
+						 uint32_t handle, u64 point,
+						 u64 flags)
 {
 	int r;
 	struct dma_fence *fence;
 #if defined(BUILD_AS_DKMS) && \
 	DRM_VERSION_CODE < DRM_VERSION(4, 14, 0)
 	r = drm_syncobj_fence_get(p->filp, handle, &fence);
-#else
+#elif defined(BUILD_AS_DKMS)
 	r = drm_syncobj_find_fence(p->filp, handle, &fence);
+#else
+	r = drm_syncobj_find_fence_point(p->filp, handle, point, flags, &fence);
 #endif
-	if (r)
+	if (r) {
+		DRM_ERROR("syncobj %u failed to find fence @ %llu (%d)!\n",
+			  handle, point, r);
 		return r;
+	}
 
 	r = amdgpu_sync_fence(p->adev, &p->job->sync, fence, true);
 	dma_fence_put(fence);
@@ -1196,12 +1265,58 @@ static int amdgpu_cs_process_syncobj_in_dep(struct amdgpu_cs_parser *p,
 		sizeof(struct drm_amdgpu_cs_chunk_sem);
 
 	for (i = 0; i < num_deps; ++i) {
-		r = amdgpu_syncobj_lookup_and_add_to_sync(p, deps[i].handle);
+		r = amdgpu_syncobj_lookup_and_add_to_sync(p, deps[i].handle,
+							  0, 0);
+		if (r)
+			return r;
+	}
+	return 0;
+}
+
+#if !defined(BUILD_AS_DKMS)
+static int amdgpu_cs_process_syncobj_timeline_in_dep(struct amdgpu_cs_parser *p,
+						     struct amdgpu_cs_chunk *chunk)
+{
+	struct drm_amdgpu_cs_chunk_syncobj *syncobj_deps;
+	unsigned num_deps;
+	int i, r;
+
+	syncobj_deps = (struct drm_amdgpu_cs_chunk_syncobj *)chunk->kdata;
+	num_deps = chunk->length_dw * 4 /
+		sizeof(struct drm_amdgpu_cs_chunk_syncobj);
+	for (i = 0; i < num_deps; ++i) {
+		r = amdgpu_syncobj_lookup_and_add_to_sync(p,
+							  syncobj_deps[i].handle,
+							  syncobj_deps[i].point,
+							  syncobj_deps[i].flags);
 		if (r)
 			return r;
 	}
 	return 0;
 }
+#endif
+
+/* Make room for num_deps more post dependencies. A submission may carry
+ * several SYNCOBJ_OUT and TIMELINE_SIGNAL chunks, which all append to the
+ * same array.
+ */
+static struct amdgpu_cs_post_dep *
+amdgpu_cs_grow_post_deps(struct amdgpu_cs_parser *p, unsigned num_deps)
+{
+	struct amdgpu_cs_post_dep *post_deps;
+	size_t count = (size_t)p->num_post_deps + num_deps;
+
+	if (count > SIZE_MAX / sizeof(*post_deps))
+		return NULL;
+
+	post_deps = krealloc(p->post_deps, count * sizeof(*post_deps),
+			     GFP_KERNEL);
+	if (!post_deps)
+		return NULL;
+
+	p->post_deps = post_deps;
+	return post_deps + p->num_post_deps;
+}
 
 static int amdgpu_cs_process_syncobj_out_dep(struct amdgpu_cs_parser *p,
 					     struct amdgpu_cs_chunk *chunk)
@@ -1209,27 +1324,71 @@ static int amdgpu_cs_process_syncobj_out_dep(struct amdgpu_cs_parser *p,
 	unsigned num_deps;
 	int i;
 	struct drm_amdgpu_cs_chunk_sem *deps;
+	struct amdgpu_cs_post_dep *post_deps;
 	deps = (struct drm_amdgpu_cs_chunk_sem *)chunk->kdata;
 	num_deps = chunk->length_dw * 4 /
 		sizeof(struct drm_amdgpu_cs_chunk_sem);
 
-	p->post_dep_syncobjs = kmalloc_array(num_deps,
-					     sizeof(struct drm_syncobj *),
-					     GFP_KERNEL);
-	p->num_post_dep_syncobjs = 0;
+	post_deps = amdgpu_cs_grow_post_deps(p, num_deps);
+	if (!post_deps)
+		return -ENOMEM;
 
-	if (!p->post_dep_syncobjs)
+	for (i = 0; i < num_deps; ++i) {
+		post_deps[i].syncobj =
+			drm_syncobj_find(p->filp, deps[i].handle);
+		if (!post_deps[i].syncobj)
+			return -EINVAL;
+		post_deps[i].chain = NULL;
+		post_deps[i].point = 0;
+		p->num_post_deps++;
+	}
+	return 0;
+}
+
+#if !defined(BUILD_AS_DKMS)
+static int amdgpu_cs_process_syncobj_timeline_out_dep(struct amdgpu_cs_parser *p,
+						      struct amdgpu_cs_chunk *chunk)
+{
+	struct drm_amdgpu_cs_chunk_syncobj *syncobj_deps;
+	struct amdgpu_cs_post_dep *post_deps;
+	unsigned num_deps;
+	int i;
+
+	syncobj_deps = (struct drm_amdgpu_cs_chunk_syncobj *)chunk->kdata;
+	num_deps = chunk->length_dw * 4 /
+		sizeof(struct drm_amdgpu_cs_chunk_syncobj);
+
+	post_deps = amdgpu_cs_grow_post_deps(p, num_deps);
+	if (!post_deps)
 		return -ENOMEM;
 
 	for (i = 0; i < num_deps; ++i) {
-		p->post_dep_syncobjs[i] = drm_syncobj_find(p->filp, deps[i].handle);
-		if (!p->post_dep_syncobjs[i])
+		struct amdgpu_cs_post_dep *dep = &post_deps[i];
+
+		dep->chain = NULL;
+		if (syncobj_deps[i].point) {
+			/* Allocate the chain node now, the fence must not be
+			 * published half way through the submission.
+			 */
+			dep->chain = kmalloc(sizeof(*dep->chain), GFP_KERNEL);
+			if (!dep->chain)
+				return -ENOMEM;
+		}
+
+		dep->syncobj = drm_syncobj_find(p->filp,
+						syncobj_deps[i].handle);
+		if (!dep->syncobj) {
+			kfree(dep->chain);
 			return -EINVAL;
-		p->num_post_dep_syncobjs++;
+		}
+		dep->point = syncobj_deps[i].point;
+		p->num_post_deps++;
 	}
+
 	return 0;
 }
 #endif
+#endif
 
 static int amdgpu_cs_dependencies(struct amdgpu_device *adev,
 				  struct amdgpu_cs_parser *p)
@@ -1254,6 +1413,16 @@ static int amdgpu_cs_dependencies(struct amdgpu_device *adev,
 			r = amdgpu_cs_process_syncobj_out_dep(p, chunk);
 			if (r)
 				return r;
+#endif
+#if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0) && !defined(BUILD_AS_DKMS)
+		} else if (chunk->chunk_id == AMDGPU_CHUNK_ID_SYNCOBJ_TIMELINE_WAIT) {
+			r = amdgpu_cs_process_syncobj_timeline_in_dep(p, chunk);
+			if (r)
+				return r;
+		} else if (chunk->chunk_id == AMDGPU_CHUNK_ID_SYNCOBJ_TIMELINE_SIGNAL) {
+			r = amdgpu_cs_process_syncobj_timeline_out_dep(p, chunk);
+			if (r)
+				return r;
 #endif
 		}
 	}
@@ -1266,8 +1435,18 @@ static void amdgpu_cs_post_dependencies(struct amdgpu_cs_parser *p)
 {
 	int i;
 
-	for (i = 0; i < p->num_post_dep_syncobjs; ++i)
-		drm_syncobj_replace_fence(p->post_dep_syncobjs[i], p->fence);
+	for (i = 0; i < p->num_post_deps; ++i) {
+#if !defined(BUILD_AS_DKMS)
+		if (p->post_deps[i].chain && p->post_deps[i].point) {
+			drm_syncobj_add_point(p->post_deps[i].syncobj,
+					      p->post_deps[i].chain,
+					      p->fence, p->post_deps[i].point);
+			p->post_deps[i].chain = NULL;
+			continue;
+		}
+#endif
+		drm_syncobj_replace_fence(p->post_deps[i].syncobj, p->fence);
+	}
 }
 #endif
 
@@ -51,6 +51,15 @@ struct amdgpu_ctx {
 	enum drm_sched_priority		override_priority;
 	struct mutex			lock;
 	atomic_t			guilty;
+
+	/* per-context share of the buffer migration budget, see
+	 * amdgpu_cs_get_threshold_for_moves. Protected by lock.
+	 */
+	struct {
+		s64			last_update_us;
+		s64			accum_us;
+		s64			accum_us_vis;
+	} mm_stats;
 };
 
 struct amdgpu_ctx_mgr {
@@ -768,6 +768,47 @@ static ssize_t amdgpu_debugfs_gpr_read(struct file *f, char __user *buf,
 	return result;
 }
 
+/**
+ * amdgpu_debugfs_benchmark_read - Read the results of the last benchmark run
+ */
+static ssize_t amdgpu_debugfs_benchmark_read(struct file *f, char __user *buf,
+					     size_t size, loff_t *pos)
+{
+	struct amdgpu_device *adev = (struct amdgpu_device *)kcl_file_private(f);
+	ssize_t result;
+
+	result = mutex_lock_interruptible(&adev->benchmark_lock);
+	if (result)
+		return result;
+
+	result = simple_read_from_buffer(buf, size, pos,
+					 adev->benchmark_report,
+					 adev->benchmark_report_len);
+	mutex_unlock(&adev->benchmark_lock);
+
+	return result;
+}
+
+/**
+ * amdgpu_debugfs_benchmark_write - Run the benchmark suite
+ *
+ * The written data is ignored. Running the suite takes a while and keeps
+ * the GPU busy, so it is only done on request rather than on every read.
+ */
+static ssize_t amdgpu_debugfs_benchmark_write(struct file *f,
+					      const char __user *buf,
+					      size_t size, loff_t *pos)
+{
+	struct amdgpu_device *adev = (struct amdgpu_device *)kcl_file_private(f);
+	int r;
+
+	r = amdgpu_benchmark_suite(adev);
+	if (r)
+		return r;
+
+	return size;
+}
+
 static const struct file_operations amdgpu_debugfs_regs_fops = {
 	.owner = THIS_MODULE,
 	.read = amdgpu_debugfs_regs_read,
@@ -793,6 +834,13 @@ static const struct file_operations amdgpu_debugfs_regs_smc_fops = {
 	.llseek = default_llseek
 };
 
+static const struct file_operations amdgpu_debugfs_benchmark_fops = {
+	.owner = THIS_MODULE,
+	.read = amdgpu_debugfs_benchmark_read,
+	.write = amdgpu_debugfs_benchmark_write,
+	.llseek = default_llseek
+};
+
 static const struct file_operations amdgpu_debugfs_gca_config_fops = {
 	.owner = THIS_MODULE,
 	.read = amdgpu_debugfs_gca_config_read,
@@ -825,6 +873,7 @@ static const struct file_operations *debugfs_regs[] = {
 	&amdgpu_debugfs_sensors_fops,
 	&amdgpu_debugfs_wave_fops,
 	&amdgpu_debugfs_gpr_fops,
+	&amdgpu_debugfs_benchmark_fops,
 };
 
 static const char *debugfs_regs_names[] = {
@@ -836,6 +885,7 @@ static const char *debugfs_regs_names[] = {
 	"amdgpu_sensors",
 	"amdgpu_wave",
 	"amdgpu_gpr",
+	"amdgpu_benchmark",
 };
 
 /**
@@ -850,6 +900,8 @@ int amdgpu_debugfs_regs_init(struct amdgpu_device *adev)
 	struct dentry *ent, *root = minor->debugfs_root;
 	unsigned int i;
 
+	mutex_init(&adev->benchmark_lock);
+
 	for (i = 0; i < ARRAY_SIZE(debugfs_regs); i++) {
 		ent = debugfs_create_file(debugfs_regs_names[i],
 					  S_IFREG | S_IRUGO, root,
@@ -872,6 +924,10 @@ void amdgpu_debugfs_regs_cleanup(struct amdgpu_device *adev)
 			adev->debugfs_regs[i] = NULL;
 		}
 	}
+
+	kfree(adev->benchmark_report);
+	adev->benchmark_report = NULL;
+	adev->benchmark_report_len = 0;
 }
 
 static int amdgpu_debugfs_test_ib(struct seq_file *m, void *data)
@@ -40,3 +40,6 @@ int amdgpu_debugfs_add_files(struct amdgpu_device *adev,
 int amdgpu_debugfs_fence_init(struct amdgpu_device *adev);
 int amdgpu_debugfs_firmware_init(struct amdgpu_device *adev);
 int amdgpu_debugfs_gem_init(struct amdgpu_device *adev);
+int amdgpu_debugfs_vmid_init(struct amdgpu_device *adev);
+int amdgpu_debugfs_kfd_vm_pool_init(struct amdgpu_device *adev);
+int amdgpu_debugfs_kfd_mem_limit_init(struct amdgpu_device *adev);
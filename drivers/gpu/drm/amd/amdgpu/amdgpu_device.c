@@ -2668,6 +2668,18 @@ int amdgpu_device_init(struct amdgpu_device *adev,
 	if (r)
 		DRM_ERROR("registering gem debugfs failed (%d).\n", r);
 
+	r = amdgpu_debugfs_vmid_init(adev);
+	if (r)
+		DRM_ERROR("registering vmid debugfs failed (%d).\n", r);
+
+	r = amdgpu_debugfs_kfd_vm_pool_init(adev);
+	if (r)
+		DRM_ERROR("registering kfd vm pool debugfs failed (%d).\n", r);
+
+	r = amdgpu_debugfs_kfd_mem_limit_init(adev);
+	if (r)
+		DRM_ERROR("registering kfd mem limit debugfs failed (%d).\n", r);
+
 	r = amdgpu_debugfs_regs_init(adev);
 	if (r)
 		DRM_ERROR("registering register debugfs failed (%d).\n", r);
@@ -3259,6 +3271,8 @@ static int amdgpu_device_reset_sriov(struct amdgpu_device *adev,
 	amdgpu_virt_release_full_gpu(adev, true);
 	if (!r && adev->virt.gim_feature & AMDGIM_FEATURE_GIM_FLR_VRAMLOST) {
 		atomic_inc(&adev->vram_lost_counter);
+		amdgpu_vram_mgr_clear_pool_reset(
+			&adev->mman.bdev.man[TTM_PL_VRAM]);
 		r = amdgpu_device_recover_vram(adev);
 	}
 
@@ -3423,6 +3437,8 @@ static int amdgpu_do_asic_reset(struct amdgpu_hive_info *hive,
 				if (vram_lost) {
 					DRM_ERROR("VRAM is lost!\n");
 					atomic_inc(&tmp_adev->vram_lost_counter);
+					amdgpu_vram_mgr_clear_pool_reset(
+						&tmp_adev->mman.bdev.man[TTM_PL_VRAM]);
 				}
 
 				r = amdgpu_gtt_mgr_recover(
@@ -71,9 +71,10 @@
  * - 3.25.0 - Add support for sensor query info (stable pstate sclk/mclk).
  * - 3.26.0 - GFX9: Process AMDGPU_IB_FLAG_TC_WB_NOT_INVALIDATE.
  * - 3.27.0 - Add new chunk to to AMDGPU_CS to enable BO_LIST creation.
+ * - 3.28.0 - Add timeline syncobj chunks to AMDGPU_CS.
  */
 #define KMS_DRIVER_MAJOR	3
-#define KMS_DRIVER_MINOR	27
+#define KMS_DRIVER_MINOR	28
 #define KMS_DRIVER_PATCHLEVEL	0
 
 #define AMDGPU_VERSION		"19.10.8.418"
@@ -117,6 +118,7 @@ uint amdgpu_pcie_lane_cap = 0;
 uint amdgpu_cg_mask = 0xffffffff;
 uint amdgpu_pg_mask = 0xffffffff;
 uint amdgpu_sdma_phase_quantum = 32;
+uint amdgpu_sdma_stripe_size = 16;
 char *amdgpu_disable_cu = NULL;
 char *amdgpu_virtual_display = NULL;
 /* OverDrive(bit 14) disabled by default*/
@@ -420,6 +422,13 @@ module_param_named(pg_mask, amdgpu_pg_mask, uint, 0444);
 MODULE_PARM_DESC(sdma_phase_quantum, "SDMA context switch phase quantum (x 1K GPU clock cycles, 0 = no change (default 32))");
 module_param_named(sdma_phase_quantum, amdgpu_sdma_phase_quantum, uint, 0444);
 
+/**
+ * DOC: sdma_stripe_size (uint)
+ * Minimum size in MiB of a buffer move before it is split across all SDMA engines. The default is 16, 0 disables striping.
+ */
+MODULE_PARM_DESC(sdma_stripe_size, "Minimum buffer move size in MB to use all SDMA engines (0 = disable, default 16)");
+module_param_named(sdma_stripe_size, amdgpu_sdma_stripe_size, uint, 0644);
+
 /**
  * DOC: disable_cu (charp)
  * Set to disable CUs (It's set like se.sh.cu,...). The default is NULL.
@@ -521,6 +530,24 @@ bool keep_idle_process_evicted;
 module_param(keep_idle_process_evicted, bool, 0444);
 MODULE_PARM_DESC(keep_idle_process_evicted, "Restore evicted process only if queues are active (N = off(default), Y = on)");
 
+/**
+ * DOC: kfd_vm_pool_size (uint)
+ * Number of pre-initialized compute VMs kept per device, so that a new KFD process does not have to wait for its
+ * page directory to be allocated and cleared. The pool is refilled in the background. Default value: 2, 0 disables the pool.
+ */
+uint amdgpu_kfd_vm_pool_size = 2;
+MODULE_PARM_DESC(kfd_vm_pool_size, "Pre-initialized compute VMs per device (0 = disable, default 2)");
+module_param_named(kfd_vm_pool_size, amdgpu_kfd_vm_pool_size, uint, 0644);
+
+/**
+ * DOC: vram_clear_pool (int)
+ * Clear freed VRAM in the background at low priority, so that allocations with AMDGPU_GEM_CREATE_VRAM_CLEARED can skip
+ * the fill when they land in VRAM that is known to be zero. Default value: 1, 0 disables background clearing.
+ */
+int amdgpu_vram_clear_pool = 1;
+MODULE_PARM_DESC(vram_clear_pool, "Clear freed VRAM in the background (0 = disable, 1 = enable (default))");
+module_param_named(vram_clear_pool, amdgpu_vram_clear_pool, int, 0444);
+
 /**
  * DOC: si_support (int)
  * Set SI support driver. This parameter works after set config CONFIG_DRM_AMDGPU_SI. For SI asic, when radeon driver is enabled,
@@ -1269,7 +1296,10 @@ static struct drm_driver kms_driver = {
 	.driver_features =
 		DRIVER_USE_AGP |
 		DRIVER_HAVE_IRQ | DRIVER_IRQ_SHARED | DRIVER_GEM |
-#if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
+#if DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0) && !defined(BUILD_AS_DKMS)
+		DRIVER_PRIME | DRIVER_RENDER | DRIVER_MODESET | DRIVER_SYNCOBJ |
+		DRIVER_SYNCOBJ_TIMELINE,
+#elif DRM_VERSION_CODE >= DRM_VERSION(4, 13, 0)
 		DRIVER_PRIME | DRIVER_RENDER | DRIVER_MODESET | DRIVER_SYNCOBJ,
 #else
 		DRIVER_PRIME | DRIVER_RENDER | DRIVER_MODESET,
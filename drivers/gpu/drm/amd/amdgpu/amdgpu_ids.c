@@ -188,6 +188,32 @@ bool amdgpu_vmid_had_gpu_reset(struct amdgpu_device *adev,
 		atomic_read(&adev->gpu_reset_counter);
 }
 
+/**
+ * amdgpu_vmid_update_usage - account a grab of a VMID
+ *
+ * @id_mgr: VMID manager the VMID belongs to
+ * @id: VMID which was just grabbed
+ *
+ * Bump the usage counter of @id and periodically halve the counters of all
+ * VMIDs, so that they reflect how often the owner used them recently.
+ * Must be called with the id_mgr lock held.
+ */
+static void amdgpu_vmid_update_usage(struct amdgpu_vmid_mgr *id_mgr,
+				     struct amdgpu_vmid *id)
+{
+	unsigned i;
+
+	if (id->usage < UINT_MAX)
+		++id->usage;
+
+	if (++id_mgr->grab_count < AMDGPU_VMID_USAGE_DECAY)
+		return;
+
+	id_mgr->grab_count = 0;
+	for (i = 1; i < id_mgr->num_ids; ++i)
+		id_mgr->ids[i].usage >>= 1;
+}
+
 /**
  * amdgpu_vm_grab_idle - grab idle VMID
  *
@@ -208,33 +234,50 @@ static int amdgpu_vmid_grab_idle(struct amdgpu_vm *vm,
 	unsigned vmhub = ring->funcs->vmhub;
 	struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[vmhub];
 	struct dma_fence **fences;
+	struct amdgpu_vmid *id;
 	unsigned i;
 	int r;
 
-	if (ring->vmid_wait && !dma_fence_is_signaled(ring->vmid_wait))
+	if (ring->vmid_wait && !dma_fence_is_signaled(ring->vmid_wait)) {
+		*idle = NULL;
+		++ring->vmid_stats.waits;
 		return amdgpu_sync_fence(adev, sync, ring->vmid_wait, false);
+	}
 
 	fences = kmalloc_array(sizeof(void *), id_mgr->num_ids, GFP_KERNEL);
 	if (!fences)
 		return -ENOMEM;
 
-	/* Check if we have an idle VMID */
+	/* Check if we have an idle VMID. Prefer the one used least by its
+	 * current owner so that busy VMs keep their VMID and don't need a
+	 * flush on their next submission, in LRU order otherwise.
+	 */
 	i = 0;
-	list_for_each_entry((*idle), &id_mgr->ids_lru, list) {
-		fences[i] = amdgpu_sync_peek_fence(&(*idle)->active, ring);
-		if (!fences[i])
+	*idle = NULL;
+	list_for_each_entry(id, &id_mgr->ids_lru, list) {
+		struct dma_fence *active;
+
+		active = amdgpu_sync_peek_fence(&id->active, ring);
+		if (active) {
+			fences[i++] = active;
+			continue;
+		}
+
+		if (!*idle || id->usage < (*idle)->usage)
+			*idle = id;
+
+		if (!id->usage)
 			break;
-		++i;
 	}
 
 	/* If we can't find a idle VMID to use, wait till one becomes available */
-	if (&(*idle)->list == &id_mgr->ids_lru) {
+	if (!*idle) {
 		u64 fence_context = adev->vm_manager.fence_context + ring->idx;
 		unsigned seqno = ++adev->vm_manager.seqno[ring->idx];
 		struct dma_fence_array *array;
 		unsigned j;
 
-		*idle = NULL;
+		++ring->vmid_stats.waits;
 		for (j = 0; j < i; ++j)
 			dma_fence_get(fences[j]);
 
@@ -450,6 +493,14 @@ int amdgpu_vmid_grab(struct amdgpu_vm *vm, struct amdgpu_ring *ring,
 		list_move_tail(&id->list, &id_mgr->ids_lru);
 	}
 
+	if (id->owner != vm->entity.fence_context) {
+		id->usage = 0;
+		++ring->vmid_stats.misses;
+	} else {
+		++ring->vmid_stats.hits;
+	}
+	amdgpu_vmid_update_usage(id_mgr, id);
+
 	id->pd_gpu_addr = job->vm_pd_addr;
 	id->owner = vm->entity.fence_context;
 
@@ -529,6 +580,7 @@ void amdgpu_vmid_reset(struct amdgpu_device *adev, unsigned vmhub,
 
 	mutex_lock(&id_mgr->lock);
 	id->owner = 0;
+	id->usage = 0;
 	id->gds_base = 0;
 	id->gds_size = 0;
 	id->gws_base = 0;
@@ -576,6 +628,7 @@ void amdgpu_vmid_mgr_init(struct amdgpu_device *adev)
 		mutex_init(&id_mgr->lock);
 		INIT_LIST_HEAD(&id_mgr->ids_lru);
 		atomic_set(&id_mgr->reserved_vmid_num, 0);
+		id_mgr->grab_count = 0;
 
 		/* skip over VMID 0, since it is the system VM */
 		for (j = 1; j < id_mgr->num_ids; ++j) {
@@ -612,3 +665,63 @@ void amdgpu_vmid_mgr_fini(struct amdgpu_device *adev)
 		}
 	}
 }
+
+/*
+ * VMID debugfs
+ */
+#if defined(CONFIG_DEBUG_FS)
+static int amdgpu_debugfs_vmid_info(struct seq_file *m, void *data)
+{
+	struct drm_info_node *node = (struct drm_info_node *)m->private;
+	struct drm_device *dev = node->minor->dev;
+	struct amdgpu_device *adev = dev->dev_private;
+	unsigned i, j;
+
+	for (i = 0; i < AMDGPU_MAX_RINGS; ++i) {
+		struct amdgpu_ring *ring = adev->rings[i];
+		struct amdgpu_vmid_stats *stats;
+
+		if (!ring || !ring->funcs->emit_vm_flush)
+			continue;
+
+		stats = &ring->vmid_stats;
+		seq_printf(m, "--- ring %d (%s) ---\n", i, ring->name);
+		seq_printf(m, "hits       %llu\n", stats->hits);
+		seq_printf(m, "misses     %llu\n", stats->misses);
+		seq_printf(m, "waits      %llu\n", stats->waits);
+		seq_printf(m, "flushes    %llu\n", stats->flushes);
+		seq_printf(m, "pipe syncs %llu\n", stats->pipe_syncs);
+	}
+
+	for (i = 0; i < AMDGPU_MAX_VMHUBS; ++i) {
+		struct amdgpu_vmid_mgr *id_mgr = &adev->vm_manager.id_mgr[i];
+
+		if (!id_mgr->num_ids)
+			continue;
+
+		seq_printf(m, "--- vmhub %u ---\n", i);
+		mutex_lock(&id_mgr->lock);
+		for (j = 1; j < id_mgr->num_ids; ++j) {
+			struct amdgpu_vmid *id = &id_mgr->ids[j];
+
+			seq_printf(m, "vmid %2u owner 0x%016llx usage %u\n",
+				   j, id->owner, id->usage);
+		}
+		mutex_unlock(&id_mgr->lock);
+	}
+	return 0;
+}
+
+static const struct drm_info_list amdgpu_debugfs_vmid_list[] = {
+	{"amdgpu_vmid_info", &amdgpu_debugfs_vmid_info, 0, NULL},
+};
+#endif
+
+int amdgpu_debugfs_vmid_init(struct amdgpu_device *adev)
+{
+#if defined(CONFIG_DEBUG_FS)
+	return amdgpu_debugfs_add_files(adev, amdgpu_debugfs_vmid_list, 1);
+#else
+	return 0;
+#endif
+}
@@ -35,6 +35,9 @@
 /* maximum number of VMIDs */
 #define AMDGPU_NUM_VMID	16
 
+/* number of grabs after which the VMID usage counters are halved */
+#define AMDGPU_VMID_USAGE_DECAY	256
+
 struct amdgpu_device;
 struct amdgpu_vm;
 struct amdgpu_ring;
@@ -62,6 +65,9 @@ struct amdgpu_vmid {
 
 	unsigned		pasid;
 	struct dma_fence	*pasid_mapping;
+
+	/* decaying number of grabs by the current owner */
+	unsigned		usage;
 };
 
 struct amdgpu_vmid_mgr {
@@ -70,6 +76,7 @@ struct amdgpu_vmid_mgr {
 	struct list_head	ids_lru;
 	struct amdgpu_vmid	ids[AMDGPU_NUM_VMID];
 	atomic_t		reserved_vmid_num;
+	unsigned		grab_count;
 };
 
 int amdgpu_pasid_alloc(unsigned int bits);
@@ -519,16 +519,18 @@ static int amdgpu_bo_do_create(struct amdgpu_device *adev,
 	if (!amdgpu_gmc_vram_full_visible(&adev->gmc) &&
 	    bo->tbo.mem.mem_type == TTM_PL_VRAM &&
 	    bo->tbo.mem.start < adev->gmc.visible_vram_size >> PAGE_SHIFT)
-		amdgpu_cs_report_moved_bytes(adev, ctx.bytes_moved,
+		amdgpu_cs_report_moved_bytes(adev, NULL, ctx.bytes_moved,
 					     ctx.bytes_moved);
 	else
-		amdgpu_cs_report_moved_bytes(adev, ctx.bytes_moved, 0);
+		amdgpu_cs_report_moved_bytes(adev, NULL, ctx.bytes_moved, 0);
 
 	if (bp->domain & AMDGPU_GEM_DOMAIN_DGMA && adev->ssg.enabled)
 		bo->tbo.ssg_can_map = true;
 
 	if (bp->flags & AMDGPU_GEM_CREATE_VRAM_CLEARED &&
-	    bo->tbo.mem.placement & TTM_PL_FLAG_VRAM) {
+	    bo->tbo.mem.placement & TTM_PL_FLAG_VRAM &&
+	    !amdgpu_vram_mgr_mem_cleared(&adev->mman.bdev.man[TTM_PL_VRAM],
+					 &bo->tbo.mem)) {
 		struct dma_fence *fence;
 
 		r = amdgpu_fill_buffer(bo, 0, bo->tbo.resv, &fence);
@@ -96,6 +96,8 @@ struct psp_xgmi_context {
 	struct amdgpu_bo                *xgmi_shared_bo;
 	uint64_t                        xgmi_shared_mc_addr;
 	void                            *xgmi_shared_buf;
+	/* topology as seen by this device, for hop counts */
+	struct psp_xgmi_topology_info	top_info;
 };
 
 struct psp_context
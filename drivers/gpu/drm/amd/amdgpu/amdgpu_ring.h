@@ -175,6 +175,17 @@ struct amdgpu_ring_funcs {
 	void (*soft_recovery)(struct amdgpu_ring *ring, unsigned vmid);
 };
 
+/* per ring VMID statistics, see amdgpu_vmid_grab() and amdgpu_vm_flush() */
+struct amdgpu_vmid_stats {
+	/* protected by the id_mgr lock */
+	uint64_t		hits;
+	uint64_t		misses;
+	uint64_t		waits;
+	/* only updated from the ring's submission path */
+	uint64_t		flushes;
+	uint64_t		pipe_syncs;
+};
+
 struct amdgpu_ring {
 	struct amdgpu_device		*adev;
 	const struct amdgpu_ring_funcs	*funcs;
@@ -212,6 +223,7 @@ struct amdgpu_ring {
 	volatile u32		*cond_exe_cpu_addr;
 	unsigned		vm_inv_eng;
 	struct dma_fence	*vmid_wait;
+	struct amdgpu_vmid_stats vmid_stats;
 	bool			has_compute_vm_bug;
 
 	atomic_t		num_jobs[DRM_SCHED_PRIORITY_MAX];
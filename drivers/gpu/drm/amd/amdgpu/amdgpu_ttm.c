@@ -48,6 +48,7 @@
 #include "amdgpu_trace.h"
 #include "amdgpu_amdkfd.h"
 #include "amdgpu_sdma.h"
+#include "amdgpu_xgmi.h"
 #include "bif/bif_4_1_d.h"
 
 #define DRM_FILE_PAGE_OFFSET (0x100000000ULL >> PAGE_SHIFT)
@@ -56,7 +57,23 @@ static int amdgpu_map_buffer(struct ttm_buffer_object *bo,
 			     struct ttm_mem_reg *mem, unsigned num_pages,
 			     uint64_t offset, unsigned window,
 			     struct amdgpu_ring *ring,
+			     struct drm_sched_entity *entity,
 			     uint64_t *addr);
+static bool amdgpu_ttm_is_peer_bar(struct amdgpu_device *adev,
+				   struct ttm_buffer_object *bo,
+				   struct ttm_mem_reg *mem);
+static int amdgpu_map_peer_vram(struct ttm_buffer_object *bo,
+				unsigned num_pages, uint64_t node_start,
+				unsigned window, struct amdgpu_ring *ring,
+				struct drm_sched_entity *entity,
+				uint64_t *addr);
+static int amdgpu_ttm_copy_stripe(struct amdgpu_device *adev, unsigned stripe,
+				  uint64_t src_offset, uint64_t dst_offset,
+				  uint32_t byte_count,
+				  struct reservation_object *resv,
+				  struct dma_fence **deps, unsigned num_deps,
+				  bool vm_needs_flush,
+				  struct dma_fence **fence);
 
 static int amdgpu_ttm_debugfs_init(struct amdgpu_device *adev);
 static void amdgpu_ttm_debugfs_fini(struct amdgpu_device *adev);
@@ -309,6 +326,51 @@ static struct drm_mm_node *amdgpu_find_mm_node(struct ttm_mem_reg *mem,
 	return mm_node;
 }
 
+/**
+ * amdgpu_ttm_stripe_ring - ring used by a stripe of a buffer move
+ */
+static struct amdgpu_ring *amdgpu_ttm_stripe_ring(struct amdgpu_device *adev,
+						  unsigned stripe)
+{
+	return stripe ? adev->mman.stripe_ring[stripe] :
+		adev->mman.buffer_funcs_ring;
+}
+
+/**
+ * amdgpu_ttm_stripe_entity - scheduler entity used by a stripe of a move
+ */
+static struct drm_sched_entity *
+amdgpu_ttm_stripe_entity(struct amdgpu_device *adev, unsigned stripe)
+{
+	return stripe ? &adev->mman.stripe_entity[stripe] :
+		&adev->mman.entity;
+}
+
+/**
+ * amdgpu_ttm_num_stripes - number of SDMA engines to use for a copy
+ *
+ * @adev: amdgpu device
+ * @size: size of the copy in bytes
+ * @force: ignore the sdma_stripe_size threshold
+ *
+ * Returns how many of the SDMA engines the copy should be split across.
+ */
+static unsigned amdgpu_ttm_num_stripes(struct amdgpu_device *adev,
+				       uint64_t size, bool force)
+{
+	unsigned i;
+
+	if (!force && (!amdgpu_sdma_stripe_size ||
+		       size < (uint64_t)amdgpu_sdma_stripe_size << 20))
+		return 1;
+
+	for (i = 1; i < adev->mman.num_stripes; ++i)
+		if (!adev->mman.stripe_ring[i]->sched.ready)
+			break;
+
+	return i;
+}
+
 /**
  * amdgpu_copy_ttm_mem_to_mem - Helper function for copy
  *
@@ -316,6 +378,15 @@ static struct drm_mm_node *amdgpu_find_mm_node(struct ttm_mem_reg *mem,
  * {dst->mem + dst->offset}. src->bo and dst->bo could be same BO for a
  * move and different for a BO to BO copy.
  *
+ * Copies of at least sdma_stripe_size MiB are split into chunks which are
+ * distributed round robin over all SDMA engines, each engine using its own
+ * pair of GART windows. The last chunk always goes to the buffer_funcs_ring
+ * and waits for the other engines.
+ *
+ * Either BO may be VRAM of another device. Within an XGMI hive that VRAM
+ * is addressed directly, otherwise it is mapped through the peer's PCIe
+ * BAR, which must then be reachable from @adev.
+ *
  * @f: Returns the last fence if multiple jobs are submitted.
  */
 int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
@@ -325,11 +396,12 @@ int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
 			       struct reservation_object *resv,
 			       struct dma_fence **f)
 {
-	struct amdgpu_ring *ring = adev->mman.buffer_funcs_ring;
+	struct dma_fence *stripe_fence[AMDGPU_TTM_MAX_STRIPES] = {};
 	struct drm_mm_node *src_mm, *dst_mm;
 	uint64_t src_node_start, dst_node_start, src_node_size,
 		 dst_node_size, src_page_offset, dst_page_offset;
-	struct dma_fence *fence = NULL;
+	unsigned num_stripes, stripe = 0, i;
+	bool src_bar, dst_bar;
 	int r = 0;
 	const uint64_t GTT_MAX_BYTES = (AMDGPU_GTT_MAX_TRANSFER_SIZE *
 					AMDGPU_GPU_PAGE_SIZE);
@@ -339,6 +411,18 @@ int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
 		return -EINVAL;
 	}
 
+	src_bar = amdgpu_ttm_is_peer_bar(adev, src->bo, src->mem);
+	dst_bar = amdgpu_ttm_is_peer_bar(adev, dst->bo, dst->mem);
+	if ((src_bar && !amdgpu_device_is_peer_accessible(
+			amdgpu_ttm_adev(src->bo->bdev), adev)) ||
+	    (dst_bar && !amdgpu_device_is_peer_accessible(
+			amdgpu_ttm_adev(dst->bo->bdev), adev))) {
+		DRM_DEBUG_DRIVER("Peer VRAM not reachable through PCIe\n");
+		return -EINVAL;
+	}
+
+	num_stripes = amdgpu_ttm_num_stripes(adev, size, false);
+
 	src_mm = amdgpu_find_mm_node(src->mem, &src->offset);
 	src_node_start = amdgpu_mm_node_addr(src->bo, src_mm, src->mem) +
 					     src->offset;
@@ -356,6 +440,8 @@ int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
 	while (size) {
 		unsigned long cur_size;
 		uint64_t from = src_node_start, to = dst_node_start;
+		struct amdgpu_ring *ring;
+		struct drm_sched_entity *entity;
 		struct dma_fence *next;
 
 		/* Copy size cannot exceed GTT_MAX_BYTES. So if src or dst
@@ -367,39 +453,66 @@ int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
 		    cur_size + dst_page_offset > GTT_MAX_BYTES)
 			cur_size -= max(src_page_offset, dst_page_offset);
 
-		/* Map only what needs to be accessed. Map src to window 0 and
-		 * dst to window 1
+		/* The last chunk must be on the first stripe so that its
+		 * fence covers the whole copy
+		 */
+		if (cur_size == size)
+			stripe = 0;
+		ring = amdgpu_ttm_stripe_ring(adev, stripe);
+		entity = amdgpu_ttm_stripe_entity(adev, stripe);
+
+		/* Map only what needs to be accessed. Map src to the first
+		 * and dst to the second window of the stripe
 		 */
 		if (src->mem->start == AMDGPU_BO_INVALID_OFFSET) {
 			r = amdgpu_map_buffer(src->bo, src->mem,
 					PFN_UP(cur_size + src_page_offset),
-					src_node_start, 0, ring,
-					&from);
+					src_node_start, stripe * 2, ring,
+					entity, &from);
 			if (r)
 				goto error;
 			/* Adjust the offset because amdgpu_map_buffer returns
 			 * start of mapped page
 			 */
 			from += src_page_offset;
+		} else if (src_bar) {
+			r = amdgpu_map_peer_vram(src->bo,
+					PFN_UP(cur_size + src_page_offset),
+					src_node_start, stripe * 2, ring,
+					entity, &from);
+			if (r)
+				goto error;
+			from += src_page_offset;
 		}
 
 		if (dst->mem->start == AMDGPU_BO_INVALID_OFFSET) {
 			r = amdgpu_map_buffer(dst->bo, dst->mem,
 					PFN_UP(cur_size + dst_page_offset),
-					dst_node_start, 1, ring,
-					&to);
+					dst_node_start, stripe * 2 + 1, ring,
+					entity, &to);
+			if (r)
+				goto error;
+			to += dst_page_offset;
+		} else if (dst_bar) {
+			r = amdgpu_map_peer_vram(dst->bo,
+					PFN_UP(cur_size + dst_page_offset),
+					dst_node_start, stripe * 2 + 1, ring,
+					entity, &to);
 			if (r)
 				goto error;
 			to += dst_page_offset;
 		}
 
-		r = amdgpu_copy_buffer(ring, from, to, cur_size,
-				       resv, &next, false, true);
+		r = amdgpu_ttm_copy_stripe(adev, stripe, from, to, cur_size,
+					   resv, &stripe_fence[1],
+					   cur_size == size ? num_stripes - 1 : 0,
+					   true, &next);
 		if (r)
 			goto error;
 
-		dma_fence_put(fence);
-		fence = next;
+		dma_fence_put(stripe_fence[stripe]);
+		stripe_fence[stripe] = next;
+		stripe = (stripe + 1) % num_stripes;
 
 		size -= cur_size;
 		if (!size)
@@ -426,9 +539,17 @@ int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
 	}
 error:
 	mutex_unlock(&adev->mman.gtt_window_lock);
+
+	/* On error the fence of the first stripe doesn't cover the others */
+	for (i = 1; i < num_stripes; ++i) {
+		if (r && stripe_fence[i])
+			dma_fence_wait(stripe_fence[i], false);
+		dma_fence_put(stripe_fence[i]);
+	}
+
 	if (f)
-		*f = dma_fence_get(fence);
-	dma_fence_put(fence);
+		*f = dma_fence_get(stripe_fence[0]);
+	dma_fence_put(stripe_fence[0]);
 	return r;
 }
 
@@ -2058,6 +2179,56 @@ void amdgpu_ttm_fini(struct amdgpu_device *adev)
 	DRM_INFO("amdgpu: ttm finalized\n");
 }
 
+/**
+ * amdgpu_ttm_stripe_init - set up entities for striped buffer moves
+ *
+ * @adev: amdgpu_device pointer
+ *
+ * Create a kernel priority entity on each SDMA engine besides the
+ * buffer_funcs_ring. Engines which aren't ready yet are skipped at the time
+ * of the copy.
+ */
+static void amdgpu_ttm_stripe_init(struct amdgpu_device *adev)
+{
+	unsigned i;
+
+	adev->mman.num_stripes = 1;
+	for (i = 0; i < adev->sdma.num_instances; ++i) {
+		struct amdgpu_ring *ring = &adev->sdma.instance[i].ring;
+		unsigned stripe = adev->mman.num_stripes;
+		struct drm_sched_rq *rq;
+		int r;
+
+		if (ring == adev->mman.buffer_funcs_ring)
+			continue;
+
+		if (stripe >= AMDGPU_TTM_MAX_STRIPES)
+			break;
+
+		rq = &ring->sched.sched_rq[DRM_SCHED_PRIORITY_KERNEL];
+		r = drm_sched_entity_init(&adev->mman.stripe_entity[stripe],
+					  &rq, 1, NULL);
+		if (r) {
+			DRM_ERROR("Failed setting up TTM BO stripe entity (%d)\n",
+				  r);
+			break;
+		}
+		adev->mman.stripe_ring[stripe] = ring;
+		++adev->mman.num_stripes;
+	}
+}
+
+static void amdgpu_ttm_stripe_fini(struct amdgpu_device *adev)
+{
+	unsigned i;
+
+	for (i = 1; i < adev->mman.num_stripes; ++i) {
+		drm_sched_entity_destroy(&adev->mman.stripe_entity[i]);
+		adev->mman.stripe_ring[i] = NULL;
+	}
+	adev->mman.num_stripes = 0;
+}
+
 /**
  * amdgpu_ttm_set_buffer_funcs_status - enable/disable use of buffer functions
  *
@@ -2089,7 +2260,20 @@ void amdgpu_ttm_set_buffer_funcs_status(struct amdgpu_device *adev, bool enable)
 				  r);
 			return;
 		}
+		rq = &ring->sched.sched_rq[DRM_SCHED_PRIORITY_MIN];
+		r = drm_sched_entity_init(&adev->mman.clear_entity, &rq, 1,
+					  NULL);
+		if (r) {
+			DRM_ERROR("Failed setting up TTM BO clear entity (%d)\n",
+				  r);
+			drm_sched_entity_destroy(&adev->mman.entity);
+			return;
+		}
+		amdgpu_ttm_stripe_init(adev);
 	} else {
+		amdgpu_vram_mgr_clear_pool_stop(man);
+		amdgpu_ttm_stripe_fini(adev);
+		drm_sched_entity_destroy(&adev->mman.clear_entity);
 		drm_sched_entity_destroy(&adev->mman.entity);
 		dma_fence_put(man->move);
 		man->move = NULL;
@@ -2102,6 +2286,9 @@ void amdgpu_ttm_set_buffer_funcs_status(struct amdgpu_device *adev, bool enable)
 		size = adev->gmc.visible_vram_size;
 	man->size = size >> PAGE_SHIFT;
 	adev->mman.buffer_funcs_enabled = enable;
+
+	if (enable)
+		amdgpu_vram_mgr_clear_pool_start(man);
 }
 
 int amdgpu_mmap(struct file *filp, struct vm_area_struct *vma)
@@ -2120,21 +2307,28 @@ int amdgpu_mmap(struct file *filp, struct vm_area_struct *vma)
 	return ttm_bo_mmap(filp, vma, &adev->mman.bdev);
 }
 
-static int amdgpu_map_buffer(struct ttm_buffer_object *bo,
-			     struct ttm_mem_reg *mem, unsigned num_pages,
-			     uint64_t offset, unsigned window,
-			     struct amdgpu_ring *ring,
-			     uint64_t *addr)
+/**
+ * amdgpu_ttm_map_window - point a GART window at a list of DMA addresses
+ *
+ * @ring: ring used to write the GART entries
+ * @entity: scheduler entity the job is submitted to
+ * @window: GART window to use
+ * @num_pages: number of pages to map
+ * @dma_address: DMA address of each page
+ * @flags: PTE flags
+ * @addr: returns the GPU address of the window
+ */
+static int amdgpu_ttm_map_window(struct amdgpu_ring *ring,
+				 struct drm_sched_entity *entity,
+				 unsigned window, unsigned num_pages,
+				 dma_addr_t *dma_address, uint64_t flags,
+				 uint64_t *addr)
 {
-	struct amdgpu_ttm_tt *gtt = (void *)bo->ttm;
 	struct amdgpu_device *adev = ring->adev;
-	struct ttm_tt *ttm = bo->ttm;
 	struct amdgpu_job *job;
 	unsigned num_dw, num_bytes;
-	dma_addr_t *dma_address;
 	struct dma_fence *fence;
 	uint64_t src_addr, dst_addr;
-	uint64_t flags;
 	int r;
 
 	BUG_ON(adev->mman.buffer_funcs->copy_max_bytes <
@@ -2165,15 +2359,13 @@ static int amdgpu_map_buffer(struct ttm_buffer_object *bo,
 	amdgpu_ring_pad_ib(ring, &job->ibs[0]);
 	WARN_ON(job->ibs[0].length_dw > num_dw);
 
-	dma_address = &gtt->ttm.dma_address[offset >> PAGE_SHIFT];
-	flags = amdgpu_ttm_tt_pte_flags(adev, ttm, mem);
 	r = amdgpu_gart_map(adev, 0, num_pages, dma_address, flags,
 			    &job->ibs[0].ptr[num_dw]);
 	if (r)
 		goto error_free;
 
-	r = amdgpu_job_submit(job, &adev->mman.entity,
-			      AMDGPU_FENCE_OWNER_UNDEFINED, &fence);
+	r = amdgpu_job_submit(job, entity, AMDGPU_FENCE_OWNER_UNDEFINED,
+			      &fence);
 	if (r)
 		goto error_free;
 
@@ -2186,25 +2378,108 @@ static int amdgpu_map_buffer(struct ttm_buffer_object *bo,
 	return r;
 }
 
-int amdgpu_copy_buffer(struct amdgpu_ring *ring, uint64_t src_offset,
-		       uint64_t dst_offset, uint32_t byte_count,
-		       struct reservation_object *resv,
-		       struct dma_fence **fence, bool direct_submit,
-		       bool vm_needs_flush)
+static int amdgpu_map_buffer(struct ttm_buffer_object *bo,
+			     struct ttm_mem_reg *mem, unsigned num_pages,
+			     uint64_t offset, unsigned window,
+			     struct amdgpu_ring *ring,
+			     struct drm_sched_entity *entity,
+			     uint64_t *addr)
 {
+	struct amdgpu_ttm_tt *gtt = (void *)bo->ttm;
 	struct amdgpu_device *adev = ring->adev;
-	struct amdgpu_job *job;
+	struct ttm_tt *ttm = bo->ttm;
+	dma_addr_t *dma_address;
+	uint64_t flags;
 
+	dma_address = &gtt->ttm.dma_address[offset >> PAGE_SHIFT];
+	flags = amdgpu_ttm_tt_pte_flags(adev, ttm, mem);
+	return amdgpu_ttm_map_window(ring, entity, window, num_pages,
+				     dma_address, flags, addr);
+}
+
+/**
+ * amdgpu_ttm_is_peer_bar - check if a copy has to go through a peer's BAR
+ *
+ * VRAM of another device is only directly addressable by @adev's copy
+ * engines when both are in the same XGMI hive. Otherwise it has to be
+ * reached over PCIe through the BAR of the device owning @bo.
+ */
+static bool amdgpu_ttm_is_peer_bar(struct amdgpu_device *adev,
+				   struct ttm_buffer_object *bo,
+				   struct ttm_mem_reg *mem)
+{
+	struct amdgpu_device *bo_adev = amdgpu_ttm_adev(bo->bdev);
+
+	return mem->mem_type == TTM_PL_VRAM && bo_adev != adev &&
+		!amdgpu_xgmi_same_hive(adev, bo_adev);
+}
+
+/**
+ * amdgpu_map_peer_vram - map VRAM of a peer device through its PCIe BAR
+ *
+ * @bo: VRAM BO owned by the peer device
+ * @num_pages: number of pages to map
+ * @node_start: MC address of the first byte in the peer's VRAM
+ * @window: GART window to use
+ * @ring: ring used to write the GART entries
+ * @entity: scheduler entity the job is submitted to
+ * @addr: returns the GPU address of the mapped page
+ */
+static int amdgpu_map_peer_vram(struct ttm_buffer_object *bo,
+				unsigned num_pages, uint64_t node_start,
+				unsigned window, struct amdgpu_ring *ring,
+				struct drm_sched_entity *entity,
+				uint64_t *addr)
+{
+	struct amdgpu_device *bo_adev = amdgpu_ttm_adev(bo->bdev);
+	uint64_t flags = AMDGPU_PTE_VALID | AMDGPU_PTE_SYSTEM |
+		AMDGPU_PTE_READABLE | AMDGPU_PTE_WRITEABLE;
+	dma_addr_t *dma_address, bus_addr;
+	unsigned i;
+	int r;
+
+	bus_addr = bo_adev->gmc.aper_base +
+		((node_start - bo->bdev->man[TTM_PL_VRAM].gpu_offset) &
+		 PAGE_MASK);
+
+	dma_address = kmalloc_array(num_pages, sizeof(*dma_address),
+				    GFP_KERNEL);
+	if (!dma_address)
+		return -ENOMEM;
+
+	for (i = 0; i < num_pages; i++)
+		dma_address[i] = bus_addr + ((uint64_t)i << PAGE_SHIFT);
+
+	r = amdgpu_ttm_map_window(ring, entity, window, num_pages,
+				  dma_address, flags, addr);
+	kfree(dma_address);
+	return r;
+}
+
+/**
+ * amdgpu_copy_buffer_job - build a copy job
+ *
+ * @ring: ring the job is going to be executed on
+ * @src_offset: GPU address to copy from
+ * @dst_offset: GPU address to copy to
+ * @byte_count: number of bytes to copy
+ * @resv: reservation object to sync to, can be NULL
+ * @vm_needs_flush: flush the GART TLB before the copy
+ * @job: resulting job, not yet submitted
+ */
+static int amdgpu_copy_buffer_job(struct amdgpu_ring *ring,
+				  uint64_t src_offset, uint64_t dst_offset,
+				  uint32_t byte_count,
+				  struct reservation_object *resv,
+				  bool vm_needs_flush,
+				  struct amdgpu_job **job)
+{
+	struct amdgpu_device *adev = ring->adev;
 	uint32_t max_bytes;
 	unsigned num_loops, num_dw;
 	unsigned i;
 	int r;
 
-	if (direct_submit && !ring->sched.ready) {
-		DRM_ERROR("Trying to move memory with ring turned off.\n");
-		return -EINVAL;
-	}
-
 	max_bytes = adev->mman.buffer_funcs->copy_max_bytes;
 	num_loops = DIV_ROUND_UP(byte_count, max_bytes);
 	num_dw = num_loops * adev->mman.buffer_funcs->copy_num_dw;
@@ -2213,28 +2488,29 @@ int amdgpu_copy_buffer(struct amdgpu_ring *ring, uint64_t src_offset,
 	while (num_dw & 0x7)
 		num_dw++;
 
-	r = amdgpu_job_alloc_with_ib(adev, num_dw * 4, &job);
+	r = amdgpu_job_alloc_with_ib(adev, num_dw * 4, job);
 	if (r)
 		return r;
 
 	if (vm_needs_flush) {
-		job->vm_pd_addr = amdgpu_gmc_pd_addr(adev->gart.bo);
-		job->vm_needs_flush = true;
+		(*job)->vm_pd_addr = amdgpu_gmc_pd_addr(adev->gart.bo);
+		(*job)->vm_needs_flush = true;
 	}
 	if (resv) {
-		r = amdgpu_sync_resv(adev, &job->sync, resv,
+		r = amdgpu_sync_resv(adev, &(*job)->sync, resv,
 				     AMDGPU_FENCE_OWNER_UNDEFINED,
 				     false);
 		if (r) {
 			DRM_ERROR("sync failed (%d).\n", r);
-			goto error_free;
+			amdgpu_job_free(*job);
+			return r;
 		}
 	}
 
 	for (i = 0; i < num_loops; i++) {
 		uint32_t cur_size_in_bytes = min(byte_count, max_bytes);
 
-		amdgpu_emit_copy_buffer(adev, &job->ibs[0], src_offset,
+		amdgpu_emit_copy_buffer(adev, &(*job)->ibs[0], src_offset,
 					dst_offset, cur_size_in_bytes);
 
 		src_offset += cur_size_in_bytes;
@@ -2242,8 +2518,31 @@ int amdgpu_copy_buffer(struct amdgpu_ring *ring, uint64_t src_offset,
 		byte_count -= cur_size_in_bytes;
 	}
 
-	amdgpu_ring_pad_ib(ring, &job->ibs[0]);
-	WARN_ON(job->ibs[0].length_dw > num_dw);
+	amdgpu_ring_pad_ib(ring, &(*job)->ibs[0]);
+	WARN_ON((*job)->ibs[0].length_dw > num_dw);
+	return 0;
+}
+
+int amdgpu_copy_buffer(struct amdgpu_ring *ring, uint64_t src_offset,
+		       uint64_t dst_offset, uint32_t byte_count,
+		       struct reservation_object *resv,
+		       struct dma_fence **fence, bool direct_submit,
+		       bool vm_needs_flush)
+{
+	struct amdgpu_device *adev = ring->adev;
+	struct amdgpu_job *job;
+	int r;
+
+	if (direct_submit && !ring->sched.ready) {
+		DRM_ERROR("Trying to move memory with ring turned off.\n");
+		return -EINVAL;
+	}
+
+	r = amdgpu_copy_buffer_job(ring, src_offset, dst_offset, byte_count,
+				   resv, vm_needs_flush, &job);
+	if (r)
+		return r;
+
 	if (direct_submit)
 		r = amdgpu_job_submit_direct(job, ring, fence);
 	else
@@ -2260,6 +2559,192 @@ int amdgpu_copy_buffer(struct amdgpu_ring *ring, uint64_t src_offset,
 	return r;
 }
 
+/**
+ * amdgpu_ttm_copy_stripe - submit a copy to one of the SDMA engines
+ *
+ * @adev: amdgpu device
+ * @stripe: stripe to submit the copy on
+ * @src_offset: GPU address to copy from
+ * @dst_offset: GPU address to copy to
+ * @byte_count: number of bytes to copy
+ * @resv: reservation object to sync to, can be NULL
+ * @deps: additional fences the copy has to wait for, entries can be NULL
+ * @num_deps: number of entries in @deps
+ * @vm_needs_flush: flush the GART TLB before the copy
+ * @fence: resulting fence
+ */
+static int amdgpu_ttm_copy_stripe(struct amdgpu_device *adev, unsigned stripe,
+				  uint64_t src_offset, uint64_t dst_offset,
+				  uint32_t byte_count,
+				  struct reservation_object *resv,
+				  struct dma_fence **deps, unsigned num_deps,
+				  bool vm_needs_flush,
+				  struct dma_fence **fence)
+{
+	struct amdgpu_ring *ring = amdgpu_ttm_stripe_ring(adev, stripe);
+	struct amdgpu_job *job;
+	unsigned i;
+	int r;
+
+	r = amdgpu_copy_buffer_job(ring, src_offset, dst_offset, byte_count,
+				   resv, vm_needs_flush, &job);
+	if (r)
+		return r;
+
+	for (i = 0; i < num_deps; ++i) {
+		if (!deps[i])
+			continue;
+
+		r = amdgpu_sync_fence(adev, &job->sync, deps[i], false);
+		if (r)
+			goto error_free;
+	}
+
+	r = amdgpu_job_submit(job, amdgpu_ttm_stripe_entity(adev, stripe),
+			      AMDGPU_FENCE_OWNER_UNDEFINED, fence);
+	if (r)
+		goto error_free;
+
+	return 0;
+
+error_free:
+	amdgpu_job_free(job);
+	DRM_ERROR("Error scheduling IBs (%d)\n", r);
+	return r;
+}
+
+/**
+ * amdgpu_copy_buffer_striped - copy a range using all SDMA engines
+ *
+ * @adev: amdgpu device
+ * @src_offset: GPU address to copy from
+ * @dst_offset: GPU address to copy to
+ * @byte_count: number of bytes to copy
+ * @resv: reservation object to sync to, can be NULL
+ * @fence: resulting fence, signaled when all engines are done
+ *
+ * Split the copy into one contiguous part per available SDMA engine. The
+ * part on the buffer_funcs_ring is submitted last and waits for the others,
+ * so the returned fence is from the usual buffer move context.
+ */
+int amdgpu_copy_buffer_striped(struct amdgpu_device *adev,
+			       uint64_t src_offset, uint64_t dst_offset,
+			       uint32_t byte_count,
+			       struct reservation_object *resv,
+			       struct dma_fence **fence)
+{
+	struct dma_fence *stripe_fence[AMDGPU_TTM_MAX_STRIPES] = {};
+	unsigned num_stripes, i;
+	uint32_t part;
+	int r = 0;
+
+	if (!adev->mman.buffer_funcs_enabled) {
+		DRM_ERROR("Trying to move memory with ring turned off.\n");
+		return -EINVAL;
+	}
+
+	num_stripes = amdgpu_ttm_num_stripes(adev, byte_count, true);
+	part = ALIGN(DIV_ROUND_UP(byte_count, num_stripes), PAGE_SIZE);
+
+	for (i = num_stripes; i-- > 0;) {
+		uint64_t offset = (uint64_t)i * part;
+		uint32_t cur_size;
+
+		if (offset >= byte_count)
+			continue;
+
+		cur_size = min_t(uint64_t, part, byte_count - offset);
+		r = amdgpu_ttm_copy_stripe(adev, i, src_offset + offset,
+					   dst_offset + offset, cur_size, resv,
+					   &stripe_fence[1],
+					   i ? 0 : num_stripes - 1, false,
+					   &stripe_fence[i]);
+		if (r)
+			break;
+	}
+
+	for (i = 0; i < num_stripes; ++i) {
+		if (r && stripe_fence[i])
+			dma_fence_wait(stripe_fence[i], false);
+		if (i)
+			dma_fence_put(stripe_fence[i]);
+	}
+
+	if (r) {
+		dma_fence_put(stripe_fence[0]);
+		return r;
+	}
+
+	*fence = stripe_fence[0];
+	return 0;
+}
+
+/**
+ * amdgpu_ttm_clear_vram - zero a range of VRAM
+ *
+ * @adev: amdgpu device
+ * @offset: start of the range, relative to the start of VRAM
+ * @size: size of the range in bytes
+ * @dep: fence the fill must wait for, or NULL
+ * @fence: resulting fence
+ *
+ * Used by the VRAM manager to clear free VRAM in the background. The fill
+ * is scheduled at the lowest priority so that it doesn't compete with
+ * buffer moves or application work. The caller must keep the range
+ * reserved until the fence signals.
+ */
+int amdgpu_ttm_clear_vram(struct amdgpu_device *adev, uint64_t offset,
+			  uint64_t size, struct dma_fence *dep,
+			  struct dma_fence **fence)
+{
+	uint32_t max_bytes = adev->mman.buffer_funcs->fill_max_bytes;
+	struct amdgpu_ring *ring = adev->mman.buffer_funcs_ring;
+	uint64_t dst_addr;
+	unsigned int num_dw;
+	struct amdgpu_job *job;
+	int r;
+
+	if (!adev->mman.buffer_funcs_enabled)
+		return -EINVAL;
+
+	num_dw = DIV_ROUND_UP(size, max_bytes) *
+		adev->mman.buffer_funcs->fill_num_dw;
+	/* for IB padding */
+	num_dw += 64;
+
+	r = amdgpu_job_alloc_with_ib(adev, num_dw * 4, &job);
+	if (r)
+		return r;
+
+	if (dep) {
+		r = amdgpu_sync_fence(adev, &job->sync, dep, false);
+		if (r) {
+			amdgpu_job_free(job);
+			return r;
+		}
+	}
+
+	dst_addr = adev->mman.bdev.man[TTM_PL_VRAM].gpu_offset + offset;
+	while (size) {
+		uint32_t cur_size_in_bytes = min_t(uint64_t, size, max_bytes);
+
+		amdgpu_emit_fill_buffer(adev, &job->ibs[0], 0, dst_addr,
+					cur_size_in_bytes);
+
+		dst_addr += cur_size_in_bytes;
+		size -= cur_size_in_bytes;
+	}
+
+	amdgpu_ring_pad_ib(ring, &job->ibs[0]);
+	WARN_ON(job->ibs[0].length_dw > num_dw);
+	r = amdgpu_job_submit(job, &adev->mman.clear_entity,
+			      AMDGPU_FENCE_OWNER_UNDEFINED, fence);
+	if (r)
+		amdgpu_job_free(job);
+
+	return r;
+}
+
 int amdgpu_fill_buffer(struct amdgpu_bo *bo,
 		       uint32_t src_data,
 		       struct reservation_object *resv,
@@ -40,7 +40,10 @@
 #define AMDGPU_PL_FLAG_DGMA_IMPORT	(TTM_PL_FLAG_PRIV << 4)
 
 #define AMDGPU_GTT_MAX_TRANSFER_SIZE	512
-#define AMDGPU_GTT_NUM_TRANSFER_WINDOWS	2
+/* maximum number of SDMA engines a single buffer move is split across */
+#define AMDGPU_TTM_MAX_STRIPES		2
+/* a source and a destination window for each stripe */
+#define AMDGPU_GTT_NUM_TRANSFER_WINDOWS	(2 * AMDGPU_TTM_MAX_STRIPES)
 
 struct amdgpu_mman {
 	struct ttm_bo_device		bdev;
@@ -60,6 +63,14 @@ struct amdgpu_mman {
 	struct mutex				gtt_window_lock;
 	/* Scheduler entity for buffer moves */
 	struct drm_sched_entity			entity;
+	/* Entities on the other SDMA engines for striped moves, stripe 0
+	 * is always the buffer_funcs_ring and uses the entity above
+	 */
+	struct drm_sched_entity			stripe_entity[AMDGPU_TTM_MAX_STRIPES];
+	struct amdgpu_ring			*stripe_ring[AMDGPU_TTM_MAX_STRIPES];
+	unsigned				num_stripes;
+	/* Low priority entity for background clears of free VRAM */
+	struct drm_sched_entity			clear_entity;
 };
 
 struct amdgpu_copy_mem {
@@ -78,6 +89,11 @@ int amdgpu_gtt_mgr_recover(struct ttm_mem_type_manager *man);
 u64 amdgpu_vram_mgr_bo_visible_size(struct amdgpu_bo *bo);
 uint64_t amdgpu_vram_mgr_usage(struct ttm_mem_type_manager *man);
 uint64_t amdgpu_vram_mgr_vis_usage(struct ttm_mem_type_manager *man);
+bool amdgpu_vram_mgr_mem_cleared(struct ttm_mem_type_manager *man,
+				 struct ttm_mem_reg *mem);
+void amdgpu_vram_mgr_clear_pool_start(struct ttm_mem_type_manager *man);
+void amdgpu_vram_mgr_clear_pool_stop(struct ttm_mem_type_manager *man);
+void amdgpu_vram_mgr_clear_pool_reset(struct ttm_mem_type_manager *man);
 
 int amdgpu_ttm_init(struct amdgpu_device *adev);
 void amdgpu_ttm_late_init(struct amdgpu_device *adev);
@@ -90,12 +106,20 @@ int amdgpu_copy_buffer(struct amdgpu_ring *ring, uint64_t src_offset,
 		       struct reservation_object *resv,
 		       struct dma_fence **fence, bool direct_submit,
 		       bool vm_needs_flush);
+int amdgpu_copy_buffer_striped(struct amdgpu_device *adev,
+			       uint64_t src_offset, uint64_t dst_offset,
+			       uint32_t byte_count,
+			       struct reservation_object *resv,
+			       struct dma_fence **fence);
 int amdgpu_ttm_copy_mem_to_mem(struct amdgpu_device *adev,
 			       struct amdgpu_copy_mem *src,
 			       struct amdgpu_copy_mem *dst,
 			       uint64_t size,
 			       struct reservation_object *resv,
 			       struct dma_fence **f);
+int amdgpu_ttm_clear_vram(struct amdgpu_device *adev, uint64_t offset,
+			  uint64_t size, struct dma_fence *dep,
+			  struct dma_fence **fence);
 int amdgpu_fill_buffer(struct amdgpu_bo *bo,
 			uint32_t src_data,
 			struct reservation_object *resv,
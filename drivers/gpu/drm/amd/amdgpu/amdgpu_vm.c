@@ -1147,12 +1147,15 @@ int amdgpu_vm_flush(struct amdgpu_ring *ring, struct amdgpu_job *job, bool need_
 	if (ring->funcs->init_cond_exec)
 		patch_offset = amdgpu_ring_init_cond_exec(ring);
 
-	if (need_pipe_sync)
+	if (need_pipe_sync) {
 		amdgpu_ring_emit_pipeline_sync(ring);
+		++ring->vmid_stats.pipe_syncs;
+	}
 
 	if (vm_flush_needed) {
 		trace_amdgpu_vm_flush(ring, job->vmid, job->vm_pd_addr);
 		amdgpu_ring_emit_vm_flush(ring, job->vmid, job->vm_pd_addr);
+		++ring->vmid_stats.flushes;
 	}
 
 	if (pasid_mapping_needed)
@@ -2371,6 +2374,52 @@ int amdgpu_vm_clear_freed(struct amdgpu_device *adev,
 
 }
 
+/**
+ * amdgpu_vm_update_range - map or clear a range without a BO mapping
+ *
+ * @adev: amdgpu_device pointer
+ * @vm: requested vm
+ * @start: first GPU page to update
+ * @last: last GPU page to update
+ * @flags: flags for the entries, 0 clears the range
+ * @pages_addr: DMA addresses of the system pages backing the range,
+ * indexed from @start, or NULL when clearing
+ * @fence: resulting fence of the last update
+ *
+ * Fill in the page table entries between @start and @last for memory
+ * that is not backed by a BO, e.g. HMM mirrored system memory. The
+ * update is split so that each job fits into a SDMA IB. Page tables
+ * for the range must already be allocated and the root PD reserved.
+ *
+ * Returns:
+ * 0 for success, errno otherwise.
+ */
+int amdgpu_vm_update_range(struct amdgpu_device *adev, struct amdgpu_vm *vm,
+			   uint64_t start, uint64_t last, uint64_t flags,
+			   dma_addr_t *pages_addr, struct dma_fence **fence)
+{
+	uint64_t addr = 0;
+	int r;
+
+	if (WARN_ON((flags & AMDGPU_PTE_VALID) && !pages_addr))
+		return -EINVAL;
+
+	do {
+		uint64_t end = min(last, start + 16ull * 1024ull - 1);
+
+		r = amdgpu_vm_bo_update_mapping(adev, NULL, pages_addr, vm,
+						start, end, flags, addr,
+						fence);
+		if (r)
+			return r;
+
+		addr += (end - start + 1) * AMDGPU_GPU_PAGE_SIZE;
+		start = end + 1;
+	} while (start <= last);
+
+	return 0;
+}
+
 /**
  * amdgpu_vm_handle_moved - handle moved BOs in the PT
  *
@@ -3295,6 +3344,41 @@ void amdgpu_vm_release_compute(struct amdgpu_device *adev, struct amdgpu_vm *vm)
 	vm->pasid = 0;
 }
 
+/**
+ * amdgpu_vm_set_pasid - bind a pasid to a vm created without one
+ *
+ * @adev: amdgpu_device pointer
+ * @vm: vm initialized with a pasid of 0
+ * @pasid: Process address space identifier
+ *
+ * Used to hand out VMs that were initialized ahead of time.
+ *
+ * Returns:
+ * 0 for success, error for failure.
+ */
+int amdgpu_vm_set_pasid(struct amdgpu_device *adev, struct amdgpu_vm *vm,
+			unsigned int pasid)
+{
+	unsigned long flags;
+	int r;
+
+	if (WARN_ON(vm->pasid))
+		return -EINVAL;
+
+	if (!pasid)
+		return 0;
+
+	spin_lock_irqsave(&adev->vm_manager.pasid_lock, flags);
+	r = idr_alloc(&adev->vm_manager.pasid_idr, vm, pasid, pasid + 1,
+		      GFP_ATOMIC);
+	spin_unlock_irqrestore(&adev->vm_manager.pasid_lock, flags);
+	if (r < 0)
+		return r;
+
+	vm->pasid = pasid;
+	return 0;
+}
+
 /**
  * amdgpu_vm_fini - tear down a vm instance
  *
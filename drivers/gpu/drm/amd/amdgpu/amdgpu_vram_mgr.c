@@ -25,13 +25,36 @@
 #include <drm/drmP.h>
 #include "amdgpu.h"
 
+/* Granularity at which VRAM is tracked as known to be zero */
+#define AMDGPU_VRAM_CLEAR_CHUNK_PAGES	((2UL << 20) >> PAGE_SHIFT)
+/* Number of chunks cleared per run of the clear worker */
+#define AMDGPU_VRAM_CLEAR_BATCH		16
+/* Dirty chunks looked at per run, most of them may still be in use */
+#define AMDGPU_VRAM_CLEAR_SCAN		256
+
 struct amdgpu_vram_mgr {
 	struct drm_mm mm;
 	spinlock_t lock;
 	atomic64_t usage;
 	atomic64_t vis_usage;
+
+	/* Pool of known-zero VRAM. A chunk is clean if it was cleared and
+	 * no range overlapping it was freed since. Protected by lock.
+	 */
+	struct ttm_mem_type_manager *man;
+	unsigned long *clean;
+	unsigned long num_chunks;
+	unsigned long num_clean;
+	unsigned long next_chunk;
+	unsigned int clear_gen;
+	bool clear_enabled;
+	struct work_struct clear_work;
+	atomic64_t clear_hits;
+	atomic64_t clear_misses;
 };
 
+static void amdgpu_vram_mgr_clear_work(struct work_struct *work);
+
 /**
  * amdgpu_vram_mgr_init - init VRAM manager and DRM MM
  *
@@ -49,6 +72,22 @@ static int amdgpu_vram_mgr_init(struct ttm_mem_type_manager *man,
 	if (!mgr)
 		return -ENOMEM;
 
+	/* VRAM starts out with unknown content, so all chunks are dirty */
+	if (amdgpu_vram_clear_pool) {
+		mgr->num_chunks = p_size / AMDGPU_VRAM_CLEAR_CHUNK_PAGES;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 15, 0)
+		mgr->clean = kcalloc(BITS_TO_LONGS(mgr->num_chunks),
+				     sizeof(long), GFP_KERNEL);
+#else
+		mgr->clean = kvzalloc(BITS_TO_LONGS(mgr->num_chunks) *
+				      sizeof(long), GFP_KERNEL);
+#endif
+		if (!mgr->clean)
+			mgr->num_chunks = 0;
+	}
+	mgr->man = man;
+	INIT_WORK(&mgr->clear_work, amdgpu_vram_mgr_clear_work);
+
 	drm_mm_init(&mgr->mm, 0, p_size);
 	spin_lock_init(&mgr->lock);
 	man->priv = mgr;
@@ -67,9 +106,16 @@ static int amdgpu_vram_mgr_fini(struct ttm_mem_type_manager *man)
 {
 	struct amdgpu_vram_mgr *mgr = man->priv;
 
+	cancel_work_sync(&mgr->clear_work);
+
 	spin_lock(&mgr->lock);
 	drm_mm_takedown(&mgr->mm);
 	spin_unlock(&mgr->lock);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 15, 0)
+	kfree(mgr->clean);
+#else
+	kvfree(mgr->clean);
+#endif
 	kfree(mgr);
 	man->priv = NULL;
 	return 0;
@@ -146,6 +192,269 @@ static void amdgpu_vram_mgr_virt_start(struct ttm_mem_reg *mem,
 	mem->start = max(mem->start, start);
 }
 
+/**
+ * amdgpu_vram_mgr_node_chunks - chunks overlapped by a node
+ *
+ * @node: MM node structure
+ * @first: resulting first chunk
+ * @last: resulting last chunk
+ */
+static void amdgpu_vram_mgr_node_chunks(struct drm_mm_node *node,
+					unsigned long *first,
+					unsigned long *last)
+{
+	*first = node->start / AMDGPU_VRAM_CLEAR_CHUNK_PAGES;
+	*last = (node->start + node->size - 1) / AMDGPU_VRAM_CLEAR_CHUNK_PAGES;
+}
+
+/**
+ * amdgpu_vram_mgr_mark_dirty - drop freed VRAM from the clear pool
+ *
+ * @mgr: VRAM manager
+ * @node: MM node that is being freed
+ *
+ * Must be called with the manager lock held.
+ */
+static void amdgpu_vram_mgr_mark_dirty(struct amdgpu_vram_mgr *mgr,
+				       struct drm_mm_node *node)
+{
+	unsigned long first, last;
+
+	amdgpu_vram_mgr_node_chunks(node, &first, &last);
+	for (; first <= last && first < mgr->num_chunks; ++first)
+		if (__test_and_clear_bit(first, mgr->clean))
+			mgr->num_clean--;
+}
+
+/**
+ * amdgpu_vram_mgr_mem_cleared - check if VRAM is known to be zero
+ *
+ * @man: TTM memory type manager
+ * @mem: newly allocated VRAM
+ *
+ * Returns true if all chunks backing @mem were cleared in the background
+ * and not freed since. Nobody can have written to the memory in that
+ * case, so a VRAM_CLEARED allocation can skip its fill. Counts pool hits
+ * and misses, so only call this for allocations that need clearing.
+ */
+bool amdgpu_vram_mgr_mem_cleared(struct ttm_mem_type_manager *man,
+				 struct ttm_mem_reg *mem)
+{
+	struct amdgpu_vram_mgr *mgr = man->priv;
+	struct drm_mm_node *nodes = mem->mm_node;
+	unsigned pages = mem->num_pages;
+	bool cleared = mgr->num_chunks != 0;
+
+	spin_lock(&mgr->lock);
+	for (; cleared && nodes && pages; pages -= nodes->size, nodes++) {
+		unsigned long first, last;
+
+		amdgpu_vram_mgr_node_chunks(nodes, &first, &last);
+		for (; first <= last; ++first) {
+			if (first >= mgr->num_chunks ||
+			    !test_bit(first, mgr->clean)) {
+				cleared = false;
+				break;
+			}
+		}
+	}
+	spin_unlock(&mgr->lock);
+
+	if (cleared)
+		atomic64_inc(&mgr->clear_hits);
+	else
+		atomic64_inc(&mgr->clear_misses);
+
+	return cleared;
+}
+
+/**
+ * amdgpu_vram_mgr_reserve_dirty - grab free chunks that need clearing
+ *
+ * @mgr: VRAM manager
+ * @nodes: array of AMDGPU_VRAM_CLEAR_BATCH zeroed nodes
+ *
+ * Reserve up to AMDGPU_VRAM_CLEAR_BATCH dirty chunks that are completely
+ * free, so that nobody can allocate them while they are cleared. Looks at
+ * up to AMDGPU_VRAM_CLEAR_SCAN dirty chunks, starting where the last scan
+ * stopped.
+ *
+ * Returns the number of reserved chunks.
+ */
+static unsigned amdgpu_vram_mgr_reserve_dirty(struct amdgpu_vram_mgr *mgr,
+					      struct drm_mm_node *nodes)
+{
+	unsigned long chunk = mgr->next_chunk;
+	unsigned scanned, n = 0;
+
+	spin_lock(&mgr->lock);
+	for (scanned = 0; scanned < AMDGPU_VRAM_CLEAR_SCAN &&
+	     mgr->num_clean < mgr->num_chunks &&
+	     n < AMDGPU_VRAM_CLEAR_BATCH; ++scanned) {
+		chunk = find_next_zero_bit(mgr->clean, mgr->num_chunks,
+					   chunk + 1);
+		if (chunk >= mgr->num_chunks) {
+			chunk = find_first_zero_bit(mgr->clean,
+						    mgr->num_chunks);
+			if (chunk >= mgr->num_chunks)
+				break;
+		}
+
+		nodes[n].start = chunk * AMDGPU_VRAM_CLEAR_CHUNK_PAGES;
+		nodes[n].size = AMDGPU_VRAM_CLEAR_CHUNK_PAGES;
+		if (!drm_mm_reserve_node(&mgr->mm, &nodes[n]))
+			++n;
+		else
+			memset(&nodes[n], 0, sizeof(nodes[n]));
+	}
+	mgr->next_chunk = chunk;
+	spin_unlock(&mgr->lock);
+
+	return n;
+}
+
+/**
+ * amdgpu_vram_mgr_clear_work - clear free VRAM in the background
+ *
+ * @work: the clear work item of the VRAM manager
+ *
+ * Clears a batch of dirty free chunks with a low priority SDMA fill and
+ * adds them to the pool once the fill has completed. Requeues itself as
+ * long as it finds work, so that a big backlog is worked off in batches.
+ *
+ * A pipelined eviction frees its VRAM before the copy out of it has
+ * finished, and only the manager's move fence tracks that copy. The fill
+ * waits for that fence, so it can neither overwrite data that still has
+ * to be copied nor be followed by a write to the chunk.
+ */
+static void amdgpu_vram_mgr_clear_work(struct work_struct *work)
+{
+	struct amdgpu_vram_mgr *mgr =
+		container_of(work, struct amdgpu_vram_mgr, clear_work);
+	struct amdgpu_device *adev = amdgpu_ttm_adev(mgr->man->bdev);
+	struct drm_mm_node nodes[AMDGPU_VRAM_CLEAR_BATCH] = {};
+	struct ttm_mem_type_manager *man = mgr->man;
+	struct dma_fence *fence = NULL, *move;
+	unsigned i, n, cleared = 0;
+	unsigned int gen;
+	int r = 0;
+
+	if (!READ_ONCE(mgr->clear_enabled))
+		return;
+
+	gen = READ_ONCE(mgr->clear_gen);
+	n = amdgpu_vram_mgr_reserve_dirty(mgr, nodes);
+	if (!n)
+		return;
+
+	/* Taken after the chunks were reserved, so it covers every pipelined
+	 * eviction that freed part of them
+	 */
+	spin_lock(&man->move_lock);
+	move = dma_fence_get(man->move);
+	spin_unlock(&man->move_lock);
+
+	/* Fills on the same entity complete in order, so waiting for the
+	 * last one is enough
+	 */
+	for (i = 0; i < n; ++i) {
+		struct dma_fence *next = NULL;
+
+		r = amdgpu_ttm_clear_vram(adev, nodes[i].start << PAGE_SHIFT,
+					  nodes[i].size << PAGE_SHIFT, move,
+					  &next);
+		if (r)
+			break;
+		dma_fence_put(fence);
+		fence = next;
+		cleared = i + 1;
+	}
+	if (fence) {
+		if (dma_fence_wait(fence, false) || fence->error)
+			cleared = 0;
+		dma_fence_put(fence);
+	}
+	if (move) {
+		if (dma_fence_wait(move, false) || move->error)
+			cleared = 0;
+		dma_fence_put(move);
+	}
+
+	spin_lock(&mgr->lock);
+	for (i = 0; i < n; ++i) {
+		unsigned long chunk = nodes[i].start /
+			AMDGPU_VRAM_CLEAR_CHUNK_PAGES;
+
+		/* A reset in the meantime may have lost VRAM again */
+		if (i < cleared && gen == mgr->clear_gen &&
+		    !__test_and_set_bit(chunk, mgr->clean))
+			mgr->num_clean++;
+		drm_mm_remove_node(&nodes[i]);
+	}
+	spin_unlock(&mgr->lock);
+
+	if (!r && n == AMDGPU_VRAM_CLEAR_BATCH &&
+	    READ_ONCE(mgr->clear_enabled))
+		schedule_work(&mgr->clear_work);
+}
+
+/**
+ * amdgpu_vram_mgr_clear_pool_start - start clearing free VRAM
+ *
+ * @man: TTM memory type manager
+ *
+ * Called when the buffer functions become available.
+ */
+void amdgpu_vram_mgr_clear_pool_start(struct ttm_mem_type_manager *man)
+{
+	struct amdgpu_vram_mgr *mgr = man->priv;
+
+	if (!mgr->num_chunks)
+		return;
+
+	WRITE_ONCE(mgr->clear_enabled, true);
+	schedule_work(&mgr->clear_work);
+}
+
+/**
+ * amdgpu_vram_mgr_clear_pool_stop - stop clearing free VRAM
+ *
+ * @man: TTM memory type manager
+ *
+ * Called before the buffer functions are disabled, e.g. for suspend. The
+ * VRAM content is not guaranteed to survive, so the pool is emptied.
+ */
+void amdgpu_vram_mgr_clear_pool_stop(struct ttm_mem_type_manager *man)
+{
+	struct amdgpu_vram_mgr *mgr = man->priv;
+
+	WRITE_ONCE(mgr->clear_enabled, false);
+	cancel_work_sync(&mgr->clear_work);
+	amdgpu_vram_mgr_clear_pool_reset(man);
+}
+
+/**
+ * amdgpu_vram_mgr_clear_pool_reset - forget all known-zero VRAM
+ *
+ * @man: TTM memory type manager
+ *
+ * Called when VRAM content was lost.
+ */
+void amdgpu_vram_mgr_clear_pool_reset(struct ttm_mem_type_manager *man)
+{
+	struct amdgpu_vram_mgr *mgr = man->priv;
+
+	spin_lock(&mgr->lock);
+	mgr->clear_gen++;
+	if (mgr->num_chunks)
+		bitmap_zero(mgr->clean, mgr->num_chunks);
+	mgr->num_clean = 0;
+	spin_unlock(&mgr->lock);
+
+	if (READ_ONCE(mgr->clear_enabled))
+		schedule_work(&mgr->clear_work);
+}
+
 /**
  * amdgpu_vram_mgr_new - allocate new ranges
  *
@@ -309,6 +618,7 @@ static void amdgpu_vram_mgr_del(struct ttm_mem_type_manager *man,
 	spin_lock(&mgr->lock);
 	while (pages) {
 		pages -= nodes->size;
+		amdgpu_vram_mgr_mark_dirty(mgr, nodes);
 		drm_mm_remove_node(nodes);
 		usage += nodes->size << PAGE_SHIFT;
 		vis_usage += amdgpu_vram_mgr_vis_size(adev, nodes);
@@ -319,6 +629,9 @@ static void amdgpu_vram_mgr_del(struct ttm_mem_type_manager *man,
 	atomic64_sub(usage, &mgr->usage);
 	atomic64_sub(vis_usage, &mgr->vis_usage);
 
+	if (READ_ONCE(mgr->clear_enabled))
+		schedule_work(&mgr->clear_work);
+
 	kfree(mem->mm_node);
 	mem->mm_node = NULL;
 }
@@ -381,10 +694,22 @@ static void amdgpu_vram_mgr_debug(struct ttm_mem_type_manager *man,
 	drm_printf(printer, "man size:%llu pages, ram usage:%lluMB, vis usage:%lluMB\n",
 		   man->size, amdgpu_vram_mgr_usage(man) >> 20,
 		   amdgpu_vram_mgr_vis_usage(man) >> 20);
+	drm_printf(printer, "clear pool: clean %luMB, dirty %luMB, hits %llu, misses %llu\n",
+		   (mgr->num_clean * AMDGPU_VRAM_CLEAR_CHUNK_PAGES) >> (20 - PAGE_SHIFT),
+		   ((mgr->num_chunks - mgr->num_clean) *
+		    AMDGPU_VRAM_CLEAR_CHUNK_PAGES) >> (20 - PAGE_SHIFT),
+		   (u64)atomic64_read(&mgr->clear_hits),
+		   (u64)atomic64_read(&mgr->clear_misses));
 #else
 	DRM_DEBUG("man size:%llu pages, ram usage:%lluMB, vis usage:%lluMB\n",
 		   man->size, amdgpu_vram_mgr_usage(man) >> 20,
 		   amdgpu_vram_mgr_vis_usage(man) >> 20);
+	DRM_DEBUG("clear pool: clean %luMB, dirty %luMB, hits %llu, misses %llu\n",
+		  (mgr->num_clean * AMDGPU_VRAM_CLEAR_CHUNK_PAGES) >> (20 - PAGE_SHIFT),
+		  ((mgr->num_chunks - mgr->num_clean) *
+		   AMDGPU_VRAM_CLEAR_CHUNK_PAGES) >> (20 - PAGE_SHIFT),
+		  (u64)atomic64_read(&mgr->clear_hits),
+		  (u64)atomic64_read(&mgr->clear_misses));
 #endif
 }
 
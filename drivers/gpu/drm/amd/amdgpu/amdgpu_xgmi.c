@@ -152,6 +152,7 @@ int amdgpu_xgmi_add_device(struct amdgpu_device *adev)
 			/* To do : continue with some node failed or disable the whole hive */
 			break;
 		}
+		tmp_adev->psp.xgmi_context.top_info = *hive_topology;
 	}
 
 	list_for_each_entry(tmp_adev, &hive->device_list, gmc.xgmi.head) {
@@ -183,3 +184,39 @@ void amdgpu_xgmi_remove_device(struct amdgpu_device *adev)
 		mutex_unlock(&hive->hive_lock);
 	}
 }
+
+/**
+ * amdgpu_xgmi_same_hive - check if two devices share an XGMI hive
+ *
+ * Devices in the same hive see each other's VRAM in their MC address
+ * space, so copies between them need neither GART nor PCIe.
+ */
+bool amdgpu_xgmi_same_hive(struct amdgpu_device *adev,
+			   struct amdgpu_device *peer_adev)
+{
+	return adev != peer_adev && adev->gmc.xgmi.hive_id &&
+		adev->gmc.xgmi.hive_id == peer_adev->gmc.xgmi.hive_id;
+}
+
+/**
+ * amdgpu_xgmi_get_hops_count - number of XGMI hops between two devices
+ *
+ * Returns the hop count the PSP reported for @peer_adev from the point of
+ * view of @adev, 1 if the PSP didn't list the peer, or 0 if the devices
+ * are not in the same hive.
+ */
+int amdgpu_xgmi_get_hops_count(struct amdgpu_device *adev,
+			       struct amdgpu_device *peer_adev)
+{
+	struct psp_xgmi_topology_info *top = &adev->psp.xgmi_context.top_info;
+	int i;
+
+	if (!amdgpu_xgmi_same_hive(adev, peer_adev))
+		return 0;
+
+	for (i = 0; i < top->num_nodes; i++)
+		if (top->nodes[i].node_id == peer_adev->gmc.xgmi.node_id)
+			return max_t(int, top->nodes[i].num_hops, 1);
+
+	return 1;
+}
@@ -44,6 +44,7 @@
 #include "kfd_device_queue_manager.h"
 #include "kfd_dbgmgr.h"
 #include "kfd_ipc.h"
+#include "kfd_peer_route.h"
 #include "kfd_trace.h"
 #include "amdgpu_amdkfd.h"
 
@@ -316,6 +317,12 @@ static int kfd_ioctl_create_queue(struct file *filep, struct kfd_process *p,
 			p->pasid,
 			dev->id);
 
+	if (q_properties.type == KFD_QUEUE_TYPE_COMPUTE) {
+		err = kfd_process_device_init_cwsr(pdd, filep);
+		if (err)
+			goto err_create_queue;
+	}
+
 	err = pqm_create_queue(&p->pqm, dev, filep, &q_properties, &queue_id);
 	if (err != 0)
 		goto err_create_queue;
@@ -566,6 +573,10 @@ static int kfd_ioctl_set_trap_handler(struct file *filep,
 		goto out;
 	}
 
+	err = kfd_process_device_init_cwsr(pdd, filep);
+	if (err)
+		goto out;
+
 	if (dev->dqm->ops.set_trap_handler(dev->dqm,
 					&pdd->qpd,
 					args->tba_addr,
@@ -1326,6 +1337,9 @@ static int kfd_ioctl_alloc_memory_of_gpu(struct file *filep,
 	} else if (flags & KFD_IOC_ALLOC_MEM_FLAGS_DOORBELL) {
 		if (args->size != kfd_doorbell_process_slice(dev))
 			return -EINVAL;
+		err = kfd_alloc_process_doorbells(p);
+		if (err)
+			return err;
 		offset = kfd_get_process_doorbells(dev, p);
 	}
 
@@ -1398,6 +1412,13 @@ static int kfd_ioctl_free_memory_of_gpu(struct file *filep,
 		ret = -EINVAL;
 		goto err_unlock;
 	}
+
+	/* Drop one reference of a repeatedly imported IPC buffer */
+	if (buf_obj->import_count > 1) {
+		buf_obj->import_count--;
+		ret = 0;
+		goto err_unlock;
+	}
 	run_rdma_free_callback(buf_obj);
 
 	ret = amdgpu_amdkfd_gpuvm_free_memory_of_gpu(dev->kgd,
@@ -1731,6 +1752,103 @@ static int kfd_ioctl_ipc_import_handle(struct file *filep,
 	return r;
 }
 
+static int kfd_ioctl_get_topology(struct file *filep,
+				  struct kfd_process *p, void *data)
+{
+	struct kfd_ioctl_get_topology_args *args = data;
+
+	return kfd_topology_get_blob((void __user *)args->blob_ptr,
+				     &args->blob_size, &args->generation_id);
+}
+
+/* Enough for every attribute type plus access attributes for many GPUs */
+#define KFD_SVM_MAX_ATTRS	256
+
+static int kfd_ioctl_svm(struct file *filep, struct kfd_process *p, void *data)
+{
+	struct kfd_ioctl_svm_args *args = data;
+	struct kfd_ioctl_svm_attribute __user *uattrs;
+	struct kfd_ioctl_svm_attribute *attrs = NULL;
+	int r;
+
+	if (args->nattr > KFD_SVM_MAX_ATTRS)
+		return -EINVAL;
+
+	uattrs = (void __user *)args->attrs_ptr;
+	if (args->nattr) {
+		attrs = memdup_user(uattrs, args->nattr * sizeof(*attrs));
+		if (IS_ERR(attrs))
+			return PTR_ERR(attrs);
+	}
+
+	r = kfd_svm_ioctl(p, args->op, args->start_addr, args->size,
+			  args->nattr, attrs);
+
+	if (!r && args->op == KFD_IOCTL_SVM_OP_GET_ATTR && args->nattr &&
+	    copy_to_user(uattrs, attrs, args->nattr * sizeof(*attrs)))
+		r = -EFAULT;
+
+	kfree(attrs);
+	return r;
+}
+
+static int kfd_ioctl_ipc_import_handles(struct file *filep,
+					struct kfd_process *p,
+					void *data)
+{
+	struct kfd_ioctl_ipc_import_handles_args *args = data;
+	struct kfd_ioctl_ipc_import_handle_args __user *uimports;
+	struct kfd_ioctl_ipc_import_handle_args *imports;
+	uint32_t i;
+	int r = 0;
+
+	args->num_imported = 0;
+	if (!args->num_handles)
+		return 0;
+	if (args->num_handles > KFD_IPC_MAX_IMPORT_HANDLES)
+		return -EINVAL;
+
+	uimports = (void __user *)args->import_array_ptr;
+	/* Up to KFD_IPC_MAX_IMPORT_HANDLES entries, too big for kmalloc to
+	 * be reliable
+	 */
+	imports = vmemdup_user(uimports,
+			       args->num_handles * sizeof(*imports));
+	if (IS_ERR(imports))
+		return PTR_ERR(imports);
+
+	for (i = 0; i < args->num_handles; i++) {
+		struct kfd_ioctl_ipc_import_handle_args *import = &imports[i];
+		struct kfd_dev *dev;
+
+		dev = kfd_device_by_id(import->gpu_id);
+		if (!dev) {
+			r = -EINVAL;
+			break;
+		}
+
+		r = kfd_ipc_import_handle(dev, p, import->gpu_id,
+					  import->share_handle,
+					  import->va_addr, &import->handle,
+					  &import->mmap_offset);
+		if (r) {
+			pr_err("Failed to import IPC handle %u of %u\n",
+			       i, args->num_handles);
+			break;
+		}
+	}
+
+	/* Handles imported before a failure stay valid, report them so that
+	 * user mode can use or free them
+	 */
+	args->num_imported = i;
+	if (i && copy_to_user(uimports, imports, i * sizeof(*imports)))
+		r = -EFAULT;
+
+	kvfree(imports);
+	return r;
+}
+
 #ifndef PTRACE_MODE_ATTACH_REALCREDS
 #define PTRACE_MODE_ATTACH_REALCREDS  PTRACE_MODE_ATTACH
 #endif
@@ -2236,6 +2354,74 @@ static int kfd_destroy_kgd_mem(struct kgd_mem *mem)
 	return amdgpu_amdkfd_gpuvm_free_memory_of_gpu(NULL, mem);
 }
 
+/* Direct peer copies at least this large are split between the copy
+ * engines of both GPUs
+ */
+#define KFD_PEER_STRIPE_SIZE	(8ULL << 20)
+
+/* Copies between the VRAM of two GPUs over the route the topology
+ * prefers, without a bounce buffer. Returns -ENOENT if the copy has to be
+ * staged through system memory instead.
+ */
+static int kfd_copy_peer_bos(struct kfd_bo *src_bo, uint64_t src_offset,
+			     struct kfd_bo *dst_bo, uint64_t dst_offset,
+			     uint64_t size, struct dma_fence **f,
+			     uint64_t *copied)
+{
+	struct kfd_dev *engine[2];
+	struct kfd_peer_route route;
+	struct dma_fence *fence = NULL;
+	unsigned int num_engines = 0;
+	uint64_t split = size, n;
+	int err;
+
+	if (kfd_topology_get_peer_route(src_bo->dev, dst_bo->dev, &route))
+		return -ENOENT;
+	if (route.type != KFD_ROUTE_XGMI &&
+	    route.type != KFD_ROUTE_XGMI_MULTIHOP &&
+	    route.type != KFD_ROUTE_PCIE_P2P)
+		return -ENOENT;
+
+	if (route.engines & KFD_ROUTE_ENGINE_SRC)
+		engine[num_engines++] = src_bo->dev;
+	if (route.engines & KFD_ROUTE_ENGINE_DST)
+		engine[num_engines++] = dst_bo->dev;
+
+	if (num_engines > 1 && size >= KFD_PEER_STRIPE_SIZE)
+		split = ALIGN(size / 2, PAGE_SIZE);
+	else
+		num_engines = 1;
+
+	/* Nothing was copied yet if this fails, e.g. because the BAR isn't
+	 * reachable after all, so the caller can still stage the copy
+	 */
+	if (amdgpu_amdkfd_copy_mem_to_mem(engine[0]->kgd, src_bo->mem,
+					  src_offset, dst_bo->mem,
+					  dst_offset, split, &fence, &n))
+		return -ENOENT;
+	*copied = n;
+
+	if (num_engines == 1) {
+		if (f)
+			*f = fence;
+		else
+			dma_fence_put(fence);
+		return 0;
+	}
+
+	err = amdgpu_amdkfd_copy_mem_to_mem(engine[1]->kgd, src_bo->mem,
+					    src_offset + split, dst_bo->mem,
+					    dst_offset + split, size - split,
+					    f, &n);
+	if (!err)
+		*copied += n;
+
+	/* Callers track a single fence, so wait for the other half here */
+	kfd_cma_fence_wait(fence);
+	dma_fence_put(fence);
+	return err;
+}
+
 /* Copies @size bytes from si->cur_bo to di->cur_bo starting at their
  * respective offset.
  * @si: Source iter
@@ -2292,13 +2478,21 @@ static int kfd_copy_bos(struct cma_iter *si, struct cma_iter *di,
 		list_add_tail(&di->cma_bo->list, &di->cma_list);
 	} else if (src_bo->dev->kgd != dst_bo->dev->kgd) {
 		/* This indicates that atleast on of the BO is in local mem.
-		 * If both are in local mem of different devices then create an
-		 * intermediate System BO and do a double copy
-		 * [VRAM]--gpu1-->[System BO]--gpu2-->[VRAM].
+		 * If both are in local mem of different devices copy over
+		 * XGMI or PCIe peer to peer if the topology has a route for
+		 * it. Otherwise create an intermediate System BO and do a
+		 * double copy [VRAM]--gpu1-->[System BO]--gpu2-->[VRAM].
 		 * If only one BO is in VRAM then use that GPU to do the copy
 		 */
 		if (src_bo->mem_type == KFD_IOC_ALLOC_MEM_FLAGS_VRAM &&
 		    dst_bo->mem_type == KFD_IOC_ALLOC_MEM_FLAGS_VRAM) {
+			err = kfd_copy_peer_bos(src_bo, si->bo_offset,
+						dst_bo, di->bo_offset,
+						size, f, copied);
+			if (err != -ENOENT)
+				return err;
+			err = 0;
+
 			dev = dst_bo->dev;
 			size = min_t(uint64_t, size, MAX_SYSTEM_BO_SIZE);
 			d2d = 1;
@@ -2885,6 +3079,15 @@ static const struct amdkfd_ioctl_desc amdkfd_ioctls[] = {
 	AMDKFD_IOCTL_DEF(AMDKFD_IOC_DBG_TRAP,
 			kfd_ioctl_dbg_set_debug_trap, 0),
 
+	AMDKFD_IOCTL_DEF(AMDKFD_IOC_IPC_IMPORT_HANDLES,
+			kfd_ioctl_ipc_import_handles, 0),
+
+	AMDKFD_IOCTL_DEF(AMDKFD_IOC_GET_TOPOLOGY,
+			kfd_ioctl_get_topology, 0),
+
+	AMDKFD_IOCTL_DEF(AMDKFD_IOC_SVM,
+			kfd_ioctl_svm, 0),
+
 };
 
 #define AMDKFD_CORE_IOCTL_COUNT	ARRAY_SIZE(amdkfd_ioctls)
@@ -341,6 +341,23 @@ static int kfd_parse_subtype_cache(struct crat_subtype_cache *cache,
 	return 0;
 }
 
+/* kfd_crat_iolink_weight - weight of an iolink subtype, lower is better.
+ * Also used by the peer route selection so both agree on link costs.
+ */
+uint32_t kfd_crat_iolink_weight(struct crat_subtype_iolink *iolink)
+{
+	switch (iolink->io_interface_type) {
+	case CRAT_IOLINK_TYPE_PCIEXPRESS:
+		return KFD_CRAT_PCIE_WEIGHT;
+	case CRAT_IOLINK_TYPE_XGMI:
+		return iolink->weight_xgmi ? iolink->weight_xgmi :
+			KFD_CRAT_XGMI_WEIGHT;
+	default:
+		return node_distance(iolink->proximity_domain_from,
+				     iolink->proximity_domain_to);
+	}
+}
+
 /* kfd_parse_subtype_iolink - parse iolink subtypes and attach it to correct
  * topology device present in the device_list
  */
@@ -368,13 +385,7 @@ static int kfd_parse_subtype_iolink(struct crat_subtype_iolink *iolink,
 			props->ver_maj = iolink->version_major;
 			props->ver_min = iolink->version_minor;
 			props->iolink_type = iolink->io_interface_type;
-
-			if (props->iolink_type == CRAT_IOLINK_TYPE_PCIEXPRESS)
-				props->weight = 20;
-			else if (props->iolink_type == CRAT_IOLINK_TYPE_XGMI)
-				props->weight = 15;
-			else
-				props->weight = node_distance(id_from, id_to);
+			props->weight = kfd_crat_iolink_weight(iolink);
 
 			props->min_latency = iolink->minimum_latency;
 			props->max_latency = iolink->maximum_latency;
@@ -1107,10 +1118,13 @@ static int kfd_fill_gpu_direct_io_link_to_cpu(int *avail_size,
 
 static int kfd_fill_gpu_xgmi_link_to_gpu(int *avail_size,
 			struct kfd_dev *kdev,
+			struct kfd_dev *peer_kdev,
 			struct crat_subtype_iolink *sub_type_hdr,
 			uint32_t proximity_domain_from,
 			uint32_t proximity_domain_to)
 {
+	uint32_t hops;
+
 	*avail_size -= sizeof(struct crat_subtype_iolink);
 	if (*avail_size < 0)
 		return -ENOMEM;
@@ -1125,6 +1139,10 @@ static int kfd_fill_gpu_xgmi_link_to_gpu(int *avail_size,
 	sub_type_hdr->io_interface_type = CRAT_IOLINK_TYPE_XGMI;
 	sub_type_hdr->proximity_domain_from = proximity_domain_from;
 	sub_type_hdr->proximity_domain_to = proximity_domain_to;
+
+	hops = amdgpu_amdkfd_get_xgmi_hops_count(kdev->kgd, peer_kdev->kgd);
+	sub_type_hdr->weight_xgmi = min_t(uint32_t, U8_MAX,
+					  KFD_CRAT_XGMI_WEIGHT * max(hops, 1U));
 	return 0;
 }
 
@@ -1302,7 +1320,7 @@ static int kfd_create_vcrat_image_gpu(void *pcrat_image,
 				(char *)sub_type_hdr +
 				sizeof(struct crat_subtype_iolink));
 			ret = kfd_fill_gpu_xgmi_link_to_gpu(
-				&avail_size, kdev,
+				&avail_size, kdev, peer_dev->gpu,
 				(struct crat_subtype_iolink *)sub_type_hdr,
 				proximity_domain, nid);
 			if (ret < 0)
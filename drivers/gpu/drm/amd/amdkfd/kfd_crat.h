@@ -259,6 +259,12 @@ struct crat_subtype_ccompute {
 
 #define CRAT_IOLINK_RESERVED_LENGTH	24
 
+/* Default link weights. XGMI links may carry their own weight, scaled by
+ * the number of hops the PSP reported between the two GPUs.
+ */
+#define KFD_CRAT_PCIE_WEIGHT		20
+#define KFD_CRAT_XGMI_WEIGHT		15
+
 struct crat_subtype_iolink {
 	uint8_t		type;
 	uint8_t		length;
@@ -274,7 +280,8 @@ struct crat_subtype_iolink {
 	uint32_t	minimum_bandwidth_mbs;
 	uint32_t	maximum_bandwidth_mbs;
 	uint32_t	recommended_transfer_size;
-	uint8_t		reserved2[CRAT_IOLINK_RESERVED_LENGTH];
+	uint8_t		reserved2[CRAT_IOLINK_RESERVED_LENGTH - 1];
+	uint8_t		weight_xgmi;
 };
 
 /*
@@ -321,6 +328,7 @@ int kfd_create_crat_image_acpi(void **crat_image, size_t *size);
 void kfd_destroy_crat_image(void *crat_image);
 int kfd_parse_crat_table(void *crat_image, struct list_head *device_list,
 			 uint32_t proximity_domain);
+uint32_t kfd_crat_iolink_weight(struct crat_subtype_iolink *iolink);
 int kfd_create_crat_image_virtual(void **crat_image, size_t *size,
 				  int flags, struct kfd_dev *kdev,
 				  uint32_t proximity_domain);
@@ -0,0 +1,423 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * CU partition manager
+ *
+ * /sys/class/kfd/kfd/cu_partitions/partitions
+ *	Write "<gpu_id> <partition> <cu list>" to define a partition, e.g.
+ *	"4660 0 0-15", or "<gpu_id> <partition> none" to remove it. CUs are
+ *	numbered like in kfd_ioctl_set_cu_mask. Partitions of a GPU must not
+ *	overlap. Reading lists the partitions with their occupancy.
+ *
+ * /sys/class/kfd/kfd/cu_partitions/assign
+ *	Write "<pid> <gpu_id> <partition>" to confine the queues of a process
+ *	on that GPU to a partition, or partition -1 to release it.
+ *
+ * Changes take effect when the runlist is rebuilt, which is forced right
+ * away. The queue's own CU mask is intersected with its partition.
+ */
+
+#include <linux/bitmap.h>
+#include <linux/ktime.h>
+#include <linux/pid.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include "kfd_priv.h"
+#include "kfd_device_queue_manager.h"
+#include "kfd_mqd_manager.h"
+#include "amdgpu_amdkfd.h"
+
+static struct kobject *kfd_cu_partition_kobj;
+static struct attribute kfd_cu_partition_attr_partitions = {
+	.name = "partitions",
+	.mode = 0644,
+};
+static struct attribute kfd_cu_partition_attr_assign = {
+	.name = "assign",
+	.mode = 0200,
+};
+
+static bool kfd_cu_partition_defined(struct kfd_cu_partition *part)
+{
+	return !bitmap_empty(part->cus, KFD_CU_PARTITION_MAX_CUS);
+}
+
+static void kfd_cu_partition_set(struct kfd_cu_partition *part,
+				 const unsigned long *cus)
+{
+	unsigned int i;
+
+	bitmap_copy(part->cus, cus, KFD_CU_PARTITION_MAX_CUS);
+	memset(part->cu_mask, 0, sizeof(part->cu_mask));
+	for_each_set_bit(i, cus, KFD_CU_PARTITION_MAX_CUS)
+		part->cu_mask[i / 32] |= 1U << (i % 32);
+}
+
+/* The shared partition holds the CUs no partition claims. It is left empty,
+ * meaning all CUs, if there are no partitions or they claim every CU.
+ */
+static void kfd_cu_partition_update_shared(struct kfd_dev *dev)
+{
+	DECLARE_BITMAP(cus, KFD_CU_PARTITION_MAX_CUS);
+	struct kfd_cu_info cu_info;
+	unsigned int i;
+
+	amdgpu_amdkfd_get_cu_info(dev->kgd, &cu_info);
+	bitmap_zero(cus, KFD_CU_PARTITION_MAX_CUS);
+	bitmap_set(cus, 0, min_t(unsigned int, cu_info.cu_active_number,
+				 KFD_CU_PARTITION_MAX_CUS));
+
+	for (i = 0; i < KFD_MAX_CU_PARTITIONS; i++)
+		bitmap_andnot(cus, cus, dev->cu_partitions[i].cus,
+			      KFD_CU_PARTITION_MAX_CUS);
+
+	if (bitmap_weight(cus, KFD_CU_PARTITION_MAX_CUS) ==
+	    cu_info.cu_active_number)
+		bitmap_zero(cus, KFD_CU_PARTITION_MAX_CUS);
+
+	kfd_cu_partition_set(&dev->cu_shared, cus);
+}
+
+static struct kfd_cu_partition *
+kfd_cu_partition_of(struct kfd_dev *dev, struct qcm_process_device *qpd)
+{
+	if (qpd->cu_partition >= 0 &&
+	    kfd_cu_partition_defined(&dev->cu_partitions[qpd->cu_partition]))
+		return &dev->cu_partitions[qpd->cu_partition];
+
+	return &dev->cu_shared;
+}
+
+static void kfd_cu_partition_account_one(struct kfd_cu_partition *part,
+					 uint64_t delta)
+{
+	if (part->queues)
+		part->active_ns += delta;
+	part->processes = 0;
+	part->queues = 0;
+}
+
+/**
+ * kfd_cu_partition_account - Close the occupancy window of the runlist
+ *
+ * Called with the DQM lock held whenever the runlist is unmapped or
+ * rebuilt.
+ */
+void kfd_cu_partition_account(struct kfd_dev *dev)
+{
+	uint64_t now = ktime_get_ns();
+	uint64_t delta = now - dev->cu_partition_timestamp;
+	unsigned int i;
+
+	for (i = 0; i < KFD_MAX_CU_PARTITIONS; i++)
+		kfd_cu_partition_account_one(&dev->cu_partitions[i], delta);
+	kfd_cu_partition_account_one(&dev->cu_shared, delta);
+
+	dev->cu_partition_timestamp = now;
+}
+
+void kfd_cu_partition_map_process(struct kfd_dev *dev,
+				  struct qcm_process_device *qpd)
+{
+	kfd_cu_partition_of(dev, qpd)->processes++;
+}
+
+/**
+ * kfd_cu_partition_map_queue - Apply the CU partition to a queue
+ *
+ * Called with the DQM lock held while the runlist is built. The queue is
+ * not mapped at this point, so its MQD can be updated in place.
+ */
+void kfd_cu_partition_map_queue(struct device_queue_manager *dqm,
+				struct qcm_process_device *qpd,
+				struct queue *q)
+{
+	struct kfd_cu_partition *part = kfd_cu_partition_of(dqm->dev, qpd);
+	struct mqd_manager *mqd_mgr;
+
+	if (q->properties.type != KFD_QUEUE_TYPE_COMPUTE)
+		return;
+
+	part->queues++;
+	part->queue_maps++;
+
+	if (q->cu_partition_gen == dqm->dev->cu_partition_gen)
+		return;
+
+	mqd_mgr = dqm->mqd_mgrs[KFD_MQD_TYPE_CP];
+	if (!mqd_mgr || !mqd_mgr->update_cu_mask)
+		return;
+
+	q->properties.cu_partition_mask =
+		kfd_cu_partition_defined(part) ? part->cu_mask : NULL;
+	mqd_mgr->update_cu_mask(mqd_mgr, q->mqd, &q->properties);
+	q->cu_partition_gen = dqm->dev->cu_partition_gen;
+}
+
+static int kfd_cu_partition_define(struct kfd_dev *dev, unsigned int id,
+				   const unsigned long *cus)
+{
+	struct kfd_cu_info cu_info;
+	unsigned int i;
+	int ret;
+
+	amdgpu_amdkfd_get_cu_info(dev->kgd, &cu_info);
+	if (find_next_bit(cus, KFD_CU_PARTITION_MAX_CUS,
+			  cu_info.cu_active_number) < KFD_CU_PARTITION_MAX_CUS)
+		return -EINVAL;
+
+	dqm_lock(dev->dqm);
+
+	for (i = 0; i < KFD_MAX_CU_PARTITIONS; i++) {
+		if (i != id && bitmap_intersects(cus, dev->cu_partitions[i].cus,
+						 KFD_CU_PARTITION_MAX_CUS)) {
+			ret = -EBUSY;
+			goto out_unlock;
+		}
+	}
+
+	kfd_cu_partition_set(&dev->cu_partitions[id], cus);
+	if (!kfd_cu_partition_defined(&dev->cu_partitions[id])) {
+		dev->cu_partitions[id].queue_maps = 0;
+		dev->cu_partitions[id].active_ns = 0;
+	}
+	kfd_cu_partition_update_shared(dev);
+
+	dev->cu_partition_gen++;
+	ret = execute_queues_for_cu_partitions(dev->dqm);
+
+out_unlock:
+	dqm_unlock(dev->dqm);
+
+	return ret;
+}
+
+static int kfd_cu_partition_assign(struct kfd_dev *dev, pid_t nr, int id)
+{
+	struct kfd_process_device *pdd;
+	struct kfd_process *p;
+	struct pid *pid;
+	int ret = 0;
+
+	pid = find_get_pid(nr);
+	if (!pid)
+		return -ESRCH;
+	p = kfd_lookup_process_by_pid(pid);
+	put_pid(pid);
+	if (!p)
+		return -ESRCH;
+
+	mutex_lock(&p->mutex);
+	pdd = kfd_get_process_device_data(dev, p);
+	if (!pdd) {
+		ret = -ENODEV;
+		goto out_unlock_process;
+	}
+
+	dqm_lock(dev->dqm);
+	if (id >= 0 && !kfd_cu_partition_defined(&dev->cu_partitions[id])) {
+		ret = -ENOENT;
+	} else if (pdd->qpd.cu_partition != id) {
+		pdd->qpd.cu_partition = id;
+		dev->cu_partition_gen++;
+		ret = execute_queues_for_cu_partitions(dev->dqm);
+	}
+	dqm_unlock(dev->dqm);
+
+out_unlock_process:
+	mutex_unlock(&p->mutex);
+	kfd_unref_process(p);
+
+	return ret;
+}
+
+static ssize_t kfd_cu_partition_show_one(char *buffer, ssize_t len,
+					 struct kfd_dev *dev, const char *name,
+					 struct kfd_cu_partition *part)
+{
+	uint64_t active_ns = part->active_ns;
+
+	/* Include the time since the runlist was mapped */
+	if (part->queues)
+		active_ns += ktime_get_ns() - dev->cu_partition_timestamp;
+
+	return len + scnprintf(buffer + len, PAGE_SIZE - len,
+		"%u %s cus %*pbl processes %u queues %u queue_maps %llu active_ms %llu\n",
+		dev->id, name, KFD_CU_PARTITION_MAX_CUS, part->cus,
+		part->processes, part->queues, part->queue_maps,
+		div_u64(active_ns, NSEC_PER_MSEC));
+}
+
+static ssize_t kfd_cu_partition_show_partitions(char *buffer)
+{
+	struct kfd_dev *dev;
+	char name[8];
+	ssize_t len = 0;
+	unsigned int i, j;
+
+	for (i = 0; kfd_topology_enum_kfd_devices(i, &dev) == 0; i++) {
+		if (!dev || !dev->init_complete)
+			continue;
+
+		dqm_lock(dev->dqm);
+		for (j = 0; j < KFD_MAX_CU_PARTITIONS; j++) {
+			if (!kfd_cu_partition_defined(&dev->cu_partitions[j]))
+				continue;
+			snprintf(name, sizeof(name), "%u", j);
+			len = kfd_cu_partition_show_one(buffer, len, dev, name,
+						&dev->cu_partitions[j]);
+		}
+		len = kfd_cu_partition_show_one(buffer, len, dev, "shared",
+						&dev->cu_shared);
+		dqm_unlock(dev->dqm);
+	}
+
+	return len;
+}
+
+static ssize_t kfd_cu_partition_show(struct kobject *kobj,
+				     struct attribute *attr, char *buffer)
+{
+	if (attr == &kfd_cu_partition_attr_partitions)
+		return kfd_cu_partition_show_partitions(buffer);
+
+	return -EINVAL;
+}
+
+static ssize_t kfd_cu_partition_store(struct kobject *kobj,
+				      struct attribute *attr,
+				      const char *buffer, size_t count)
+{
+	DECLARE_BITMAP(cus, KFD_CU_PARTITION_MAX_CUS);
+	struct kfd_dev *dev;
+	char list[64];
+	uint32_t gpu_id;
+	int id, nr;
+	int ret;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (attr == &kfd_cu_partition_attr_partitions) {
+		if (sscanf(buffer, "%u %d %63s", &gpu_id, &id, list) != 3)
+			return -EINVAL;
+
+		bitmap_zero(cus, KFD_CU_PARTITION_MAX_CUS);
+		if (strcmp(list, "none")) {
+			ret = bitmap_parselist(list, cus,
+					       KFD_CU_PARTITION_MAX_CUS);
+			if (ret)
+				return ret;
+		}
+	} else {
+		if (sscanf(buffer, "%d %u %d", &nr, &gpu_id, &id) != 3)
+			return -EINVAL;
+	}
+
+	if (id >= KFD_MAX_CU_PARTITIONS || id < -1 ||
+	    (id == -1 && attr == &kfd_cu_partition_attr_partitions))
+		return -EINVAL;
+
+	dev = kfd_device_by_id(gpu_id);
+	if (!dev || !dev->init_complete)
+		return -ENODEV;
+	if (dev->dqm->sched_policy == KFD_SCHED_POLICY_NO_HWS)
+		return -EOPNOTSUPP;
+
+	if (attr == &kfd_cu_partition_attr_partitions)
+		ret = kfd_cu_partition_define(dev, id, cus);
+	else
+		ret = kfd_cu_partition_assign(dev, nr, id);
+
+	return ret ? ret : count;
+}
+
+static void kfd_cu_partition_kobj_release(struct kobject *kobj)
+{
+	kfree(kobj);
+}
+
+static const struct sysfs_ops kfd_cu_partition_ops = {
+	.show = kfd_cu_partition_show,
+	.store = kfd_cu_partition_store,
+};
+
+static struct kobj_type kfd_cu_partition_type = {
+	.release = kfd_cu_partition_kobj_release,
+	.sysfs_ops = &kfd_cu_partition_ops,
+};
+
+/* Failure only loses the partitioning interface, so it is not fatal */
+void kfd_cu_partition_sysfs_init(void)
+{
+	int ret;
+
+	kfd_cu_partition_kobj = kzalloc(sizeof(*kfd_cu_partition_kobj),
+					GFP_KERNEL);
+	if (!kfd_cu_partition_kobj)
+		return;
+
+	ret = kobject_init_and_add(kfd_cu_partition_kobj,
+				   &kfd_cu_partition_type,
+				   &kfd_device->kobj, "cu_partitions");
+	if (ret)
+		goto err_put;
+
+	sysfs_attr_init(&kfd_cu_partition_attr_partitions);
+	sysfs_attr_init(&kfd_cu_partition_attr_assign);
+	ret = sysfs_create_file(kfd_cu_partition_kobj,
+				&kfd_cu_partition_attr_partitions);
+	if (ret)
+		goto err_del;
+	ret = sysfs_create_file(kfd_cu_partition_kobj,
+				&kfd_cu_partition_attr_assign);
+	if (ret)
+		goto err_remove;
+
+	return;
+
+err_remove:
+	sysfs_remove_file(kfd_cu_partition_kobj,
+			  &kfd_cu_partition_attr_partitions);
+err_del:
+	kobject_del(kfd_cu_partition_kobj);
+err_put:
+	pr_warn("Could not create CU partition sysfs files\n");
+	kobject_put(kfd_cu_partition_kobj);
+	kfd_cu_partition_kobj = NULL;
+}
+
+void kfd_cu_partition_sysfs_fini(void)
+{
+	if (!kfd_cu_partition_kobj)
+		return;
+
+	sysfs_remove_file(kfd_cu_partition_kobj,
+			  &kfd_cu_partition_attr_assign);
+	sysfs_remove_file(kfd_cu_partition_kobj,
+			  &kfd_cu_partition_attr_partitions);
+	kobject_del(kfd_cu_partition_kobj);
+	kobject_put(kfd_cu_partition_kobj);
+	kfd_cu_partition_kobj = NULL;
+}
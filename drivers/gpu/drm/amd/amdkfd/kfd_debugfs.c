@@ -21,12 +21,54 @@
  */
 
 #include <linux/debugfs.h>
+#include <linux/slab.h>
 #include <linux/uaccess.h>
 
 #include "kfd_priv.h"
 
 static struct dentry *debugfs_root;
 
+/**
+ * kfd_debugfs_run_tests - run a suite of in-kernel tests
+ * @m: seq_file the results are printed to
+ * @suite: tests to run
+ *
+ * Runs every test with a freshly allocated context and prints one TAP
+ * line per test.
+ *
+ * Returns 0 if the tests were run, whether or not they passed, -errno
+ * otherwise.
+ */
+int kfd_debugfs_run_tests(struct seq_file *m,
+			  const struct kfd_test_suite *suite)
+{
+	unsigned int i, failed = 0;
+	void *ctx;
+	bool ok;
+
+	ctx = kzalloc(suite->ctx_size, GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	seq_printf(m, "1..%u\n", suite->num_tests);
+	for (i = 0; i < suite->num_tests; i++) {
+		if (suite->init)
+			suite->init(ctx);
+		ok = suite->tests[i].func(ctx);
+		if (suite->fini)
+			suite->fini(ctx);
+
+		if (!ok)
+			failed++;
+		seq_printf(m, "%sok %u %s\n", ok ? "" : "not ",
+			   i + 1, suite->tests[i].name);
+	}
+	seq_printf(m, "# %u of %u tests failed\n", failed, suite->num_tests);
+
+	kfree(ctx);
+	return 0;
+}
+
 static int kfd_debugfs_open(struct inode *inode, struct file *file)
 {
 	int (*show)(struct seq_file *, void *) = inode->i_private;
@@ -115,6 +157,32 @@ void kfd_debugfs_init(void)
 
 	if (!ent)
 		pr_warn("Failed to create rls in kfd debugfs\n");
+
+	ent = debugfs_create_file("peer_routes", S_IFREG | 0444, debugfs_root,
+				  kfd_debugfs_peer_routes,
+				  &kfd_debugfs_fops);
+	if (!ent)
+		pr_warn("Failed to create peer_routes in kfd debugfs\n");
+
+	ent = debugfs_create_file("peer_route_test", S_IFREG | 0444,
+				  debugfs_root, kfd_debugfs_peer_route_test,
+				  &kfd_debugfs_fops);
+	if (!ent)
+		pr_warn("Failed to create peer_route_test in kfd debugfs\n");
+
+#ifdef CONFIG_HSA_AMD_SVM
+	ent = debugfs_create_file("svm", S_IFREG | 0444, debugfs_root,
+				  kfd_debugfs_svm_by_process,
+				  &kfd_debugfs_fops);
+	if (!ent)
+		pr_warn("Failed to create svm in kfd debugfs\n");
+
+	ent = debugfs_create_file("svm_policy_test", S_IFREG | 0444,
+				  debugfs_root, kfd_debugfs_svm_policy_test,
+				  &kfd_debugfs_fops);
+	if (!ent)
+		pr_warn("Failed to create svm_policy_test in kfd debugfs\n");
+#endif
 }
 
 void kfd_debugfs_fini(void)
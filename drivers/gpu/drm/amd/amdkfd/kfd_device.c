@@ -23,6 +23,7 @@
 
 #include <linux/pci.h>
 #include <linux/slab.h>
+#include <linux/dma-buf.h>
 #include "kfd_priv.h"
 #include "kfd_device_queue_manager.h"
 #include "kfd_pm4_headers_vi.h"
@@ -469,6 +470,7 @@ struct kfd_dev *kgd2kfd_probe(struct kgd_dev *kgd,
 	atomic_set(&kfd->compute_profile, 0);
 
 	mutex_init(&kfd->doorbell_mutex);
+	mutex_init(&kfd->cwsr_isa_lock);
 	memset(&kfd->doorbell_available_index, 0,
 		sizeof(kfd->doorbell_available_index));
 
@@ -639,6 +641,9 @@ void kgd2kfd_device_exit(struct kfd_dev *kfd)
 		amdgpu_amdkfd_free_gtt_mem(kfd->kgd, kfd->gtt_mem);
 	}
 
+	if (kfd->cwsr_isa_dmabuf)
+		dma_buf_put(kfd->cwsr_isa_dmabuf);
+
 	kfree(kfd);
 }
 
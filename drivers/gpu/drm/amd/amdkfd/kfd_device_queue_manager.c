@@ -149,6 +149,16 @@ bool check_if_queues_active(struct device_queue_manager *dqm,
 	return busy;
 }
 
+/* Rebuild the runlist so that changed CU partitions are applied to the
+ * MQDs. dqm->lock has to be held. Only used with HWS, without it queues
+ * are not mapped through a runlist.
+ */
+int execute_queues_for_cu_partitions(struct device_queue_manager *dqm)
+{
+	return execute_queues_cpsch(dqm,
+			KFD_UNMAP_QUEUES_FILTER_DYNAMIC_QUEUES, 0);
+}
+
 static int allocate_doorbell(struct qcm_process_device *qpd, struct queue *q)
 {
 	struct kfd_dev *dev = qpd->dqm->dev;
@@ -612,6 +622,7 @@ static int evict_process_queues_nocpsch(struct device_queue_manager *dqm,
 		if (retval)
 			goto out;
 		dqm->queue_count--;
+		atomic64_inc(&pdd->process->counters.queue_preemptions);
 	}
 
 out:
@@ -624,6 +635,7 @@ static int evict_process_queues_cpsch(struct device_queue_manager *dqm,
 {
 	struct queue *q;
 	struct kfd_process_device *pdd;
+	unsigned int n_evicted = 0;
 	int retval = 0;
 
 	dqm_lock(dqm);
@@ -641,11 +653,15 @@ static int evict_process_queues_cpsch(struct device_queue_manager *dqm,
 		q->properties.is_evicted = true;
 		q->properties.is_active = false;
 		dqm->queue_count--;
+		n_evicted++;
 	}
 	retval = execute_queues_cpsch(dqm,
 				qpd->is_debug ?
 				KFD_UNMAP_QUEUES_FILTER_ALL_QUEUES :
 				KFD_UNMAP_QUEUES_FILTER_DYNAMIC_QUEUES, 0);
+	if (!retval)
+		atomic64_add(n_evicted,
+			     &pdd->process->counters.queue_preemptions);
 
 out:
 	dqm_unlock(dqm);
@@ -1333,6 +1349,7 @@ static int unmap_queues_cpsch(struct device_queue_manager *dqm,
 
 	pm_release_ib(&dqm->packets);
 	dqm->active_runlist = false;
+	kfd_cu_partition_account(dqm->dev);
 
 	return retval;
 }
@@ -1497,8 +1514,11 @@ static int set_trap_handler(struct device_queue_manager *dqm,
 	uint64_t *tma;
 
 	if (dqm->dev->cwsr_enabled) {
+		if (!qpd->tma_kaddr)
+			return -EINVAL;
+
 		/* Jump from CWSR trap handler to user trap */
-		tma = (uint64_t *)(qpd->cwsr_kaddr + KFD_CWSR_TMA_OFFSET);
+		tma = (uint64_t *)qpd->tma_kaddr;
 		tma[0] = tba_addr;
 		tma[1] = tma_addr;
 	} else {
@@ -38,6 +38,17 @@ static DEFINE_IDA2(doorbell_ida);
 #endif
 static unsigned int max_doorbell_slices;
 
+/*
+ * Slices released by exiting processes are parked here, still reserved in
+ * the IDA, and handed to the next process that creates a queue. This keeps
+ * short-lived processes off the IDA and reuses slices whose pages were
+ * recently mapped.
+ */
+#define KFD_DOORBELL_CACHE_SIZE	16
+static DEFINE_SPINLOCK(doorbell_cache_lock);
+static unsigned int doorbell_cache[KFD_DOORBELL_CACHE_SIZE];
+static unsigned int doorbell_cache_count;
+
 /*
  * Each device exposes a doorbell aperture, a PCI MMIO aperture that
  * receives 32-bit writes that are passed to queues as wptr values.
@@ -228,6 +239,10 @@ int kfd_doorbell_mmap(struct kfd_dev *dev, struct kfd_process *process,
 	if (vma->vm_end - vma->vm_start != kfd_doorbell_process_slice(dev))
 		return -EINVAL;
 
+	ret = kfd_alloc_process_doorbells(process);
+	if (ret)
+		return ret;
+
 	/* Calculate physical address of doorbell */
 	address = kfd_get_process_doorbells(dev, process);
 
@@ -375,18 +390,65 @@ phys_addr_t kfd_get_process_doorbells(struct kfd_dev *dev,
 		process->doorbell_index * kfd_doorbell_process_slice(dev);
 }
 
+static unsigned int kfd_doorbell_cache_get(void)
+{
+	unsigned int index = 0;
+
+	spin_lock(&doorbell_cache_lock);
+	if (doorbell_cache_count)
+		index = doorbell_cache[--doorbell_cache_count];
+	spin_unlock(&doorbell_cache_lock);
+
+	return index;
+}
+
+static void kfd_doorbell_slice_put(unsigned int index)
+{
+	spin_lock(&doorbell_cache_lock);
+	if (doorbell_cache_count < KFD_DOORBELL_CACHE_SIZE) {
+		doorbell_cache[doorbell_cache_count++] = index;
+		index = 0;
+	}
+	spin_unlock(&doorbell_cache_lock);
+
+	if (index)
+		ida_simple_remove(&doorbell_ida, index);
+}
+
+/**
+ * kfd_alloc_process_doorbells - Assign a doorbell slice to a process
+ *
+ * Slices are assigned lazily, the first time a queue is created or the
+ * doorbells are mapped, so processes that never submit work don't hold
+ * one. Safe to call repeatedly and concurrently.
+ *
+ * Returns 0 on success, negative error code if no slice is available.
+ */
 int kfd_alloc_process_doorbells(struct kfd_process *process)
 {
-	int r = ida_simple_get(&doorbell_ida, 1, max_doorbell_slices,
-				GFP_KERNEL);
-	if (r > 0)
-		process->doorbell_index = r;
+	unsigned int index;
+	int r;
 
-	return r;
+	if (READ_ONCE(process->doorbell_index))
+		return 0;
+
+	index = kfd_doorbell_cache_get();
+	if (!index) {
+		r = ida_simple_get(&doorbell_ida, 1, max_doorbell_slices,
+				   GFP_KERNEL);
+		if (r < 0)
+			return r;
+		index = r;
+	}
+
+	if (cmpxchg(&process->doorbell_index, 0, index))
+		kfd_doorbell_slice_put(index);
+
+	return 0;
 }
 
 void kfd_free_process_doorbells(struct kfd_process *process)
 {
 	if (process->doorbell_index)
-		ida_simple_remove(&doorbell_ida, process->doorbell_index);
+		kfd_doorbell_slice_put(process->doorbell_index);
 }
@@ -116,6 +116,15 @@ static void event_interrupt_wq_v9(struct kfd_dev *dev,
 		info.prot_read  = ring_id & 0x10;
 		info.prot_write = ring_id & 0x20;
 
+		/* Retry faults on SVM addresses are resolved by mapping the
+		 * page, then the GPU retries the access
+		 */
+		if ((ih_ring_entry[5] & 0x80) &&
+		    kfd_svm_handle_gpu_fault(dev, pasid,
+					     info.page_addr << 12,
+					     ih_ring_entry[5] & 0x20))
+			return;
+
 		kfd_process_vm_fault(dev->dqm, pasid);
 		kfd_signal_vm_fault_event(dev, pasid, &info);
 	}
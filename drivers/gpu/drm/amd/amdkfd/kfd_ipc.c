@@ -31,6 +31,10 @@
 #define KFD_IPC_HASH_TABLE_SIZE_SHIFT 4
 #define KFD_IPC_HASH_TABLE_SIZE_MASK ((1 << KFD_IPC_HASH_TABLE_SIZE_SHIFT) - 1)
 
+/* Writers serialize on the mutex, lookups only take the RCU read lock and
+ * must acquire their reference with kref_get_unless_zero since the last
+ * reference may be dropped concurrently.
+ */
 static struct kfd_ipc_handles {
 	DECLARE_HASHTABLE(handles, KFD_IPC_HASH_TABLE_SIZE_SHIFT);
 	struct mutex lock;
@@ -64,7 +68,7 @@ static int ipc_store_insert(void *val, void *sh, struct kfd_ipc_obj **ipc_obj)
 	memcpy(sh, obj->share_handle, sizeof(obj->share_handle));
 
 	mutex_lock(&kfd_ipc_handles.lock);
-	hlist_add_head(&obj->node,
+	hlist_add_head_rcu(&obj->node,
 		&kfd_ipc_handles.handles[HANDLE_TO_KEY(obj->share_handle)]);
 	mutex_unlock(&kfd_ipc_handles.lock);
 
@@ -81,11 +85,12 @@ static void ipc_obj_release(struct kref *r)
 	obj = container_of(r, struct kfd_ipc_obj, ref);
 
 	mutex_lock(&kfd_ipc_handles.lock);
-	hash_del(&obj->node);
+	hash_del_rcu(&obj->node);
 	mutex_unlock(&kfd_ipc_handles.lock);
 
 	dma_buf_put(obj->data);
-	kfree(obj);
+	/* Lookups walk the buckets under RCU and may still see the object */
+	kfree_rcu(obj, rcu);
 }
 
 void ipc_obj_get(struct kfd_ipc_obj *obj)
@@ -106,6 +111,30 @@ int kfd_ipc_init(void)
 	return 0;
 }
 
+/* Find a BO of this process that was imported from ipc_obj at va_addr on
+ * dev. Must be called with p->mutex held.
+ */
+static struct kfd_bo *kfd_ipc_find_imported_bo(struct kfd_process *p,
+					       struct kfd_dev *dev,
+					       uint64_t va_addr,
+					       struct kfd_ipc_obj *ipc_obj)
+{
+	struct interval_tree_node *it_node;
+	struct kfd_bo *kfd_bo;
+
+	for (it_node = interval_tree_iter_first(&p->bo_interval_tree,
+						va_addr, va_addr);
+	     it_node;
+	     it_node = interval_tree_iter_next(it_node, va_addr, va_addr)) {
+		kfd_bo = container_of(it_node, struct kfd_bo, it);
+		if (kfd_bo->dev == dev && kfd_bo->it.start == va_addr &&
+		    kfd_bo->kfd_ipc_obj == ipc_obj && kfd_bo->import_count)
+			return kfd_bo;
+	}
+
+	return NULL;
+}
+
 static int kfd_import_dmabuf_create_kfd_bo(struct kfd_dev *dev,
 			  struct kfd_process *p,
 			  uint32_t gpu_id, struct dma_buf *dmabuf,
@@ -118,6 +147,7 @@ static int kfd_import_dmabuf_create_kfd_bo(struct kfd_dev *dev,
 	uint64_t size;
 	int idr_handle;
 	struct kfd_process_device *pdd = NULL;
+	struct kfd_bo *kfd_bo;
 
 	if (!handle)
 		return -EINVAL;
@@ -133,6 +163,23 @@ static int kfd_import_dmabuf_create_kfd_bo(struct kfd_dev *dev,
 		goto err_unlock;
 	}
 
+	/* Importing the same IPC handle at the same address again reuses the
+	 * existing BO instead of creating another dmabuf attachment
+	 */
+	if (ipc_obj) {
+		kfd_bo = kfd_ipc_find_imported_bo(p, dev, va_addr, ipc_obj);
+		if (kfd_bo) {
+			kfd_bo->import_count++;
+			*mmap_offset = kfd_bo->mmap_offset;
+			mutex_unlock(&p->mutex);
+
+			*handle = MAKE_HANDLE(gpu_id, kfd_bo->handle);
+			/* The BO already holds a reference to ipc_obj */
+			ipc_obj_put(&ipc_obj);
+			return 0;
+		}
+	}
+
 	r = amdgpu_amdkfd_gpuvm_import_dmabuf(dev->kgd, dmabuf,
 					va_addr, pdd->vm,
 					(struct kgd_mem **)&mem, &size,
@@ -148,6 +195,12 @@ static int kfd_import_dmabuf_create_kfd_bo(struct kfd_dev *dev,
 		goto err_free;
 	}
 
+	if (ipc_obj) {
+		kfd_bo = kfd_process_device_find_bo(pdd, idr_handle);
+		kfd_bo->import_count = 1;
+		kfd_bo->mmap_offset = *mmap_offset;
+	}
+
 	mutex_unlock(&p->mutex);
 
 	*handle = MAKE_HANDLE(gpu_id, idr_handle);
@@ -191,28 +244,29 @@ int kfd_ipc_import_handle(struct kfd_dev *dev, struct kfd_process *p,
 	struct hlist_node *tmp_node;
 #endif
 
-	mutex_lock(&kfd_ipc_handles.lock);
+	rcu_read_lock();
 	/* Convert the user provided handle to hash key and search only in that
 	 * bucket
 	 */
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3, 9, 0)
-	hlist_for_each_entry(entry, tmp_node,
+	hlist_for_each_entry_rcu(entry, tmp_node,
 		&kfd_ipc_handles.handles[HANDLE_TO_KEY(share_handle)], node) {
 #else
-	hlist_for_each_entry(entry,
+	hlist_for_each_entry_rcu(entry,
 		&kfd_ipc_handles.handles[HANDLE_TO_KEY(share_handle)], node) {
 #endif
 		if (!memcmp(entry->share_handle, share_handle,
 			    sizeof(entry->share_handle))) {
-			found = entry;
+			/* Skip objects that are being released */
+			if (kref_get_unless_zero(&entry->ref))
+				found = entry;
 			break;
 		}
 	}
-	mutex_unlock(&kfd_ipc_handles.lock);
+	rcu_read_unlock();
 
 	if (!found)
 		return -EINVAL;
-	ipc_obj_get(found);
 
 	pr_debug("Found ipc_dma_buf: %p\n", found->data);
 
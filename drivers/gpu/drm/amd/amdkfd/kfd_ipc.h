@@ -25,11 +25,13 @@
 #define KFD_IPC_H_
 
 #include <linux/types.h>
+#include <linux/rcupdate.h>
 #include "kfd_priv.h"
 
 struct kfd_ipc_obj {
 	struct hlist_node node;
 	struct kref ref;
+	struct rcu_head rcu;
 	void *data;
 	uint32_t share_handle[4];
 };
@@ -60,12 +60,20 @@ static int kfd_init(void)
 	if (err < 0)
 		goto err_create_wq;
 
+	err = kfd_procfs_init();
+	if (err < 0)
+		goto err_procfs;
+
+	kfd_cu_partition_sysfs_init();
+
 	kfd_init_peer_direct();
 
 	kfd_debugfs_init();
 
 	return 0;
 
+err_procfs:
+	kfd_process_destroy_wq();
 err_create_wq:
 err_ipc:
 	kfd_topology_shutdown();
@@ -79,6 +87,8 @@ static void kfd_exit(void)
 {
 	kfd_debugfs_fini();
 	kfd_close_peer_direct();
+	kfd_cu_partition_sysfs_fini();
+	kfd_procfs_shutdown();
 	kfd_process_destroy_wq();
 	kfd_topology_shutdown();
 	kfd_chardev_exit();
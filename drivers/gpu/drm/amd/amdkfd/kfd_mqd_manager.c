@@ -131,3 +131,39 @@ void mqd_symmetrically_map_cu_mask(struct mqd_manager *mm,
 		} while (cu >= cu_per_sh[se] && cu < 32);
 	}
 }
+
+/* Compute the SE masks of a queue from the CU mask set with
+ * kfd_ioctl_set_cu_mask and the CU partition of its process. A queue mask
+ * that doesn't overlap the partition at all gets the whole partition.
+ */
+void mqd_get_queue_se_mask(struct mqd_manager *mm,
+		struct queue_properties *q, uint32_t *se_mask)
+{
+	uint32_t cu_mask[KFD_CU_PARTITION_MASK_DWORDS];
+	bool empty = true;
+	int i;
+
+	if (!q->cu_partition_mask) {
+		if (!q->cu_mask_count) {
+			for (i = 0; i < 4; i++)
+				se_mask[i] = 0xFFFFFFFF;
+			return;
+		}
+		mqd_symmetrically_map_cu_mask(mm,
+			q->cu_mask, q->cu_mask_count, se_mask);
+		return;
+	}
+
+	for (i = 0; i < KFD_CU_PARTITION_MASK_DWORDS; i++) {
+		cu_mask[i] = q->cu_partition_mask[i];
+		if (q->cu_mask_count)
+			cu_mask[i] &= i < q->cu_mask_count / 32 ?
+				q->cu_mask[i] : 0;
+		if (cu_mask[i])
+			empty = false;
+	}
+
+	mqd_symmetrically_map_cu_mask(mm,
+		empty ? q->cu_partition_mask : cu_mask,
+		KFD_CU_PARTITION_MAX_CUS, se_mask);
+}
@@ -95,6 +95,9 @@ struct mqd_manager {
 
 	bool	(*check_queue_active)(struct queue *q);
 
+	void	(*update_cu_mask)(struct mqd_manager *mm, void *mqd,
+				struct queue_properties *q);
+
 #if defined(CONFIG_DEBUG_FS)
 	int	(*debugfs_show_mqd)(struct seq_file *m, void *data);
 #endif
@@ -114,5 +117,7 @@ void uninit_mqd_hiq_sdma(struct mqd_manager *mm, void *mqd,
 void mqd_symmetrically_map_cu_mask(struct mqd_manager *mm,
 		const uint32_t *cu_mask, uint32_t cu_mask_count,
 		uint32_t *se_mask);
+void mqd_get_queue_se_mask(struct mqd_manager *mm,
+		struct queue_properties *q, uint32_t *se_mask);
 
 #endif /* KFD_MQD_MANAGER_H_ */
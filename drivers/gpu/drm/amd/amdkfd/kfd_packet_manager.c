@@ -142,6 +142,8 @@ static int pm_create_runlist_ib(struct packet_manager *pm,
 	pr_debug("Building runlist ib process count: %d queues count %d\n",
 		pm->dqm->processes_count, pm->dqm->queue_count);
 
+	kfd_cu_partition_account(pm->dqm->dev);
+
 	/* build the run list ib packet */
 	list_for_each_entry(cur, queues, list) {
 		qpd = cur->qpd;
@@ -159,6 +161,7 @@ static int pm_create_runlist_ib(struct packet_manager *pm,
 		proccesses_mapped++;
 		inc_wptr(&rl_wptr, pm->pmf->map_process_size,
 				alloc_size_bytes);
+		kfd_cu_partition_map_process(pm->dqm->dev, qpd);
 
 		list_for_each_entry(kq, &qpd->priv_queue_list, list) {
 			if (!kq->queue->properties.is_active)
@@ -186,6 +189,8 @@ static int pm_create_runlist_ib(struct packet_manager *pm,
 			pr_debug("static_queue, mapping user queue %d, is debug status %d\n",
 				q->queue, qpd->is_debug);
 
+			kfd_cu_partition_map_queue(pm->dqm, qpd, q);
+
 			retval = pm->pmf->map_queues(pm,
 						&rl_buffer[rl_wptr],
 						q,
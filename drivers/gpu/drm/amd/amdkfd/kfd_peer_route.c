@@ -0,0 +1,338 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include "kfd_crat.h"
+#include "kfd_peer_route.h"
+
+#define KFD_ROUTE_INF	UINT_MAX
+
+/* Hop-bounded shortest paths from one node. dist[h][v] is the cheapest
+ * way to reach v in exactly h links, best[v] the cheapest over all h.
+ */
+struct kfd_route_search {
+	uint32_t dist[KFD_ROUTE_MAX_HOPS + 1][KFD_ROUTE_MAX_NODES];
+	uint8_t prev[KFD_ROUTE_MAX_HOPS + 1][KFD_ROUTE_MAX_NODES];
+	uint32_t best[KFD_ROUTE_MAX_NODES];
+	uint8_t best_hops[KFD_ROUTE_MAX_NODES];
+};
+
+void kfd_route_graph_init(struct kfd_route_graph *g)
+{
+	memset(g, 0, sizeof(*g));
+}
+
+int kfd_route_graph_add_node(struct kfd_route_graph *g, uint32_t node,
+			     bool gpu)
+{
+	if (node >= KFD_ROUTE_MAX_NODES)
+		return -E2BIG;
+
+	g->num_nodes = max(g->num_nodes, node + 1);
+	if (gpu)
+		set_bit(node, g->gpu);
+	return 0;
+}
+
+/* Adding the same kind of link twice counts as parallel links */
+int kfd_route_graph_add_link(struct kfd_route_graph *g, uint32_t from,
+			     uint32_t to, uint8_t type, uint32_t weight)
+{
+	struct kfd_route_link *link;
+
+	if (from >= KFD_ROUTE_MAX_NODES || to >= KFD_ROUTE_MAX_NODES ||
+	    from == to)
+		return -EINVAL;
+
+	g->num_nodes = max3(g->num_nodes, from + 1, to + 1);
+	link = &g->link[from][to];
+	weight = clamp_t(uint32_t, weight, 1, U16_MAX);
+
+	if (link->weight && link->type == type) {
+		if (link->count < U8_MAX)
+			link->count++;
+		link->weight = min_t(uint32_t, link->weight, weight);
+		return 0;
+	}
+
+	/* Keep the cheaper of two different kinds of link */
+	if (link->weight && link->weight <= weight)
+		return 0;
+
+	link->type = type;
+	link->count = 1;
+	link->weight = weight;
+	return 0;
+}
+
+/* kfd_route_graph_from_crat - add the nodes and iolinks of a CRAT image
+ *	@proximity_domain: proximity domain of the first node in the image
+ */
+int kfd_route_graph_from_crat(struct kfd_route_graph *g, void *crat_image,
+			      uint32_t proximity_domain)
+{
+	struct crat_header *crat_table = crat_image;
+	struct crat_subtype_generic *sub_type_hdr;
+	struct crat_subtype_computeunit *cu;
+	struct crat_subtype_iolink *iolink;
+	char *end = (char *)crat_image + crat_table->length;
+	uint32_t i, weight;
+	int ret;
+
+	for (i = 0; i < crat_table->num_domains; i++) {
+		ret = kfd_route_graph_add_node(g, proximity_domain + i, false);
+		if (ret)
+			return ret;
+	}
+
+	sub_type_hdr = (struct crat_subtype_generic *)(crat_table + 1);
+	while ((char *)sub_type_hdr + sizeof(*sub_type_hdr) < end) {
+		if (!sub_type_hdr->length)
+			return -EINVAL;
+		if (!(sub_type_hdr->flags & CRAT_SUBTYPE_FLAGS_ENABLED))
+			goto next;
+
+		switch (sub_type_hdr->type) {
+		case CRAT_SUBTYPE_COMPUTEUNIT_AFFINITY:
+			cu = (struct crat_subtype_computeunit *)sub_type_hdr;
+			ret = kfd_route_graph_add_node(g, cu->proximity_domain,
+					cu->flags & CRAT_CU_FLAGS_GPU_PRESENT);
+			break;
+		case CRAT_SUBTYPE_IOLINK_AFFINITY:
+			iolink = (struct crat_subtype_iolink *)sub_type_hdr;
+			weight = kfd_crat_iolink_weight(iolink);
+			ret = kfd_route_graph_add_link(g,
+					iolink->proximity_domain_from,
+					iolink->proximity_domain_to,
+					iolink->io_interface_type, weight);
+			if (!ret && (iolink->flags &
+				     CRAT_IOLINK_FLAGS_BI_DIRECTIONAL))
+				ret = kfd_route_graph_add_link(g,
+						iolink->proximity_domain_to,
+						iolink->proximity_domain_from,
+						iolink->io_interface_type,
+						weight);
+			break;
+		default:
+			ret = 0;
+		}
+		if (ret)
+			return ret;
+next:
+		sub_type_hdr = (typeof(sub_type_hdr))((char *)sub_type_hdr +
+				sub_type_hdr->length);
+	}
+
+	return 0;
+}
+
+/* Parallel links share the traffic, so they make a hop cheaper */
+static uint32_t kfd_route_link_cost(const struct kfd_route_link *link)
+{
+	return DIV_ROUND_UP(link->weight, link->count);
+}
+
+static bool kfd_route_link_is_xgmi(const struct kfd_route_link *link)
+{
+	return link->type == CRAT_IOLINK_TYPE_XGMI;
+}
+
+/* kfd_route_search_from - cheapest paths from @from over either XGMI links
+ * only, or over any other links with CPU nodes as the only intermediates.
+ * Traffic can't be forwarded through a GPU except by the XGMI fabric.
+ */
+static void kfd_route_search_from(const struct kfd_route_graph *g,
+				  struct kfd_route_search *s, uint32_t from,
+				  bool xgmi)
+{
+	const struct kfd_route_link *link;
+	uint32_t h, u, v, w;
+
+	memset(s->dist, 0xff, sizeof(s->dist));
+	memset(s->best, 0xff, sizeof(s->best));
+	memset(s->best_hops, 0, sizeof(s->best_hops));
+	s->dist[0][from] = 0;
+
+	for (h = 1; h <= KFD_ROUTE_MAX_HOPS; h++) {
+		for (u = 0; u < g->num_nodes; u++) {
+			if (s->dist[h - 1][u] == KFD_ROUTE_INF)
+				continue;
+			if (!xgmi && u != from && test_bit(u, g->gpu))
+				continue;
+
+			for (v = 0; v < g->num_nodes; v++) {
+				link = &g->link[u][v];
+				if (!link->weight || v == from ||
+				    kfd_route_link_is_xgmi(link) != xgmi)
+					continue;
+
+				w = s->dist[h - 1][u];
+				w += kfd_route_link_cost(link);
+				if (w < s->dist[h][v]) {
+					s->dist[h][v] = w;
+					s->prev[h][v] = u;
+				}
+			}
+		}
+
+		for (v = 0; v < g->num_nodes; v++) {
+			if (s->dist[h][v] < s->best[v]) {
+				s->best[v] = s->dist[h][v];
+				s->best_hops[v] = h;
+			}
+		}
+	}
+}
+
+/* Fill the path and link count of @route from a finished search. If
+ * @reverse, the search ran from the destination and the path is flipped.
+ */
+static void kfd_route_fill_path(const struct kfd_route_graph *g,
+				const struct kfd_route_search *s,
+				uint32_t to, bool reverse,
+				struct kfd_peer_route *route)
+{
+	uint32_t h, v = to, u, hops = s->best_hops[to];
+	uint32_t num_links = U8_MAX;
+
+	route->hops = hops;
+	for (h = hops; h > 0; h--) {
+		u = s->prev[h][v];
+		num_links = min_t(uint32_t, num_links, g->link[u][v].count);
+		route->path[reverse ? hops - h : h] = v;
+		v = u;
+	}
+	route->path[reverse ? hops : 0] = v;
+	route->num_links = num_links;
+}
+
+/* kfd_route_find - pick the cheapest way to copy from GPU @from to GPU @to
+ *
+ * XGMI paths are used as is. A PCIe path from @from to @to means @from's
+ * copy engine can write into @to's BAR, a path the other way round that
+ * @to's engine can read from @from's BAR. Staging through system memory
+ * always works but the two copies are serialised through the bounce
+ * buffer, so both legs count twice. Ties go to XGMI, then PCIe.
+ */
+int kfd_route_find(const struct kfd_route_graph *g, uint32_t from,
+		   uint32_t to, struct kfd_peer_route *route)
+{
+	uint32_t cpu_from[KFD_ROUTE_MAX_NODES];
+	struct kfd_route_search *s;
+	uint32_t push, pull, c, w;
+
+	memset(route, 0, sizeof(*route));
+	if (from >= g->num_nodes || to >= g->num_nodes ||
+	    !test_bit(from, g->gpu) || !test_bit(to, g->gpu))
+		return -EINVAL;
+
+	if (from == to) {
+		route->type = KFD_ROUTE_LOCAL;
+		route->engines = KFD_ROUTE_ENGINE_SRC | KFD_ROUTE_ENGINE_DST;
+		route->path[0] = from;
+		return 0;
+	}
+
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+	route->weight = KFD_ROUTE_INF;
+
+	kfd_route_search_from(g, s, from, true);
+	if (s->best[to] != KFD_ROUTE_INF) {
+		kfd_route_fill_path(g, s, to, false, route);
+		route->type = route->hops == 1 ? KFD_ROUTE_XGMI :
+			KFD_ROUTE_XGMI_MULTIHOP;
+		route->weight = s->best[to];
+		route->engines = KFD_ROUTE_ENGINE_SRC | KFD_ROUTE_ENGINE_DST;
+	}
+
+	kfd_route_search_from(g, s, from, false);
+	push = s->best[to];
+	memcpy(cpu_from, s->best, sizeof(cpu_from));
+	if (push < route->weight) {
+		kfd_route_fill_path(g, s, to, false, route);
+		route->type = KFD_ROUTE_PCIE_P2P;
+		route->weight = push;
+	}
+
+	kfd_route_search_from(g, s, to, false);
+	pull = s->best[from];
+	if (pull < route->weight) {
+		kfd_route_fill_path(g, s, from, true, route);
+		route->type = KFD_ROUTE_PCIE_P2P;
+		route->weight = pull;
+	}
+	if (route->type == KFD_ROUTE_PCIE_P2P)
+		route->engines = (push != KFD_ROUTE_INF ?
+				  KFD_ROUTE_ENGINE_SRC : 0) |
+				 (pull != KFD_ROUTE_INF ?
+				  KFD_ROUTE_ENGINE_DST : 0);
+
+	for (c = 0; c < g->num_nodes; c++) {
+		if (test_bit(c, g->gpu) || cpu_from[c] == KFD_ROUTE_INF ||
+		    s->best[c] == KFD_ROUTE_INF)
+			continue;
+
+		w = 2 * (cpu_from[c] + s->best[c]);
+		if (w < route->weight) {
+			route->type = KFD_ROUTE_SYSMEM;
+			route->weight = w;
+			route->hops = 2;
+			route->num_links = 1;
+			route->path[0] = from;
+			route->path[1] = c;
+			route->path[2] = to;
+			route->engines = KFD_ROUTE_ENGINE_SRC |
+				KFD_ROUTE_ENGINE_DST;
+		}
+	}
+
+	kfree(s);
+
+	if (route->type == KFD_ROUTE_NONE) {
+		route->weight = 0;
+		return -ENOENT;
+	}
+	return 0;
+}
+
+const char *kfd_route_type_name(enum kfd_route_type type)
+{
+	switch (type) {
+	case KFD_ROUTE_LOCAL:
+		return "local";
+	case KFD_ROUTE_XGMI:
+		return "xgmi";
+	case KFD_ROUTE_XGMI_MULTIHOP:
+		return "xgmi-multihop";
+	case KFD_ROUTE_PCIE_P2P:
+		return "pcie-p2p";
+	case KFD_ROUTE_SYSMEM:
+		return "sysmem";
+	default:
+		return "none";
+	}
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef KFD_PEER_ROUTE_H_
+#define KFD_PEER_ROUTE_H_
+
+#include <linux/types.h>
+#include <linux/bitmap.h>
+
+/* Peer route selection
+ *
+ * Picks the path for a copy between the VRAM of two GPUs from the iolinks
+ * of the topology. Nodes are proximity domains, links carry the CRAT
+ * weight (lower is better). The graph can be built from the live topology
+ * or from a CRAT image, so selection can be tested on made-up systems.
+ */
+#define KFD_ROUTE_MAX_NODES	32
+#define KFD_ROUTE_MAX_HOPS	4
+
+enum kfd_route_type {
+	KFD_ROUTE_NONE = 0,
+	/* Both ends on the same GPU */
+	KFD_ROUTE_LOCAL,
+	/* Single XGMI link */
+	KFD_ROUTE_XGMI,
+	/* XGMI through other GPUs of the hive; the data fabric forwards
+	 * the traffic, so it is still a single copy
+	 */
+	KFD_ROUTE_XGMI_MULTIHOP,
+	/* One GPU's copy engine accesses the other's VRAM through its BAR */
+	KFD_ROUTE_PCIE_P2P,
+	/* Bounce through system memory, one copy on each GPU */
+	KFD_ROUTE_SYSMEM,
+};
+
+/* Copy engines that can drive the copy */
+#define KFD_ROUTE_ENGINE_SRC	(1 << 0)
+#define KFD_ROUTE_ENGINE_DST	(1 << 1)
+
+struct kfd_peer_route {
+	enum kfd_route_type type;
+	uint32_t weight;
+	uint32_t hops;
+	/* Parallel links on the narrowest hop */
+	uint32_t num_links;
+	uint32_t engines;
+	uint32_t path[KFD_ROUTE_MAX_HOPS + 1];
+};
+
+struct kfd_route_link {
+	uint8_t type;
+	/* Number of parallel links of this type */
+	uint8_t count;
+	/* 0 if there is no link */
+	uint16_t weight;
+};
+
+struct kfd_route_graph {
+	uint32_t num_nodes;
+	DECLARE_BITMAP(gpu, KFD_ROUTE_MAX_NODES);
+	struct kfd_route_link link[KFD_ROUTE_MAX_NODES][KFD_ROUTE_MAX_NODES];
+};
+
+void kfd_route_graph_init(struct kfd_route_graph *g);
+int kfd_route_graph_add_node(struct kfd_route_graph *g, uint32_t node,
+			     bool gpu);
+int kfd_route_graph_add_link(struct kfd_route_graph *g, uint32_t from,
+			     uint32_t to, uint8_t type, uint32_t weight);
+int kfd_route_graph_from_crat(struct kfd_route_graph *g, void *crat_image,
+			      uint32_t proximity_domain);
+int kfd_route_find(const struct kfd_route_graph *g, uint32_t from,
+		   uint32_t to, struct kfd_peer_route *route);
+const char *kfd_route_type_name(enum kfd_route_type type);
+
+#endif
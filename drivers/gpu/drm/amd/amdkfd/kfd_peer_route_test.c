@@ -0,0 +1,315 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Tests for peer route selection on synthetic CRAT images. Node 0 is a
+ * CPU, the other nodes are GPUs linked to it over PCIe the way a virtual
+ * CRAT describes them. Read the peer_route_test file in the kfd debugfs
+ * directory to run them.
+ */
+
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include "kfd_priv.h"
+#include "kfd_crat.h"
+#include "kfd_peer_route.h"
+
+#define TEST_CRAT_SIZE	4096
+#define CPU		0
+
+struct route_test_ctx {
+	uint8_t crat[TEST_CRAT_SIZE];
+	struct kfd_route_graph graph;
+	struct kfd_peer_route route;
+};
+
+static void *route_test_next(struct route_test_ctx *ctx, uint8_t length)
+{
+	struct crat_header *crat_table = (struct crat_header *)ctx->crat;
+	struct crat_subtype_generic *sub_type_hdr;
+
+	if (WARN_ON(crat_table->length + length > TEST_CRAT_SIZE))
+		return NULL;
+
+	sub_type_hdr = (void *)(ctx->crat + crat_table->length);
+	sub_type_hdr->length = length;
+	sub_type_hdr->flags = CRAT_SUBTYPE_FLAGS_ENABLED;
+	crat_table->length += length;
+	crat_table->total_entries++;
+	return sub_type_hdr;
+}
+
+static void route_test_add_cu(struct route_test_ctx *ctx, uint32_t node,
+			      bool gpu)
+{
+	struct crat_subtype_computeunit *cu;
+
+	cu = route_test_next(ctx, sizeof(*cu));
+	if (!cu)
+		return;
+	cu->type = CRAT_SUBTYPE_COMPUTEUNIT_AFFINITY;
+	cu->flags |= gpu ? CRAT_CU_FLAGS_GPU_PRESENT : CRAT_CU_FLAGS_CPU_PRESENT;
+	cu->proximity_domain = node;
+}
+
+static void route_test_add_iolink(struct route_test_ctx *ctx, uint32_t from,
+				  uint32_t to, uint8_t type,
+				  uint8_t weight_xgmi)
+{
+	struct crat_subtype_iolink *iolink;
+
+	iolink = route_test_next(ctx, sizeof(*iolink));
+	if (!iolink)
+		return;
+	iolink->type = CRAT_SUBTYPE_IOLINK_AFFINITY;
+	iolink->flags |= CRAT_IOLINK_FLAGS_BI_DIRECTIONAL;
+	iolink->io_interface_type = type;
+	iolink->proximity_domain_from = from;
+	iolink->proximity_domain_to = to;
+	iolink->weight_xgmi = weight_xgmi;
+}
+
+/* GPU to CPU link; like a virtual CRAT, only large BAR GPUs can be
+ * reached from the CPU side
+ */
+static void route_test_add_gpu(struct route_test_ctx *ctx, uint32_t node,
+			       bool large_bar)
+{
+	struct crat_subtype_iolink *iolink;
+
+	route_test_add_cu(ctx, node, true);
+	route_test_add_iolink(ctx, node, CPU, CRAT_IOLINK_TYPE_PCIEXPRESS, 0);
+
+	iolink = (void *)(ctx->crat +
+			  ((struct crat_header *)ctx->crat)->length -
+			  sizeof(*iolink));
+	if (!large_bar)
+		iolink->flags &= ~CRAT_IOLINK_FLAGS_BI_DIRECTIONAL;
+}
+
+static void route_test_init(struct route_test_ctx *ctx, uint16_t num_nodes)
+{
+	struct crat_header *crat_table = (struct crat_header *)ctx->crat;
+
+	memset(ctx, 0, sizeof(*ctx));
+	memcpy(&crat_table->signature, CRAT_SIGNATURE,
+	       sizeof(crat_table->signature));
+	crat_table->length = sizeof(*crat_table);
+	crat_table->num_domains = num_nodes;
+	route_test_add_cu(ctx, CPU, false);
+}
+
+static int route_test_find(struct route_test_ctx *ctx, uint32_t from,
+			   uint32_t to)
+{
+	int ret;
+
+	kfd_route_graph_init(&ctx->graph);
+	ret = kfd_route_graph_from_crat(&ctx->graph, ctx->crat, 0);
+	if (ret)
+		return ret;
+
+	return kfd_route_find(&ctx->graph, from, to, &ctx->route);
+}
+
+static bool route_test_local(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 2);
+	route_test_add_gpu(ctx, 1, false);
+
+	return !route_test_find(ctx, 1, 1) &&
+		ctx->route.type == KFD_ROUTE_LOCAL && !ctx->route.hops;
+}
+
+static bool route_test_xgmi(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 3);
+	route_test_add_gpu(ctx, 1, false);
+	route_test_add_gpu(ctx, 2, false);
+	route_test_add_iolink(ctx, 1, 2, CRAT_IOLINK_TYPE_XGMI, 0);
+
+	return !route_test_find(ctx, 2, 1) &&
+		ctx->route.type == KFD_ROUTE_XGMI &&
+		ctx->route.weight == KFD_CRAT_XGMI_WEIGHT &&
+		ctx->route.hops == 1 &&
+		ctx->route.path[0] == 2 && ctx->route.path[1] == 1 &&
+		ctx->route.engines == (KFD_ROUTE_ENGINE_SRC |
+				       KFD_ROUTE_ENGINE_DST);
+}
+
+static bool route_test_xgmi_multihop(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 5);
+	route_test_add_gpu(ctx, 1, false);
+	route_test_add_gpu(ctx, 2, false);
+	route_test_add_gpu(ctx, 3, false);
+	route_test_add_gpu(ctx, 4, false);
+	route_test_add_iolink(ctx, 1, 2, CRAT_IOLINK_TYPE_XGMI, 0);
+	route_test_add_iolink(ctx, 2, 3, CRAT_IOLINK_TYPE_XGMI, 0);
+	route_test_add_iolink(ctx, 3, 4, CRAT_IOLINK_TYPE_XGMI, 0);
+	route_test_add_iolink(ctx, 4, 1, CRAT_IOLINK_TYPE_XGMI, 0);
+
+	return !route_test_find(ctx, 1, 3) &&
+		ctx->route.type == KFD_ROUTE_XGMI_MULTIHOP &&
+		ctx->route.hops == 2 &&
+		ctx->route.weight == 2 * KFD_CRAT_XGMI_WEIGHT &&
+		ctx->route.path[0] == 1 && ctx->route.path[2] == 3;
+}
+
+static bool route_test_parallel_links(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 3);
+	route_test_add_gpu(ctx, 1, false);
+	route_test_add_gpu(ctx, 2, false);
+	route_test_add_iolink(ctx, 1, 2, CRAT_IOLINK_TYPE_XGMI, 0);
+	route_test_add_iolink(ctx, 1, 2, CRAT_IOLINK_TYPE_XGMI, 0);
+
+	return !route_test_find(ctx, 1, 2) &&
+		ctx->route.type == KFD_ROUTE_XGMI &&
+		ctx->route.num_links == 2 &&
+		ctx->route.weight == DIV_ROUND_UP(KFD_CRAT_XGMI_WEIGHT, 2);
+}
+
+static bool route_test_p2p(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 3);
+	route_test_add_gpu(ctx, 1, true);
+	route_test_add_gpu(ctx, 2, true);
+
+	return !route_test_find(ctx, 1, 2) &&
+		ctx->route.type == KFD_ROUTE_PCIE_P2P &&
+		ctx->route.weight == 2 * KFD_CRAT_PCIE_WEIGHT &&
+		ctx->route.path[0] == 1 && ctx->route.path[1] == CPU &&
+		ctx->route.path[2] == 2 &&
+		ctx->route.engines == (KFD_ROUTE_ENGINE_SRC |
+				       KFD_ROUTE_ENGINE_DST);
+}
+
+/* Only the large BAR GPU can be accessed by its peer's copy engine */
+static bool route_test_p2p_one_bar(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 3);
+	route_test_add_gpu(ctx, 1, false);
+	route_test_add_gpu(ctx, 2, true);
+
+	if (route_test_find(ctx, 1, 2) ||
+	    ctx->route.type != KFD_ROUTE_PCIE_P2P ||
+	    ctx->route.engines != KFD_ROUTE_ENGINE_SRC)
+		return false;
+
+	return !route_test_find(ctx, 2, 1) &&
+		ctx->route.type == KFD_ROUTE_PCIE_P2P &&
+		ctx->route.engines == KFD_ROUTE_ENGINE_DST &&
+		ctx->route.path[0] == 2 && ctx->route.path[2] == 1;
+}
+
+static bool route_test_sysmem(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 3);
+	route_test_add_gpu(ctx, 1, false);
+	route_test_add_gpu(ctx, 2, false);
+
+	return !route_test_find(ctx, 1, 2) &&
+		ctx->route.type == KFD_ROUTE_SYSMEM &&
+		ctx->route.weight == 4 * KFD_CRAT_PCIE_WEIGHT &&
+		ctx->route.path[1] == CPU;
+}
+
+/* A slow multi-hop XGMI link loses against PCIe peer to peer */
+static bool route_test_weights(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 3);
+	route_test_add_gpu(ctx, 1, true);
+	route_test_add_gpu(ctx, 2, true);
+	route_test_add_iolink(ctx, 1, 2, CRAT_IOLINK_TYPE_XGMI,
+			      4 * KFD_CRAT_XGMI_WEIGHT);
+
+	return !route_test_find(ctx, 1, 2) &&
+		ctx->route.type == KFD_ROUTE_PCIE_P2P;
+}
+
+/* PCIe traffic is not forwarded through another GPU */
+static bool route_test_no_gpu_forwarding(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 4);
+	route_test_add_cu(ctx, 1, true);
+	route_test_add_cu(ctx, 2, true);
+	route_test_add_cu(ctx, 3, true);
+	route_test_add_iolink(ctx, 1, 2, CRAT_IOLINK_TYPE_PCIEXPRESS, 0);
+	route_test_add_iolink(ctx, 2, 3, CRAT_IOLINK_TYPE_PCIEXPRESS, 0);
+
+	return !route_test_find(ctx, 1, 2) &&
+		ctx->route.type == KFD_ROUTE_PCIE_P2P &&
+		route_test_find(ctx, 1, 3) == -ENOENT;
+}
+
+static bool route_test_cpu_endpoint(void *data)
+{
+	struct route_test_ctx *ctx = data;
+
+	route_test_init(ctx, 2);
+	route_test_add_gpu(ctx, 1, true);
+
+	return route_test_find(ctx, CPU, 1) == -EINVAL;
+}
+
+static const struct kfd_test peer_route_tests[] = {
+	{ "local", route_test_local },
+	{ "xgmi", route_test_xgmi },
+	{ "xgmi_multihop", route_test_xgmi_multihop },
+	{ "parallel_links", route_test_parallel_links },
+	{ "p2p", route_test_p2p },
+	{ "p2p_one_bar", route_test_p2p_one_bar },
+	{ "sysmem", route_test_sysmem },
+	{ "weights", route_test_weights },
+	{ "no_gpu_forwarding", route_test_no_gpu_forwarding },
+	{ "cpu_endpoint", route_test_cpu_endpoint },
+};
+
+/* Every test builds its own CRAT, so no per-test setup is needed */
+static const struct kfd_test_suite peer_route_test_suite = {
+	.tests = peer_route_tests,
+	.num_tests = ARRAY_SIZE(peer_route_tests),
+	.ctx_size = sizeof(struct route_test_ctx),
+};
+
+int kfd_debugfs_peer_route_test(struct seq_file *m, void *data)
+{
+	return kfd_debugfs_run_tests(m, &peer_route_test_suite);
+}
@@ -384,6 +384,29 @@ static void amd_put_pages(struct sg_table *sg_head, void *client_context)
 	} else
 		pr_err("Pointer to p2p info is null\n");
 }
+/* Largest page size reported to the RDMA core for a registration */
+#define AMD_PEER_MAX_PAGE_SIZE	(1UL << 30)
+
+/* Find the largest power-of-two page size that the DMA segments of a
+ * registration are built from. Segment starts, segment ends and the
+ * user VA must all be aligned to it, so that the NIC can describe the
+ * whole range with page-sized translations.
+ */
+static unsigned long amd_sg_page_size(struct sg_table *sg, uint64_t va)
+{
+	struct scatterlist *s;
+	uint64_t mask = va | AMD_PEER_MAX_PAGE_SIZE;
+	unsigned int i;
+
+	for_each_sg(sg->sgl, s, sg->nents, i) {
+		mask |= sg_dma_address(s);
+		if (!sg_is_last(s))
+			mask |= sg_dma_len(s);
+	}
+
+	return max_t(unsigned long, 1UL << __ffs64(mask), PAGE_SIZE);
+}
+
 static unsigned long amd_get_page_size(void *client_context)
 {
 	unsigned long page_size;
@@ -397,6 +420,13 @@ static unsigned long amd_get_page_size(void *client_context)
 			mem_context->va,
 			mem_context->size);
 
+	/* Once the pages are pinned, report their real contiguity. This is
+	 * what the RDMA core uses to size its translation tables.
+	 */
+	if (mem_context->p2p_info && !mem_context->free_callback_called)
+		return amd_sg_page_size(mem_context->p2p_info->pages,
+					mem_context->va);
+
 
 	result = rdma_interface->get_page_size(
 				mem_context->va,
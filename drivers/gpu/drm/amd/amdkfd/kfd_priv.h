@@ -46,6 +46,7 @@
 #include <kgd_kfd_interface.h>
 
 #include "amd_shared.h"
+#include "kfd_svm.h"
 
 #define KFD_MAX_RING_ENTRY_SIZE	8
 
@@ -213,6 +214,31 @@ struct kfd_vmid_info {
 	uint32_t vmid_num_kfd;
 };
 
+/* CU partitions
+ *
+ * An administrator can split the CUs of a GPU into disjoint partitions and
+ * assign processes to them through sysfs. The masks are applied to the
+ * MQDs when the queues are mapped through the runlist. Processes that are
+ * not assigned to a partition get the CUs no partition claims.
+ */
+#define KFD_MAX_CU_PARTITIONS		8
+#define KFD_CU_PARTITION_MAX_CUS	128
+#define KFD_CU_PARTITION_MASK_DWORDS	(KFD_CU_PARTITION_MAX_CUS / 32)
+
+struct kfd_cu_partition {
+	/* In the CU numbering of kfd_ioctl_set_cu_mask, empty if the
+	 * partition is not defined
+	 */
+	DECLARE_BITMAP(cus, KFD_CU_PARTITION_MAX_CUS);
+	uint32_t cu_mask[KFD_CU_PARTITION_MASK_DWORDS];
+	/* Occupancy of the current runlist */
+	unsigned int processes;
+	unsigned int queues;
+	/* Queue mappings and time with queues in the runlist, accumulated */
+	uint64_t queue_maps;
+	uint64_t active_ns;
+};
+
 struct kfd_dev {
 	struct kgd_dev *kgd;
 
@@ -281,6 +307,9 @@ struct kfd_dev {
 	bool cwsr_enabled;
 	const void *cwsr_isa;
 	unsigned int cwsr_isa_size;
+	/* Trap handler BO shared by all dGPU processes, created on first use */
+	struct mutex cwsr_isa_lock;
+	struct dma_buf *cwsr_isa_dmabuf;
 
 	/* xGMI */
 	uint64_t hive_id;
@@ -288,6 +317,14 @@ struct kfd_dev {
 
 	/* Compute Profile ref. count */
 	atomic_t compute_profile;
+
+	/* CU partitions, protected by the DQM lock */
+	struct kfd_cu_partition cu_partitions[KFD_MAX_CU_PARTITIONS];
+	/* Partition of processes not assigned to one */
+	struct kfd_cu_partition cu_shared;
+	/* Bumped on every change, queues pick it up when mapped */
+	uint32_t cu_partition_gen;
+	uint64_t cu_partition_timestamp;
 };
 
 struct kfd_ipc_obj;
@@ -301,6 +338,13 @@ struct kfd_bo {
 	/* page-aligned VA address */
 	uint64_t cpuva;
 	unsigned int mem_type;
+	/* IDR handle within the process device */
+	int handle;
+	/* Number of IPC imports of the same handle at the same VA sharing
+	 * this BO, protected by the process mutex
+	 */
+	unsigned int import_count;
+	uint64_t mmap_offset;
 };
 
 struct cma_system_bo {
@@ -473,6 +517,8 @@ struct queue_properties {
 	/* Relevant for CU */
 	uint32_t cu_mask_count; /* Must be a multiple of 32 */
 	uint32_t *cu_mask;
+	/* Mask of the process's CU partition, NULL if it may use all CUs */
+	const uint32_t *cu_partition_mask;
 };
 
 /**
@@ -519,6 +565,9 @@ struct queue {
 	unsigned int sdma_id;
 	unsigned int doorbell_id;
 
+	/* kfd_dev.cu_partition_gen when the CU mask was last applied */
+	uint32_t cu_partition_gen;
+
 	struct kfd_process	*process;
 	struct kfd_dev		*device;
 };
@@ -598,8 +647,9 @@ struct qcm_process_device {
 	uint32_t num_oac;
 	uint32_t sh_hidden_private_base;
 
-	/* CWSR memory */
+	/* CWSR memory, set up when the first queue is created */
 	void *cwsr_kaddr;
+	void *tma_kaddr;
 	uint64_t cwsr_base;
 	uint64_t tba_addr;
 	uint64_t tma_addr;
@@ -621,6 +671,11 @@ struct qcm_process_device {
 	 *  1 means doorbells are mapped
 	 */
 	int doorbell_mapped;
+
+	/* CU partition the process is assigned to, -1 if none. Protected
+	 * by the DQM lock
+	 */
+	int cu_partition;
 };
 
 /* KFD Memory Eviction */
@@ -710,6 +765,20 @@ struct kfd_process_device {
 
 #define qpd_to_pdd(x) container_of(x, struct kfd_process_device, qpd)
 
+/* Restore latency histogram buckets. Bucket 0 counts restores that
+ * completed in under 1ms, bucket n those in [2^(n-1), 2^n) ms and the
+ * last bucket everything slower.
+ */
+#define KFD_RESTORE_LATENCY_BUCKETS 12
+
+/* Always-on per-process performance counters, exported through sysfs */
+struct kfd_process_counters {
+	atomic64_t evictions;
+	atomic64_t restores;
+	atomic64_t queue_preemptions;
+	atomic64_t restore_latency[KFD_RESTORE_LATENCY_BUCKETS];
+};
+
 /* Process data */
 struct kfd_process {
 	/*
@@ -746,6 +815,7 @@ struct kfd_process {
 	struct rcu_head	rcu;
 
 	unsigned int pasid;
+	/* Doorbell slice, 0 until the first queue is created */
 	unsigned int doorbell_index;
 
 	/*
@@ -793,6 +863,18 @@ struct kfd_process {
 	 */
 	unsigned long last_restore_timestamp;
 	unsigned long last_evict_timestamp;
+
+	struct kfd_process_counters counters;
+
+	/* sysfs directory /sys/class/kfd/kfd/proc/<pasid> */
+	struct kobject *kobj;
+	struct attribute attr_pid;
+	struct attribute attr_counters;
+
+#ifdef CONFIG_HSA_AMD_SVM
+	/* Shared virtual memory ranges and their HMM mirror */
+	struct svm_range_list svms;
+#endif
 };
 
 #define KFD_PROCESS_TABLE_SIZE 5 /* bits: 32 entries */
@@ -820,6 +902,18 @@ bool kfd_dev_is_large_bar(struct kfd_dev *dev);
 
 int kfd_process_create_wq(void);
 void kfd_process_destroy_wq(void);
+int kfd_procfs_init(void);
+void kfd_procfs_shutdown(void);
+
+/* CU partitions */
+void kfd_cu_partition_sysfs_init(void);
+void kfd_cu_partition_sysfs_fini(void);
+void kfd_cu_partition_account(struct kfd_dev *dev);
+void kfd_cu_partition_map_process(struct kfd_dev *dev,
+				  struct qcm_process_device *qpd);
+void kfd_cu_partition_map_queue(struct device_queue_manager *dqm,
+				struct qcm_process_device *qpd,
+				struct queue *q);
 struct kfd_process *kfd_create_process(struct file *filep);
 struct kfd_process *kfd_get_process(const struct task_struct *);
 struct kfd_process *kfd_lookup_process_by_pasid(unsigned int pasid);
@@ -832,6 +926,8 @@ int kfd_resume_all_processes(void);
 
 int kfd_process_device_init_vm(struct kfd_process_device *pdd,
 			       struct file *drm_file);
+int kfd_process_device_init_cwsr(struct kfd_process_device *pdd,
+				 struct file *filep);
 struct kfd_process_device *kfd_bind_process_to_device(struct kfd_dev *dev,
 						struct kfd_process *p);
 struct kfd_process_device *kfd_get_process_device_data(struct kfd_dev *dev,
@@ -920,7 +1016,12 @@ struct kfd_dev *kfd_device_by_id(uint32_t gpu_id);
 struct kfd_dev *kfd_device_by_pci_dev(const struct pci_dev *pdev);
 struct kfd_dev *kfd_device_by_kgd(const struct kgd_dev *kgd);
 int kfd_topology_enum_kfd_devices(uint8_t idx, struct kfd_dev **kdev);
+int kfd_topology_get_blob(void __user *buf, uint32_t *size,
+			  uint32_t *generation);
 int kfd_numa_node_to_apic_id(int numa_node_id);
+struct kfd_peer_route;
+int kfd_topology_get_peer_route(struct kfd_dev *from, struct kfd_dev *to,
+				struct kfd_peer_route *route);
 
 /* Interrupts */
 int kfd_interrupt_init(struct kfd_dev *dev);
@@ -1131,12 +1232,38 @@ int pqm_debugfs_mqds(struct seq_file *m, void *data);
 int kfd_debugfs_hqds_by_device(struct seq_file *m, void *data);
 int dqm_debugfs_hqds(struct seq_file *m, void *data);
 int kfd_debugfs_rls_by_device(struct seq_file *m, void *data);
+int kfd_debugfs_peer_routes(struct seq_file *m, void *data);
+int kfd_debugfs_peer_route_test(struct seq_file *m, void *data);
+
+/* In-kernel tests run from debugfs, see kfd_debugfs_run_tests */
+struct kfd_test {
+	const char *name;
+	bool (*func)(void *ctx);
+};
+
+struct kfd_test_suite {
+	const struct kfd_test *tests;
+	unsigned int num_tests;
+	/* Size of the context passed to every test */
+	size_t ctx_size;
+	/* Optional, called before and after every test */
+	void (*init)(void *ctx);
+	void (*fini)(void *ctx);
+};
+
+int kfd_debugfs_run_tests(struct seq_file *m,
+			  const struct kfd_test_suite *suite);
 int pm_debugfs_runlist(struct seq_file *m, void *data);
 
 int kfd_debugfs_hang_hws(struct kfd_dev *dev);
 int pm_debugfs_hang_hws(struct packet_manager *pm);
 int dqm_debugfs_execute_queues(struct device_queue_manager *dqm);
 
+#ifdef CONFIG_HSA_AMD_SVM
+int kfd_debugfs_svm_by_process(struct seq_file *m, void *data);
+int kfd_debugfs_svm_policy_test(struct seq_file *m, void *data);
+#endif
+
 #else
 
 static inline void kfd_debugfs_init(void) {}
@@ -117,6 +117,175 @@ void kfd_process_destroy_wq(void)
 	}
 }
 
+/* sysfs directory holding one subdirectory per process, named by PASID */
+static struct kobject *kfd_procfs_kobj;
+
+#define procfs_show_gen_prop(buffer, fmt, ...) \
+		snprintf(buffer, PAGE_SIZE, "%s"fmt, buffer, __VA_ARGS__)
+#define procfs_show_64bit_prop(buffer, name, value) \
+		procfs_show_gen_prop(buffer, "%s %llu\n", name, value)
+
+static ssize_t kfd_procfs_show_counters(struct kfd_process *p, char *buffer)
+{
+	struct amdgpu_amdkfd_process_counters vm_counters = {0};
+	ssize_t ret;
+	int i;
+
+	if (p->kgd_process_info)
+		amdgpu_amdkfd_gpuvm_get_process_counters(p->kgd_process_info,
+							 &vm_counters);
+
+	procfs_show_64bit_prop(buffer, "evictions",
+			(u64)atomic64_read(&p->counters.evictions));
+	procfs_show_64bit_prop(buffer, "restores",
+			(u64)atomic64_read(&p->counters.restores));
+	procfs_show_64bit_prop(buffer, "queue_preemptions",
+			(u64)atomic64_read(&p->counters.queue_preemptions));
+	procfs_show_64bit_prop(buffer, "userptr_invalidations",
+			vm_counters.userptr_invalidations);
+	procfs_show_64bit_prop(buffer, "bytes_migrated",
+			vm_counters.bytes_migrated);
+	ret = procfs_show_64bit_prop(buffer, "pt_updates",
+			vm_counters.pt_updates);
+
+	/* Restore latency histogram, one line per bucket named by its
+	 * upper bound in ms
+	 */
+	for (i = 0; i < KFD_RESTORE_LATENCY_BUCKETS; i++) {
+		u64 count = atomic64_read(&p->counters.restore_latency[i]);
+
+		if (i < KFD_RESTORE_LATENCY_BUCKETS - 1)
+			ret = procfs_show_gen_prop(buffer,
+					"restore_latency_lt_%ums %llu\n",
+					1U << i, count);
+		else
+			ret = procfs_show_gen_prop(buffer,
+					"restore_latency_ge_%ums %llu\n",
+					1U << (i - 1), count);
+	}
+
+	return ret;
+}
+
+static ssize_t kfd_procfs_show(struct kobject *kobj, struct attribute *attr,
+			       char *buffer)
+{
+	struct kfd_process *p;
+
+	/* Making sure that the buffer is an empty string */
+	buffer[0] = 0;
+
+	if (strcmp(attr->name, "pid") == 0) {
+		p = container_of(attr, struct kfd_process, attr_pid);
+		return snprintf(buffer, PAGE_SIZE, "%d\n",
+				task_pid_nr(p->lead_thread));
+	} else if (strcmp(attr->name, "counters") == 0) {
+		p = container_of(attr, struct kfd_process, attr_counters);
+		return kfd_procfs_show_counters(p, buffer);
+	}
+
+	return -EINVAL;
+}
+
+static void kfd_procfs_kobj_release(struct kobject *kobj)
+{
+	kfree(kobj);
+}
+
+static const struct sysfs_ops kfd_procfs_ops = {
+	.show = kfd_procfs_show,
+};
+
+static struct kobj_type kfd_procfs_type = {
+	.release = kfd_procfs_kobj_release,
+	.sysfs_ops = &kfd_procfs_ops,
+};
+
+int kfd_procfs_init(void)
+{
+	int ret;
+
+	kfd_procfs_kobj = kzalloc(sizeof(*kfd_procfs_kobj), GFP_KERNEL);
+	if (!kfd_procfs_kobj)
+		return -ENOMEM;
+
+	ret = kobject_init_and_add(kfd_procfs_kobj, &kfd_procfs_type,
+				   &kfd_device->kobj, "proc");
+	if (ret) {
+		pr_warn("Could not create procfs proc folder\n");
+		kobject_put(kfd_procfs_kobj);
+		kfd_procfs_kobj = NULL;
+	}
+
+	return ret;
+}
+
+void kfd_procfs_shutdown(void)
+{
+	if (kfd_procfs_kobj) {
+		kobject_del(kfd_procfs_kobj);
+		kobject_put(kfd_procfs_kobj);
+		kfd_procfs_kobj = NULL;
+	}
+}
+
+/* Failure to create the sysfs entries only loses the counters, so it
+ * does not fail process creation
+ */
+static void kfd_procfs_add_process(struct kfd_process *p)
+{
+	int ret;
+
+	if (!kfd_procfs_kobj)
+		return;
+
+	p->kobj = kzalloc(sizeof(*p->kobj), GFP_KERNEL);
+	if (!p->kobj)
+		return;
+
+	ret = kobject_init_and_add(p->kobj, &kfd_procfs_type,
+				   kfd_procfs_kobj, "%u", p->pasid);
+	if (ret) {
+		pr_warn("Creating procfs pasid directory failed\n");
+		goto err_put;
+	}
+
+	p->attr_pid.name = "pid";
+	p->attr_pid.mode = KFD_SYSFS_FILE_MODE;
+	sysfs_attr_init(&p->attr_pid);
+	p->attr_counters.name = "counters";
+	p->attr_counters.mode = KFD_SYSFS_FILE_MODE;
+	sysfs_attr_init(&p->attr_counters);
+
+	ret = sysfs_create_file(p->kobj, &p->attr_pid);
+	if (ret)
+		goto err_del;
+	ret = sysfs_create_file(p->kobj, &p->attr_counters);
+	if (ret)
+		goto err_del;
+
+	return;
+
+err_del:
+	pr_warn("Creating procfs files for pasid %u failed\n", p->pasid);
+	kobject_del(p->kobj);
+err_put:
+	kobject_put(p->kobj);
+	p->kobj = NULL;
+}
+
+static void kfd_procfs_del_process(struct kfd_process *p)
+{
+	if (!p->kobj)
+		return;
+
+	sysfs_remove_file(p->kobj, &p->attr_pid);
+	sysfs_remove_file(p->kobj, &p->attr_counters);
+	kobject_del(p->kobj);
+	kobject_put(p->kobj);
+	p->kobj = NULL;
+}
+
 static void kfd_process_free_gpuvm(struct kgd_mem *mem,
 			struct kfd_process_device *pdd)
 {
@@ -129,12 +298,12 @@ static void kfd_process_free_gpuvm(struct kgd_mem *mem,
 /* kfd_process_alloc_gpuvm - Allocate GPU VM for the KFD process
  *	This function should be only called right after the process
  *	is created and when kfd_processes_mutex is still being held
- *	to avoid concurrency. Because of that exclusiveness, we do
- *	not need to take p->mutex.
+ *	to avoid concurrency, or with p->mutex held.
  */
 static int kfd_process_alloc_gpuvm(struct kfd_process_device *pdd,
 				   uint64_t gpu_va, uint32_t size,
-				   uint32_t flags, void **kptr)
+				   uint32_t flags, void **kptr,
+				   struct kgd_mem **pmem)
 {
 	struct kfd_dev *kdev = pdd->dev;
 	struct kgd_mem *mem = NULL;
@@ -164,8 +333,6 @@ static int kfd_process_alloc_gpuvm(struct kfd_process_device *pdd,
 
 	/* Create an obj handle so kfd_process_device_remove_obj_handle
 	 * will take care of the bo removal when the process finishes.
-	 * We do not need to take p->mutex, because the process is just
-	 * created and the ioctls have not had the chance to run.
 	 */
 	handle = kfd_process_device_create_obj_handle(
 			pdd, mem, gpu_va, size, 0, mem_type, NULL);
@@ -184,6 +351,9 @@ static int kfd_process_alloc_gpuvm(struct kfd_process_device *pdd,
 		}
 	}
 
+	if (pmem)
+		*pmem = mem;
+
 	return err;
 
 free_obj_handle:
@@ -221,7 +391,7 @@ static int kfd_process_device_reserve_ib_mem(struct kfd_process_device *pdd)
 
 	/* ib_base is only set for dGPU */
 	ret = kfd_process_alloc_gpuvm(pdd, qpd->ib_base, PAGE_SIZE, flags,
-				      &kaddr);
+				      &kaddr, NULL);
 	if (ret)
 		return ret;
 
@@ -253,8 +423,11 @@ struct kfd_process *kfd_create_process(struct file *filep)
 	process = find_process(thread, false);
 	if (process)
 		pr_debug("Process already found\n");
-	else
+	else {
 		process = create_process(thread, filep);
+		if (!IS_ERR(process))
+			kfd_procfs_add_process(process);
+	}
 
 	mutex_unlock(&kfd_processes_mutex);
 
@@ -414,6 +587,8 @@ static void kfd_process_wq_release(struct work_struct *work)
 	struct kfd_process *p = container_of(work, struct kfd_process,
 					     release_work);
 
+	kfd_procfs_del_process(p);
+
 	kfd_iommu_unbind_process(p);
 
 	kfd_process_free_outstanding_kfd_bos(p);
@@ -470,6 +645,9 @@ static void kfd_process_notifier_release(struct mmu_notifier *mn,
 	cancel_delayed_work_sync(&p->eviction_work);
 	cancel_delayed_work_sync(&p->restore_work);
 
+	/* The HMM mirror must go while the mm is still alive */
+	kfd_svm_fini(p);
+
 	mutex_lock(&p->mutex);
 
 	/* Iterate over all process device data structures and if the
@@ -522,41 +700,128 @@ static const struct mmu_notifier_ops kfd_process_mmu_notifier_ops = {
 	.release = kfd_process_notifier_release,
 };
 
-static int kfd_process_init_cwsr_apu(struct kfd_process *p, struct file *filep)
+static int kfd_process_device_init_cwsr_apu(struct kfd_process_device *pdd,
+					    struct file *filep)
 {
-	unsigned long  offset;
-	struct kfd_process_device *pdd;
+	struct kfd_dev *dev = pdd->dev;
+	struct qcm_process_device *qpd = &pdd->qpd;
+	unsigned long offset;
 
-	list_for_each_entry(pdd, &p->per_device_data, per_device_list) {
-		struct kfd_dev *dev = pdd->dev;
-		struct qcm_process_device *qpd = &pdd->qpd;
+	if (!dev->cwsr_enabled || qpd->cwsr_kaddr || qpd->cwsr_base)
+		return 0;
 
-		if (!dev->cwsr_enabled || qpd->cwsr_kaddr || qpd->cwsr_base)
-			continue;
+	offset = (KFD_MMAP_TYPE_RESERVED_MEM | KFD_MMAP_GPU_ID(dev->id))
+		<< PAGE_SHIFT;
+	qpd->tba_addr = (int64_t)vm_mmap(filep, 0,
+		KFD_CWSR_TBA_TMA_SIZE, PROT_READ | PROT_EXEC,
+		MAP_SHARED, offset);
 
-		offset = (KFD_MMAP_TYPE_RESERVED_MEM | KFD_MMAP_GPU_ID(dev->id))
-			<< PAGE_SHIFT;
-		qpd->tba_addr = (int64_t)vm_mmap(filep, 0,
-			KFD_CWSR_TBA_TMA_SIZE, PROT_READ | PROT_EXEC,
-			MAP_SHARED, offset);
+	if (IS_ERR_VALUE(qpd->tba_addr)) {
+		int err = qpd->tba_addr;
 
-		if (IS_ERR_VALUE(qpd->tba_addr)) {
-			int err = qpd->tba_addr;
+		pr_err("Failure to set tba address. error %d.\n", err);
+		qpd->tba_addr = 0;
+		qpd->cwsr_kaddr = NULL;
+		return err;
+	}
 
-			pr_err("Failure to set tba address. error %d.\n", err);
-			qpd->tba_addr = 0;
-			qpd->cwsr_kaddr = NULL;
-			return err;
-		}
+	memcpy(qpd->cwsr_kaddr, dev->cwsr_isa, dev->cwsr_isa_size);
+
+	qpd->tma_addr = qpd->tba_addr + KFD_CWSR_TMA_OFFSET;
+	qpd->tma_kaddr = qpd->cwsr_kaddr + KFD_CWSR_TMA_OFFSET;
+	pr_debug("set tba :0x%llx, tma:0x%llx, cwsr_kaddr:%p for pqm.\n",
+		qpd->tba_addr, qpd->tma_addr, qpd->cwsr_kaddr);
+
+	return 0;
+}
+
+/* Map the trap handler code at cwsr_base. The code is the same for every
+ * process on a device, so only the first process allocates and fills it.
+ * Everybody else imports that BO read-only through a dma-buf kept by the
+ * device.
+ */
+static int kfd_process_device_map_cwsr_isa(struct kfd_process_device *pdd,
+					   uint32_t flags,
+					   struct kgd_mem **pmem)
+{
+	struct kfd_dev *dev = pdd->dev;
+	uint64_t va = pdd->qpd.cwsr_base;
+	struct kgd_mem *mem;
+	void *kaddr;
+	int handle;
+	int ret;
+
+	mutex_lock(&dev->cwsr_isa_lock);
 
-		memcpy(qpd->cwsr_kaddr, dev->cwsr_isa, dev->cwsr_isa_size);
+	if (!dev->cwsr_isa_dmabuf) {
+		ret = kfd_process_alloc_gpuvm(pdd, va, KFD_CWSR_TMA_OFFSET,
+					      flags, &kaddr, pmem);
+		if (ret)
+			goto out_unlock;
+		mem = *pmem;
 
-		qpd->tma_addr = qpd->tba_addr + KFD_CWSR_TMA_OFFSET;
-		pr_debug("set tba :0x%llx, tma:0x%llx, cwsr_kaddr:%p for pqm.\n",
-			qpd->tba_addr, qpd->tma_addr, qpd->cwsr_kaddr);
+		memcpy(kaddr, dev->cwsr_isa, dev->cwsr_isa_size);
+
+		/* Not fatal, the next process just gets its own copy */
+		if (amdgpu_amdkfd_gpuvm_export_dmabuf(dev->kgd, pdd->vm, mem,
+						      &dev->cwsr_isa_dmabuf))
+			dev->cwsr_isa_dmabuf = NULL;
+		goto out_unlock;
 	}
 
+	ret = amdgpu_amdkfd_gpuvm_import_dmabuf(dev->kgd, dev->cwsr_isa_dmabuf,
+						va, pdd->vm, &mem, NULL, NULL);
+	if (ret)
+		goto out_unlock;
+
+	amdgpu_amdkfd_gpuvm_set_mem_readonly(mem);
+
+	ret = amdgpu_amdkfd_gpuvm_map_memory_to_gpu(dev->kgd, mem, pdd->vm);
+	if (ret)
+		goto err_map_mem;
+
+	ret = amdgpu_amdkfd_gpuvm_sync_memory(dev->kgd, mem, true);
+	if (ret)
+		goto err_free;
+
+	handle = kfd_process_device_create_obj_handle(pdd, mem, va,
+				KFD_CWSR_TMA_OFFSET, 0,
+				KFD_IOC_ALLOC_MEM_FLAGS_GTT, NULL);
+	if (handle < 0) {
+		ret = handle;
+		goto err_free;
+	}
+
+	*pmem = mem;
+	mutex_unlock(&dev->cwsr_isa_lock);
 	return 0;
+
+err_free:
+	kfd_process_free_gpuvm(mem, pdd);
+	goto out_unlock;
+err_map_mem:
+	amdgpu_amdkfd_gpuvm_free_memory_of_gpu(dev->kgd, mem);
+out_unlock:
+	mutex_unlock(&dev->cwsr_isa_lock);
+	return ret;
+}
+
+/* Undo kfd_process_device_map_cwsr_isa. The device's dma-buf keeps the
+ * shared code BO alive for other processes.
+ */
+static void kfd_process_device_unmap_cwsr_isa(struct kfd_process_device *pdd,
+					      struct kgd_mem *mem)
+{
+	struct kfd_bo *buf_obj;
+	int id;
+
+	idr_for_each_entry(&pdd->alloc_idr, buf_obj, id) {
+		if (buf_obj->mem == mem) {
+			kfd_process_device_remove_obj_handle(pdd, id);
+			break;
+		}
+	}
+	kfd_process_free_gpuvm(mem, pdd);
 }
 
 static int kfd_process_device_init_cwsr_dgpu(struct kfd_process_device *pdd)
@@ -565,30 +830,59 @@ static int kfd_process_device_init_cwsr_dgpu(struct kfd_process_device *pdd)
 	struct qcm_process_device *qpd = &pdd->qpd;
 	uint32_t flags = ALLOC_MEM_FLAGS_GTT |
 		ALLOC_MEM_FLAGS_NO_SUBSTITUTE | ALLOC_MEM_FLAGS_EXECUTABLE;
+	struct kgd_mem *isa_mem;
 	void *kaddr;
 	int ret;
 
-	if (!dev->cwsr_enabled || qpd->cwsr_kaddr || !qpd->cwsr_base)
+	if (!dev->cwsr_enabled || qpd->tma_kaddr || !qpd->cwsr_base)
 		return 0;
 
 	/* cwsr_base is only set for dGPU */
-	ret = kfd_process_alloc_gpuvm(pdd, qpd->cwsr_base,
-				      KFD_CWSR_TBA_TMA_SIZE, flags, &kaddr);
+	ret = kfd_process_device_map_cwsr_isa(pdd, flags, &isa_mem);
 	if (ret)
 		return ret;
 
-	qpd->cwsr_kaddr = kaddr;
-	qpd->tba_addr = qpd->cwsr_base;
-
-	memcpy(qpd->cwsr_kaddr, dev->cwsr_isa, dev->cwsr_isa_size);
+	/* The TMA is written by set_trap_handler and stays per process.
+	 * If it can't be allocated, unmap the code again so that the next
+	 * attempt can map it at cwsr_base.
+	 */
+	ret = kfd_process_alloc_gpuvm(pdd, qpd->cwsr_base + KFD_CWSR_TMA_OFFSET,
+				      KFD_CWSR_TBA_TMA_SIZE - KFD_CWSR_TMA_OFFSET,
+				      flags, &kaddr, NULL);
+	if (ret) {
+		kfd_process_device_unmap_cwsr_isa(pdd, isa_mem);
+		return ret;
+	}
 
+	qpd->tma_kaddr = kaddr;
+	qpd->tba_addr = qpd->cwsr_base;
 	qpd->tma_addr = qpd->tba_addr + KFD_CWSR_TMA_OFFSET;
-	pr_debug("set tba :0x%llx, tma:0x%llx, cwsr_kaddr:%p for pqm.\n",
-		 qpd->tba_addr, qpd->tma_addr, qpd->cwsr_kaddr);
+	pr_debug("set tba :0x%llx, tma:0x%llx, tma_kaddr:%p for pqm.\n",
+		 qpd->tba_addr, qpd->tma_addr, qpd->tma_kaddr);
 
 	return 0;
 }
 
+/**
+ * kfd_process_device_init_cwsr - set up the CWSR trap handler on a device
+ * @pdd: process device data
+ * @filep: KFD file, used to map the trap handler on APUs
+ *
+ * Called before the first queue is created on a device rather than when
+ * the process binds to it, so devices without queues do not pay for the
+ * allocation and mapping. Assumes that the process lock is held.
+ *
+ * Returns 0 on success, -errno on failure.
+ */
+int kfd_process_device_init_cwsr(struct kfd_process_device *pdd,
+				 struct file *filep)
+{
+	if (pdd->qpd.cwsr_base)
+		return kfd_process_device_init_cwsr_dgpu(pdd);
+
+	return kfd_process_device_init_cwsr_apu(pdd, filep);
+}
+
 static struct kfd_process *create_process(const struct task_struct *thread,
 					struct file *filep)
 {
@@ -610,12 +904,10 @@ static struct kfd_process *create_process(const struct task_struct *thread,
 	if (process->pasid == 0)
 		goto err_alloc_pasid;
 
-	if (kfd_alloc_process_doorbells(process) < 0)
-		goto err_alloc_doorbells;
-
 	kref_init(&process->ref);
 
 	mutex_init(&process->mutex);
+	kfd_svm_init(process);
 
 	process->mm = thread->mm;
 
@@ -649,10 +941,6 @@ static struct kfd_process *create_process(const struct task_struct *thread,
 	INIT_DELAYED_WORK(&process->restore_work, restore_process_worker);
 	process->last_restore_timestamp = get_jiffies_64();
 
-	err = kfd_process_init_cwsr_apu(process, filep);
-	if (err)
-		goto err_init_cwsr;
-
 	/* If PeerDirect interface was not detected try to detect it again
 	 * in case if network driver was loaded later.
 	 */
@@ -660,9 +948,6 @@ static struct kfd_process *create_process(const struct task_struct *thread,
 
 	return process;
 
-err_init_cwsr:
-	kfd_process_free_outstanding_kfd_bos(process);
-	kfd_process_destroy_pdds(process);
 err_init_apertures:
 	pqm_uninit(&process->pqm);
 err_process_pqm_init:
@@ -671,8 +956,6 @@ static struct kfd_process *create_process(const struct task_struct *thread,
 	mmu_notifier_unregister_no_release(&process->mmu_notifier, process->mm);
 err_mmu_notifier:
 	mutex_destroy(&process->mutex);
-	kfd_free_process_doorbells(process);
-err_alloc_doorbells:
 	kfd_pasid_free(process->pasid);
 err_alloc_pasid:
 	kfree(process);
@@ -736,6 +1019,7 @@ struct kfd_process_device *kfd_create_process_device_data(struct kfd_dev *dev,
 	INIT_LIST_HEAD(&pdd->qpd.queues_list);
 	INIT_LIST_HEAD(&pdd->qpd.priv_queue_list);
 	pdd->qpd.dqm = dev->dqm;
+	pdd->qpd.cu_partition = -1;
 	pdd->qpd.pqm = &p->pqm;
 	pdd->qpd.evicted = 0;
 	mutex_init(&pdd->qpd.doorbell_lock);
@@ -795,15 +1079,11 @@ int kfd_process_device_init_vm(struct kfd_process_device *pdd,
 	ret = kfd_process_device_reserve_ib_mem(pdd);
 	if (ret)
 		goto err_reserve_ib_mem;
-	ret = kfd_process_device_init_cwsr_dgpu(pdd);
-	if (ret)
-		goto err_init_cwsr;
 
 	pdd->drm_file = drm_file;
 
 	return 0;
 
-err_init_cwsr:
 err_reserve_ib_mem:
 	kfd_process_device_free_bos(pdd);
 	if (!drm_file)
@@ -901,6 +1181,8 @@ int kfd_process_device_create_obj_handle(struct kfd_process_device *pdd,
 
 	if (handle < 0)
 		kfree(buf_obj);
+	else
+		buf_obj->handle = handle;
 
 	return handle;
 }
@@ -1151,6 +1433,14 @@ static bool kfd_process_unmap_doorbells_if_idle(struct kfd_process *p)
 	if (!keep_idle_process_evicted)
 		return false;
 
+	/* The queue state is saved in the MQDs, so a busy process can be
+	 * restored without touching its doorbell mappings. Only tear them
+	 * down once the process looks idle.
+	 */
+	list_for_each_entry(pdd, &p->per_device_data, per_device_list)
+		if (check_if_queues_active(pdd->qpd.dqm, &pdd->qpd))
+			return false;
+
 	/* Unmap doorbell first to avoid race conditions. Otherwise while the
 	 * second queue is checked, the first queue may get more work, but we
 	 * won't detect that since it has been checked
@@ -1199,6 +1489,7 @@ static void evict_process_worker(struct work_struct *work)
 	pr_info("Started evicting pasid %d\n", p->pasid);
 	ret = kfd_process_evict_queues(p);
 	if (!ret) {
+		atomic64_inc(&p->counters.evictions);
 		dma_fence_signal(p->ef);
 		dma_fence_put(p->ef);
 		p->ef = NULL;
@@ -1215,6 +1506,16 @@ static void evict_process_worker(struct work_struct *work)
 	trace_kfd_evict_process_worker_end(p, ret ? "Failed" : "Success");
 }
 
+static void kfd_process_count_restore(struct kfd_process *p)
+{
+	unsigned int ms = jiffies_to_msecs(jiffies - p->last_evict_timestamp);
+	unsigned int bucket = min_t(unsigned int, fls(ms),
+				    KFD_RESTORE_LATENCY_BUCKETS - 1);
+
+	atomic64_inc(&p->counters.restores);
+	atomic64_inc(&p->counters.restore_latency[bucket]);
+}
+
 static void restore_process_worker(struct work_struct *work)
 {
 	struct delayed_work *dwork;
@@ -1269,9 +1570,10 @@ static void restore_process_worker(struct work_struct *work)
 
 	ret = kfd_process_restore_queues(p);
 	trace_kfd_restore_process_worker_end(p,	ret ? "Failed" : "Success");
-	if (!ret)
+	if (!ret) {
+		kfd_process_count_restore(p);
 		pr_info("Finished restoring pasid %d\n", p->pasid);
-	else
+	} else
 		pr_err("Failed to restore queues of pasid %d\n", p->pasid);
 }
 
@@ -25,17 +25,84 @@
 #include <linux/pid.h>
 #include <linux/err.h>
 #include <linux/slab.h>
+#include <linux/kref.h>
 #include <drm/amd_rdma.h>
 #include "kfd_priv.h"
 #include "amdgpu_amdkfd.h"
 
+/* Pinned sg_table of a BO range, shared by all registrations of
+ * exactly that range
+ */
+struct rdma_sg {
+	struct kref ref;
+	struct kfd_bo *buf_obj;
+	struct sg_table *sg;
+};
+
 struct rdma_cb {
 	struct list_head node;
 	struct amd_p2p_info amd_p2p_data;
 	void  (*free_callback)(void *client_priv);
 	void  *client_priv;
+	struct rdma_sg *rdma_sg;
 };
 
+static void rdma_sg_release(struct kref *ref)
+{
+	struct rdma_sg *rdma_sg = container_of(ref, struct rdma_sg, ref);
+	struct kfd_bo *buf_obj = rdma_sg->buf_obj;
+
+	amdgpu_amdkfd_gpuvm_unpin_put_sg_table(buf_obj->mem, rdma_sg->sg);
+	kfd_dec_compute_active(buf_obj->dev);
+	kfree(rdma_sg);
+}
+
+/* Look for a live registration of the same range of the BO, so that
+ * repeated registrations, e.g. one per RDMA connection, share a single
+ * pinned sg_table.
+ */
+static struct rdma_sg *rdma_sg_lookup(struct kfd_bo *buf_obj,
+				      uint64_t address, uint64_t length)
+{
+	struct rdma_cb *rdma_cb_data;
+
+	list_for_each_entry(rdma_cb_data, &buf_obj->cb_data_head, node) {
+		if (rdma_cb_data->amd_p2p_data.va == address &&
+		    rdma_cb_data->amd_p2p_data.size == length) {
+			kref_get(&rdma_cb_data->rdma_sg->ref);
+			return rdma_cb_data->rdma_sg;
+		}
+	}
+
+	return NULL;
+}
+
+static struct rdma_sg *rdma_sg_create(struct kfd_bo *buf_obj,
+				      uint64_t address, uint64_t length)
+{
+	struct rdma_sg *rdma_sg;
+	int ret;
+
+	rdma_sg = kzalloc(sizeof(*rdma_sg), GFP_KERNEL);
+	if (!rdma_sg)
+		return ERR_PTR(-ENOMEM);
+
+	ret = amdgpu_amdkfd_gpuvm_pin_get_sg_table(buf_obj->dev->kgd,
+			buf_obj->mem, address - buf_obj->it.start, length,
+			&rdma_sg->sg);
+	if (ret) {
+		pr_err("amdgpu_amdkfd_gpuvm_pin_get_sg_table failed.\n");
+		kfree(rdma_sg);
+		return ERR_PTR(ret);
+	}
+
+	kref_init(&rdma_sg->ref);
+	rdma_sg->buf_obj = buf_obj;
+	kfd_inc_compute_active(buf_obj->dev);
+
+	return rdma_sg;
+}
+
 /**
  * This function makes the pages underlying a range of GPU virtual memory
  * accessible for DMA operations from another PCIe device
@@ -65,13 +132,10 @@ static int get_pages(uint64_t address, uint64_t length, struct pid *pid,
 		void  *client_priv)
 {
 	struct kfd_bo *buf_obj;
-	struct kgd_mem *mem;
-	struct sg_table *sg_table_tmp;
-	struct kfd_dev *dev;
 	uint64_t last = address + length - 1;
-	uint64_t offset;
 	struct kfd_process *p;
 	struct rdma_cb *rdma_cb_data;
+	struct rdma_sg *rdma_sg;
 	int ret = 0;
 
 	p = kfd_lookup_process_by_pid(pid);
@@ -95,31 +159,28 @@ static int get_pages(uint64_t address, uint64_t length, struct pid *pid,
 		goto out;
 	}
 
-	mem = buf_obj->mem;
-	dev = buf_obj->dev;
-	offset = address - buf_obj->it.start;
-
-	ret = amdgpu_amdkfd_gpuvm_pin_get_sg_table(dev->kgd, mem,
-			offset, length, &sg_table_tmp);
-
-	if (ret) {
-		pr_err("amdgpu_amdkfd_gpuvm_pin_get_sg_table failed.\n");
-		*amd_p2p_data = NULL;
-		goto free_mem;
+	rdma_sg = rdma_sg_lookup(buf_obj, address, length);
+	if (!rdma_sg) {
+		rdma_sg = rdma_sg_create(buf_obj, address, length);
+		if (IS_ERR(rdma_sg)) {
+			ret = PTR_ERR(rdma_sg);
+			*amd_p2p_data = NULL;
+			goto free_mem;
+		}
 	}
 
 	rdma_cb_data->amd_p2p_data.va = address;
 	rdma_cb_data->amd_p2p_data.size = length;
 	rdma_cb_data->amd_p2p_data.pid = pid;
 	rdma_cb_data->amd_p2p_data.priv = buf_obj;
-	rdma_cb_data->amd_p2p_data.pages = sg_table_tmp;
+	rdma_cb_data->amd_p2p_data.pages = rdma_sg->sg;
 
 	rdma_cb_data->free_callback = free_callback;
 	rdma_cb_data->client_priv = client_priv;
+	rdma_cb_data->rdma_sg = rdma_sg;
 
 	list_add(&rdma_cb_data->node, &buf_obj->cb_data_head);
 
-	kfd_inc_compute_active(dev);
 	*amd_p2p_data = &rdma_cb_data->amd_p2p_data;
 
 	goto out;
@@ -135,9 +196,6 @@ static int get_pages(uint64_t address, uint64_t length, struct pid *pid,
 
 static int put_pages_helper(struct amd_p2p_info *p2p_data)
 {
-	struct kfd_bo *buf_obj;
-	struct kfd_dev *dev;
-	struct sg_table *sg_table_tmp;
 	struct rdma_cb *rdma_cb_data;
 
 	if (!p2p_data) {
@@ -147,16 +205,10 @@ static int put_pages_helper(struct amd_p2p_info *p2p_data)
 
 	rdma_cb_data = container_of(p2p_data, struct rdma_cb, amd_p2p_data);
 
-	buf_obj = p2p_data->priv;
-	dev = buf_obj->dev;
-	sg_table_tmp = p2p_data->pages;
-
 	list_del(&rdma_cb_data->node);
+	kref_put(&rdma_cb_data->rdma_sg->ref, rdma_sg_release);
 	kfree(rdma_cb_data);
 
-	amdgpu_amdkfd_gpuvm_unpin_put_sg_table(buf_obj->mem, sg_table_tmp);
-	kfd_dec_compute_active(dev);
-
 	return 0;
 }
 
@@ -200,7 +252,12 @@ static int put_pages(struct amd_p2p_info **p_p2p_data)
 		return -EINVAL;
 	}
 
+	/* The registration list and the shared sg_tables are protected by
+	 * the process mutex
+	 */
+	mutex_lock(&p->mutex);
 	ret = put_pages_helper(*p_p2p_data);
+	mutex_unlock(&p->mutex);
 
 	if (!ret)
 		*p_p2p_data = NULL;
@@ -0,0 +1,1183 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <linux/dma-mapping.h>
+#include <linux/hmm.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include <linux/slab.h>
+#include "kfd_priv.h"
+#include "kfd_svm.h"
+#include "amdgpu_amdkfd.h"
+
+/* Invalidations are batched for a short time before the GPU mappings
+ * are removed and the queues restarted, so that e.g. an munmap of
+ * many small ranges only stops the queues once.
+ */
+#define SVM_RESTORE_DELAY_MS	1
+
+/* How often to retry faulting in a range that is invalidated by the
+ * CPU concurrently, before giving up and letting the GPU retry
+ */
+#define SVM_FAULT_RETRIES	8
+
+#define SVM_FLAGS_MAPPING	(KFD_IOCTL_SVM_FLAG_GPU_RO | \
+				 KFD_IOCTL_SVM_FLAG_GPU_EXEC)
+#define SVM_FLAGS_ALL		(SVM_FLAGS_MAPPING | \
+				 KFD_IOCTL_SVM_FLAG_GPU_READ_MOSTLY)
+#define SVM_MAX_GRANULARITY	30
+
+static const uint64_t svm_range_hmm_flags[HMM_PFN_FLAG_MAX] = {
+	[HMM_PFN_VALID] = 1 << 0,
+	[HMM_PFN_WRITE] = 1 << 1,
+	[HMM_PFN_DEVICE_PRIVATE] = 1 << 2,
+};
+
+static const uint64_t svm_range_hmm_values[HMM_PFN_VALUE_MAX] = {
+	[HMM_PFN_ERROR] = ~0ULL << 1,
+	[HMM_PFN_NONE] = 0,
+	[HMM_PFN_SPECIAL] = ~0ULL << 2,
+};
+
+static inline unsigned long svm_range_npages(struct svm_range *prange)
+{
+	return prange->it_node.last - prange->it_node.start + 1;
+}
+
+static inline struct device *svm_range_dev(struct kfd_process_device *pdd)
+{
+	return &pdd->dev->pdev->dev;
+}
+
+/* Backend for the placement policy
+ *
+ * Moving pages to VRAM needs device private memory registered with HMM,
+ * which KFD doesn't have yet. Until then every range is placed in system
+ * memory and GPUs map it remotely, which is what the policy falls back
+ * to when a location can't host a range. GPU locations are rejected by
+ * svm_range_check_locs, so user space can tell that they aren't honoured.
+ */
+static bool svm_migrate_can_host(void *priv, uint32_t loc, uint64_t npages)
+{
+	return loc == SVM_LOC_SYSMEM;
+}
+
+static int svm_migrate_range(void *priv, void *range, uint32_t from,
+			     uint32_t to)
+{
+	/* Pages only ever live in system memory, nothing to copy */
+	return to == SVM_LOC_SYSMEM ? 0 : -EOPNOTSUPP;
+}
+
+static const struct svm_migrate_ops svm_migrate_sysmem_ops = {
+	.can_host = svm_migrate_can_host,
+	.migrate = svm_migrate_range,
+};
+
+static void svm_range_policy_attr(struct svm_range *prange,
+				  struct svm_policy_attr *attr)
+{
+	attr->preferred_loc = prange->preferred_loc;
+	attr->flags = 0;
+	if (prange->flags & KFD_IOCTL_SVM_FLAG_GPU_READ_MOSTLY)
+		attr->flags |= SVM_POLICY_READ_MOSTLY;
+	attr->access_in_place = prange->access_in_place;
+}
+
+static int svm_range_place(struct svm_range_list *svms,
+			   struct svm_range *prange,
+			   enum svm_policy_event event, uint32_t loc, bool write)
+{
+	struct svm_policy_attr attr;
+
+	svm_range_policy_attr(prange, &attr);
+
+	return svm_policy_handle_event(&svm_policy_default_params, &attr,
+				       &prange->state, &svm_migrate_sysmem_ops,
+				       svms, prange, svm_range_npages(prange),
+				       event, loc, write, get_jiffies_64(),
+				       &svms->stats);
+}
+
+/* Returns the GPU index of pdd, assigning the next free one on first
+ * use. Called with svms->lock held.
+ */
+static int svm_range_gpuidx(struct svm_range_list *svms,
+			    struct kfd_process_device *pdd)
+{
+	unsigned int i;
+
+	for (i = 0; i < svms->npdds; i++)
+		if (svms->pdds[i] == pdd)
+			return i;
+
+	if (svms->npdds == KFD_SVM_MAX_GPUS)
+		return -ENOSPC;
+
+	svms->pdds[svms->npdds] = pdd;
+	return svms->npdds++;
+}
+
+static struct svm_range *svm_range_new(unsigned long start,
+				       unsigned long last)
+{
+	struct svm_range *prange;
+
+	prange = kzalloc(sizeof(*prange), GFP_KERNEL);
+	if (!prange)
+		return NULL;
+
+	prange->it_node.start = start;
+	prange->it_node.last = last;
+	prange->preferred_loc = SVM_LOC_UNDEFINED;
+	prange->prefetch_loc = SVM_LOC_UNDEFINED;
+	prange->granularity = KFD_SVM_DEFAULT_GRANULARITY;
+	/* Accessible by all GPUs of the process unless told otherwise */
+	prange->access = ~0UL;
+	svm_policy_state_init(&prange->state);
+
+	return prange;
+}
+
+static void svm_range_add(struct svm_range_list *svms,
+			  struct svm_range *prange)
+{
+	spin_lock(&svms->tree_lock);
+	interval_tree_insert(&prange->it_node, &svms->objects);
+	spin_unlock(&svms->tree_lock);
+}
+
+static struct svm_range *svm_range_from_addr(struct svm_range_list *svms,
+					     unsigned long addr)
+{
+	struct interval_tree_node *node;
+
+	node = interval_tree_iter_first(&svms->objects, addr, addr);
+	if (!node)
+		return NULL;
+
+	return container_of(node, struct svm_range, it_node);
+}
+
+static void svm_range_dma_unmap(struct device *dev, dma_addr_t *dma_addr,
+				unsigned long offset, unsigned long npages)
+{
+	unsigned long i;
+
+	for (i = offset; i < offset + npages; i++) {
+		if (!dma_addr[i])
+			continue;
+		dma_unmap_page(dev, dma_addr[i], PAGE_SIZE, DMA_BIDIRECTIONAL);
+		dma_addr[i] = 0;
+	}
+}
+
+/* Drops the DMA mappings and arrays of all GPUs. The range must not be
+ * mapped on any GPU any more.
+ */
+static void svm_range_free_dma(struct svm_range_list *svms,
+			       struct svm_range *prange)
+{
+	unsigned int i;
+
+	for (i = 0; i < KFD_SVM_MAX_GPUS; i++) {
+		if (!prange->dma_addr[i])
+			continue;
+		svm_range_dma_unmap(svm_range_dev(svms->pdds[i]),
+				    prange->dma_addr[i], 0,
+				    svm_range_npages(prange));
+		kvfree(prange->dma_addr[i]);
+		prange->dma_addr[i] = NULL;
+	}
+}
+
+/* Unmaps pages [start, last] of prange from all GPUs that may have
+ * them mapped. Called with svms->lock held.
+ *
+ * Pages whose GPU mapping could not be removed keep their DMA
+ * mappings, so the caller can try again.
+ */
+static int svm_range_unmap_from_gpus(struct svm_range_list *svms,
+				     struct svm_range *prange,
+				     unsigned long start, unsigned long last)
+{
+	unsigned long offset = start - prange->it_node.start;
+	unsigned long npages = last - start + 1;
+	unsigned int gpuidx;
+	int r = 0;
+
+	for_each_set_bit(gpuidx, &prange->mapped, KFD_SVM_MAX_GPUS) {
+		struct kfd_process_device *pdd = svms->pdds[gpuidx];
+		int ret;
+
+		ret = amdgpu_amdkfd_gpuvm_svm_unmap(pdd->dev->kgd, pdd->vm,
+						    start, npages);
+		if (ret) {
+			pr_debug("Failed to unmap SVM pages 0x%lx-0x%lx from GPU 0x%x\n",
+				 start, last, pdd->dev->id);
+			r = ret;
+			continue;
+		}
+		kfd_flush_tlb(pdd);
+
+		svm_range_dma_unmap(svm_range_dev(pdd), prange->dma_addr[gpuidx],
+				    offset, npages);
+	}
+
+	if (!r && start == prange->it_node.start &&
+	    last == prange->it_node.last) {
+		spin_lock(&svms->tree_lock);
+		prange->mapped = 0;
+		spin_unlock(&svms->tree_lock);
+	}
+
+	return r;
+}
+
+static int svm_range_unmap_all(struct svm_range_list *svms,
+			       struct svm_range *prange)
+{
+	int r;
+
+	r = svm_range_unmap_from_gpus(svms, prange, prange->it_node.start,
+				      prange->it_node.last);
+	if (r)
+		return r;
+
+	svm_range_free_dma(svms, prange);
+	return 0;
+}
+
+/* Splits prange at page addr. prange keeps [start, addr - 1], the new
+ * range gets [addr, last] and the same attributes. Called with
+ * svms->lock held.
+ */
+static struct svm_range *svm_range_split(struct svm_range_list *svms,
+					 struct svm_range *prange,
+					 unsigned long addr)
+{
+	struct svm_range *tail;
+	int r;
+
+	r = svm_range_unmap_all(svms, prange);
+	if (r)
+		return ERR_PTR(r);
+
+	tail = svm_range_new(addr, prange->it_node.last);
+	if (!tail)
+		return ERR_PTR(-ENOMEM);
+
+	tail->preferred_loc = prange->preferred_loc;
+	tail->prefetch_loc = prange->prefetch_loc;
+	tail->flags = prange->flags;
+	tail->granularity = prange->granularity;
+	tail->access = prange->access;
+	tail->access_in_place = prange->access_in_place;
+	tail->state = prange->state;
+
+	spin_lock(&svms->tree_lock);
+	interval_tree_remove(&prange->it_node, &svms->objects);
+	prange->it_node.last = addr - 1;
+	interval_tree_insert(&prange->it_node, &svms->objects);
+	interval_tree_insert(&tail->it_node, &svms->objects);
+	spin_unlock(&svms->tree_lock);
+
+	return tail;
+}
+
+/* Makes [start, last] covered by ranges that don't extend beyond it,
+ * splitting ranges at the boundaries and filling holes with new ranges
+ * with default attributes.
+ */
+static int svm_range_prepare(struct svm_range_list *svms,
+			     unsigned long start, unsigned long last)
+{
+	struct interval_tree_node *node;
+	struct svm_range *prange, *tail;
+	unsigned long addr;
+
+	prange = svm_range_from_addr(svms, start);
+	if (prange && prange->it_node.start < start) {
+		tail = svm_range_split(svms, prange, start);
+		if (IS_ERR(tail))
+			return PTR_ERR(tail);
+	}
+
+	prange = svm_range_from_addr(svms, last);
+	if (prange && prange->it_node.last > last) {
+		tail = svm_range_split(svms, prange, last + 1);
+		if (IS_ERR(tail))
+			return PTR_ERR(tail);
+	}
+
+	addr = start;
+	node = interval_tree_iter_first(&svms->objects, start, last);
+	while (addr <= last) {
+		if (!node || node->start > addr) {
+			prange = svm_range_new(addr,
+					       node ? node->start - 1 : last);
+			if (!prange)
+				return -ENOMEM;
+			svm_range_add(svms, prange);
+		}
+		if (!node)
+			break;
+
+		addr = node->last + 1;
+		node = interval_tree_iter_next(node, start, last);
+	}
+
+	return 0;
+}
+
+/* Creates a range for a GPU fault on an address the application didn't
+ * set any attributes for. It covers the default granularity around the
+ * fault, clipped to the VMA and to neighbouring ranges.
+ */
+static struct svm_range *
+svm_range_create_unregistered(struct svm_range_list *svms,
+			      struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long size = 1UL << KFD_SVM_DEFAULT_GRANULARITY;
+	struct interval_tree_node *node;
+	struct svm_range *prange;
+	unsigned long start, last;
+
+	start = max(addr & ~(size - 1), vma->vm_start >> PAGE_SHIFT);
+	last = min((addr & ~(size - 1)) + size - 1,
+		   (vma->vm_end >> PAGE_SHIFT) - 1);
+
+	node = interval_tree_iter_first(&svms->objects, start, last);
+	while (node) {
+		if (node->last < addr)
+			start = max(start, node->last + 1);
+		else
+			last = min(last, node->start - 1);
+		node = interval_tree_iter_next(node, start, last);
+	}
+
+	prange = svm_range_new(start, last);
+	if (prange)
+		svm_range_add(svms, prange);
+
+	return prange;
+}
+
+/* Faults in pages [start, last] of prange, which must be inside vma,
+ * and maps them on GPU gpuidx. Called with mmap_sem read-locked and
+ * svms->lock held.
+ */
+static int svm_range_map_to_gpu(struct svm_range_list *svms,
+				struct svm_range *prange, unsigned int gpuidx,
+				struct vm_area_struct *vma,
+				unsigned long start, unsigned long last)
+{
+	struct kfd_process_device *pdd = svms->pdds[gpuidx];
+	struct device *dev = svm_range_dev(pdd);
+	unsigned long npages = last - start + 1;
+	struct hmm_range range;
+	dma_addr_t *dma_addr;
+	unsigned int tries = 0;
+	uint64_t *pfns;
+	unsigned long i;
+	bool writable;
+	int r;
+
+	if (!prange->dma_addr[gpuidx]) {
+		prange->dma_addr[gpuidx] = kvcalloc(svm_range_npages(prange),
+						    sizeof(dma_addr_t),
+						    GFP_KERNEL);
+		if (!prange->dma_addr[gpuidx])
+			return -ENOMEM;
+	}
+	dma_addr = prange->dma_addr[gpuidx] + (start - prange->it_node.start);
+
+	pfns = kvmalloc_array(npages, sizeof(*pfns), GFP_KERNEL);
+	if (!pfns)
+		return -ENOMEM;
+
+	/* Mark the range as mapped before faulting it in, so that a CPU
+	 * invalidation racing with the GPU page table update is not
+	 * missed
+	 */
+	spin_lock(&svms->tree_lock);
+	prange->mapped |= BIT(gpuidx);
+	spin_unlock(&svms->tree_lock);
+
+	/* Fault in writable pages where possible, so that the range can
+	 * be mapped with a single set of permissions
+	 */
+	writable = (vma->vm_flags & VM_WRITE) &&
+		!(prange->flags & KFD_IOCTL_SVM_FLAG_GPU_RO);
+
+	range.vma = vma;
+	range.start = start << PAGE_SHIFT;
+	range.end = (last + 1) << PAGE_SHIFT;
+	range.pfns = pfns;
+	range.flags = svm_range_hmm_flags;
+	range.values = svm_range_hmm_values;
+	range.pfn_shift = PAGE_SHIFT;
+
+again:
+	for (i = 0; i < npages; i++) {
+		pfns[i] = svm_range_hmm_flags[HMM_PFN_VALID];
+		if (writable)
+			pfns[i] |= svm_range_hmm_flags[HMM_PFN_WRITE];
+	}
+
+	r = hmm_vma_fault(&range, true);
+	if (r)
+		goto out_free;
+
+	for (i = 0; i < npages; i++) {
+		struct page *page = hmm_pfn_to_page(&range, pfns[i]);
+
+		if (!page) {
+			r = -EFAULT;
+			break;
+		}
+		if (dma_addr[i])
+			dma_unmap_page(dev, dma_addr[i], PAGE_SIZE,
+				       DMA_BIDIRECTIONAL);
+		dma_addr[i] = dma_map_page(dev, page, 0, PAGE_SIZE,
+					   DMA_BIDIRECTIONAL);
+		if (dma_mapping_error(dev, dma_addr[i])) {
+			dma_addr[i] = 0;
+			r = -EFAULT;
+			break;
+		}
+	}
+
+	if (!hmm_vma_range_done(&range) && !r) {
+		if (++tries < SVM_FAULT_RETRIES)
+			goto again;
+		r = -EAGAIN;
+	}
+	if (r)
+		goto out_free;
+
+	r = amdgpu_amdkfd_gpuvm_svm_map(pdd->dev->kgd, pdd->vm, start, npages,
+					dma_addr, writable,
+					prange->flags & KFD_IOCTL_SVM_FLAG_GPU_EXEC);
+	if (!r)
+		kfd_flush_tlb(pdd);
+
+out_free:
+	kvfree(pfns);
+	return r;
+}
+
+/* Places the range at its prefetch location. svm_range_check_locs only lets
+ * system memory through, so GPUs still map the range on their next fault.
+ */
+static int svm_range_prefetch(struct svm_range_list *svms,
+			      struct svm_range *prange)
+{
+	uint32_t loc = prange->prefetch_loc;
+
+	if (loc == SVM_LOC_UNDEFINED)
+		return 0;
+
+	return svm_range_place(svms, prange, SVM_POLICY_PREFETCH, loc, false);
+}
+
+static uint32_t svm_range_loc_from_user(uint32_t value, int gpuidx)
+{
+	if (value == KFD_IOCTL_SVM_LOCATION_SYSMEM)
+		return SVM_LOC_SYSMEM;
+	if (value == KFD_IOCTL_SVM_LOCATION_UNDEFINED)
+		return SVM_LOC_UNDEFINED;
+	return SVM_LOC_FROM_GPU(gpuidx);
+}
+
+static uint32_t svm_range_loc_to_user(struct svm_range_list *svms,
+				      uint32_t loc)
+{
+	if (loc == SVM_LOC_SYSMEM)
+		return KFD_IOCTL_SVM_LOCATION_SYSMEM;
+	if (loc == SVM_LOC_UNDEFINED)
+		return KFD_IOCTL_SVM_LOCATION_UNDEFINED;
+	return svms->pdds[SVM_LOC_TO_GPU(loc)]->dev->id;
+}
+
+/* Preferred and prefetch locations can only be system memory until the
+ * backend can place ranges in VRAM
+ */
+static int svm_range_check_locs(uint32_t nattr,
+				struct kfd_ioctl_svm_attribute *attrs)
+{
+	uint32_t i;
+
+	for (i = 0; i < nattr; i++) {
+		if (attrs[i].type != KFD_IOCTL_SVM_ATTR_PREFERRED_LOC &&
+		    attrs[i].type != KFD_IOCTL_SVM_ATTR_PREFETCH_LOC)
+			continue;
+		if (attrs[i].value != KFD_IOCTL_SVM_LOCATION_SYSMEM &&
+		    attrs[i].value != KFD_IOCTL_SVM_LOCATION_UNDEFINED) {
+			pr_debug("GPU location 0x%x not supported\n",
+				 attrs[i].value);
+			return -EOPNOTSUPP;
+		}
+	}
+
+	return 0;
+}
+
+/* Looks up the process devices named by gpu_id in attrs. Called with
+ * p->mutex held. Devices are bound to the process if bind is set.
+ */
+static int svm_range_get_pdds(struct kfd_process *p, bool bind,
+			      uint32_t nattr,
+			      struct kfd_ioctl_svm_attribute *attrs,
+			      struct kfd_process_device **pdds)
+{
+	struct kfd_process_device *pdd;
+	struct kfd_dev *dev;
+	uint32_t i;
+
+	for (i = 0; i < nattr; i++) {
+		uint32_t value = attrs[i].value;
+
+		switch (attrs[i].type) {
+		case KFD_IOCTL_SVM_ATTR_PREFERRED_LOC:
+		case KFD_IOCTL_SVM_ATTR_PREFETCH_LOC:
+			if (value == KFD_IOCTL_SVM_LOCATION_SYSMEM ||
+			    value == KFD_IOCTL_SVM_LOCATION_UNDEFINED)
+				continue;
+			/* fall through */
+		case KFD_IOCTL_SVM_ATTR_ACCESS:
+		case KFD_IOCTL_SVM_ATTR_ACCESS_IN_PLACE:
+		case KFD_IOCTL_SVM_ATTR_NO_ACCESS:
+			dev = kfd_device_by_id(value);
+			if (!dev) {
+				pr_debug("Invalid gpu_id 0x%x\n", value);
+				return -EINVAL;
+			}
+			if (bind)
+				pdd = kfd_bind_process_to_device(dev, p);
+			else
+				pdd = kfd_get_process_device_data(dev, p);
+			if (IS_ERR_OR_NULL(pdd))
+				return pdd ? PTR_ERR(pdd) : -EINVAL;
+			pdds[i] = pdd;
+			break;
+		case KFD_IOCTL_SVM_ATTR_SET_FLAGS:
+		case KFD_IOCTL_SVM_ATTR_CLR_FLAGS:
+			if (value & ~SVM_FLAGS_ALL)
+				return -EINVAL;
+			break;
+		case KFD_IOCTL_SVM_ATTR_GRANULARITY:
+			if (value > SVM_MAX_GRANULARITY)
+				return -EINVAL;
+			break;
+		default:
+			pr_debug("Unknown SVM attribute %u\n", attrs[i].type);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/* Applies attrs to prange. Returns true if existing GPU mappings of
+ * the range no longer match its attributes.
+ */
+static bool svm_range_apply_attrs(struct svm_range *prange, uint32_t nattr,
+				  struct kfd_ioctl_svm_attribute *attrs,
+				  int *gpuidx)
+{
+	bool unmap = false;
+	uint32_t i, flags;
+
+	for (i = 0; i < nattr; i++) {
+		uint32_t value = attrs[i].value;
+
+		switch (attrs[i].type) {
+		case KFD_IOCTL_SVM_ATTR_PREFERRED_LOC:
+			prange->preferred_loc =
+				svm_range_loc_from_user(value, gpuidx[i]);
+			break;
+		case KFD_IOCTL_SVM_ATTR_PREFETCH_LOC:
+			prange->prefetch_loc =
+				svm_range_loc_from_user(value, gpuidx[i]);
+			break;
+		case KFD_IOCTL_SVM_ATTR_ACCESS:
+			set_bit(gpuidx[i], &prange->access);
+			clear_bit(gpuidx[i], &prange->access_in_place);
+			break;
+		case KFD_IOCTL_SVM_ATTR_ACCESS_IN_PLACE:
+			set_bit(gpuidx[i], &prange->access);
+			set_bit(gpuidx[i], &prange->access_in_place);
+			break;
+		case KFD_IOCTL_SVM_ATTR_NO_ACCESS:
+			clear_bit(gpuidx[i], &prange->access);
+			clear_bit(gpuidx[i], &prange->access_in_place);
+			unmap = true;
+			break;
+		case KFD_IOCTL_SVM_ATTR_SET_FLAGS:
+		case KFD_IOCTL_SVM_ATTR_CLR_FLAGS:
+			flags = prange->flags;
+			if (attrs[i].type == KFD_IOCTL_SVM_ATTR_SET_FLAGS)
+				prange->flags |= value;
+			else
+				prange->flags &= ~value;
+			if ((flags ^ prange->flags) & SVM_FLAGS_MAPPING)
+				unmap = true;
+			break;
+		case KFD_IOCTL_SVM_ATTR_GRANULARITY:
+			prange->granularity = value;
+			break;
+		}
+	}
+
+	return unmap;
+}
+
+static int svm_range_set_attr(struct svm_range_list *svms,
+			      unsigned long start, unsigned long last,
+			      uint32_t nattr,
+			      struct kfd_ioctl_svm_attribute *attrs,
+			      struct kfd_process_device **pdds)
+{
+	struct interval_tree_node *node;
+	struct svm_range *prange;
+	int *gpuidx;
+	uint32_t i;
+	int r;
+
+	gpuidx = kmalloc_array(nattr, sizeof(*gpuidx), GFP_KERNEL);
+	if (!gpuidx)
+		return -ENOMEM;
+
+	for (i = 0; i < nattr; i++) {
+		gpuidx[i] = pdds[i] ? svm_range_gpuidx(svms, pdds[i]) : 0;
+		if (gpuidx[i] < 0) {
+			r = gpuidx[i];
+			goto out;
+		}
+	}
+
+	r = svm_range_prepare(svms, start, last);
+	if (r)
+		goto out;
+
+	for (node = interval_tree_iter_first(&svms->objects, start, last);
+	     node; node = interval_tree_iter_next(node, start, last)) {
+		prange = container_of(node, struct svm_range, it_node);
+
+		if (svm_range_apply_attrs(prange, nattr, attrs, gpuidx)) {
+			r = svm_range_unmap_all(svms, prange);
+			if (r)
+				goto out;
+		}
+	}
+
+	for (node = interval_tree_iter_first(&svms->objects, start, last);
+	     node; node = interval_tree_iter_next(node, start, last)) {
+		prange = container_of(node, struct svm_range, it_node);
+
+		r = svm_range_prefetch(svms, prange);
+		if (r)
+			goto out;
+	}
+
+out:
+	kfree(gpuidx);
+	return r;
+}
+
+/* Attributes common to all pages of a queried range */
+struct svm_range_attr_summary {
+	bool valid;
+	uint32_t preferred_loc;
+	uint32_t prefetch_loc;
+	uint32_t flags;
+	uint8_t granularity;
+	unsigned long access;
+	unsigned long access_in_place;
+};
+
+static void svm_range_summarize(struct svm_range_attr_summary *sum,
+				struct svm_range *prange)
+{
+	if (!sum->valid) {
+		sum->valid = true;
+		sum->preferred_loc = prange->preferred_loc;
+		sum->prefetch_loc = prange->prefetch_loc;
+		sum->flags = prange->flags;
+		sum->granularity = prange->granularity;
+		sum->access = prange->access;
+		sum->access_in_place = prange->access_in_place;
+		return;
+	}
+
+	if (sum->preferred_loc != prange->preferred_loc)
+		sum->preferred_loc = SVM_LOC_UNDEFINED;
+	if (sum->prefetch_loc != prange->prefetch_loc)
+		sum->prefetch_loc = SVM_LOC_UNDEFINED;
+	sum->flags &= prange->flags;
+	sum->granularity = min(sum->granularity, prange->granularity);
+	sum->access &= prange->access;
+	sum->access_in_place &= prange->access_in_place;
+}
+
+static int svm_range_get_attr(struct svm_range_list *svms,
+			      unsigned long start, unsigned long last,
+			      uint32_t nattr,
+			      struct kfd_ioctl_svm_attribute *attrs,
+			      struct kfd_process_device **pdds)
+{
+	struct svm_range_attr_summary sum = { .valid = false };
+	struct interval_tree_node *node;
+	struct svm_range *dflt;
+	unsigned long addr = start;
+	uint32_t i;
+	int idx;
+
+	dflt = svm_range_new(start, last);
+	if (!dflt)
+		return -ENOMEM;
+
+	for (node = interval_tree_iter_first(&svms->objects, start, last);
+	     node; node = interval_tree_iter_next(node, start, last)) {
+		if (node->start > addr)
+			svm_range_summarize(&sum, dflt);
+		svm_range_summarize(&sum,
+				    container_of(node, struct svm_range,
+						 it_node));
+		addr = node->last + 1;
+	}
+	if (addr <= last)
+		svm_range_summarize(&sum, dflt);
+	kfree(dflt);
+
+	for (i = 0; i < nattr; i++) {
+		switch (attrs[i].type) {
+		case KFD_IOCTL_SVM_ATTR_PREFERRED_LOC:
+			attrs[i].value = svm_range_loc_to_user(svms,
+							sum.preferred_loc);
+			break;
+		case KFD_IOCTL_SVM_ATTR_PREFETCH_LOC:
+			attrs[i].value = svm_range_loc_to_user(svms,
+							sum.prefetch_loc);
+			break;
+		case KFD_IOCTL_SVM_ATTR_ACCESS:
+		case KFD_IOCTL_SVM_ATTR_ACCESS_IN_PLACE:
+		case KFD_IOCTL_SVM_ATTR_NO_ACCESS:
+			idx = svm_range_gpuidx(svms, pdds[i]);
+			if (idx < 0)
+				return idx;
+			if (test_bit(idx, &sum.access_in_place))
+				attrs[i].type =
+					KFD_IOCTL_SVM_ATTR_ACCESS_IN_PLACE;
+			else if (test_bit(idx, &sum.access))
+				attrs[i].type = KFD_IOCTL_SVM_ATTR_ACCESS;
+			else
+				attrs[i].type = KFD_IOCTL_SVM_ATTR_NO_ACCESS;
+			break;
+		case KFD_IOCTL_SVM_ATTR_SET_FLAGS:
+		case KFD_IOCTL_SVM_ATTR_CLR_FLAGS:
+			attrs[i].value = sum.flags;
+			break;
+		case KFD_IOCTL_SVM_ATTR_GRANULARITY:
+			attrs[i].value = sum.granularity;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* CPU page table updates
+ *
+ * Called from MMU notifiers, possibly in reclaim, so this must not
+ * allocate memory or take locks held while allocating memory. If any
+ * affected pages are mapped on a GPU, stop the queues and leave the
+ * GPU page table update to svm_range_restore_work, like userptr BO
+ * eviction does.
+ */
+static void svm_range_sync_cpu_device_pagetables(struct hmm_mirror *mirror,
+					enum hmm_update_type update,
+					unsigned long start,
+					unsigned long end)
+{
+	struct svm_range_list *svms =
+		container_of(mirror, struct svm_range_list, mirror);
+	struct kfd_process *p = container_of(svms, struct kfd_process, svms);
+	struct interval_tree_node *node;
+	bool mapped = false;
+	unsigned long last;
+
+	start >>= PAGE_SHIFT;
+	last = (end - 1) >> PAGE_SHIFT;
+
+	spin_lock(&svms->tree_lock);
+	for (node = interval_tree_iter_first(&svms->objects, start, last);
+	     node; node = interval_tree_iter_next(node, start, last)) {
+		if (container_of(node, struct svm_range, it_node)->mapped) {
+			mapped = true;
+			break;
+		}
+	}
+	if (mapped) {
+		svms->invalid_start = min(svms->invalid_start, start);
+		svms->invalid_last = max(svms->invalid_last, last);
+	}
+	spin_unlock(&svms->tree_lock);
+
+	if (!mapped)
+		return;
+
+	if (atomic_inc_return(&svms->evicted) == 1) {
+		/* First invalidation, stop the queues */
+		if (kfd_process_evict_queues(p))
+			pr_err("Failed to evict queues for SVM invalidation\n");
+		schedule_delayed_work(&svms->restore_work,
+				      msecs_to_jiffies(SVM_RESTORE_DELAY_MS));
+	}
+}
+
+static const struct hmm_mirror_ops svm_range_mirror_ops = {
+	.sync_cpu_device_pagetables = svm_range_sync_cpu_device_pagetables,
+};
+
+static void svm_range_restore_work(struct work_struct *work)
+{
+	struct delayed_work *dwork = to_delayed_work(work);
+	struct svm_range_list *svms =
+		container_of(dwork, struct svm_range_list, restore_work);
+	struct kfd_process *p = container_of(svms, struct kfd_process, svms);
+	int evicted = atomic_read(&svms->evicted);
+	struct interval_tree_node *node;
+	unsigned long start, last;
+	int r = 0;
+
+	mutex_lock(&svms->lock);
+
+	spin_lock(&svms->tree_lock);
+	start = svms->invalid_start;
+	last = svms->invalid_last;
+	svms->invalid_start = ULONG_MAX;
+	svms->invalid_last = 0;
+	spin_unlock(&svms->tree_lock);
+
+	for (node = interval_tree_iter_first(&svms->objects, start, last);
+	     start <= last && node;
+	     node = interval_tree_iter_next(node, start, last)) {
+		unsigned long s = max(start, node->start);
+		unsigned long l = min(last, node->last);
+		int ret;
+
+		ret = svm_range_unmap_from_gpus(svms,
+				container_of(node, struct svm_range, it_node),
+				s, l);
+		if (ret) {
+			/* Page tables are evicted, try again later */
+			spin_lock(&svms->tree_lock);
+			svms->invalid_start = min(svms->invalid_start, s);
+			svms->invalid_last = max(svms->invalid_last, l);
+			spin_unlock(&svms->tree_lock);
+			r = ret;
+		}
+	}
+
+	mutex_unlock(&svms->lock);
+
+	/* Keep the queues stopped until all stale mappings are gone and
+	 * no new invalidations came in meanwhile
+	 */
+	if (r || atomic_cmpxchg(&svms->evicted, evicted, 0) != evicted) {
+		schedule_delayed_work(&svms->restore_work,
+				      msecs_to_jiffies(SVM_RESTORE_DELAY_MS));
+		return;
+	}
+
+	if (kfd_process_restore_queues(p))
+		pr_err("Failed to restore queues after SVM invalidation\n");
+}
+
+/* hmm_mirror_register needs mmap_sem held for write, so the mirror is
+ * only registered once a process actually uses SVM
+ */
+static int svm_range_register_mirror(struct svm_range_list *svms,
+				     struct mm_struct *mm)
+{
+	int r = 0;
+
+	if (READ_ONCE(svms->mirror_registered))
+		return 0;
+
+	down_write(&mm->mmap_sem);
+	mutex_lock(&svms->lock);
+	if (svms->released) {
+		r = -ESRCH;
+	} else if (!svms->mirror_registered) {
+		svms->mirror.ops = &svm_range_mirror_ops;
+		r = hmm_mirror_register(&svms->mirror, mm);
+		if (!r)
+			WRITE_ONCE(svms->mirror_registered, true);
+	}
+	mutex_unlock(&svms->lock);
+	up_write(&mm->mmap_sem);
+
+	return r;
+}
+
+int kfd_svm_ioctl(struct kfd_process *p, uint32_t op, uint64_t start,
+		  uint64_t size, uint32_t nattr,
+		  struct kfd_ioctl_svm_attribute *attrs)
+{
+	struct svm_range_list *svms = &p->svms;
+	struct kfd_process_device **pdds;
+	struct mm_struct *mm;
+	unsigned long first, last;
+	int r;
+
+	if (!size || (start | size) & ~PAGE_MASK || start + size < start)
+		return -EINVAL;
+	if (op != KFD_IOCTL_SVM_OP_SET_ATTR && op != KFD_IOCTL_SVM_OP_GET_ATTR)
+		return -EINVAL;
+	if (op == KFD_IOCTL_SVM_OP_SET_ATTR) {
+		r = svm_range_check_locs(nattr, attrs);
+		if (r)
+			return r;
+	}
+
+	first = start >> PAGE_SHIFT;
+	last = ((start + size) >> PAGE_SHIFT) - 1;
+
+	pdds = kcalloc(nattr, sizeof(*pdds), GFP_KERNEL);
+	if (nattr && !pdds)
+		return -ENOMEM;
+
+	mutex_lock(&p->mutex);
+	r = svm_range_get_pdds(p, op == KFD_IOCTL_SVM_OP_SET_ATTR, nattr,
+			       attrs, pdds);
+	mutex_unlock(&p->mutex);
+	if (r)
+		goto out_free;
+
+	mm = get_task_mm(p->lead_thread);
+	if (!mm) {
+		r = -ESRCH;
+		goto out_free;
+	}
+
+	r = svm_range_register_mirror(svms, mm);
+	if (r)
+		goto out_mmput;
+
+	down_read(&mm->mmap_sem);
+	mutex_lock(&svms->lock);
+
+	if (op == KFD_IOCTL_SVM_OP_SET_ATTR)
+		r = svm_range_set_attr(svms, first, last, nattr, attrs, pdds);
+	else
+		r = svm_range_get_attr(svms, first, last, nattr, attrs, pdds);
+
+	mutex_unlock(&svms->lock);
+	up_read(&mm->mmap_sem);
+
+out_mmput:
+	mmput(mm);
+out_free:
+	kfree(pdds);
+	return r;
+}
+
+/* Handles a retry fault from a GPU. addr is the faulting byte address.
+ *
+ * Returns true if the fault was resolved, or can be left for the GPU to
+ * retry. Returns false if the address is not accessible by this GPU, so
+ * that it is reported as a VM fault.
+ */
+bool kfd_svm_handle_gpu_fault(struct kfd_dev *dev, unsigned int pasid,
+			      uint64_t addr, bool write)
+{
+	struct kfd_process_device *pdd;
+	struct svm_range_list *svms;
+	struct vm_area_struct *vma;
+	struct svm_range *prange;
+	unsigned long page = addr >> PAGE_SHIFT;
+	unsigned long size, start, last;
+	struct kfd_process *p;
+	struct mm_struct *mm;
+	bool handled = false;
+	int gpuidx, r;
+
+	p = kfd_lookup_process_by_pasid(pasid);
+	if (!p)
+		return false;
+	svms = &p->svms;
+
+	pdd = kfd_get_process_device_data(dev, p);
+	if (!pdd || !pdd->vm)
+		goto out_unref;
+
+	mm = get_task_mm(p->lead_thread);
+	if (!mm)
+		goto out_unref;
+
+	if (svm_range_register_mirror(svms, mm))
+		goto out_mmput;
+
+	down_read(&mm->mmap_sem);
+	mutex_lock(&svms->lock);
+
+	if (svms->released)
+		goto out_unlock;
+
+	vma = find_vma(mm, addr);
+	if (!vma || addr < vma->vm_start)
+		goto out_unlock;
+
+	gpuidx = svm_range_gpuidx(svms, pdd);
+	if (gpuidx < 0)
+		goto out_unlock;
+
+	prange = svm_range_from_addr(svms, page);
+	if (!prange) {
+		prange = svm_range_create_unregistered(svms, vma, page);
+		if (!prange)
+			goto out_unlock;
+	}
+
+	if (!test_bit(gpuidx, &prange->access))
+		goto out_unlock;
+	if (write && (!(vma->vm_flags & VM_WRITE) ||
+		      (prange->flags & KFD_IOCTL_SVM_FLAG_GPU_RO)))
+		goto out_unlock;
+
+	r = svm_range_place(svms, prange, SVM_POLICY_GPU_FAULT,
+			    SVM_LOC_FROM_GPU(gpuidx), write);
+	if (r)
+		goto out_unlock;
+
+	size = 1UL << prange->granularity;
+	start = max3(page & ~(size - 1), prange->it_node.start,
+		     vma->vm_start >> PAGE_SHIFT);
+	last = min3((page & ~(size - 1)) + size - 1, prange->it_node.last,
+		    (vma->vm_end >> PAGE_SHIFT) - 1);
+
+	r = svm_range_map_to_gpu(svms, prange, gpuidx, vma, start, last);
+	if (r && r != -EAGAIN)
+		pr_debug("Failed to map SVM fault 0x%llx on GPU 0x%x: %d\n",
+			 addr, dev->id, r);
+	handled = !r || r == -EAGAIN;
+
+out_unlock:
+	mutex_unlock(&svms->lock);
+	up_read(&mm->mmap_sem);
+	if (handled)
+		amdgpu_amdkfd_gpuvm_clear_retry_fault(dev->kgd, pasid, addr);
+out_mmput:
+	mmput(mm);
+out_unref:
+	kfd_unref_process(p);
+	return handled;
+}
+
+void kfd_svm_init(struct kfd_process *p)
+{
+	struct svm_range_list *svms = &p->svms;
+
+	mutex_init(&svms->lock);
+	spin_lock_init(&svms->tree_lock);
+	svms->objects = RB_ROOT_CACHED;
+	svms->invalid_start = ULONG_MAX;
+	svms->invalid_last = 0;
+	atomic_set(&svms->evicted, 0);
+	INIT_DELAYED_WORK(&svms->restore_work, svm_range_restore_work);
+}
+
+/* Called when the mm is released, while it is still valid. The queues
+ * are destroyed right after, so GPU page tables are left alone and the
+ * ranges only drop their DMA mappings.
+ */
+void kfd_svm_fini(struct kfd_process *p)
+{
+	struct svm_range_list *svms = &p->svms;
+	struct interval_tree_node *node;
+	bool registered;
+
+	mutex_lock(&svms->lock);
+	svms->released = true;
+	registered = svms->mirror_registered;
+	mutex_unlock(&svms->lock);
+
+	if (registered)
+		hmm_mirror_unregister(&svms->mirror);
+	cancel_delayed_work_sync(&svms->restore_work);
+
+	mutex_lock(&svms->lock);
+	while ((node = interval_tree_iter_first(&svms->objects, 0,
+						 ULONG_MAX))) {
+		struct svm_range *prange =
+			container_of(node, struct svm_range, it_node);
+
+		spin_lock(&svms->tree_lock);
+		interval_tree_remove(node, &svms->objects);
+		spin_unlock(&svms->tree_lock);
+
+		svm_range_free_dma(svms, prange);
+		kfree(prange);
+	}
+	mutex_unlock(&svms->lock);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+
+int kfd_debugfs_svm_by_process(struct seq_file *m, void *data)
+{
+	struct kfd_process *p;
+	unsigned int temp;
+	int idx = srcu_read_lock(&kfd_processes_srcu);
+
+	hash_for_each_rcu(kfd_processes_table, temp, p, kfd_processes) {
+		struct svm_range_list *svms = &p->svms;
+		struct interval_tree_node *node;
+		unsigned long nranges = 0;
+
+		mutex_lock(&svms->lock);
+		for (node = interval_tree_iter_first(&svms->objects, 0,
+						     ULONG_MAX);
+		     node; node = interval_tree_iter_next(node, 0, ULONG_MAX))
+			nranges++;
+
+		seq_printf(m, "Process %d PASID %d:\n",
+			   p->lead_thread->tgid, p->pasid);
+		seq_printf(m, "  ranges %lu faults %llu migrations %llu migrate_failures %llu remote_maps %llu thrash_events %llu\n",
+			   nranges, svms->stats.faults,
+			   svms->stats.migrations,
+			   svms->stats.migrate_failures,
+			   svms->stats.remote_maps,
+			   svms->stats.thrash_events);
+		mutex_unlock(&svms->lock);
+	}
+
+	srcu_read_unlock(&kfd_processes_srcu, idx);
+
+	return 0;
+}
+
+#endif
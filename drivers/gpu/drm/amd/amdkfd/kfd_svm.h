@@ -0,0 +1,138 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef KFD_SVM_H_
+#define KFD_SVM_H_
+
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct kfd_dev;
+struct kfd_process;
+struct kfd_ioctl_svm_attribute;
+
+#ifdef CONFIG_HSA_AMD_SVM
+
+#include <linux/hmm.h>
+#include <linux/interval_tree.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include "kfd_svm_policy.h"
+
+#define KFD_SVM_MAX_GPUS		32
+#define KFD_SVM_DEFAULT_GRANULARITY	9
+
+struct kfd_process_device;
+
+/* A range of virtual addresses with common SVM attributes
+ *
+ * it_node.start and it_node.last are CPU page numbers. Ranges never
+ * overlap. dma_addr[gpuidx] holds the DMA address of each page mapped
+ * on that GPU, or 0.
+ */
+struct svm_range {
+	struct interval_tree_node	it_node;
+	/* Internal locations, see kfd_svm_policy.h */
+	uint32_t			preferred_loc;
+	uint32_t			prefetch_loc;
+	/* KFD_IOCTL_SVM_FLAG_* */
+	uint32_t			flags;
+	uint8_t				granularity;
+	/* Bitmaps indexed by GPU index */
+	unsigned long			access;
+	unsigned long			access_in_place;
+	/* GPUs that may have pages of the range mapped, protected by
+	 * svm_range_list.tree_lock as well as svm_range_list.lock
+	 */
+	unsigned long			mapped;
+	struct svm_policy_state		state;
+	dma_addr_t			*dma_addr[KFD_SVM_MAX_GPUS];
+};
+
+/* Per-process SVM state
+ *
+ * lock serializes attribute changes, faults and GPU page table updates.
+ * The HMM invalidation callback cannot take it, because it is held while
+ * allocating memory. It only looks at the range tree under tree_lock,
+ * stops the queues and leaves the unmapping to restore_work.
+ */
+struct svm_range_list {
+	struct mutex			lock;
+	spinlock_t			tree_lock;
+	struct rb_root_cached		objects;
+	/* Devices in order of first use; a range's bitmaps are indexed
+	 * by the position here
+	 */
+	struct kfd_process_device	*pdds[KFD_SVM_MAX_GPUS];
+	unsigned int			npdds;
+
+	struct hmm_mirror		mirror;
+	bool				mirror_registered;
+	bool				released;
+
+	/* Pages invalidated by the CPU but still mapped on GPUs,
+	 * protected by tree_lock
+	 */
+	unsigned long			invalid_start;
+	unsigned long			invalid_last;
+	atomic_t			evicted;
+	struct delayed_work		restore_work;
+
+	struct svm_policy_stats		stats;
+};
+
+void kfd_svm_init(struct kfd_process *p);
+void kfd_svm_fini(struct kfd_process *p);
+int kfd_svm_ioctl(struct kfd_process *p, uint32_t op, uint64_t start,
+		  uint64_t size, uint32_t nattr,
+		  struct kfd_ioctl_svm_attribute *attrs);
+bool kfd_svm_handle_gpu_fault(struct kfd_dev *dev, unsigned int pasid,
+			      uint64_t addr, bool write);
+
+#else
+
+static inline void kfd_svm_init(struct kfd_process *p)
+{
+	/* empty */
+}
+static inline void kfd_svm_fini(struct kfd_process *p)
+{
+	/* empty */
+}
+static inline int kfd_svm_ioctl(struct kfd_process *p, uint32_t op,
+				uint64_t start, uint64_t size, uint32_t nattr,
+				struct kfd_ioctl_svm_attribute *attrs)
+{
+	return -EOPNOTSUPP;
+}
+static inline bool kfd_svm_handle_gpu_fault(struct kfd_dev *dev,
+					    unsigned int pasid,
+					    uint64_t addr, bool write)
+{
+	return false;
+}
+
+#endif /* CONFIG_HSA_AMD_SVM */
+
+#endif /* KFD_SVM_H_ */
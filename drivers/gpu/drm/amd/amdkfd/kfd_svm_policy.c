@@ -0,0 +1,160 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/jiffies.h>
+#include "kfd_svm_policy.h"
+
+const struct svm_policy_params svm_policy_default_params = {
+	.migrate_threshold = 2,
+	.thrash_limit = 4,
+	.thrash_window = HZ,
+};
+
+void svm_policy_state_init(struct svm_policy_state *state)
+{
+	state->actual_loc = SVM_LOC_UNDEFINED;
+	state->last_loc = SVM_LOC_UNDEFINED;
+	state->streak = 0;
+	state->migrations = 0;
+	state->window_start = 0;
+	state->thrashing = false;
+}
+
+static bool svm_policy_in_place(const struct svm_policy_attr *attr,
+				uint32_t loc)
+{
+	return SVM_LOC_IS_GPU(loc) && SVM_LOC_TO_GPU(loc) < BITS_PER_LONG &&
+		test_bit(SVM_LOC_TO_GPU(loc), &attr->access_in_place);
+}
+
+/**
+ * svm_policy_decide - pick the location for a range after an access
+ * @params: tuning parameters
+ * @attr: attributes of the range
+ * @state: placement state of the range, updated with the access
+ * @event: kind of access
+ * @loc: location that accessed the range, or the prefetch target
+ * @write: whether the access was a write
+ * @now: current time, in the units of @params->thrash_window
+ *
+ * Returns the location the range should be in. If that is not the
+ * current location the caller migrates the range, otherwise the accessor
+ * maps it where it is.
+ */
+uint32_t svm_policy_decide(const struct svm_policy_params *params,
+			   const struct svm_policy_attr *attr,
+			   struct svm_policy_state *state,
+			   enum svm_policy_event event, uint32_t loc,
+			   bool write, uint64_t now)
+{
+	if (now - state->window_start >= params->thrash_window) {
+		state->window_start = now;
+		state->migrations = 0;
+		state->thrashing = false;
+	}
+
+	if (loc == state->last_loc) {
+		state->streak++;
+	} else {
+		state->last_loc = loc;
+		state->streak = 1;
+	}
+
+	if (event == SVM_POLICY_PREFETCH)
+		return loc;
+
+	/* The CPU cannot map device memory */
+	if (event == SVM_POLICY_CPU_FAULT)
+		return SVM_LOC_SYSMEM;
+
+	/* First touch */
+	if (state->actual_loc == SVM_LOC_UNDEFINED)
+		return attr->preferred_loc != SVM_LOC_UNDEFINED ?
+			attr->preferred_loc : loc;
+
+	if (state->actual_loc == loc || state->thrashing ||
+	    svm_policy_in_place(attr, loc) ||
+	    ((attr->flags & SVM_POLICY_READ_MOSTLY) && !write) ||
+	    attr->preferred_loc == state->actual_loc ||
+	    state->streak < params->migrate_threshold)
+		return state->actual_loc;
+
+	return loc;
+}
+
+/**
+ * svm_policy_handle_event - place a range after an access
+ *
+ * Runs svm_policy_decide() and migrates the range through @ops if it
+ * should move. Falls back to system memory if the chosen location has no
+ * room. On success state->actual_loc is where the range must be mapped.
+ *
+ * Returns 0 on success or the error from ops->migrate().
+ */
+int svm_policy_handle_event(const struct svm_policy_params *params,
+			    const struct svm_policy_attr *attr,
+			    struct svm_policy_state *state,
+			    const struct svm_migrate_ops *ops, void *priv,
+			    void *range, uint64_t npages,
+			    enum svm_policy_event event, uint32_t loc,
+			    bool write, uint64_t now,
+			    struct svm_policy_stats *stats)
+{
+	uint32_t target;
+	int r;
+
+	if (event != SVM_POLICY_PREFETCH)
+		stats->faults++;
+
+	target = svm_policy_decide(params, attr, state, event, loc, write,
+				   now);
+	if (target != state->actual_loc &&
+	    !ops->can_host(priv, target, npages))
+		target = SVM_LOC_SYSMEM;
+
+	if (target != state->actual_loc) {
+		r = ops->migrate(priv, range, state->actual_loc, target);
+		if (r) {
+			stats->migrate_failures++;
+			return r;
+		}
+
+		/* Initial placement does not count against thrashing */
+		if (state->actual_loc != SVM_LOC_UNDEFINED) {
+			stats->migrations++;
+			if (++state->migrations > params->thrash_limit &&
+			    !state->thrashing) {
+				state->thrashing = true;
+				stats->thrash_events++;
+			}
+		}
+		state->actual_loc = target;
+		state->streak = 0;
+	}
+
+	if (event != SVM_POLICY_PREFETCH && target != loc)
+		stats->remote_maps++;
+
+	return 0;
+}
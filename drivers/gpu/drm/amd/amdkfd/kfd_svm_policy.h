@@ -0,0 +1,118 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef KFD_SVM_POLICY_H_
+#define KFD_SVM_POLICY_H_
+
+#include <linux/types.h>
+
+/* SVM placement policy
+ *
+ * Decides where the pages of an SVM range should live when a device or
+ * the CPU touches them. It only deals with locations and counters, and
+ * calls back into a backend through struct svm_migrate_ops to move data,
+ * so it can be exercised without a GPU.
+ *
+ * Locations are SVM_LOC_SYSMEM, SVM_LOC_UNDEFINED or a device index + 1.
+ */
+#define SVM_LOC_SYSMEM		0
+#define SVM_LOC_UNDEFINED	0xffffffff
+
+#define SVM_LOC_FROM_GPU(idx)	((idx) + 1)
+#define SVM_LOC_TO_GPU(loc)	((loc) - 1)
+#define SVM_LOC_IS_GPU(loc)	((loc) != SVM_LOC_SYSMEM && \
+				 (loc) != SVM_LOC_UNDEFINED)
+
+/* Range attributes the policy looks at */
+#define SVM_POLICY_READ_MOSTLY	(1 << 0)
+
+struct svm_policy_attr {
+	uint32_t preferred_loc;
+	uint32_t flags;
+	/* Devices that access the range in place, without migration */
+	unsigned long access_in_place;
+};
+
+/* Per-range policy state, owned by the caller */
+struct svm_policy_state {
+	uint32_t actual_loc;
+	/* Location that touched the range most recently, and how many
+	 * times in a row
+	 */
+	uint32_t last_loc;
+	unsigned int streak;
+	/* Migrations since window_start; a range that migrates more than
+	 * thrash_limit times in a window stays put until the window ends
+	 */
+	unsigned int migrations;
+	uint64_t window_start;
+	bool thrashing;
+};
+
+struct svm_policy_params {
+	/* Consecutive faults from one location before migrating there */
+	unsigned int migrate_threshold;
+	unsigned int thrash_limit;
+	uint64_t thrash_window;
+};
+
+enum svm_policy_event {
+	SVM_POLICY_GPU_FAULT,
+	SVM_POLICY_CPU_FAULT,
+	SVM_POLICY_PREFETCH,
+};
+
+struct svm_migrate_ops {
+	/* Whether @loc can take @npages more pages right now */
+	bool (*can_host)(void *priv, uint32_t loc, uint64_t npages);
+	/* Move the range's pages from @from to @to */
+	int (*migrate)(void *priv, void *range, uint32_t from, uint32_t to);
+};
+
+struct svm_policy_stats {
+	uint64_t faults;
+	uint64_t migrations;
+	uint64_t migrate_failures;
+	uint64_t remote_maps;
+	uint64_t thrash_events;
+};
+
+void svm_policy_state_init(struct svm_policy_state *state);
+
+uint32_t svm_policy_decide(const struct svm_policy_params *params,
+			   const struct svm_policy_attr *attr,
+			   struct svm_policy_state *state,
+			   enum svm_policy_event event, uint32_t loc,
+			   bool write, uint64_t now);
+
+int svm_policy_handle_event(const struct svm_policy_params *params,
+			    const struct svm_policy_attr *attr,
+			    struct svm_policy_state *state,
+			    const struct svm_migrate_ops *ops, void *priv,
+			    void *range, uint64_t npages,
+			    enum svm_policy_event event, uint32_t loc,
+			    bool write, uint64_t now,
+			    struct svm_policy_stats *stats);
+
+extern const struct svm_policy_params svm_policy_default_params;
+
+#endif /* KFD_SVM_POLICY_H_ */
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2019 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Tests for the SVM placement policy against a mock device that keeps
+ * "device memory" in kernel buffers, so they run without a GPU. Read
+ * the svm_policy_test file in the kfd debugfs directory to run them.
+ */
+
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include "kfd_priv.h"
+#include "kfd_svm_policy.h"
+
+#define MOCK_GPUS	2
+#define MOCK_PAGES	4
+#define MOCK_PAGE_SIZE	64
+
+struct svm_mock_dev {
+	uint64_t capacity[MOCK_GPUS];
+	uint64_t used[MOCK_GPUS];
+	unsigned int copies;
+	bool fail_migrate;
+};
+
+struct svm_mock_range {
+	struct svm_policy_attr attr;
+	struct svm_policy_state state;
+	uint8_t *data;
+};
+
+static bool svm_mock_can_host(void *priv, uint32_t loc, uint64_t npages)
+{
+	struct svm_mock_dev *mdev = priv;
+
+	if (!SVM_LOC_IS_GPU(loc))
+		return true;
+	return mdev->used[SVM_LOC_TO_GPU(loc)] + npages <=
+		mdev->capacity[SVM_LOC_TO_GPU(loc)];
+}
+
+static int svm_mock_migrate(void *priv, void *range, uint32_t from,
+			    uint32_t to)
+{
+	struct svm_mock_dev *mdev = priv;
+	struct svm_mock_range *mrange = range;
+	uint8_t *data;
+
+	if (mdev->fail_migrate)
+		return -EIO;
+
+	data = kzalloc(MOCK_PAGES * MOCK_PAGE_SIZE, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
+	if (from != SVM_LOC_UNDEFINED) {
+		memcpy(data, mrange->data, MOCK_PAGES * MOCK_PAGE_SIZE);
+		mdev->copies++;
+	}
+	kfree(mrange->data);
+	mrange->data = data;
+
+	if (SVM_LOC_IS_GPU(from))
+		mdev->used[SVM_LOC_TO_GPU(from)] -= MOCK_PAGES;
+	if (SVM_LOC_IS_GPU(to))
+		mdev->used[SVM_LOC_TO_GPU(to)] += MOCK_PAGES;
+
+	return 0;
+}
+
+static const struct svm_migrate_ops svm_mock_ops = {
+	.can_host = svm_mock_can_host,
+	.migrate = svm_mock_migrate,
+};
+
+static const struct svm_policy_params svm_test_params = {
+	.migrate_threshold = 2,
+	.thrash_limit = 3,
+	.thrash_window = 100,
+};
+
+struct svm_test_ctx {
+	struct svm_mock_dev mdev;
+	struct svm_mock_range range;
+	struct svm_policy_stats stats;
+	uint64_t now;
+};
+
+#define GPU0	SVM_LOC_FROM_GPU(0)
+#define GPU1	SVM_LOC_FROM_GPU(1)
+
+static void svm_test_init(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->mdev.capacity[0] = MOCK_PAGES * 4;
+	ctx->mdev.capacity[1] = MOCK_PAGES * 4;
+	ctx->range.attr.preferred_loc = SVM_LOC_UNDEFINED;
+	svm_policy_state_init(&ctx->range.state);
+}
+
+static void svm_test_fini(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	kfree(ctx->range.data);
+}
+
+static int svm_test_event(struct svm_test_ctx *ctx,
+			  enum svm_policy_event event, uint32_t loc,
+			  bool write)
+{
+	return svm_policy_handle_event(&svm_test_params, &ctx->range.attr,
+				       &ctx->range.state, &svm_mock_ops,
+				       &ctx->mdev, &ctx->range, MOCK_PAGES,
+				       event, loc, write, ctx->now++,
+				       &ctx->stats);
+}
+
+#define svm_test_gpu_fault(ctx, loc, write) \
+	svm_test_event(ctx, SVM_POLICY_GPU_FAULT, loc, write)
+#define svm_test_cpu_fault(ctx) \
+	svm_test_event(ctx, SVM_POLICY_CPU_FAULT, SVM_LOC_SYSMEM, true)
+#define svm_test_loc(ctx) ((ctx)->range.state.actual_loc)
+
+static bool svm_test_first_touch(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	return !svm_test_gpu_fault(ctx, GPU0, false) &&
+		svm_test_loc(ctx) == GPU0 && ctx->mdev.used[0] == MOCK_PAGES &&
+		!ctx->mdev.copies;
+}
+
+static bool svm_test_first_touch_preferred(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	ctx->range.attr.preferred_loc = GPU1;
+	return !svm_test_gpu_fault(ctx, GPU0, false) &&
+		svm_test_loc(ctx) == GPU1 && ctx->stats.remote_maps == 1;
+}
+
+static bool svm_test_threshold(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	svm_test_cpu_fault(ctx);
+	memset(ctx->range.data, 0x5a, MOCK_PAGES * MOCK_PAGE_SIZE);
+
+	if (svm_test_gpu_fault(ctx, GPU0, true) ||
+	    svm_test_loc(ctx) != SVM_LOC_SYSMEM)
+		return false;
+	if (svm_test_gpu_fault(ctx, GPU0, true) || svm_test_loc(ctx) != GPU0)
+		return false;
+
+	return ctx->mdev.copies == 1 && ctx->range.data[0] == 0x5a &&
+		ctx->range.data[MOCK_PAGES * MOCK_PAGE_SIZE - 1] == 0x5a;
+}
+
+static bool svm_test_read_mostly(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	ctx->range.attr.flags = SVM_POLICY_READ_MOSTLY;
+	svm_test_cpu_fault(ctx);
+
+	svm_test_gpu_fault(ctx, GPU0, false);
+	svm_test_gpu_fault(ctx, GPU0, false);
+	svm_test_gpu_fault(ctx, GPU0, false);
+	if (svm_test_loc(ctx) != SVM_LOC_SYSMEM)
+		return false;
+
+	svm_test_gpu_fault(ctx, GPU0, true);
+	return svm_test_loc(ctx) == GPU0;
+}
+
+static bool svm_test_access_in_place(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	ctx->range.attr.access_in_place = BIT(1);
+	svm_test_gpu_fault(ctx, GPU0, true);
+
+	svm_test_gpu_fault(ctx, GPU1, true);
+	svm_test_gpu_fault(ctx, GPU1, true);
+	svm_test_gpu_fault(ctx, GPU1, true);
+
+	return svm_test_loc(ctx) == GPU0 && ctx->stats.remote_maps == 3;
+}
+
+static bool svm_test_stay_preferred(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	ctx->range.attr.preferred_loc = GPU0;
+	svm_test_gpu_fault(ctx, GPU0, true);
+
+	svm_test_gpu_fault(ctx, GPU1, true);
+	svm_test_gpu_fault(ctx, GPU1, true);
+	svm_test_gpu_fault(ctx, GPU1, true);
+
+	return svm_test_loc(ctx) == GPU0;
+}
+
+static bool svm_test_cpu_fault_migrates_back(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	svm_test_gpu_fault(ctx, GPU0, true);
+	svm_test_cpu_fault(ctx);
+
+	return svm_test_loc(ctx) == SVM_LOC_SYSMEM && !ctx->mdev.used[0];
+}
+
+static bool svm_test_capacity_fallback(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	ctx->mdev.capacity[0] = MOCK_PAGES - 1;
+
+	return !svm_test_gpu_fault(ctx, GPU0, true) &&
+		svm_test_loc(ctx) == SVM_LOC_SYSMEM &&
+		ctx->stats.remote_maps == 1;
+}
+
+static bool svm_test_prefetch(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	ctx->range.attr.preferred_loc = GPU0;
+	svm_test_gpu_fault(ctx, GPU0, true);
+
+	return !svm_test_event(ctx, SVM_POLICY_PREFETCH, GPU1, false) &&
+		svm_test_loc(ctx) == GPU1 && !ctx->mdev.used[0] &&
+		ctx->mdev.used[1] == MOCK_PAGES;
+}
+
+static bool svm_test_thrashing(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+	unsigned int i;
+
+	svm_test_cpu_fault(ctx);
+	for (i = 0; i < 4; i++) {
+		svm_test_gpu_fault(ctx, GPU0, true);
+		svm_test_gpu_fault(ctx, GPU0, true);
+		svm_test_cpu_fault(ctx);
+	}
+	if (!ctx->range.state.thrashing || ctx->stats.thrash_events != 1)
+		return false;
+
+	/* Thrashing ranges stay in system memory for the rest of the window */
+	svm_test_gpu_fault(ctx, GPU0, true);
+	svm_test_gpu_fault(ctx, GPU0, true);
+	if (svm_test_loc(ctx) != SVM_LOC_SYSMEM)
+		return false;
+
+	ctx->now += svm_test_params.thrash_window;
+	svm_test_gpu_fault(ctx, GPU0, true);
+	svm_test_gpu_fault(ctx, GPU0, true);
+	return svm_test_loc(ctx) == GPU0 && !ctx->range.state.thrashing;
+}
+
+static bool svm_test_migrate_failure(void *data)
+{
+	struct svm_test_ctx *ctx = data;
+
+	svm_test_cpu_fault(ctx);
+	ctx->mdev.fail_migrate = true;
+
+	svm_test_gpu_fault(ctx, GPU0, true);
+	return svm_test_gpu_fault(ctx, GPU0, true) == -EIO &&
+		svm_test_loc(ctx) == SVM_LOC_SYSMEM &&
+		ctx->stats.migrate_failures == 1;
+}
+
+static const struct kfd_test svm_policy_tests[] = {
+	{ "first_touch", svm_test_first_touch },
+	{ "first_touch_preferred", svm_test_first_touch_preferred },
+	{ "threshold", svm_test_threshold },
+	{ "read_mostly", svm_test_read_mostly },
+	{ "access_in_place", svm_test_access_in_place },
+	{ "stay_preferred", svm_test_stay_preferred },
+	{ "cpu_fault_migrates_back", svm_test_cpu_fault_migrates_back },
+	{ "capacity_fallback", svm_test_capacity_fallback },
+	{ "prefetch", svm_test_prefetch },
+	{ "thrashing", svm_test_thrashing },
+	{ "migrate_failure", svm_test_migrate_failure },
+};
+
+static const struct kfd_test_suite svm_policy_test_suite = {
+	.tests = svm_policy_tests,
+	.num_tests = ARRAY_SIZE(svm_policy_tests),
+	.ctx_size = sizeof(struct svm_test_ctx),
+	.init = svm_test_init,
+	.fini = svm_test_fini,
+};
+
+int kfd_debugfs_svm_policy_test(struct seq_file *m, void *data)
+{
+	return kfd_debugfs_run_tests(m, &svm_policy_test_suite);
+}
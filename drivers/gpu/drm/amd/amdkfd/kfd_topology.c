@@ -30,12 +30,15 @@
 #include <linux/log2.h>
 #include <linux/dmi.h>
 #include <linux/atomic.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 
 #include "kfd_priv.h"
 #include "kfd_crat.h"
 #include "kfd_topology.h"
 #include "kfd_device_queue_manager.h"
 #include "kfd_iommu.h"
+#include "kfd_peer_route.h"
 #include "amdgpu_amdkfd.h"
 
 /* topology_device_list - Master list of all topology devices */
@@ -431,14 +434,52 @@ static struct kfd_perf_attr perf_attr_iommu[] = {
 /****************************************/
 #endif
 
+static uint32_t kfd_topology_gpu_capability(struct kfd_topology_device *dev)
+{
+	uint32_t capability = dev->node_props.capability;
+	uint32_t log_max_watch_addr;
+
+	log_max_watch_addr =
+		__ilog2_u32(dev->gpu->device_info->num_of_watch_points);
+
+	if (log_max_watch_addr) {
+		capability |= HSA_CAP_WATCH_POINTS_SUPPORTED;
+
+		capability |= ((log_max_watch_addr <<
+				HSA_CAP_WATCH_POINTS_TOTALBITS_SHIFT) &
+			       HSA_CAP_WATCH_POINTS_TOTALBITS_MASK);
+	}
+
+	if (dev->gpu->device_info->asic_family == CHIP_TONGA)
+		capability |= HSA_CAP_AQL_QUEUE_DOUBLE_MAP;
+
+	return capability;
+}
+
+static uint64_t kfd_topology_gpu_local_mem_size(struct kfd_topology_device *dev)
+{
+	struct kfd_local_mem_info local_mem_info;
+
+	/*
+	 * If the ASIC is APU except Kaveri, set local memory size
+	 * to 0 to disable local memory support
+	 */
+	if (dev->gpu->device_info->needs_iommu_device &&
+	    dev->gpu->device_info->asic_family != CHIP_KAVERI)
+		return 0;
+
+	amdgpu_amdkfd_get_local_mem_info(dev->gpu->kgd, &local_mem_info);
+
+	return local_mem_info.local_mem_size_private +
+		local_mem_info.local_mem_size_public;
+}
+
 static ssize_t node_show(struct kobject *kobj, struct attribute *attr,
 		char *buffer)
 {
 	struct kfd_topology_device *dev;
 	char public_name[KFD_TOPOLOGY_PUBLIC_NAME_SIZE];
 	uint32_t i;
-	uint32_t log_max_watch_addr;
-	struct kfd_local_mem_info local_mem_info;
 
 	/* Making sure that the buffer is an empty string */
 	buffer[0] = 0;
@@ -514,44 +555,15 @@ static ssize_t node_show(struct kobject *kobj, struct attribute *attr,
 			dev->node_props.hive_id);
 
 	if (dev->gpu) {
-		log_max_watch_addr =
-			__ilog2_u32(dev->gpu->device_info->num_of_watch_points);
-
-		if (log_max_watch_addr) {
-			dev->node_props.capability |=
-					HSA_CAP_WATCH_POINTS_SUPPORTED;
-
-			dev->node_props.capability |=
-				((log_max_watch_addr <<
-					HSA_CAP_WATCH_POINTS_TOTALBITS_SHIFT) &
-				HSA_CAP_WATCH_POINTS_TOTALBITS_MASK);
-		}
-
-		if (dev->gpu->device_info->asic_family == CHIP_TONGA)
-			dev->node_props.capability |=
-					HSA_CAP_AQL_QUEUE_DOUBLE_MAP;
-
 		sysfs_show_32bit_prop(buffer, "max_engine_clk_fcompute",
 			dev->node_props.max_engine_clk_fcompute);
-
-		/*
-		 * If the ASIC is APU except Kaveri, set local memory size
-		 * to 0 to disable local memory support
-		 */
-		if (!dev->gpu->device_info->needs_iommu_device
-			|| dev->gpu->device_info->asic_family == CHIP_KAVERI) {
-			amdgpu_amdkfd_get_local_mem_info(dev->gpu->kgd,
-				&local_mem_info);
-			sysfs_show_64bit_prop(buffer, "local_mem_size",
-					local_mem_info.local_mem_size_private +
-					local_mem_info.local_mem_size_public);
-		} else
-			sysfs_show_64bit_prop(buffer, "local_mem_size", 0ULL);
+		sysfs_show_64bit_prop(buffer, "local_mem_size",
+				kfd_topology_gpu_local_mem_size(dev));
 
 		sysfs_show_32bit_prop(buffer, "fw_version",
 				dev->gpu->mec_fw_version);
 		sysfs_show_32bit_prop(buffer, "capability",
-				dev->node_props.capability);
+				kfd_topology_gpu_capability(dev));
 		sysfs_show_64bit_prop(buffer, "debug_prop",
 				dev->node_props.debug_prop);
 		sysfs_show_32bit_prop(buffer, "sdma_fw_version",
@@ -1109,10 +1121,11 @@ int kfd_topology_init(void)
 					&topology_device_list);
 	atomic_set(&topology_crat_proximity_domain, sys_props.num_devices-1);
 	ret = kfd_topology_update_sysfs();
+	if (!ret)
+		sys_props.generation_count++;
 	up_write(&topology_lock);
 
 	if (!ret) {
-		sys_props.generation_count++;
 		kfd_update_system_properties();
 		kfd_debug_print_topology();
 		pr_info("Finished initializing topology\n");
@@ -1335,11 +1348,11 @@ int kfd_topology_add_device(struct kfd_dev *gpu)
 		 * device
 		 */
 		res = kfd_topology_update_sysfs();
-		up_write(&topology_lock);
-
 		if (!res)
 			sys_props.generation_count++;
-		else
+		up_write(&topology_lock);
+
+		if (res)
 			pr_err("Failed to update GPU (ID: 0x%x) to sysfs topology. res=%d\n",
 						gpu_id, res);
 		dev = kfd_assign_gpu(gpu);
@@ -1453,6 +1466,7 @@ int kfd_topology_remove_device(struct kfd_dev *gpu)
 			kfd_remove_sysfs_node_entry(dev);
 			kfd_release_topology_device(dev);
 			sys_props.num_devices--;
+			sys_props.generation_count++;
 			res = 0;
 			if (kfd_topology_update_sysfs() < 0)
 				kfd_topology_release_sysfs();
@@ -1467,6 +1481,203 @@ int kfd_topology_remove_device(struct kfd_dev *gpu)
 	return res;
 }
 
+/* Called with topology_lock held */
+static uint32_t kfd_topology_blob_size(void)
+{
+	struct kfd_topology_device *dev;
+	struct kfd_mem_properties *mem;
+	struct kfd_cache_properties *cache;
+	struct kfd_iolink_properties *iolink;
+	uint32_t size = sizeof(struct kfd_topology_blob_header);
+
+	list_for_each_entry(dev, &topology_device_list, list) {
+		size += sizeof(struct kfd_topology_blob_node);
+		if (dev->gpu && kfd_devcgroup_check_permission(dev->gpu))
+			continue;
+		list_for_each_entry(mem, &dev->mem_props, list)
+			size += sizeof(struct kfd_topology_blob_mem);
+		list_for_each_entry(cache, &dev->cache_props, list)
+			size += sizeof(struct kfd_topology_blob_cache);
+		list_for_each_entry(iolink, &dev->io_link_props, list)
+			size += sizeof(struct kfd_topology_blob_iolink);
+	}
+
+	return size;
+}
+
+/* Called with topology_lock held, returns the first byte after the node */
+static void *kfd_topology_fill_blob_node(struct kfd_topology_device *dev,
+					 void *ptr)
+{
+	struct kfd_topology_blob_node *node = ptr;
+	struct kfd_mem_properties *mem;
+	struct kfd_cache_properties *cache;
+	struct kfd_iolink_properties *iolink;
+	uint32_t i;
+
+	ptr += sizeof(*node);
+	node->gpu_id = dev->gpu_id;
+	if (dev->gpu && kfd_devcgroup_check_permission(dev->gpu)) {
+		node->flags = KFD_TOPOLOGY_BLOB_NODE_NO_ACCESS;
+		return ptr;
+	}
+
+	node->cpu_cores_count = dev->node_props.cpu_cores_count;
+	node->simd_count = dev->node_props.simd_count;
+	node->mem_banks_count = dev->node_props.mem_banks_count;
+	node->caches_count = dev->node_props.caches_count;
+	node->io_links_count = dev->node_props.io_links_count;
+	node->cpu_core_id_base = dev->node_props.cpu_core_id_base;
+	node->simd_id_base = dev->node_props.simd_id_base;
+	node->max_waves_per_simd = dev->node_props.max_waves_per_simd;
+	node->lds_size_in_kb = dev->node_props.lds_size_in_kb;
+	node->gds_size_in_kb = dev->node_props.gds_size_in_kb;
+	node->wave_front_size = dev->node_props.wave_front_size;
+	node->array_count = dev->node_props.array_count;
+	node->simd_arrays_per_engine = dev->node_props.simd_arrays_per_engine;
+	node->cu_per_simd_array = dev->node_props.cu_per_simd_array;
+	node->simd_per_cu = dev->node_props.simd_per_cu;
+	node->max_slots_scratch_cu = dev->node_props.max_slots_scratch_cu;
+	node->vendor_id = dev->node_props.vendor_id;
+	node->device_id = dev->node_props.device_id;
+	node->location_id = dev->node_props.location_id;
+	node->drm_render_minor = dev->node_props.drm_render_minor;
+	node->hive_id = dev->node_props.hive_id;
+	node->max_engine_clk_ccompute = cpufreq_quick_get_max(0) / 1000;
+	if (dev->gpu) {
+		node->max_engine_clk_fcompute =
+			dev->node_props.max_engine_clk_fcompute;
+		node->local_mem_size = kfd_topology_gpu_local_mem_size(dev);
+		node->fw_version = dev->gpu->mec_fw_version;
+		node->capability = kfd_topology_gpu_capability(dev);
+		node->debug_prop = dev->node_props.debug_prop;
+		node->sdma_fw_version = dev->gpu->sdma_fw_version;
+	}
+	for (i = 0; i < KFD_TOPOLOGY_BLOB_NAME_SIZE - 1; i++) {
+		node->name[i] = (char)dev->node_props.marketing_name[i];
+		if (!dev->node_props.marketing_name[i])
+			break;
+	}
+
+	list_for_each_entry(mem, &dev->mem_props, list) {
+		struct kfd_topology_blob_mem *m = ptr;
+
+		m->heap_type = mem->heap_type;
+		m->flags = mem->flags;
+		m->size_in_bytes = mem->size_in_bytes;
+		m->width = mem->width;
+		m->mem_clk_max = mem->mem_clk_max;
+		node->num_mem_banks++;
+		ptr += sizeof(*m);
+	}
+
+	list_for_each_entry(cache, &dev->cache_props, list) {
+		struct kfd_topology_blob_cache *c = ptr;
+
+		c->processor_id_low = cache->processor_id_low;
+		c->level = cache->cache_level;
+		c->size = cache->cache_size;
+		c->cache_line_size = cache->cacheline_size;
+		c->cache_lines_per_tag = cache->cachelines_per_tag;
+		c->association = cache->cache_assoc;
+		c->latency = cache->cache_latency;
+		c->type = cache->cache_type;
+		memcpy(c->sibling_map, cache->sibling_map,
+		       sizeof(c->sibling_map));
+		node->num_caches++;
+		ptr += sizeof(*c);
+	}
+
+	list_for_each_entry(iolink, &dev->io_link_props, list) {
+		struct kfd_topology_blob_iolink *l = ptr;
+
+		l->type = iolink->iolink_type;
+		l->version_major = iolink->ver_maj;
+		l->version_minor = iolink->ver_min;
+		l->node_from = iolink->node_from;
+		l->node_to = iolink->node_to;
+		l->weight = iolink->weight;
+		l->min_latency = iolink->min_latency;
+		l->max_latency = iolink->max_latency;
+		l->min_bandwidth = iolink->min_bandwidth;
+		l->max_bandwidth = iolink->max_bandwidth;
+		l->recommended_transfer_size = iolink->rec_transfer_size;
+		l->flags = iolink->flags;
+		node->num_io_links++;
+		ptr += sizeof(*l);
+	}
+
+	return ptr;
+}
+
+/* kfd_topology_get_blob - Copy a consistent snapshot of the whole topology
+ *	to user mode in the packed format of struct kfd_topology_blob_header
+ *	@buf: user buffer, may be NULL if *size is 0
+ *	@size: in: size of @buf, out: size of the blob
+ *	@generation: out: topology generation the blob was taken from
+ */
+int kfd_topology_get_blob(void __user *buf, uint32_t *size,
+			  uint32_t *generation)
+{
+	struct kfd_topology_blob_header *header;
+	struct kfd_topology_device *dev;
+	uint32_t blob_size;
+	void *blob, *ptr;
+	int ret = 0;
+
+	BUILD_BUG_ON(KFD_TOPOLOGY_BLOB_SIBLINGMAP_SIZE != CRAT_SIBLINGMAP_SIZE);
+
+	down_read(&topology_lock);
+
+	blob_size = kfd_topology_blob_size();
+	*generation = sys_props.generation_count;
+	if (!*size)
+		goto out_size;
+	if (*size < blob_size) {
+		ret = -ENOSPC;
+		goto out_size;
+	}
+
+	blob = vzalloc(blob_size);
+	if (!blob) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	header = blob;
+	header->version = KFD_TOPOLOGY_BLOB_VERSION;
+	header->size = blob_size;
+	header->generation_id = sys_props.generation_count;
+	header->num_nodes = sys_props.num_devices;
+	header->platform_oem = sys_props.platform_oem;
+	header->platform_id = sys_props.platform_id;
+	header->platform_rev = sys_props.platform_rev;
+	header->header_size = sizeof(*header);
+	header->node_size = sizeof(struct kfd_topology_blob_node);
+	header->mem_size = sizeof(struct kfd_topology_blob_mem);
+	header->cache_size = sizeof(struct kfd_topology_blob_cache);
+	header->iolink_size = sizeof(struct kfd_topology_blob_iolink);
+
+	ptr = blob + sizeof(*header);
+	list_for_each_entry(dev, &topology_device_list, list)
+		ptr = kfd_topology_fill_blob_node(dev, ptr);
+
+	up_read(&topology_lock);
+
+	WARN_ON(ptr != blob + blob_size);
+	if (copy_to_user(buf, blob, blob_size))
+		ret = -EFAULT;
+	vfree(blob);
+	*size = blob_size;
+	return ret;
+
+out_size:
+	*size = blob_size;
+out_unlock:
+	up_read(&topology_lock);
+	return ret;
+}
+
 /* kfd_topology_enum_kfd_devices - Enumerate through all devices in KFD
  *	topology. If GPU device is found @idx, then valid kfd_dev pointer is
  *	returned through @kdev
@@ -1498,6 +1709,65 @@ int kfd_topology_enum_kfd_devices(uint8_t idx, struct kfd_dev **kdev)
 
 }
 
+/* Called with topology_lock held */
+static void kfd_topology_route_graph(struct kfd_route_graph *g)
+{
+	struct kfd_topology_device *dev;
+	struct kfd_iolink_properties *iolink;
+
+	kfd_route_graph_init(g);
+	list_for_each_entry(dev, &topology_device_list, list) {
+		if (kfd_route_graph_add_node(g, dev->proximity_domain,
+					     dev->gpu))
+			continue;
+		list_for_each_entry(iolink, &dev->io_link_props, list)
+			kfd_route_graph_add_link(g, iolink->node_from,
+						 iolink->node_to,
+						 iolink->iolink_type,
+						 iolink->weight);
+	}
+}
+
+/* Called with topology_lock held */
+static int kfd_topology_proximity_domain(struct kfd_dev *gpu)
+{
+	struct kfd_topology_device *dev;
+
+	list_for_each_entry(dev, &topology_device_list, list)
+		if (dev->gpu == gpu)
+			return dev->proximity_domain;
+
+	return -ENODEV;
+}
+
+/* kfd_topology_get_peer_route - cheapest route for copying from the VRAM
+ *	of @from to the VRAM of @to, based on the iolinks of the topology
+ */
+int kfd_topology_get_peer_route(struct kfd_dev *from, struct kfd_dev *to,
+				struct kfd_peer_route *route)
+{
+	struct kfd_route_graph *g;
+	int from_pd, to_pd, ret;
+
+	g = kmalloc(sizeof(*g), GFP_KERNEL);
+	if (!g)
+		return -ENOMEM;
+
+	down_read(&topology_lock);
+	from_pd = kfd_topology_proximity_domain(from);
+	to_pd = kfd_topology_proximity_domain(to);
+	kfd_topology_route_graph(g);
+	up_read(&topology_lock);
+
+	if (from_pd < 0 || to_pd < 0)
+		ret = -ENODEV;
+	else
+		ret = kfd_route_find(g, from_pd, to_pd, route);
+
+	kfree(g);
+	return ret;
+}
+
 static int kfd_cpumask_to_apic_id(const struct cpumask *cpumask)
 {
 	int first_cpu_of_numa_node;
@@ -1579,4 +1849,45 @@ int kfd_debugfs_rls_by_device(struct seq_file *m, void *data)
 	return r;
 }
 
+int kfd_debugfs_peer_routes(struct seq_file *m, void *data)
+{
+	struct kfd_topology_device *from, *to;
+	struct kfd_route_graph *g;
+	struct kfd_peer_route route;
+	unsigned int h;
+
+	g = kmalloc(sizeof(*g), GFP_KERNEL);
+	if (!g)
+		return -ENOMEM;
+
+	down_read(&topology_lock);
+	kfd_topology_route_graph(g);
+
+	list_for_each_entry(from, &topology_device_list, list) {
+		if (!from->gpu)
+			continue;
+		list_for_each_entry(to, &topology_device_list, list) {
+			if (!to->gpu || to == from)
+				continue;
+			if (kfd_route_find(g, from->proximity_domain,
+					   to->proximity_domain, &route))
+				continue;
+
+			seq_printf(m, "gpu_id %x -> gpu_id %x: %s weight %u links %u engines %x path",
+				   from->gpu->id, to->gpu->id,
+				   kfd_route_type_name(route.type),
+				   route.weight, route.num_links,
+				   route.engines);
+			for (h = 0; h <= route.hops; h++)
+				seq_printf(m, " %u", route.path[h]);
+			seq_puts(m, "\n");
+		}
+	}
+
+	up_read(&topology_lock);
+	kfree(g);
+
+	return 0;
+}
+
 #endif
@@ -72,10 +72,12 @@
  *
  * drm_mm maintains a stack of most recently freed holes, which of all
  * simplistic datastructures seems to be a fairly decent approach to clustering
- * allocations and avoiding too much fragmentation. This means free space
- * searches are O(num_holes). Given that all the fancy features drm_mm supports
- * something better would be fairly complex and since gfx thrashing is a fairly
- * steep cliff not a real concern. Removing a node again is O(1).
+ * allocations and avoiding too much fragmentation. Holes are additionally
+ * indexed by size and by address. The address index tracks the largest hole
+ * in each subtree, so bottom-up and top-down searches skip over runs of holes
+ * that are too small and stay logarithmic even when the range is heavily
+ * fragmented. Only the eviction mode still walks the hole stack, making it
+ * O(num_holes). Removing a node is O(log num_holes).
  *
  * drm_mm supports a few features: Alignment and range restrictions can be
  * supplied. Furthermore every &drm_mm_node has a color value (which is just an
@@ -239,16 +241,74 @@ static void drm_mm_interval_tree_add_node(struct drm_mm_node *hole_node,
 #define HOLE_SIZE(NODE) ((NODE)->hole_size)
 #define HOLE_ADDR(NODE) (__drm_mm_hole_node_start(NODE))
 
+static inline struct drm_mm_node *rb_hole_size_to_node(struct rb_node *rb)
+{
+	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_size);
+}
+
+static inline struct drm_mm_node *rb_hole_addr_to_node(struct rb_node *rb)
+{
+	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_addr);
+}
+
+/*
+ * The address ordered hole tree is augmented with the largest hole in each
+ * subtree. This lets the bottom-up and top-down searches skip over whole
+ * subtrees of holes that are too small for the request, keeping them
+ * logarithmic even when the address space is heavily fragmented.
+ */
+static inline u64 hole_addr_compute_max(struct drm_mm_node *node)
+{
+	struct drm_mm_node *child;
+	u64 max = node->hole_size;
+
+	child = rb_hole_addr_to_node(node->rb_hole_addr.rb_left);
+	if (child && child->subtree_max_hole > max)
+		max = child->subtree_max_hole;
+
+	child = rb_hole_addr_to_node(node->rb_hole_addr.rb_right);
+	if (child && child->subtree_max_hole > max)
+		max = child->subtree_max_hole;
+
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, hole_addr_augment,
+		     struct drm_mm_node, rb_hole_addr,
+		     u64, subtree_max_hole, hole_addr_compute_max)
+
+static void insert_hole_addr(struct rb_root *root, struct drm_mm_node *node)
+{
+	struct rb_node **link = &root->rb_node, *rb = NULL;
+	u64 start = HOLE_ADDR(node), max = node->subtree_max_hole;
+	struct drm_mm_node *parent;
+
+	while (*link) {
+		rb = *link;
+		parent = rb_hole_addr_to_node(rb);
+		if (parent->subtree_max_hole < max)
+			parent->subtree_max_hole = max;
+		if (start < HOLE_ADDR(parent))
+			link = &parent->rb_hole_addr.rb_left;
+		else
+			link = &parent->rb_hole_addr.rb_right;
+	}
+
+	rb_link_node(&node->rb_hole_addr, rb, link);
+	rb_insert_augmented(&node->rb_hole_addr, root, &hole_addr_augment);
+}
+
 static void add_hole(struct drm_mm_node *node)
 {
 	struct drm_mm *mm = node->mm;
 
 	node->hole_size =
 		__drm_mm_hole_node_end(node) - __drm_mm_hole_node_start(node);
+	node->subtree_max_hole = node->hole_size;
 	DRM_MM_BUG_ON(!drm_mm_hole_follows(node));
 
 	RB_INSERT(mm->holes_size, rb_hole_size, HOLE_SIZE);
-	RB_INSERT(mm->holes_addr, rb_hole_addr, HOLE_ADDR);
+	insert_hole_addr(&mm->holes_addr, node);
 
 	list_add(&node->hole_stack, &mm->hole_stack);
 }
@@ -259,20 +319,17 @@ static void rm_hole(struct drm_mm_node *node)
 
 	list_del(&node->hole_stack);
 	rb_erase(&node->rb_hole_size, &node->mm->holes_size);
-	rb_erase(&node->rb_hole_addr, &node->mm->holes_addr);
+	rb_erase_augmented(&node->rb_hole_addr, &node->mm->holes_addr,
+			   &hole_addr_augment);
 	node->hole_size = 0;
+	node->subtree_max_hole = 0;
 
 	DRM_MM_BUG_ON(drm_mm_hole_follows(node));
 }
 
-static inline struct drm_mm_node *rb_hole_size_to_node(struct rb_node *rb)
-{
-	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_size);
-}
-
-static inline struct drm_mm_node *rb_hole_addr_to_node(struct rb_node *rb)
+static inline bool usable_hole_addr(struct rb_node *rb, u64 size)
 {
-	return rb_entry_safe(rb, struct drm_mm_node, rb_hole_addr);
+	return rb && rb_hole_addr_to_node(rb)->subtree_max_hole >= size;
 }
 
 static inline u64 rb_hole_size(struct rb_node *rb)
@@ -299,21 +356,26 @@ static struct drm_mm_node *best_hole(struct drm_mm *mm, u64 size)
 	return rb_hole_size_to_node(best);
 }
 
-static struct drm_mm_node *find_hole(struct drm_mm *mm, u64 addr)
+static struct drm_mm_node *find_hole_addr(struct drm_mm *mm, u64 addr,
+					  u64 size)
 {
 	struct drm_mm_node *node = NULL;
-	struct rb_node **link = &mm->holes_addr.rb_node;
+	struct rb_node *rb = mm->holes_addr.rb_node;
 
-	while (*link) {
+	while (rb) {
 		u64 hole_start;
 
-		node = rb_hole_addr_to_node(*link);
+		/* Nothing below here can satisfy the request */
+		if (!usable_hole_addr(rb, size))
+			break;
+
+		node = rb_hole_addr_to_node(rb);
 		hole_start = __drm_mm_hole_node_start(node);
 
 		if (addr < hole_start)
-			link = &node->rb_hole_addr.rb_left;
+			rb = node->rb_hole_addr.rb_left;
 		else if (addr > hole_start + node->hole_size)
-			link = &node->rb_hole_addr.rb_right;
+			rb = node->rb_hole_addr.rb_right;
 		else
 			break;
 	}
@@ -321,6 +383,37 @@ static struct drm_mm_node *find_hole(struct drm_mm *mm, u64 addr)
 	return node;
 }
 
+static struct drm_mm_node *find_hole(struct drm_mm *mm, u64 addr)
+{
+	return find_hole_addr(mm, addr, 0);
+}
+
+/*
+ * In-order successor (or predecessor for top-down) in the address tree,
+ * skipping subtrees whose largest hole is smaller than @size. The returned
+ * hole itself may still be too small, the caller checks each candidate.
+ */
+#define DECLARE_NEXT_HOLE_ADDR(name, first, last)			\
+static struct drm_mm_node *name(struct drm_mm_node *entry, u64 size)	\
+{									\
+	struct rb_node *parent, *rb = &entry->rb_hole_addr;		\
+									\
+	if (usable_hole_addr(rb->first, size)) {			\
+		rb = rb->first;						\
+		while (usable_hole_addr(rb->last, size))		\
+			rb = rb->last;					\
+		return rb_hole_addr_to_node(rb);			\
+	}								\
+									\
+	while ((parent = rb_parent(rb)) && rb == parent->first)		\
+		rb = parent;						\
+									\
+	return rb_hole_addr_to_node(parent);				\
+}
+
+DECLARE_NEXT_HOLE_ADDR(next_hole_low_addr, rb_right, rb_left)
+DECLARE_NEXT_HOLE_ADDR(next_hole_high_addr, rb_left, rb_right)
+
 static struct drm_mm_node *
 first_hole(struct drm_mm *mm,
 	   u64 start, u64 end, u64 size,
@@ -335,10 +428,10 @@ first_hole(struct drm_mm *mm,
 		return best_hole(mm, size);
 
 	case DRM_MM_INSERT_LOW:
-		return find_hole(mm, start);
+		return find_hole_addr(mm, start, size);
 
 	case DRM_MM_INSERT_HIGH:
-		return find_hole(mm, end);
+		return find_hole_addr(mm, end, size);
 
 	case DRM_MM_INSERT_EVICT:
 		return list_first_entry_or_null(&mm->hole_stack,
@@ -350,6 +443,7 @@ first_hole(struct drm_mm *mm,
 static struct drm_mm_node *
 next_hole(struct drm_mm *mm,
 	  struct drm_mm_node *node,
+	  u64 size,
 	  enum drm_mm_insert_mode mode)
 {
 	switch (mode) {
@@ -358,10 +452,10 @@ next_hole(struct drm_mm *mm,
 		return rb_hole_size_to_node(rb_next(&node->rb_hole_size));
 
 	case DRM_MM_INSERT_LOW:
-		return rb_hole_addr_to_node(rb_next(&node->rb_hole_addr));
+		return next_hole_low_addr(node, size);
 
 	case DRM_MM_INSERT_HIGH:
-		return rb_hole_addr_to_node(rb_prev(&node->rb_hole_addr));
+		return next_hole_high_addr(node, size);
 
 	case DRM_MM_INSERT_EVICT:
 		node = list_next_entry(node, hole_stack);
@@ -462,7 +556,7 @@ int drm_mm_insert_node_in_range(struct drm_mm * const mm,
 
 	remainder_mask = is_power_of_2(alignment) ? alignment - 1 : 0;
 	for (hole = first_hole(mm, range_start, range_end, size, mode); hole;
-	     hole = next_hole(mm, hole, mode)) {
+	     hole = next_hole(mm, hole, size, mode)) {
 		u64 hole_start = __drm_mm_hole_node_start(hole);
 		u64 hole_end = hole_start + hole->hole_size;
 		u64 adj_start, adj_end;
@@ -41,6 +41,12 @@
  *
  * Their primary use-case is to implement Vulkan fences and semaphores.
  *
+ * A syncobj can also be used as a timeline. Each signal operation then adds
+ * a new 64bit point to a &dma_fence_chain instead of replacing the fence, and
+ * waiters can ask for any point on the timeline, including points which have
+ * not been submitted yet when the wait starts. Binary users simply use point
+ * 0, which always refers to the last fence added.
+ *
  * syncobj have a kref reference count, but also have an optional file.
  * The file is only created once the syncobj is exported.
  * The file takes a reference on the kref.
@@ -56,6 +62,20 @@
 #include "drm_internal.h"
 #include <drm/drm_syncobj.h>
 
+/* Upper bound for waiting on a point to be submitted in drm_syncobj_find_fence */
+#define DRM_SYNCOBJ_WAIT_FOR_SUBMIT_TIMEOUT 5000000000ULL /* 5s */
+
+struct syncobj_wait_entry {
+	struct task_struct *task;
+	struct dma_fence *fence;
+	struct dma_fence_cb fence_cb;
+	struct drm_syncobj_cb syncobj_cb;
+	u64 point;
+};
+
+static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
+				      struct drm_syncobj_cb *cb);
+
 /**
  * drm_syncobj_find - lookup and reference a sync object.
  * @file_private: drm file private pointer
@@ -90,34 +110,41 @@ static void drm_syncobj_add_callback_locked(struct drm_syncobj *syncobj,
 	list_add_tail(&cb->node, &syncobj->cb_list);
 }
 
-static int drm_syncobj_fence_get_or_add_callback(struct drm_syncobj *syncobj,
-						 struct dma_fence **fence,
-						 struct drm_syncobj_cb *cb,
-						 drm_syncobj_func_t func)
+/* Called with the syncobj lock held, returns false if wait->point has not
+ * been submitted yet.
+ */
+static bool syncobj_wait_entry_get_fence(struct drm_syncobj *syncobj,
+					 struct syncobj_wait_entry *wait)
 {
-	int ret;
+	struct dma_fence *fence;
 
-	*fence = drm_syncobj_fence_get(syncobj);
-	if (*fence)
-		return 1;
+	fence = dma_fence_get(rcu_dereference_protected(syncobj->fence,
+							lockdep_is_held(&syncobj->lock)));
+	if (!fence || dma_fence_chain_find_seqno(&fence, wait->point)) {
+		dma_fence_put(fence);
+		return false;
+	}
+
+	/* The point may already be signaled and garbage collected */
+	wait->fence = fence ? fence : dma_fence_get_stub();
+	return true;
+}
+
+static void drm_syncobj_fence_add_wait(struct drm_syncobj *syncobj,
+				       struct syncobj_wait_entry *wait)
+{
+	if (wait->fence)
+		return;
 
 	spin_lock(&syncobj->lock);
 	/* We've already tried once to get a fence and failed.  Now that we
 	 * have the lock, try one more time just to be sure we don't add a
 	 * callback when a fence has already been set.
 	 */
-	if (syncobj->fence) {
-		*fence = dma_fence_get(rcu_dereference_protected(syncobj->fence,
-								 lockdep_is_held(&syncobj->lock)));
-		ret = 1;
-	} else {
-		*fence = NULL;
-		drm_syncobj_add_callback_locked(syncobj, cb, func);
-		ret = 0;
-	}
+	if (!syncobj_wait_entry_get_fence(syncobj, wait))
+		drm_syncobj_add_callback_locked(syncobj, &wait->syncobj_cb,
+						syncobj_wait_syncobj_func);
 	spin_unlock(&syncobj->lock);
-
-	return ret;
 }
 
 /**
@@ -126,7 +153,9 @@ static int drm_syncobj_fence_get_or_add_callback(struct drm_syncobj *syncobj,
  * @cb: Callback to add
  * @func: Func to use when initializing the drm_syncobj_cb struct
  *
- * This adds a callback to be called next time the fence is replaced
+ * This adds a callback to be called next time the fence is replaced or a
+ * timeline point is added. The callback is removed before it is called and
+ * may add itself again.
  */
 void drm_syncobj_add_callback(struct drm_syncobj *syncobj,
 			      struct drm_syncobj_cb *cb,
@@ -152,6 +181,21 @@ void drm_syncobj_remove_callback(struct drm_syncobj *syncobj,
 }
 EXPORT_SYMBOL(drm_syncobj_remove_callback);
 
+static void drm_syncobj_run_callbacks_locked(struct drm_syncobj *syncobj)
+{
+	struct drm_syncobj_cb *cur, *tmp;
+	LIST_HEAD(cb_list);
+
+	/* Callbacks may re-arm themselves, e.g. when waiting for a timeline
+	 * point which is still not submitted. Only run the ones queued so far.
+	 */
+	list_splice_init(&syncobj->cb_list, &cb_list);
+	list_for_each_entry_safe(cur, tmp, &cb_list, node) {
+		list_del_init(&cur->node);
+		cur->func(syncobj, cur);
+	}
+}
+
 /**
  * drm_syncobj_replace_fence - replace fence in a sync object.
  * @syncobj: Sync object to replace fence in
@@ -163,7 +207,6 @@ void drm_syncobj_replace_fence(struct drm_syncobj *syncobj,
 			       struct dma_fence *fence)
 {
 	struct dma_fence *old_fence;
-	struct drm_syncobj_cb *cur, *tmp;
 
 	if (fence)
 		dma_fence_get(fence);
@@ -174,12 +217,8 @@ void drm_syncobj_replace_fence(struct drm_syncobj *syncobj,
 					      lockdep_is_held(&syncobj->lock));
 	rcu_assign_pointer(syncobj->fence, fence);
 
-	if (fence != old_fence) {
-		list_for_each_entry_safe(cur, tmp, &syncobj->cb_list, node) {
-			list_del_init(&cur->node);
-			cur->func(syncobj, cur);
-		}
-	}
+	if (fence != old_fence)
+		drm_syncobj_run_callbacks_locked(syncobj);
 
 	spin_unlock(&syncobj->lock);
 
@@ -187,6 +226,45 @@ void drm_syncobj_replace_fence(struct drm_syncobj *syncobj,
 }
 EXPORT_SYMBOL(drm_syncobj_replace_fence);
 
+/**
+ * drm_syncobj_add_point - add new timeline point to the syncobj
+ * @syncobj: sync object to add timeline point do
+ * @chain: chain node to use to add the point
+ * @fence: fence to encapsulate in the chain node
+ * @point: sequence number to use for the point
+ *
+ * Add the chain node as new timeline point to the syncobj. Takes over the
+ * reference to @chain, which must be allocated by the caller.
+ */
+void drm_syncobj_add_point(struct drm_syncobj *syncobj,
+			   struct dma_fence_chain *chain,
+			   struct dma_fence *fence,
+			   u64 point)
+{
+	struct dma_fence *prev;
+
+	dma_fence_get(fence);
+
+	spin_lock(&syncobj->lock);
+
+	prev = dma_fence_get(rcu_dereference_protected(syncobj->fence,
+						       lockdep_is_held(&syncobj->lock)));
+	/* Points must increase, otherwise queries may return stale values */
+	if (prev && dma_fence_chain_seqno(prev) >= point)
+		DRM_DEBUG("You are adding an unordered point to timeline!\n");
+	dma_fence_chain_init(chain, prev, fence, point);
+	rcu_assign_pointer(syncobj->fence, &chain->base);
+
+	drm_syncobj_run_callbacks_locked(syncobj);
+
+	spin_unlock(&syncobj->lock);
+
+	/* Walk the chain once to trigger garbage collection */
+	dma_fence_chain_for_each(fence, prev);
+	dma_fence_put(prev);
+}
+EXPORT_SYMBOL(drm_syncobj_add_point);
+
 struct drm_syncobj_null_fence {
 	struct dma_fence base;
 	spinlock_t lock;
@@ -226,35 +304,109 @@ static void drm_syncobj_assign_null_handle(struct drm_syncobj *syncobj)
 }
 
 /**
- * drm_syncobj_find_fence - lookup and reference the fence in a sync object
+ * drm_syncobj_find_fence_point - lookup and reference the fence of a point
  * @file_private: drm file private pointer
  * @handle: sync object handle to lookup.
+ * @point: timeline point, 0 for the last fence added
+ * @flags: DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT or 0
  * @fence: out parameter for the fence
  *
- * This is just a convenience function that combines drm_syncobj_find() and
- * drm_syncobj_fence_get().
+ * With DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT this waits, interruptible and
+ * for a bounded time, until @point has been submitted.
  *
  * Returns 0 on success or a negative error value on failure. On success @fence
  * contains a reference to the fence, which must be released by calling
  * dma_fence_put().
  */
-int drm_syncobj_find_fence(struct drm_file *file_private,
-			   u32 handle,
-			   struct dma_fence **fence)
+int drm_syncobj_find_fence_point(struct drm_file *file_private,
+				 u32 handle, u64 point, u64 flags,
+				 struct dma_fence **fence)
 {
 	struct drm_syncobj *syncobj = drm_syncobj_find(file_private, handle);
-	int ret = 0;
+	struct syncobj_wait_entry wait;
+	signed long timeout = nsecs_to_jiffies(DRM_SYNCOBJ_WAIT_FOR_SUBMIT_TIMEOUT);
+	int ret;
 
 	if (!syncobj)
 		return -ENOENT;
 
 	*fence = drm_syncobj_fence_get(syncobj);
-	if (!*fence) {
+	if (*fence) {
+		ret = dma_fence_chain_find_seqno(fence, point);
+		if (!ret) {
+			/* The point may already be signaled and garbage
+			 * collected, hand out a signaled fence instead.
+			 */
+			if (!*fence)
+				*fence = dma_fence_get_stub();
+			goto out;
+		}
+		dma_fence_put(*fence);
+		*fence = NULL;
+	} else {
 		ret = -EINVAL;
 	}
+
+	if (!(flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT))
+		goto out;
+
+	memset(&wait, 0, sizeof(wait));
+	wait.task = current;
+	wait.point = point;
+	drm_syncobj_fence_add_wait(syncobj, &wait);
+
+	do {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (wait.fence) {
+			ret = 0;
+			break;
+		}
+		if (timeout == 0) {
+			ret = -ETIME;
+			break;
+		}
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+
+		timeout = schedule_timeout(timeout);
+	} while (1);
+
+	__set_current_state(TASK_RUNNING);
+	if (wait.syncobj_cb.func)
+		drm_syncobj_remove_callback(syncobj, &wait.syncobj_cb);
+
+	/* The point may have been submitted while we were bailing out */
+	if (wait.fence)
+		ret = 0;
+	*fence = wait.fence;
+
+out:
 	drm_syncobj_put(syncobj);
 	return ret;
 }
+EXPORT_SYMBOL(drm_syncobj_find_fence_point);
+
+/**
+ * drm_syncobj_find_fence - lookup and reference the fence in a sync object
+ * @file_private: drm file private pointer
+ * @handle: sync object handle to lookup.
+ * @fence: out parameter for the fence
+ *
+ * This is just a convenience function that combines drm_syncobj_find() and
+ * drm_syncobj_fence_get().
+ *
+ * Returns 0 on success or a negative error value on failure. On success @fence
+ * contains a reference to the fence, which must be released by calling
+ * dma_fence_put().
+ */
+int drm_syncobj_find_fence(struct drm_file *file_private,
+			   u32 handle,
+			   struct dma_fence **fence)
+{
+	return drm_syncobj_find_fence_point(file_private, handle, 0, 0, fence);
+}
 EXPORT_SYMBOL(drm_syncobj_find_fence);
 
 /**
@@ -645,13 +797,6 @@ drm_syncobj_fd_to_handle_ioctl(struct drm_device *dev, void *data,
 					&args->handle);
 }
 
-struct syncobj_wait_entry {
-	struct task_struct *task;
-	struct dma_fence *fence;
-	struct dma_fence_cb fence_cb;
-	struct drm_syncobj_cb syncobj_cb;
-};
-
 static void syncobj_wait_fence_func(struct dma_fence *fence,
 				    struct dma_fence_cb *cb)
 {
@@ -668,12 +813,18 @@ static void syncobj_wait_syncobj_func(struct drm_syncobj *syncobj,
 		container_of(cb, struct syncobj_wait_entry, syncobj_cb);
 
 	/* This happens inside the syncobj lock */
-	wait->fence = dma_fence_get(rcu_dereference_protected(syncobj->fence,
-							      lockdep_is_held(&syncobj->lock)));
+	if (!syncobj_wait_entry_get_fence(syncobj, wait)) {
+		/* Not submitted yet, wait for the next update */
+		drm_syncobj_add_callback_locked(syncobj, cb,
+						syncobj_wait_syncobj_func);
+		return;
+	}
+
 	wake_up_process(wait->task);
 }
 
 static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
+						  u64 *points,
 						  uint32_t count,
 						  uint32_t flags,
 						  signed long timeout,
@@ -696,8 +847,11 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 	signaled_count = 0;
 	for (i = 0; i < count; ++i) {
 		entries[i].task = current;
-		entries[i].fence = drm_syncobj_fence_get(syncobjs[i]);
-		if (!entries[i].fence) {
+		entries[i].point = points ? points[i] : 0;
+		fence = drm_syncobj_fence_get(syncobjs[i]);
+		if (!fence ||
+		    dma_fence_chain_find_seqno(&fence, entries[i].point)) {
+			dma_fence_put(fence);
 			if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) {
 				continue;
 			} else {
@@ -706,7 +860,10 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 			}
 		}
 
-		if (dma_fence_is_signaled(entries[i].fence)) {
+		entries[i].fence = fence ? fence : dma_fence_get_stub();
+
+		if ((flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) ||
+		    dma_fence_is_signaled(entries[i].fence)) {
 			if (signaled_count == 0 && idx)
 				*idx = i;
 			signaled_count++;
@@ -732,12 +889,8 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 	 */
 
 	if (flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) {
-		for (i = 0; i < count; ++i) {
-			drm_syncobj_fence_get_or_add_callback(syncobjs[i],
-							      &entries[i].fence,
-							      &entries[i].syncobj_cb,
-							      syncobj_wait_syncobj_func);
-		}
+		for (i = 0; i < count; ++i)
+			drm_syncobj_fence_add_wait(syncobjs[i], &entries[i]);
 	}
 
 	do {
@@ -749,7 +902,8 @@ static signed long drm_syncobj_array_wait_timeout(struct drm_syncobj **syncobjs,
 			if (!fence)
 				continue;
 
-			if (dma_fence_is_signaled(fence) ||
+			if ((flags & DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE) ||
+			    dma_fence_is_signaled(fence) ||
 			    (!entries[i].fence_cb.func &&
 			     dma_fence_add_callback(fence,
 						    &entries[i].fence_cb,
@@ -834,21 +988,36 @@ static signed long drm_timeout_abs_to_jiffies(int64_t timeout_nsec)
 
 static int drm_syncobj_array_wait(struct drm_device *dev,
 				  struct drm_file *file_private,
-				  struct drm_syncobj_wait *wait,
-				  struct drm_syncobj **syncobjs)
+				  struct drm_syncobj **syncobjs,
+				  void __user *user_points,
+				  uint32_t count, uint32_t flags,
+				  int64_t timeout_nsec,
+				  uint32_t *first_signaled)
 {
-	signed long timeout = drm_timeout_abs_to_jiffies(wait->timeout_nsec);
+	signed long timeout = drm_timeout_abs_to_jiffies(timeout_nsec);
 	signed long ret = 0;
 	uint32_t first = ~0;
+	u64 *points = NULL;
+
+	if (user_points) {
+		points = kmalloc_array(count, sizeof(*points), GFP_KERNEL);
+		if (!points)
+			return -ENOMEM;
+
+		if (copy_from_user(points, user_points,
+				   sizeof(u64) * count)) {
+			kfree(points);
+			return -EFAULT;
+		}
+	}
 
-	ret = drm_syncobj_array_wait_timeout(syncobjs,
-					     wait->count_handles,
-					     wait->flags,
+	ret = drm_syncobj_array_wait_timeout(syncobjs, points, count, flags,
 					     timeout, &first);
+	kfree(points);
 	if (ret < 0)
 		return ret;
 
-	wait->first_signaled = first;
+	*first_signaled = first;
 	if (ret == 0)
 		return -ETIME;
 	return 0;
@@ -935,8 +1104,47 @@ drm_syncobj_wait_ioctl(struct drm_device *dev, void *data,
 	if (ret < 0)
 		return ret;
 
-	ret = drm_syncobj_array_wait(dev, file_private,
-				     args, syncobjs);
+	ret = drm_syncobj_array_wait(dev, file_private, syncobjs, NULL,
+				     args->count_handles, args->flags,
+				     args->timeout_nsec,
+				     &args->first_signaled);
+
+	drm_syncobj_array_free(syncobjs, args->count_handles);
+
+	return ret;
+}
+
+int
+drm_syncobj_timeline_wait_ioctl(struct drm_device *dev, void *data,
+				struct drm_file *file_private)
+{
+	struct drm_syncobj_timeline_wait *args = data;
+	struct drm_syncobj **syncobjs;
+	int ret = 0;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ_TIMELINE))
+		return -ENODEV;
+
+	if (args->flags & ~(DRM_SYNCOBJ_WAIT_FLAGS_WAIT_ALL |
+			    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT |
+			    DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE))
+		return -EINVAL;
+
+	if (args->count_handles == 0 || args->pad)
+		return -EINVAL;
+
+	ret = drm_syncobj_array_find(file_private,
+				     u64_to_user_ptr(args->handles),
+				     args->count_handles,
+				     &syncobjs);
+	if (ret < 0)
+		return ret;
+
+	ret = drm_syncobj_array_wait(dev, file_private, syncobjs,
+				     u64_to_user_ptr(args->points),
+				     args->count_handles, args->flags,
+				     args->timeout_nsec,
+				     &args->first_signaled);
 
 	drm_syncobj_array_free(syncobjs, args->count_handles);
 
@@ -1008,3 +1216,204 @@ drm_syncobj_signal_ioctl(struct drm_device *dev, void *data,
 
 	return ret;
 }
+
+int
+drm_syncobj_timeline_signal_ioctl(struct drm_device *dev, void *data,
+				  struct drm_file *file_private)
+{
+	struct drm_syncobj_timeline_array *args = data;
+	struct drm_syncobj **syncobjs;
+	struct dma_fence_chain **chains;
+	u64 *points;
+	uint32_t i, j;
+	int ret;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ_TIMELINE))
+		return -ENODEV;
+
+	if (args->flags != 0)
+		return -EINVAL;
+
+	if (args->count_handles == 0)
+		return -EINVAL;
+
+	ret = drm_syncobj_array_find(file_private,
+				     u64_to_user_ptr(args->handles),
+				     args->count_handles,
+				     &syncobjs);
+	if (ret < 0)
+		return ret;
+
+	points = kmalloc_array(args->count_handles, sizeof(*points),
+			       GFP_KERNEL);
+	if (!points) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (copy_from_user(points, u64_to_user_ptr(args->points),
+			   sizeof(u64) * args->count_handles)) {
+		ret = -EFAULT;
+		goto err_points;
+	}
+
+	/* Allocate all chain nodes up front so that either all or none of
+	 * the points are signaled.
+	 */
+	chains = kcalloc(args->count_handles, sizeof(*chains), GFP_KERNEL);
+	if (!chains) {
+		ret = -ENOMEM;
+		goto err_points;
+	}
+	for (i = 0; i < args->count_handles; i++) {
+		if (!points[i])
+			continue;
+
+		chains[i] = kzalloc(sizeof(**chains), GFP_KERNEL);
+		if (!chains[i]) {
+			for (j = 0; j < i; j++)
+				kfree(chains[j]);
+			ret = -ENOMEM;
+			goto err_chains;
+		}
+	}
+
+	for (i = 0; i < args->count_handles; i++) {
+		struct dma_fence *fence = dma_fence_get_stub();
+
+		if (chains[i])
+			drm_syncobj_add_point(syncobjs[i], chains[i],
+					      fence, points[i]);
+		else
+			drm_syncobj_replace_fence(syncobjs[i], fence);
+		dma_fence_put(fence);
+	}
+
+err_chains:
+	kfree(chains);
+err_points:
+	kfree(points);
+out:
+	drm_syncobj_array_free(syncobjs, args->count_handles);
+
+	return ret;
+}
+
+int
+drm_syncobj_query_ioctl(struct drm_device *dev, void *data,
+			struct drm_file *file_private)
+{
+	struct drm_syncobj_timeline_array *args = data;
+	struct drm_syncobj **syncobjs;
+	u64 __user *points = u64_to_user_ptr(args->points);
+	uint32_t i;
+	int ret;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ_TIMELINE))
+		return -ENODEV;
+
+	if (args->flags != 0)
+		return -EINVAL;
+
+	if (args->count_handles == 0)
+		return -EINVAL;
+
+	ret = drm_syncobj_array_find(file_private,
+				     u64_to_user_ptr(args->handles),
+				     args->count_handles,
+				     &syncobjs);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < args->count_handles; i++) {
+		struct dma_fence *fence, *iter, *last = NULL;
+		u64 point = 0;
+
+		fence = drm_syncobj_fence_get(syncobjs[i]);
+		if (to_dma_fence_chain(fence)) {
+			/* Signaled nodes are garbage collected by the walk,
+			 * so the oldest node left tells how far the timeline
+			 * has progressed.
+			 */
+			dma_fence_chain_for_each(iter, fence) {
+				struct dma_fence_chain *node;
+
+				node = to_dma_fence_chain(iter);
+				if (!node) {
+					dma_fence_put(iter);
+					break;
+				}
+
+				dma_fence_put(last);
+				last = dma_fence_get(iter);
+				if (!node->prev_seqno) {
+					/* Start of the ordered timeline */
+					dma_fence_put(iter);
+					break;
+				}
+			}
+
+			point = dma_fence_is_signaled(last) ?
+				to_dma_fence_chain(last)->seqno :
+				to_dma_fence_chain(last)->prev_seqno;
+			dma_fence_put(last);
+		}
+		dma_fence_put(fence);
+
+		if (copy_to_user(&points[i], &point, sizeof(u64))) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	drm_syncobj_array_free(syncobjs, args->count_handles);
+
+	return ret;
+}
+
+int
+drm_syncobj_transfer_ioctl(struct drm_device *dev, void *data,
+			   struct drm_file *file_private)
+{
+	struct drm_syncobj_transfer *args = data;
+	struct dma_fence_chain *chain;
+	struct drm_syncobj *dst;
+	struct dma_fence *fence;
+	int ret;
+
+	if (!drm_core_check_feature(dev, DRIVER_SYNCOBJ_TIMELINE))
+		return -ENODEV;
+
+	if (args->flags & ~DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT)
+		return -EINVAL;
+
+	if (args->pad)
+		return -EINVAL;
+
+	dst = drm_syncobj_find(file_private, args->dst_handle);
+	if (!dst)
+		return -ENOENT;
+
+	ret = drm_syncobj_find_fence_point(file_private, args->src_handle,
+					   args->src_point, args->flags,
+					   &fence);
+	if (ret)
+		goto out;
+
+	if (args->dst_point) {
+		chain = kzalloc(sizeof(*chain), GFP_KERNEL);
+		if (!chain) {
+			ret = -ENOMEM;
+			goto out_fence;
+		}
+		drm_syncobj_add_point(dst, chain, fence, args->dst_point);
+	} else {
+		drm_syncobj_replace_fence(dst, fence);
+	}
+
+out_fence:
+	dma_fence_put(fence);
+out:
+	drm_syncobj_put(dst);
+
+	return ret;
+}
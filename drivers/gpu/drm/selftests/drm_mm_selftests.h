@@ -23,3 +23,6 @@ selftest(topdown, igt_topdown)
 selftest(color, igt_color)
 selftest(color_evict, igt_color_evict)
 selftest(color_evict_range, igt_color_evict_range)
+selftest(hole_search, igt_hole_search)
+selftest(frag, igt_frag)
+selftest(bench, igt_bench)
@@ -9,6 +9,7 @@
 #include <linux/slab.h>
 #include <linux/random.h>
 #include <linux/vmalloc.h>
+#include <linux/ktime.h>
 
 #include <drm/drm_mm.h>
 
@@ -2280,6 +2281,351 @@ static int igt_color_evict_range(void *ignored)
 	return ret;
 }
 
+static u64 expected_hole_addr(const struct drm_mm *mm,
+			      u64 size, u64 alignment,
+			      u64 range_start, u64 range_end,
+			      bool topdown, bool *found)
+{
+	struct drm_mm_node *hole;
+	u64 hole_start, hole_end;
+	u64 result = 0;
+
+	/* Brute force walk over every hole in address order */
+	*found = false;
+	drm_mm_for_each_hole(hole, mm, hole_start, hole_end) {
+		u64 start = max(hole_start, range_start);
+		u64 end = min(hole_end, range_end);
+		u64 addr, rem;
+
+		if (end <= start || end - start < size)
+			continue;
+
+		if (topdown) {
+			addr = end - size;
+			div64_u64_rem(addr, alignment, &rem);
+			addr -= rem;
+			if (addr < start)
+				continue;
+		} else {
+			addr = start;
+			div64_u64_rem(addr, alignment, &rem);
+			if (rem)
+				addr += alignment - rem;
+			if (addr > end || end - addr < size)
+				continue;
+		}
+
+		result = addr;
+		*found = true;
+		if (!topdown)
+			break;
+	}
+
+	return result;
+}
+
+static int igt_hole_search(void *ignored)
+{
+	DRM_RND_STATE(prng, random_seed);
+	const unsigned int count = min(4096u, max_iterations);
+	const u64 total = 64ull << 20;
+	struct drm_mm_node *nodes, *node, *next;
+	struct drm_mm mm;
+	unsigned int n, m;
+	int ret = -ENOMEM;
+
+	/* Check that the bottom-up and top-down searches, which skip subtrees
+	 * of holes that are too small, still find exactly the first (or last)
+	 * suitable hole under heavy fragmentation with random alignments and
+	 * ranges.
+	 */
+
+	nodes = vzalloc(array_size(count, sizeof(*nodes)));
+	if (!nodes)
+		goto err;
+
+	ret = -EINVAL;
+	drm_mm_init(&mm, 0, total);
+
+	/* Fragment the address space with a mix of small and large holes */
+	for (n = 0; n < count; n++) {
+		u64 size = 1 + (prandom_u32_state(&prng) % 4096);
+
+		if (drm_mm_insert_node_generic(&mm, &nodes[n], size, 0, 0,
+					       DRM_MM_INSERT_LOW))
+			break;
+	}
+	for (m = 0; m < n; m++) {
+		if (prandom_u32_state(&prng) & 1)
+			drm_mm_remove_node(&nodes[m]);
+	}
+
+	for (m = 0; m < count; m++) {
+		struct drm_mm_node tmp = {};
+		bool topdown = prandom_u32_state(&prng) & 1;
+		u64 size = 1 + (prandom_u32_state(&prng) % 8192);
+		u64 alignment = BIT_ULL(prandom_u32_state(&prng) % 12);
+		u64 range_start = prandom_u32_state(&prng) % (total / 2);
+		u64 range_end = range_start + size +
+			prandom_u32_state(&prng) % (total / 2);
+		u64 expect;
+		bool found;
+		int err;
+
+		expect = expected_hole_addr(&mm, size, alignment,
+					    range_start, range_end,
+					    topdown, &found);
+
+		err = drm_mm_insert_node_in_range(&mm, &tmp, size, alignment, 0,
+						  range_start, range_end,
+						  topdown ? DRM_MM_INSERT_HIGH :
+							    DRM_MM_INSERT_LOW);
+		if (!found) {
+			if (err != -ENOSPC) {
+				pr_err("%s insert (size=%llu, alignment=%llu, range [%llx, %llx]) did not fail, err=%d\n",
+				       topdown ? "top-down" : "bottom-up",
+				       size, alignment, range_start, range_end,
+				       err);
+				if (!err)
+					drm_mm_remove_node(&tmp);
+				goto out;
+			}
+			continue;
+		}
+
+		if (err) {
+			pr_err("%s insert (size=%llu, alignment=%llu, range [%llx, %llx]) failed, expected %llx\n",
+			       topdown ? "top-down" : "bottom-up",
+			       size, alignment, range_start, range_end, expect);
+			goto out;
+		}
+
+		if (tmp.start != expect) {
+			pr_err("%s insert (size=%llu, alignment=%llu, range [%llx, %llx]) placed at %llx, expected %llx\n",
+			       topdown ? "top-down" : "bottom-up",
+			       size, alignment, range_start, range_end,
+			       tmp.start, expect);
+			drm_mm_remove_node(&tmp);
+			goto out;
+		}
+		drm_mm_remove_node(&tmp);
+
+		/* Keep churning so that the augmented tree is rebalanced */
+		node = &nodes[prandom_u32_state(&prng) % count];
+		if (drm_mm_node_allocated(node))
+			drm_mm_remove_node(node);
+		else
+			drm_mm_insert_node_generic(&mm, node,
+						   1 + (prandom_u32_state(&prng) % 4096),
+						   0, 0, DRM_MM_INSERT_BEST);
+
+		cond_resched();
+	}
+
+	ret = 0;
+out:
+	if (ret)
+		show_mm(&mm);
+	drm_mm_for_each_node_safe(node, next, &mm)
+		drm_mm_remove_node(node);
+	drm_mm_takedown(&mm);
+	vfree(nodes);
+err:
+	return ret;
+}
+
+static u64 get_insert_time(struct drm_mm *mm,
+			   unsigned int num_insert,
+			   struct drm_mm_node *nodes,
+			   enum drm_mm_insert_mode mode)
+{
+	unsigned int size = 8192;
+	ktime_t start;
+	unsigned int i;
+
+	start = ktime_get();
+	for (i = 0; i < num_insert; i++) {
+		if (drm_mm_insert_node_generic(mm, &nodes[i], size, 0, 0,
+					       mode)) {
+			pr_err("%s insert failed\n", __func__);
+			return 0;
+		}
+	}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int igt_frag(void *ignored)
+{
+	const unsigned int insert_size = 10000;
+	const unsigned int scale_factor = 4;
+	const struct insert_mode *mode;
+	struct drm_mm_node *nodes, *node, *next;
+	struct drm_mm mm;
+	int ret = -ENOMEM;
+
+	/* Fragment the address space with holes that are too small for the
+	 * following requests and check that inserting twice as many nodes
+	 * takes roughly twice as long, i.e. the searches do not degrade to
+	 * walking every hole.
+	 */
+
+	nodes = vzalloc(array_size(insert_size * 5, sizeof(*nodes)));
+	if (!nodes)
+		goto err;
+
+	ret = -EINVAL;
+	drm_mm_init(&mm, 1, U64_MAX - 2);
+	for (mode = insert_modes; mode->name; mode++) {
+		u64 insert_time1, insert_time2;
+		unsigned int i;
+
+		if (mode->mode != DRM_MM_INSERT_LOW &&
+		    mode->mode != DRM_MM_INSERT_HIGH)
+			continue;
+
+		/* Leave a 4096 byte hole after every 4096 byte node */
+		for (i = 0; i < insert_size * 2; i++) {
+			if (drm_mm_insert_node_generic(&mm, &nodes[i], 4096,
+						       0, 0, mode->mode))
+				goto out;
+		}
+		for (i = 0; i < insert_size * 2; i += 2)
+			drm_mm_remove_node(&nodes[i]);
+
+		insert_time1 = get_insert_time(&mm, insert_size,
+					       nodes + insert_size * 2,
+					       mode->mode);
+		if (!insert_time1)
+			goto out;
+
+		insert_time2 = get_insert_time(&mm, insert_size * 2,
+					       nodes + insert_size * 3,
+					       mode->mode);
+		if (!insert_time2)
+			goto out;
+
+		pr_info("%s fragmented insert of %u and %u nodes took %llu and %llu nsecs\n",
+			mode->name, insert_size, insert_size * 2,
+			insert_time1, insert_time2);
+
+		if (insert_time2 > scale_factor * insert_time1) {
+			pr_err("%s fragmented insert took %llu nsecs more\n",
+			       mode->name,
+			       insert_time2 - scale_factor * insert_time1);
+			goto out;
+		}
+
+		drm_mm_for_each_node_safe(node, next, &mm)
+			drm_mm_remove_node(node);
+	}
+
+	ret = 0;
+out:
+	drm_mm_for_each_node_safe(node, next, &mm)
+		drm_mm_remove_node(node);
+	drm_mm_takedown(&mm);
+	vfree(nodes);
+err:
+	return ret;
+}
+
+static int igt_bench(void *ignored)
+{
+	DRM_RND_STATE(prng, random_seed);
+	const unsigned int count = 16384;
+	const u64 total = 1ull << 36;
+	const struct insert_mode *mode;
+	struct drm_mm_node *nodes, *node, *next;
+	unsigned int *order;
+	struct drm_mm mm;
+	int ret = -ENOMEM;
+
+	/* Report allocation and free throughput for each insertion mode
+	 * under random churn with mixed sizes and alignments, and how
+	 * fragmented the address space is left afterwards. Only fails if
+	 * the allocator runs out of space, the numbers are informational.
+	 */
+
+	nodes = vzalloc(array_size(count, sizeof(*nodes)));
+	if (!nodes)
+		goto err;
+
+	order = drm_random_order(count, &prng);
+	if (!order)
+		goto err_nodes;
+
+	ret = -EINVAL;
+	for (mode = insert_modes; mode->name; mode++) {
+		u64 insert_ns = 0, remove_ns = 0, ops = 0;
+		u64 free = 0, largest = 0, hole_start, hole_end;
+		unsigned long holes = 0;
+		struct drm_mm_node *hole;
+		unsigned int round, n;
+		ktime_t start;
+
+		drm_mm_init(&mm, 0, total);
+
+		for (round = 0; round < 8; round++) {
+			start = ktime_get();
+			for (n = 0; n < count; n++) {
+				node = &nodes[order[n]];
+				if (drm_mm_node_allocated(node))
+					continue;
+
+				if (drm_mm_insert_node_generic(&mm, node,
+							       1 + prandom_u32_state(&prng) % (1 << 20),
+							       BIT_ULL(prandom_u32_state(&prng) % 16),
+							       0, mode->mode)) {
+					pr_err("%s bench insert failed, round %u step %u\n",
+					       mode->name, round, n);
+					goto out;
+				}
+				ops++;
+			}
+			insert_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+			/* Free a random half to leave holes of varying sizes */
+			drm_random_reorder(order, count, &prng);
+			start = ktime_get();
+			for (n = 0; n < count / 2; n++)
+				drm_mm_remove_node(&nodes[order[n]]);
+			remove_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+
+			cond_resched();
+		}
+
+		drm_mm_for_each_hole(hole, &mm, hole_start, hole_end) {
+			free += hole_end - hole_start;
+			largest = max(largest, hole_end - hole_start);
+			holes++;
+		}
+
+		pr_info("%s: %llu inserts in %llu us (%llu ns/op), %u removes in %llu us, %lu holes, largest hole %llu%% of free space\n",
+			mode->name, ops, div_u64(insert_ns, 1000),
+			div64_u64(insert_ns, max_t(u64, ops, 1)),
+			8 * (count / 2), div_u64(remove_ns, 1000),
+			holes, div64_u64(largest * 100, max_t(u64, free, 1)));
+
+		drm_mm_for_each_node_safe(node, next, &mm)
+			drm_mm_remove_node(node);
+		drm_mm_takedown(&mm);
+	}
+
+	ret = 0;
+	goto err_order;
+out:
+	drm_mm_for_each_node_safe(node, next, &mm)
+		drm_mm_remove_node(node);
+	drm_mm_takedown(&mm);
+err_order:
+	kfree(order);
+err_nodes:
+	vfree(nodes);
+err:
+	return ret;
+}
+
 #include "drm_selftest.c"
 
 static int __init test_drm_mm_init(void)
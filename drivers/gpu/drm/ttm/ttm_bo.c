@@ -1170,6 +1170,12 @@ int ttm_bo_validate(struct ttm_buffer_object *bo,
 	uint32_t new_flags;
 
 	reservation_object_assert_held(bo->resv);
+	/*
+	 * Read swapped out content back in the background while the new
+	 * placement's pages are allocated.
+	 */
+	if (bo->ttm)
+		ttm_tt_swapin_prefetch(bo->ttm);
 	/*
 	 * Check whether we need to move buffer.
 	 */
@@ -1771,17 +1777,25 @@ void ttm_bo_synccpu_write_release(struct ttm_buffer_object *bo)
 }
 EXPORT_SYMBOL(ttm_bo_synccpu_write_release);
 
-/**
- * A buffer object shrink method that tries to swap out the first
- * buffer object on the bo_global::swap_lru list.
+/*
+ * Pick the first buffer object on the bo_global::swap_lru list that can be
+ * swapped out, move it to cached system memory and wait for it to idle.
+ * On success *bo is returned reserved (if *locked) with a list reference,
+ * ready for ttm_tt_swapout(), or NULL if a destroyed BO was cleaned up
+ * instead.
  */
-int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
+static int ttm_bo_swapout_prepare(struct ttm_bo_global *glob,
+				  struct ttm_operation_ctx *ctx,
+				  struct ttm_buffer_object **out_bo,
+				  bool *out_locked)
 {
 	struct ttm_buffer_object *bo;
 	int ret = -EBUSY;
 	bool locked;
 	unsigned i;
 
+	*out_bo = NULL;
+
 	spin_lock(&glob->lru_lock);
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i) {
 		list_for_each_entry(bo, &glob->swap_lru[i], swap) {
@@ -1847,9 +1861,19 @@ int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
 	if (bo->bdev->driver->swap_notify)
 		bo->bdev->driver->swap_notify(bo);
 
-	ret = ttm_tt_swapout(bo->ttm, bo->persistent_swap_storage);
+	*out_bo = bo;
+	*out_locked = locked;
+	return 0;
+
 out:
+	if (locked)
+		kcl_reservation_object_unlock(bo->resv);
+	kref_put(&bo->list_kref, ttm_bo_release_list);
+	return ret;
+}
 
+static void ttm_bo_swapout_finish(struct ttm_buffer_object *bo, bool locked)
+{
 	/**
 	 *
 	 * Unreserve without putting on LRU to avoid swapping out an
@@ -1858,10 +1882,106 @@ int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
 	if (locked)
 		kcl_reservation_object_unlock(bo->resv);
 	kref_put(&bo->list_kref, ttm_bo_release_list);
+}
+
+/**
+ * A buffer object shrink method that tries to swap out the first
+ * buffer object on the bo_global::swap_lru list.
+ */
+int ttm_bo_swapout(struct ttm_bo_global *glob, struct ttm_operation_ctx *ctx)
+{
+	struct ttm_buffer_object *bo;
+	bool locked;
+	int ret;
+
+	ret = ttm_bo_swapout_prepare(glob, ctx, &bo, &locked);
+	if (ret || !bo)
+		return ret;
+
+	ret = ttm_tt_swapout(bo->ttm, bo->persistent_swap_storage);
+	ttm_bo_swapout_finish(bo, locked);
 	return ret;
 }
 EXPORT_SYMBOL(ttm_bo_swapout);
 
+#define TTM_SWAPOUT_BATCH	8
+
+struct ttm_bo_swapout_item {
+	struct work_struct work;
+	struct ttm_buffer_object *bo;
+	bool locked;
+	int ret;
+};
+
+static void ttm_bo_swapout_work(struct work_struct *work)
+{
+	struct ttm_bo_swapout_item *item =
+		container_of(work, struct ttm_bo_swapout_item, work);
+
+	item->ret = ttm_tt_swapout(item->bo->ttm,
+				   item->bo->persistent_swap_storage);
+}
+
+/**
+ * ttm_bo_swapout_batch - Swap out several buffer objects in parallel
+ *
+ * @glob: The global BO state.
+ * @ctx: Operation context, as for ttm_bo_swapout().
+ * @num_pages: Number of pages the caller wants to free.
+ *
+ * Picks buffer objects off the swap LRU until they add up to @num_pages or
+ * the batch is full, and copies their content to shmem concurrently on the
+ * swapout workqueue. The BOs stay reserved by the caller until all copies
+ * are done, so reservation ownership doesn't move between tasks.
+ *
+ * Returns 0 if anything was swapped out or cleaned up, a negative error
+ * code otherwise.
+ */
+int ttm_bo_swapout_batch(struct ttm_bo_global *glob,
+			 struct ttm_operation_ctx *ctx,
+			 unsigned long num_pages)
+{
+	struct ttm_bo_swapout_item items[TTM_SWAPOUT_BATCH];
+	struct workqueue_struct *wq = glob->mem_glob->swapout_queue;
+	unsigned long pages = 0;
+	unsigned int i, n = 0;
+	bool progress = false;
+	int ret = 0;
+
+	if (!wq)
+		return ttm_bo_swapout(glob, ctx);
+
+	while (n < TTM_SWAPOUT_BATCH && pages < num_pages) {
+		ret = ttm_bo_swapout_prepare(glob, ctx, &items[n].bo,
+					     &items[n].locked);
+		if (ret)
+			break;
+		if (!items[n].bo) {
+			/* A destroyed BO was freed, let the caller recheck */
+			progress = true;
+			break;
+		}
+
+		INIT_WORK_ONSTACK(&items[n].work, ttm_bo_swapout_work);
+		queue_work(wq, &items[n].work);
+		pages += items[n].bo->num_pages;
+		n++;
+	}
+
+	for (i = 0; i < n; i++) {
+		flush_work(&items[i].work);
+		destroy_work_on_stack(&items[i].work);
+		if (!items[i].ret)
+			progress = true;
+		else
+			ret = items[i].ret;
+		ttm_bo_swapout_finish(items[i].bo, items[i].locked);
+	}
+
+	return progress ? 0 : ret;
+}
+EXPORT_SYMBOL(ttm_bo_swapout_batch);
+
 void ttm_bo_swapout_all(struct ttm_bo_device *bdev)
 {
 	struct ttm_operation_ctx ctx = {
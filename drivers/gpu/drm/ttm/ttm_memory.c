@@ -38,6 +38,7 @@
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
+#include <linux/crypto.h>
 
 #define TTM_MEMORY_ALLOC_RETRIES 4
 
@@ -175,6 +176,10 @@ static struct attribute ttm_mem_global_lower_mem_limit = {
 	.name = "lower_mem_limit",
 	.mode = S_IRUGO | S_IWUSR
 };
+static struct attribute ttm_mem_global_swap_compression = {
+	.name = "swap_compression",
+	.mode = S_IRUGO | S_IWUSR
+};
 
 static ssize_t ttm_mem_global_show(struct kobject *kobj,
 				 struct attribute *attr,
@@ -184,6 +189,10 @@ static ssize_t ttm_mem_global_show(struct kobject *kobj,
 		container_of(kobj, struct ttm_mem_global, kobj);
 	uint64_t val = 0;
 
+	if (attr == &ttm_mem_global_swap_compression)
+		return snprintf(buffer, PAGE_SIZE, "%s\n",
+				ttm_tt_swap_compression());
+
 	spin_lock(&glob->lock);
 	val = glob->lower_mem_limit;
 	spin_unlock(&glob->lock);
@@ -204,6 +213,16 @@ static ssize_t ttm_mem_global_store(struct kobject *kobj,
 	struct ttm_mem_global *glob =
 		container_of(kobj, struct ttm_mem_global, kobj);
 
+	if (attr == &ttm_mem_global_swap_compression) {
+		char name[CRYPTO_MAX_ALG_NAME];
+		int ret;
+
+		if (sscanf(buffer, "%127s", name) != 1)
+			return -EINVAL;
+		ret = ttm_tt_swap_set_compression(name);
+		return ret ? ret : size;
+	}
+
 	chars = sscanf(buffer, "%lu", &val);
 	if (chars == 0)
 		return size;
@@ -221,6 +240,7 @@ static ssize_t ttm_mem_global_store(struct kobject *kobj,
 
 static struct attribute *ttm_mem_global_attrs[] = {
 	&ttm_mem_global_lower_mem_limit,
+	&ttm_mem_global_swap_compression,
 	NULL
 };
 
@@ -234,12 +254,14 @@ static struct kobj_type ttm_mem_glob_kobj_type = {
 	.default_attrs = ttm_mem_global_attrs,
 };
 
-static bool ttm_zones_above_swap_target(struct ttm_mem_global *glob,
-					bool from_wq, uint64_t extra)
+/* Returns how many bytes the fullest zone is above its swap target */
+static uint64_t ttm_zones_swap_excess(struct ttm_mem_global *glob,
+				      bool from_wq, uint64_t extra)
 {
 	unsigned int i;
 	struct ttm_mem_zone *zone;
 	uint64_t target;
+	uint64_t excess = 0;
 
 	for (i = 0; i < glob->num_zones; ++i) {
 		zone = glob->zones[i];
@@ -254,9 +276,9 @@ static bool ttm_zones_above_swap_target(struct ttm_mem_global *glob,
 		target = (extra > target) ? 0ULL : target;
 
 		if (zone->used_mem > target)
-			return true;
+			excess = max(excess, zone->used_mem - target);
 	}
-	return false;
+	return excess;
 }
 
 /**
@@ -264,18 +286,22 @@ static bool ttm_zones_above_swap_target(struct ttm_mem_global *glob,
  * Extend this if needed, perhaps using a linked list of callbacks.
  * Note that this function is reentrant:
  * many threads may try to swap out at any given time.
+ * BOs are swapped out in batches sized after the excess, with their
+ * content copied to shmem in parallel.
  */
 
 static void ttm_shrink(struct ttm_mem_global *glob, bool from_wq,
 			uint64_t extra, struct ttm_operation_ctx *ctx)
 {
+	uint64_t excess;
 	int ret;
 
 	spin_lock(&glob->lock);
 
-	while (ttm_zones_above_swap_target(glob, from_wq, extra)) {
+	while ((excess = ttm_zones_swap_excess(glob, from_wq, extra))) {
 		spin_unlock(&glob->lock);
-		ret = ttm_bo_swapout(glob->bo_glob, ctx);
+		ret = ttm_bo_swapout_batch(glob->bo_glob, ctx,
+					   DIV_ROUND_UP(excess, PAGE_SIZE));
 		spin_lock(&glob->lock);
 		if (unlikely(ret != 0))
 			break;
@@ -423,6 +449,8 @@ int ttm_mem_global_init(struct ttm_mem_global *glob)
 	spin_lock_init(&glob->lock);
 	glob->swap_queue = create_singlethread_workqueue("ttm_swap");
 	INIT_WORK(&glob->work, ttm_shrink_work);
+	glob->swapout_queue = alloc_workqueue("ttm_swapout",
+					      WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
 	ret = kobject_init_and_add(
 		&glob->kobj, &ttm_mem_glob_kobj_type, ttm_get_kobj(), "memory_accounting");
 	if (unlikely(ret != 0)) {
@@ -472,6 +500,11 @@ void ttm_mem_global_release(struct ttm_mem_global *glob)
 	flush_workqueue(glob->swap_queue);
 	destroy_workqueue(glob->swap_queue);
 	glob->swap_queue = NULL;
+	if (glob->swapout_queue) {
+		destroy_workqueue(glob->swapout_queue);
+		glob->swapout_queue = NULL;
+	}
+	ttm_tt_swap_fini();
 	for (i = 0; i < glob->num_zones; ++i) {
 		zone = glob->zones[i];
 		kobject_del(&zone->kobj);
@@ -36,6 +36,9 @@
 #include <linux/pagemap.h>
 #include <linux/shmem_fs.h>
 #include <linux/file.h>
+#include <linux/crypto.h>
+#include <linux/highmem.h>
+#include <linux/percpu.h>
 #include <drm/drm_cache.h>
 #if DRM_VERSION_CODE < DRM_VERSION(4, 12, 0)
 #include <drm/drm_mem_util.h>
@@ -230,6 +233,14 @@ int ttm_tt_set_placement_caching(struct ttm_tt *ttm, uint32_t placement)
 }
 EXPORT_SYMBOL(ttm_tt_set_placement_caching);
 
+static void ttm_tt_swap_free(struct ttm_tt *ttm)
+{
+	kvfree(ttm->swap_len);
+	ttm->swap_len = NULL;
+	ttm->swap_compressor = NULL;
+	ttm->swap_pages = 0;
+}
+
 void ttm_tt_destroy(struct ttm_tt *ttm)
 {
 	if (ttm == NULL)
@@ -245,6 +256,7 @@ void ttm_tt_destroy(struct ttm_tt *ttm)
 		fput(ttm->swap_storage);
 
 	ttm->swap_storage = NULL;
+	ttm_tt_swap_free(ttm);
 	ttm->func->destroy(ttm);
 }
 
@@ -257,6 +269,9 @@ void ttm_tt_init_fields(struct ttm_tt *ttm, struct ttm_buffer_object *bo,
 	ttm->page_flags = page_flags;
 	ttm->state = tt_unpopulated;
 	ttm->swap_storage = NULL;
+	ttm->swap_compressor = NULL;
+	ttm->swap_len = NULL;
+	ttm->swap_pages = 0;
 	ttm->sg = bo->sg;
 }
 
@@ -380,6 +395,355 @@ int ttm_tt_bind(struct ttm_tt *ttm, struct ttm_mem_reg *bo_mem,
 }
 EXPORT_SYMBOL(ttm_tt_bind);
 
+static gfp_t ttm_tt_swap_gfp(struct ttm_tt *ttm,
+			      struct address_space *swap_space)
+{
+	gfp_t gfp_mask = mapping_gfp_mask(swap_space);
+
+	if (ttm->page_flags & TTM_PAGE_FLAG_NO_RETRY)
+		gfp_mask |= __GFP_RETRY_MAYFAIL;
+
+	return gfp_mask;
+}
+
+static int ttm_tt_swapout_pages(struct ttm_tt *ttm,
+				struct address_space *swap_space)
+{
+	struct page *from_page;
+	struct page *to_page;
+	int i;
+
+	for (i = 0; i < ttm->num_pages; ++i) {
+		gfp_t gfp_mask = ttm_tt_swap_gfp(ttm, swap_space);
+
+		from_page = ttm->pages[i];
+		if (unlikely(from_page == NULL))
+			continue;
+
+		to_page = shmem_read_mapping_page_gfp(swap_space, i, gfp_mask);
+		if (IS_ERR(to_page))
+			return PTR_ERR(to_page);
+
+		copy_highpage(to_page, from_page);
+		set_page_dirty(to_page);
+		mark_page_accessed(to_page);
+		put_page(to_page);
+	}
+
+	ttm->swap_pages = ttm->num_pages;
+
+	return 0;
+}
+
+/*
+ * Swap compression
+ *
+ * Each page is compressed on its own and the results are packed back to
+ * back into the shmem file, with the length of every page kept in
+ * ttm->swap_len. Pages that don't compress are stored as is, and pages
+ * that were never allocated get a length of 0.
+ *
+ * Compression runs with preemption disabled on a per-CPU transform, so
+ * BOs swapped out in parallel don't contend. Compressors are kept until
+ * TTM is unloaded since swapped out content may still refer to them.
+ */
+struct ttm_swap_compressor {
+	struct list_head head;
+	char name[CRYPTO_MAX_ALG_NAME];
+	struct crypto_comp * __percpu *tfm;
+};
+
+static struct ttm_swap_compressor *ttm_swap_comp;
+
+#if IS_REACHABLE(CONFIG_CRYPTO)
+static DEFINE_MUTEX(ttm_swap_comp_lock);
+static LIST_HEAD(ttm_swap_comp_list);
+
+static int ttm_tt_swap_write(struct address_space *swap_space, gfp_t gfp,
+			     loff_t pos, const void *buf, size_t len)
+{
+	while (len) {
+		size_t offset = pos & ~PAGE_MASK;
+		size_t n = min_t(size_t, len, PAGE_SIZE - offset);
+		struct page *page;
+		void *addr;
+
+		page = shmem_read_mapping_page_gfp(swap_space,
+						   pos >> PAGE_SHIFT, gfp);
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+
+		addr = kmap_atomic(page);
+		memcpy(addr + offset, buf, n);
+		kunmap_atomic(addr);
+		set_page_dirty(page);
+		mark_page_accessed(page);
+		put_page(page);
+
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int ttm_tt_swap_read(struct address_space *swap_space, gfp_t gfp,
+			    loff_t pos, void *buf, size_t len)
+{
+	while (len) {
+		size_t offset = pos & ~PAGE_MASK;
+		size_t n = min_t(size_t, len, PAGE_SIZE - offset);
+		struct page *page;
+		void *addr;
+
+		page = shmem_read_mapping_page_gfp(swap_space,
+						   pos >> PAGE_SHIFT, gfp);
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+
+		addr = kmap_atomic(page);
+		memcpy(buf, addr + offset, n);
+		kunmap_atomic(addr);
+		put_page(page);
+
+		buf += n;
+		pos += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void ttm_tt_swap_free_compressor(struct ttm_swap_compressor *comp)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = *per_cpu_ptr(comp->tfm, cpu);
+
+		if (!IS_ERR_OR_NULL(tfm))
+			crypto_free_comp(tfm);
+	}
+	free_percpu(comp->tfm);
+	kfree(comp);
+}
+
+static struct ttm_swap_compressor *ttm_tt_swap_get_compressor(const char *name)
+{
+	struct ttm_swap_compressor *comp;
+	int cpu;
+
+	list_for_each_entry(comp, &ttm_swap_comp_list, head)
+		if (!strcmp(comp->name, name))
+			return comp;
+
+	if (!crypto_has_comp(name, 0, 0))
+		return ERR_PTR(-ENOENT);
+
+	comp = kzalloc(sizeof(*comp), GFP_KERNEL);
+	if (!comp)
+		return ERR_PTR(-ENOMEM);
+
+	strlcpy(comp->name, name, sizeof(comp->name));
+	comp->tfm = alloc_percpu(struct crypto_comp *);
+	if (!comp->tfm) {
+		kfree(comp);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct crypto_comp *tfm = crypto_alloc_comp(name, 0, 0);
+
+		*per_cpu_ptr(comp->tfm, cpu) = tfm;
+		if (IS_ERR(tfm)) {
+			ttm_tt_swap_free_compressor(comp);
+			return ERR_CAST(tfm);
+		}
+	}
+
+	list_add(&comp->head, &ttm_swap_comp_list);
+
+	return comp;
+}
+
+int ttm_tt_swap_set_compression(const char *name)
+{
+	struct ttm_swap_compressor *comp = NULL;
+
+	mutex_lock(&ttm_swap_comp_lock);
+	if (strcmp(name, "none")) {
+		comp = ttm_tt_swap_get_compressor(name);
+		if (IS_ERR(comp)) {
+			mutex_unlock(&ttm_swap_comp_lock);
+			return PTR_ERR(comp);
+		}
+	}
+	WRITE_ONCE(ttm_swap_comp, comp);
+	mutex_unlock(&ttm_swap_comp_lock);
+
+	return 0;
+}
+
+void ttm_tt_swap_fini(void)
+{
+	struct ttm_swap_compressor *comp, *tmp;
+
+	mutex_lock(&ttm_swap_comp_lock);
+	ttm_swap_comp = NULL;
+	list_for_each_entry_safe(comp, tmp, &ttm_swap_comp_list, head) {
+		list_del(&comp->head);
+		ttm_tt_swap_free_compressor(comp);
+	}
+	mutex_unlock(&ttm_swap_comp_lock);
+}
+
+static int ttm_tt_swapout_compressed(struct ttm_tt *ttm,
+				     struct address_space *swap_space,
+				     struct ttm_swap_compressor *comp)
+{
+	gfp_t gfp_mask = ttm_tt_swap_gfp(ttm, swap_space);
+	unsigned int dlen;
+	loff_t pos = 0;
+	uint32_t *len;
+	void *buf;
+	int i, ret;
+
+	len = kvmalloc_array(ttm->num_pages, sizeof(*len), GFP_KERNEL);
+	buf = kmalloc(2 * PAGE_SIZE, GFP_KERNEL);
+	if (!len || !buf) {
+		/* Fall back to a plain copy */
+		kfree(buf);
+		kvfree(len);
+		return ttm_tt_swapout_pages(ttm, swap_space);
+	}
+
+	for (i = 0; i < ttm->num_pages; ++i) {
+		struct page *from_page = ttm->pages[i];
+		void *src;
+
+		len[i] = 0;
+		if (unlikely(from_page == NULL))
+			continue;
+
+		dlen = 2 * PAGE_SIZE;
+		src = kmap_atomic(from_page);
+		ret = crypto_comp_compress(*get_cpu_ptr(comp->tfm), src,
+					   PAGE_SIZE, buf, &dlen);
+		put_cpu_ptr(comp->tfm);
+		if (ret || dlen >= PAGE_SIZE) {
+			memcpy(buf, src, PAGE_SIZE);
+			dlen = PAGE_SIZE;
+		}
+		kunmap_atomic(src);
+
+		ret = ttm_tt_swap_write(swap_space, gfp_mask, pos, buf, dlen);
+		if (ret)
+			goto out_free;
+
+		len[i] = dlen;
+		pos += dlen;
+	}
+
+	kfree(buf);
+	ttm->swap_len = len;
+	ttm->swap_compressor = comp;
+	ttm->swap_pages = DIV_ROUND_UP(pos, PAGE_SIZE);
+
+	return 0;
+
+out_free:
+	kfree(buf);
+	kvfree(len);
+	return ret;
+}
+
+static int ttm_tt_swapin_compressed(struct ttm_tt *ttm,
+				    struct address_space *swap_space)
+{
+	struct ttm_swap_compressor *comp = ttm->swap_compressor;
+	gfp_t gfp_mask = ttm_tt_swap_gfp(ttm, swap_space);
+	unsigned int dlen;
+	loff_t pos = 0;
+	void *buf;
+	int i, ret = 0;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < ttm->num_pages; ++i) {
+		struct page *to_page = ttm->pages[i];
+		uint32_t len = ttm->swap_len[i];
+		void *dst;
+
+		if (unlikely(to_page == NULL)) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		if (!len) {
+			clear_highpage(to_page);
+			continue;
+		}
+
+		ret = ttm_tt_swap_read(swap_space, gfp_mask, pos, buf, len);
+		if (ret)
+			break;
+		pos += len;
+
+		dst = kmap_atomic(to_page);
+		if (len == PAGE_SIZE) {
+			memcpy(dst, buf, PAGE_SIZE);
+		} else {
+			dlen = PAGE_SIZE;
+			ret = crypto_comp_decompress(*get_cpu_ptr(comp->tfm),
+						     buf, len, dst, &dlen);
+			put_cpu_ptr(comp->tfm);
+			if (!ret && dlen != PAGE_SIZE)
+				ret = -EIO;
+		}
+		kunmap_atomic(dst);
+		if (ret)
+			break;
+	}
+
+	kfree(buf);
+	return ret;
+}
+#else
+int ttm_tt_swap_set_compression(const char *name)
+{
+	return strcmp(name, "none") ? -ENODEV : 0;
+}
+
+void ttm_tt_swap_fini(void)
+{
+}
+
+static int ttm_tt_swapout_compressed(struct ttm_tt *ttm,
+				     struct address_space *swap_space,
+				     struct ttm_swap_compressor *comp)
+{
+	return ttm_tt_swapout_pages(ttm, swap_space);
+}
+
+static int ttm_tt_swapin_compressed(struct ttm_tt *ttm,
+				    struct address_space *swap_space)
+{
+	return -ENODEV;
+}
+#endif
+EXPORT_SYMBOL(ttm_tt_swap_set_compression);
+
+const char *ttm_tt_swap_compression(void)
+{
+	struct ttm_swap_compressor *comp = READ_ONCE(ttm_swap_comp);
+
+	return comp ? comp->name : "none";
+}
+EXPORT_SYMBOL(ttm_tt_swap_compression);
+
 int ttm_tt_swapin(struct ttm_tt *ttm)
 {
 	struct address_space *swap_space;
@@ -394,10 +758,16 @@ int ttm_tt_swapin(struct ttm_tt *ttm)
 
 	swap_space = swap_storage->f_mapping;
 
+	if (ttm->swap_len) {
+		ret = ttm_tt_swapin_compressed(ttm, swap_space);
+		if (ret)
+			goto out_err;
+		goto out_done;
+	}
+
 	for (i = 0; i < ttm->num_pages; ++i) {
-		gfp_t gfp_mask = mapping_gfp_mask(swap_space);
+		gfp_t gfp_mask = ttm_tt_swap_gfp(ttm, swap_space);
 
-		gfp_mask |= (ttm->page_flags & TTM_PAGE_FLAG_NO_RETRY ? __GFP_RETRY_MAYFAIL : 0);
 		from_page = shmem_read_mapping_page_gfp(swap_space, i, gfp_mask);
 
 		if (IS_ERR(from_page)) {
@@ -412,24 +782,72 @@ int ttm_tt_swapin(struct ttm_tt *ttm)
 		put_page(from_page);
 	}
 
+out_done:
 	if (!(ttm->page_flags & TTM_PAGE_FLAG_PERSISTENT_SWAP))
 		fput(swap_storage);
 	ttm->swap_storage = NULL;
 	ttm->page_flags &= ~TTM_PAGE_FLAG_SWAPPED;
+	ttm_tt_swap_free(ttm);
 
 	return 0;
 out_err:
 	return ret;
 }
 
+struct ttm_tt_prefetch {
+	struct work_struct work;
+	struct file *swap_storage;
+	unsigned long num_pages;
+};
+
+static void ttm_tt_swapin_prefetch_work(struct work_struct *work)
+{
+	struct ttm_tt_prefetch *prefetch =
+		container_of(work, struct ttm_tt_prefetch, work);
+	struct address_space *swap_space = prefetch->swap_storage->f_mapping;
+	unsigned long i;
+
+	for (i = 0; i < prefetch->num_pages; ++i) {
+		struct page *page;
+
+		page = shmem_read_mapping_page_gfp(swap_space, i,
+				mapping_gfp_mask(swap_space) |
+				__GFP_NORETRY | __GFP_NOWARN);
+		if (IS_ERR(page))
+			break;
+		put_page(page);
+	}
+
+	fput(prefetch->swap_storage);
+	kfree(prefetch);
+}
+
+void ttm_tt_swapin_prefetch(struct ttm_tt *ttm)
+{
+	struct ttm_tt_prefetch *prefetch;
+
+	if (!(ttm->page_flags & TTM_PAGE_FLAG_SWAPPED) || !ttm->swap_storage ||
+	    !ttm_mem_glob.swapout_queue)
+		return;
+
+	prefetch = kmalloc(sizeof(*prefetch), GFP_NOWAIT | __GFP_NOWARN);
+	if (!prefetch)
+		return;
+
+	INIT_WORK(&prefetch->work, ttm_tt_swapin_prefetch_work);
+	prefetch->swap_storage = get_file(ttm->swap_storage);
+	prefetch->num_pages = ttm->swap_pages ? ttm->swap_pages :
+		ttm->num_pages;
+	queue_work(ttm_mem_glob.swapout_queue, &prefetch->work);
+}
+EXPORT_SYMBOL(ttm_tt_swapin_prefetch);
+
 int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 {
+	struct ttm_swap_compressor *comp = NULL;
 	struct address_space *swap_space;
 	struct file *swap_storage;
-	struct page *from_page;
-	struct page *to_page;
-	int i;
-	int ret = -ENOMEM;
+	int ret;
 
 	BUG_ON(ttm->state != tt_unbound && ttm->state != tt_unpopulated);
 	BUG_ON(ttm->caching_state != tt_cached);
@@ -442,31 +860,22 @@ int ttm_tt_swapout(struct ttm_tt *ttm, struct file *persistent_swap_storage)
 			pr_err("Failed allocating swap storage\n");
 			return PTR_ERR(swap_storage);
 		}
+		/* Persistent storage is shared with user space and must
+		 * keep the plain layout
+		 */
+		comp = READ_ONCE(ttm_swap_comp);
 	} else {
 		swap_storage = persistent_swap_storage;
 	}
 
 	swap_space = swap_storage->f_mapping;
 
-	for (i = 0; i < ttm->num_pages; ++i) {
-		gfp_t gfp_mask = mapping_gfp_mask(swap_space);
-
-		gfp_mask |= (ttm->page_flags & TTM_PAGE_FLAG_NO_RETRY ? __GFP_RETRY_MAYFAIL : 0);
-
-		from_page = ttm->pages[i];
-		if (unlikely(from_page == NULL))
-			continue;
-
-		to_page = shmem_read_mapping_page_gfp(swap_space, i, gfp_mask);
-		if (IS_ERR(to_page)) {
-			ret = PTR_ERR(to_page);
-			goto out_err;
-		}
-		copy_highpage(to_page, from_page);
-		set_page_dirty(to_page);
-		mark_page_accessed(to_page);
-		put_page(to_page);
-	}
+	if (comp)
+		ret = ttm_tt_swapout_compressed(ttm, swap_space, comp);
+	else
+		ret = ttm_tt_swapout_pages(ttm, swap_space);
+	if (ret)
+		goto out_err;
 
 	ttm_tt_unpopulate(ttm);
 	ttm->swap_storage = swap_storage;
@@ -3321,6 +3321,10 @@ static int ext4_readpage(struct file *file, struct page *page)
 
 	trace_ext4_readpage(page);
 
+	/* Only readahead adds THPs, see ext4_set_aops() */
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) && PageTransHuge(page))
+		return mpage_readpage_thp(page, ext4_get_block);
+
 	if (ext4_has_inline_data(inode))
 		ret = ext4_readpage_inline(inode, page);
 
@@ -3958,6 +3962,7 @@ void ext4_set_aops(struct inode *inode)
 		break;
 	case EXT4_INODE_JOURNAL_DATA_MODE:
 		inode->i_mapping->a_ops = &ext4_journalled_aops;
+		mapping_clear_thp_support(inode->i_mapping);
 		return;
 	default:
 		BUG();
@@ -3968,6 +3973,16 @@ void ext4_set_aops(struct inode *inode)
 		inode->i_mapping->a_ops = &ext4_da_aops;
 	else
 		inode->i_mapping->a_ops = &ext4_aops;
+
+	/*
+	 * Readahead may read plain, block mapped regular files into THPs.
+	 * Inline data files are too small for a THP to ever fit below EOF.
+	 */
+	if (S_ISREG(inode->i_mode) && !IS_DAX(inode) &&
+	    !ext4_encrypted_inode(inode))
+		mapping_set_thp_support(inode->i_mapping);
+	else
+		mapping_clear_thp_support(inode->i_mapping);
 }
 
 static int __ext4_block_zero_page_range(handle_t *handle,
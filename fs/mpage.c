@@ -30,6 +30,7 @@
 #include <linux/backing-dev.h>
 #include <linux/pagevec.h>
 #include <linux/cleancache.h>
+#include <linux/slab.h>
 #include "internal.h"
 
 /*
@@ -416,6 +417,150 @@ int mpage_readpage(struct page *page, get_block_t get_block)
 }
 EXPORT_SYMBOL(mpage_readpage);
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/*
+ * Reading a THP takes as many BIOs as the file has extents in its range.
+ * The head page stays locked until the last of them completes.
+ */
+struct mpage_thp_read {
+	struct page *head;
+	atomic_t pending;
+	bool failed;
+};
+
+static void mpage_thp_read_done(struct mpage_thp_read *rd)
+{
+	if (!atomic_dec_and_test(&rd->pending))
+		return;
+	/* No PG_error on compound pages: readers see !PageUptodate */
+	if (!READ_ONCE(rd->failed))
+		SetPageUptodate(rd->head);
+	unlock_page(rd->head);
+	kfree(rd);
+}
+
+static void mpage_thp_end_io(struct bio *bio)
+{
+	struct mpage_thp_read *rd = bio->bi_private;
+
+	if (bio->bi_status)
+		WRITE_ONCE(rd->failed, true);
+	bio_put(bio);
+	mpage_thp_read_done(rd);
+}
+
+static struct bio *mpage_thp_submit(struct bio *bio, struct mpage_thp_read *rd)
+{
+	atomic_inc(&rd->pending);
+	bio->bi_private = rd;
+	bio->bi_end_io = mpage_thp_end_io;
+	bio_set_op_attrs(bio, REQ_OP_READ, 0);
+	guard_bio_eod(REQ_OP_READ, bio);
+	submit_bio(bio);
+	return NULL;
+}
+
+/**
+ * mpage_readpage_thp - start reading a THP
+ * @head: the locked head page, just added to the page cache by readahead
+ * @get_block: the filesystem's block mapper function
+ *
+ * For filesystems that set mapping_set_thp_support() on their regular
+ * files, to be called from ->readpage for a THP. Holes and blocks beyond
+ * EOF are zeroed, everything else is read with one BIO per run of
+ * contiguous blocks. Unlike mpage_readpage() there is no fallback to
+ * buffer heads, a THP never has them. @head is unlocked once all I/O has
+ * completed, and marked uptodate if none of it failed.
+ */
+int mpage_readpage_thp(struct page *head, get_block_t get_block)
+{
+	struct inode *inode = head->mapping->host;
+	const unsigned blkbits = inode->i_blkbits;
+	const unsigned blocksize = 1 << blkbits;
+	const unsigned blocks_per_page = PAGE_SIZE >> blkbits;
+	const unsigned nr_blocks = HPAGE_PMD_NR * blocks_per_page;
+	sector_t first_block = (sector_t)head->index << (PAGE_SHIFT - blkbits);
+	sector_t last_block = (i_size_read(inode) + blocksize - 1) >> blkbits;
+	gfp_t gfp = mapping_gfp_constraint(head->mapping, GFP_KERNEL);
+	struct mpage_thp_read *rd;
+	struct buffer_head map_bh;
+	struct bio *bio = NULL;
+	sector_t next_sector = 0;
+	unsigned block = 0;
+
+	VM_BUG_ON_PAGE(!PageTransHuge(head), head);
+	VM_BUG_ON_PAGE(!PageLocked(head), head);
+
+	rd = kmalloc(sizeof(*rd), gfp);
+	if (!rd) {
+		unlock_page(head);
+		return -ENOMEM;
+	}
+	rd->head = head;
+	atomic_set(&rd->pending, 1);
+	rd->failed = false;
+
+	while (block < nr_blocks) {
+		unsigned nr = nr_blocks - block;
+		unsigned i;
+
+		map_bh.b_state = 0;
+		if (first_block + block < last_block) {
+			map_bh.b_size = (size_t)nr << blkbits;
+			if (get_block(inode, first_block + block, &map_bh, 0)) {
+				rd->failed = true;
+				break;
+			}
+			/* b_size is only trustworthy for mapped extents */
+			if (buffer_mapped(&map_bh))
+				nr = min_t(unsigned, nr, max_t(size_t,
+					   map_bh.b_size >> blkbits, 1));
+			else
+				nr = 1;
+		}
+
+		if (!buffer_mapped(&map_bh) || buffer_unwritten(&map_bh)) {
+			/* A hole, unwritten extent, or past EOF */
+			for (i = 0; i < nr; i++, block++)
+				zero_user(head + block / blocks_per_page,
+					  (block % blocks_per_page) << blkbits,
+					  blocksize);
+			continue;
+		}
+
+		for (i = 0; i < nr; i++, block++) {
+			struct page *page = head + block / blocks_per_page;
+			unsigned offset = (block % blocks_per_page) << blkbits;
+			sector_t sector = (map_bh.b_blocknr + i) << (blkbits - 9);
+
+			if (bio && sector != next_sector)
+				bio = mpage_thp_submit(bio, rd);
+			if (bio &&
+			    bio_add_page(bio, page, blocksize, offset) < blocksize)
+				bio = mpage_thp_submit(bio, rd);
+			if (!bio) {
+				bio = mpage_alloc(map_bh.b_bdev, sector,
+						  min_t(int, nr_blocks - block,
+							BIO_MAX_PAGES), gfp);
+				if (!bio) {
+					rd->failed = true;
+					goto out;
+				}
+				bio_add_page(bio, page, blocksize, offset);
+			}
+			next_sector = sector + (blocksize >> 9);
+		}
+	}
+out:
+	if (bio)
+		mpage_thp_submit(bio, rd);
+	/* Drop the reference that kept the page locked while submitting */
+	mpage_thp_read_done(rd);
+	return 0;
+}
+EXPORT_SYMBOL(mpage_readpage_thp);
+#endif
+
 /*
  * Writing is not so simple.
  *
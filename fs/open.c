@@ -768,6 +768,15 @@ static int do_dentry_open(struct file *f,
 			goto cleanup_file;
 		}
 		f->f_mode |= FMODE_WRITER;
+
+		/*
+		 * The page cache of a file open for write must not hold
+		 * THPs. Pairs with the barrier in add_to_page_cache_thp():
+		 * either we see its THP here, or it sees the writer.
+		 */
+		smp_mb();
+		if (filemap_nr_thps(inode->i_mapping))
+			filemap_drop_thps(inode->i_mapping);
 	}
 
 	/* POSIX.1-2008/SUSv4 Section XSI 2.9.7 */
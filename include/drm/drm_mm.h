@@ -136,6 +136,7 @@ struct drm_mm_node {
 	struct rb_node rb_hole_addr;
 	u64 __subtree_last;
 	u64 hole_size;
+	u64 subtree_max_hole;
 	bool allocated : 1;
 	bool scanned_block : 1;
 #ifdef CONFIG_DRM_DEBUG_MM
@@ -27,6 +27,7 @@
 #define __DRM_SYNCOBJ_H__
 
 #include "linux/dma-fence.h"
+#include "linux/dma-fence-chain.h"
 
 struct drm_syncobj_cb;
 
@@ -42,7 +43,8 @@ struct drm_syncobj {
 	struct kref refcount;
 	/**
 	 * @fence:
-	 * NULL or a pointer to the fence bound to this object.
+	 * NULL or a pointer to the fence bound to this object. For timeline
+	 * syncobjs this is the last &dma_fence_chain node added.
 	 *
 	 * This field should not be used directly. Use drm_syncobj_fence_get()
 	 * and drm_syncobj_replace_fence() instead.
@@ -73,8 +75,8 @@ typedef void (*drm_syncobj_func_t)(struct drm_syncobj *syncobj,
  *
  * This struct will be initialized by drm_syncobj_add_callback, additional
  * data can be passed along by embedding drm_syncobj_cb in another struct.
- * The callback will get called the next time drm_syncobj_replace_fence is
- * called.
+ * The callback will get called the next time drm_syncobj_replace_fence or
+ * drm_syncobj_add_point is called.
  */
 struct drm_syncobj_cb {
 	struct list_head node;
@@ -136,11 +138,18 @@ void drm_syncobj_add_callback(struct drm_syncobj *syncobj,
 			      drm_syncobj_func_t func);
 void drm_syncobj_remove_callback(struct drm_syncobj *syncobj,
 				 struct drm_syncobj_cb *cb);
+void drm_syncobj_add_point(struct drm_syncobj *syncobj,
+			   struct dma_fence_chain *chain,
+			   struct dma_fence *fence,
+			   u64 point);
 void drm_syncobj_replace_fence(struct drm_syncobj *syncobj,
 			       struct dma_fence *fence);
 int drm_syncobj_find_fence(struct drm_file *file_private,
 			   u32 handle,
 			   struct dma_fence **fence);
+int drm_syncobj_find_fence_point(struct drm_file *file_private,
+				 u32 handle, u64 point, u64 flags,
+				 struct dma_fence **fence);
 void drm_syncobj_free(struct kref *kref);
 int drm_syncobj_create(struct drm_syncobj **out_syncobj, uint32_t flags,
 		       struct dma_fence *fence);
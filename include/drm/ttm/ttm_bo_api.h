@@ -777,6 +777,9 @@ ssize_t ttm_bo_io(struct ttm_bo_device *bdev, struct file *filp,
 
 int ttm_bo_swapout(struct ttm_bo_global *glob,
 			struct ttm_operation_ctx *ctx);
+int ttm_bo_swapout_batch(struct ttm_bo_global *glob,
+			 struct ttm_operation_ctx *ctx,
+			 unsigned long num_pages);
 void ttm_bo_swapout_all(struct ttm_bo_device *bdev);
 int ttm_bo_wait_unreserved(struct ttm_buffer_object *bo);
 #endif
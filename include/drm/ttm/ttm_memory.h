@@ -47,6 +47,8 @@
  * for the GPU, and this will otherwise block other workqueue tasks(?)
  * At this point we use only a single-threaded workqueue.
  * @work: The workqueue callback for the shrink queue.
+ * @swapout_queue: Unbound workqueue copying BO content to and from shmem,
+ * so that a batch of BOs is swapped out in parallel.
  * @lock: Lock to protect the @shrink - and the memory accounting members,
  * that is, essentially the whole structure with some exceptions.
  * @lower_mem_limit: include lower limit of swap space and lower limit of
@@ -68,6 +70,7 @@ extern struct ttm_mem_global {
 	struct ttm_bo_global *bo_glob;
 	struct workqueue_struct *swap_queue;
 	struct work_struct work;
+	struct workqueue_struct *swapout_queue;
 	spinlock_t lock;
 	uint64_t lower_mem_limit;
 	struct ttm_mem_zone *zones[TTM_MEM_MAX_ZONES];
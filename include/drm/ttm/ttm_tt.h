@@ -33,6 +33,7 @@ struct ttm_tt;
 struct ttm_mem_reg;
 struct ttm_buffer_object;
 struct ttm_operation_ctx;
+struct ttm_swap_compressor;
 
 #define TTM_PAGE_FLAG_WRITE           (1 << 3)
 #define TTM_PAGE_FLAG_SWAPPED         (1 << 4)
@@ -95,6 +96,9 @@ struct ttm_backend_func {
  * @bdev: Pointer to the current struct ttm_bo_device.
  * @be: Pointer to the ttm backend.
  * @swap_storage: Pointer to shmem struct file for swap storage.
+ * @swap_compressor: Compressor the swapped content was packed with, if any.
+ * @swap_len: Compressed length of each page while swapped out compressed.
+ * @swap_pages: Number of shmem pages holding the swapped content.
  * @caching_state: The current caching state of the pages.
  * @state: The current binding state of the pages.
  *
@@ -110,6 +114,9 @@ struct ttm_tt {
 	unsigned long num_pages;
 	struct sg_table *sg; /* for SG objects via dma-buf */
 	struct file *swap_storage;
+	struct ttm_swap_compressor *swap_compressor;
+	uint32_t *swap_len;
+	unsigned long swap_pages;
 	enum ttm_caching_state caching_state;
 	enum {
 		tt_bound,
@@ -213,6 +220,29 @@ void ttm_tt_unbind(struct ttm_tt *ttm);
  */
 int ttm_tt_swapin(struct ttm_tt *ttm);
 
+/**
+ * ttm_tt_swapin_prefetch:
+ *
+ * @ttm: The struct ttm_tt.
+ *
+ * Start reading the swap storage of a swapped out ttm_tt in the background,
+ * so that a following ttm_tt_swapin() doesn't wait on the swap device page
+ * by page.
+ */
+void ttm_tt_swapin_prefetch(struct ttm_tt *ttm);
+
+/**
+ * ttm_tt_swap_set_compression:
+ *
+ * @name: Name of a crypto compression algorithm, or "none".
+ *
+ * Select the algorithm used to compress ttm_tt content swapped out to shmem.
+ * Content already swapped out keeps the algorithm it was packed with.
+ */
+int ttm_tt_swap_set_compression(const char *name);
+const char *ttm_tt_swap_compression(void);
+void ttm_tt_swap_fini(void);
+
 /**
  * ttm_tt_set_placement_caching:
  *
@@ -59,6 +59,9 @@ enum transparent_hugepage_flag {
 	TRANSPARENT_HUGEPAGE_DEFRAG_REQ_MADV_FLAG,
 	TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG,
 	TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG,
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	TRANSPARENT_HUGEPAGE_FILE_READAHEAD_FLAG,
+#endif
 #ifdef CONFIG_DEBUG_VM
 	TRANSPARENT_HUGEPAGE_DEBUG_COW_FLAG,
 #endif
@@ -119,6 +122,13 @@ static inline bool transparent_hugepage_enabled(struct vm_area_struct *vma)
 #define transparent_hugepage_use_zero_page()				\
 	(transparent_hugepage_flags &					\
 	 (1<<TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG))
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+#define transparent_hugepage_file_readahead()				\
+	(transparent_hugepage_flags &					\
+	 (1<<TRANSPARENT_HUGEPAGE_FILE_READAHEAD_FLAG))
+#else
+#define transparent_hugepage_file_readahead() 0
+#endif
 #ifdef CONFIG_DEBUG_VM
 #define transparent_hugepage_debug_cow()				\
 	(transparent_hugepage_flags &					\
@@ -71,6 +71,56 @@ struct mem_cgroup_reclaim_cookie {
 	unsigned int generation;
 };
 
+/*
+ * Take and release lruvec->lru_lock with interrupts already disabled. With
+ * CONFIG_LRU_LOCK_STAT these also account the lock in lruvec->lock_stat.
+ */
+#ifdef CONFIG_LRU_LOCK_STAT
+void __lruvec_lock(struct lruvec *lruvec);
+bool __lruvec_trylock(struct lruvec *lruvec);
+void __lruvec_unlock(struct lruvec *lruvec);
+#else
+static inline void __lruvec_lock(struct lruvec *lruvec)
+{
+	spin_lock(&lruvec->lru_lock);
+}
+
+static inline bool __lruvec_trylock(struct lruvec *lruvec)
+{
+	return spin_trylock(&lruvec->lru_lock);
+}
+
+static inline void __lruvec_unlock(struct lruvec *lruvec)
+{
+	spin_unlock(&lruvec->lru_lock);
+}
+#endif
+
+static inline void lruvec_lock_irq(struct lruvec *lruvec)
+{
+	local_irq_disable();
+	__lruvec_lock(lruvec);
+}
+
+static inline void lruvec_unlock_irq(struct lruvec *lruvec)
+{
+	__lruvec_unlock(lruvec);
+	local_irq_enable();
+}
+
+#define lruvec_lock_irqsave(lruvec, flags)		\
+	do {						\
+		local_irq_save(flags);			\
+		__lruvec_lock(lruvec);			\
+	} while (0)
+
+static inline void lruvec_unlock_irqrestore(struct lruvec *lruvec,
+					    unsigned long flags)
+{
+	__lruvec_unlock(lruvec);
+	local_irq_restore(flags);
+}
+
 #ifdef CONFIG_MEMCG
 
 #define MEM_CGROUP_ID_SHIFT	16
@@ -366,6 +416,7 @@ static inline struct lruvec *mem_cgroup_lruvec(struct pglist_data *pgdat,
 }
 
 struct lruvec *mem_cgroup_page_lruvec(struct page *, struct pglist_data *);
+struct lruvec *lock_page_lruvec(struct page *page);
 
 bool task_in_mem_cgroup(struct task_struct *task, struct mem_cgroup *memcg);
 struct mem_cgroup *mem_cgroup_from_task(struct task_struct *p);
@@ -405,6 +456,24 @@ static inline struct mem_cgroup *lruvec_memcg(struct lruvec *lruvec)
 	return mz->memcg;
 }
 
+/*
+ * Whether @lruvec is the one @page is on. page->mem_cgroup is only compared,
+ * never dereferenced, so this is safe on a page that is being moved to
+ * another memcg; the answer is stable once the lru_lock of @lruvec is held.
+ */
+static inline bool lruvec_holds_page_lru_lock(struct page *page,
+					      struct lruvec *lruvec)
+{
+	struct mem_cgroup *memcg;
+
+	if (mem_cgroup_disabled())
+		return lruvec == node_lruvec(page_pgdat(page));
+
+	memcg = page->mem_cgroup ? : root_mem_cgroup;
+	return lruvec_memcg(lruvec) == memcg &&
+		lruvec_pgdat(lruvec) == page_pgdat(page);
+}
+
 /**
  * parent_mem_cgroup - find the accounting parent of a memcg
  * @memcg: memcg whose parent to find
@@ -825,6 +894,20 @@ static inline struct lruvec *mem_cgroup_page_lruvec(struct page *page,
 	return &pgdat->lruvec;
 }
 
+static inline struct lruvec *lock_page_lruvec(struct page *page)
+{
+	struct lruvec *lruvec = node_lruvec(page_pgdat(page));
+
+	__lruvec_lock(lruvec);
+	return lruvec;
+}
+
+static inline bool lruvec_holds_page_lru_lock(struct page *page,
+					      struct lruvec *lruvec)
+{
+	return lruvec == node_lruvec(page_pgdat(page));
+}
+
 static inline bool mm_match_cgroup(struct mm_struct *mm,
 		struct mem_cgroup *memcg)
 {
@@ -1031,6 +1114,46 @@ void count_memcg_event_mm(struct mm_struct *mm, enum vm_event_item idx)
 }
 #endif /* CONFIG_MEMCG */
 
+static inline struct lruvec *lock_page_lruvec_irq(struct page *page)
+{
+	local_irq_disable();
+	return lock_page_lruvec(page);
+}
+
+#define lock_page_lruvec_irqsave(page, flags)		\
+({							\
+	local_irq_save(flags);				\
+	lock_page_lruvec(page);				\
+})
+
+/*
+ * Switch from the locked lruvec, which may be NULL, to the one of @page,
+ * keeping the lock if it already covers @page. Meant for batched walks over
+ * pages that mostly share an lruvec.
+ */
+static inline struct lruvec *relock_page_lruvec_irq(struct page *page,
+						    struct lruvec *locked)
+{
+	if (locked) {
+		if (lruvec_holds_page_lru_lock(page, locked))
+			return locked;
+		lruvec_unlock_irq(locked);
+	}
+	return lock_page_lruvec_irq(page);
+}
+
+static inline struct lruvec *relock_page_lruvec_irqsave(struct page *page,
+							struct lruvec *locked,
+							unsigned long *flags)
+{
+	if (locked) {
+		if (lruvec_holds_page_lru_lock(page, locked))
+			return locked;
+		lruvec_unlock_irqrestore(locked, *flags);
+	}
+	return lock_page_lruvec_irqsave(page, *flags);
+}
+
 /* idx can be of type enum memcg_stat_item or node_stat_item */
 static inline void __inc_memcg_state(struct mem_cgroup *memcg,
 				     int idx)
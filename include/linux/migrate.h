@@ -61,6 +61,11 @@ static inline struct page *new_page_nodemask(struct page *page,
 
 #ifdef CONFIG_MIGRATION
 
+/* Upper bound for vm.migrate_copy_threads */
+#define MIGRATE_COPY_THREADS_MAX	16
+
+extern int sysctl_migrate_copy_threads;
+
 extern void putback_movable_pages(struct list_head *l);
 extern int migrate_page(struct address_space *mapping,
 			struct page *newpage, struct page *page,
@@ -44,9 +44,167 @@ static __always_inline void update_lru_size(struct lruvec *lruvec,
 #endif
 }
 
+#ifdef CONFIG_LRU_GEN
+
+static inline bool lru_gen_enabled(struct lruvec *lruvec)
+{
+	return READ_ONCE(lruvec->lrugen.enabled);
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* Returns the generation a page is on, or -1 if it isn't on a gen list */
+static inline int page_lru_gen(struct page *page)
+{
+	unsigned long flags = READ_ONCE(page->flags);
+
+	return ((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+/* The two youngest generations stand in for the active lists */
+static inline bool lru_gen_is_active(struct lruvec *lruvec, int gen)
+{
+	unsigned long max_seq = READ_ONCE(lruvec->lrugen.max_seq);
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+static inline enum lru_list lru_gen_lru(struct lruvec *lruvec, int type,
+					int gen)
+{
+	return type * LRU_FILE + (lru_gen_is_active(lruvec, gen) ? LRU_ACTIVE : 0);
+}
+
+/* Moves the page's pages from old_gen to new_gen, either may be -1 */
+static inline void lru_gen_update_size(struct lruvec *lruvec,
+				       struct page *page, int old_gen,
+				       int new_gen)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	int delta = hpage_nr_pages(page);
+
+	lockdep_assert_held(&lruvec->lru_lock);
+
+	if (old_gen >= 0) {
+		lrugen->nr_pages[old_gen][type][zone] -= delta;
+		update_lru_size(lruvec, lru_gen_lru(lruvec, type, old_gen),
+				zone, -delta);
+	}
+	if (new_gen >= 0) {
+		lrugen->nr_pages[new_gen][type][zone] += delta;
+		update_lru_size(lruvec, lru_gen_lru(lruvec, type, new_gen),
+				zone, delta);
+	}
+}
+
+/* Moves a page that is on a gen list of @lruvec to the head of @gen */
+static inline void lru_gen_move_page(struct lruvec *lruvec, struct page *page,
+				     int gen)
+{
+	int old_gen = page_lru_gen(page);
+
+	VM_BUG_ON_PAGE(old_gen < 0, page);
+
+	set_mask_bits(&page->flags, LRU_GEN_MASK,
+		      (gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, old_gen, gen);
+	list_move(&page->lru, &lruvec->lrugen.lists[gen]
+				[page_is_file_cache(page)][page_zonenum(page)]);
+}
+
+/*
+ * Active pages go into the youngest generation, and pages being put back
+ * by reclaim into the oldest one. The rest are added to the second oldest
+ * generation, so they get one more round of aging before eviction.
+ */
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool reclaiming)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	unsigned long seq;
+	int gen;
+
+	if (!lrugen->enabled || PageUnevictable(page))
+		return false;
+
+	VM_BUG_ON_PAGE(page_lru_gen(page) != -1, page);
+
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if (reclaiming)
+		seq = lrugen->min_seq[type];
+	else
+		seq = lrugen->min_seq[type] + 1;
+
+	gen = lru_gen_from_seq(seq);
+	set_mask_bits(&page->flags, LRU_GEN_MASK | BIT(PG_active),
+		      (gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, -1, gen);
+
+	if (reclaiming)
+		list_add_tail(&page->lru, &lrugen->lists[gen][type][zone]);
+	else
+		list_add(&page->lru, &lrugen->lists[gen][type][zone]);
+
+	return true;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	VM_BUG_ON_PAGE(PageActive(page), page);
+	VM_BUG_ON_PAGE(PageUnevictable(page), page);
+
+	set_mask_bits(&page->flags, LRU_GEN_MASK, 0);
+	lru_gen_update_size(lruvec, page, gen, -1);
+	list_del(&page->lru);
+
+	return true;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(struct lruvec *lruvec)
+{
+	return false;
+}
+
+static inline int page_lru_gen(struct page *page)
+{
+	return -1;
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, false))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add(&page->lru, &lruvec->lists[lru]);
 }
@@ -54,6 +212,9 @@ static __always_inline void add_page_to_lru_list(struct page *page,
 static __always_inline void add_page_to_lru_list_tail(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, true))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add_tail(&page->lru, &lruvec->lists[lru]);
 }
@@ -61,6 +222,9 @@ static __always_inline void add_page_to_lru_list_tail(struct page *page,
 static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_del_page(lruvec, page))
+		return;
+
 	list_del(&page->lru);
 	update_lru_size(lruvec, lru, page_zonenum(page), -hpage_nr_pages(page));
 }
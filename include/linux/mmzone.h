@@ -174,6 +174,7 @@ enum node_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_SHMEM_THPS,
 	NR_SHMEM_PMDMAPPED,
+	NR_FILE_THPS,		/* huge pages in the page cache of regular files */
 	NR_ANON_THPS,
 	NR_UNSTABLE_NFS,	/* NFS unstable pages */
 	NR_VMSCAN_WRITE,
@@ -233,7 +234,53 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_LOCK_STAT
+/* How lruvec->lru_lock is used; updated under the lock */
+struct lru_lock_stat {
+	unsigned long			acquired;
+	unsigned long			contended;
+	u64				wait_ns;
+	u64				hold_ns;
+	u64				locked_at;
+};
+#endif
+
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU keeps evictable pages in generations by when they were
+ * last found accessed, instead of on active and inactive lists. Aging walks
+ * the page tables of the processes using the lruvec, moves the pages found
+ * accessed into the youngest generation, max_seq, and then starts a new one.
+ * Eviction takes pages from the oldest generation of each type, min_seq[].
+ * The two youngest generations are accounted as the active lists, the rest
+ * as the inactive ones.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
+struct lru_gen {
+	unsigned long			max_seq;
+	/* The anon ones in [0], file ones in [1] */
+	unsigned long			min_seq[2];
+	/* Pages by generation (seq % MAX_NR_GENS), type and zone */
+	struct list_head		lists[MAX_NR_GENS][2][MAX_NR_ZONES];
+	long				nr_pages[MAX_NR_GENS][2][MAX_NR_ZONES];
+	/* Whether pages added to the lruvec go on these lists */
+	bool				enabled;
+	/* Bit 0 is set while aging walks page tables for the lruvec */
+	unsigned long			aging;
+};
+
+void lru_gen_init_lruvec(struct lruvec *lruvec);
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
+
 struct lruvec {
+	/* Protects the lists, their sizes, reclaim_stat and lrugen */
+	spinlock_t			lru_lock;
 	struct list_head		lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat	reclaim_stat;
 	/* Evictions & activations on the inactive file list */
@@ -243,6 +290,12 @@ struct lruvec {
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
+#ifdef CONFIG_LRU_LOCK_STAT
+	struct lru_lock_stat		lock_stat;
+#endif
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen			lrugen;
+#endif
 };
 
 /* Mask used at gathering information at once (see memcontrol.c) */
@@ -694,7 +747,6 @@ typedef struct pglist_data {
 
 	/* Write-intensive fields used by page reclaim */
 	ZONE_PADDING(_pad1_)
-	spinlock_t		lru_lock;
 
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
 	/*
@@ -735,11 +787,6 @@ typedef struct pglist_data {
 
 #define node_start_pfn(nid)	(NODE_DATA(nid)->node_start_pfn)
 #define node_end_pfn(nid) pgdat_end_pfn(NODE_DATA(nid))
-static inline spinlock_t *zone_lru_lock(struct zone *zone)
-{
-	return &zone->zone_pgdat->lru_lock;
-}
-
 static inline struct lruvec *node_lruvec(struct pglist_data *pgdat)
 {
 	return &pgdat->lruvec;
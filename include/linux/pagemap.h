@@ -29,6 +29,7 @@ enum mapping_flags {
 	AS_EXITING	= 4, 	/* final truncate in progress */
 	/* writeback related tags are not used */
 	AS_NO_WRITEBACK_TAGS = 5,
+	AS_THP_SUPPORT	= 6,	/* ->readpage can read into a THP */
 };
 
 /**
@@ -97,6 +98,62 @@ static inline int mapping_use_writeback_tags(struct address_space *mapping)
 	return !test_bit(AS_NO_WRITEBACK_TAGS, &mapping->flags);
 }
 
+/*
+ * A filesystem sets AS_THP_SUPPORT on a regular file's mapping when its
+ * ->readpage can fill a whole transparent huge page. Readahead then reads
+ * the file into THPs, as long as nobody has it open for write.
+ */
+static inline void mapping_set_thp_support(struct address_space *mapping)
+{
+	set_bit(AS_THP_SUPPORT, &mapping->flags);
+}
+
+static inline void mapping_clear_thp_support(struct address_space *mapping)
+{
+	clear_bit(AS_THP_SUPPORT, &mapping->flags);
+}
+
+static inline bool mapping_thp_support(struct address_space *mapping)
+{
+	return IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) &&
+		test_bit(AS_THP_SUPPORT, &mapping->flags);
+}
+
+static inline int filemap_nr_thps(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	return atomic_read(&mapping->nr_thps);
+#else
+	return 0;
+#endif
+}
+
+static inline void filemap_nr_thps_inc(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_inc(&mapping->nr_thps);
+#else
+	WARN_ON_ONCE(1);
+#endif
+}
+
+static inline void filemap_nr_thps_dec(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_dec(&mapping->nr_thps);
+#else
+	WARN_ON_ONCE(1);
+#endif
+}
+
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+void filemap_drop_thps(struct address_space *mapping);
+#else
+static inline void filemap_drop_thps(struct address_space *mapping)
+{
+}
+#endif
+
 static inline gfp_t mapping_gfp_mask(struct address_space * mapping)
 {
 	return mapping->gfp_mask;
@@ -619,6 +676,16 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 				pgoff_t index, gfp_t gfp_mask);
 extern void delete_from_page_cache(struct page *page);
 extern void __delete_from_page_cache(struct page *page, void *shadow);
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+int add_to_page_cache_thp(struct page *page, struct address_space *mapping,
+				pgoff_t index, gfp_t gfp_mask);
+#else
+static inline int add_to_page_cache_thp(struct page *page,
+		struct address_space *mapping, pgoff_t index, gfp_t gfp_mask)
+{
+	return -EINVAL;
+}
+#endif
 int replace_page_cache_page(struct page *old, struct page *new, gfp_t gfp_mask);
 void delete_from_page_cache_batch(struct address_space *mapping,
 				  struct pagevec *pvec);
@@ -54,11 +54,23 @@ extern const char reservation_seqcount_string[];
  * @rcu: for internal use
  * @shared_count: table of shared fences
  * @shared_max: for growing shared fence table
+ * @index: update side hash of fence contexts to shared slots, for internal use
+ * @index_bits: log2 of the number of @index buckets
+ * @index_valid: @index matches @shared, cleared when @shared is modified
+ *	directly
+ * @prune_cursor: next slot to check for a signaled fence, for internal use
  * @shared: shared fence table
+ *
+ * Lists must be allocated with reservation_object_list_alloc(). Code which
+ * fills @shared by hand must leave @index_valid cleared.
  */
 struct reservation_object_list {
 	struct rcu_head rcu;
 	u32 shared_count, shared_max;
+	u32 *index;
+	u32 index_bits;
+	bool index_valid;
+	u32 prune_cursor;
 	struct dma_fence __rcu *shared[];
 };
 
@@ -263,6 +275,8 @@ reservation_object_get_excl_rcu(struct reservation_object *obj)
 
 int reservation_object_reserve_shared(struct reservation_object *obj,
 				      unsigned int num_fences);
+struct reservation_object_list *
+reservation_object_list_alloc(unsigned int shared_max);
 void reservation_object_add_shared_fence(struct reservation_object *obj,
 					 struct dma_fence *fence);
 
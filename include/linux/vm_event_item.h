@@ -110,6 +110,11 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_SWAP
 		SWAP_RA,
 		SWAP_RA_HIT,
+#endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+		SPF_HANDLED,	/* resolved without mmap_sem */
+		SPF_SKIP,	/* VMA not eligible, went to mmap_sem */
+		SPF_ABORT,	/* raced with a VMA change, went to mmap_sem */
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -500,6 +500,187 @@ struct kfd_ioctl_ipc_import_handle_args {
 	__u32 pad;
 };
 
+/* Maximum number of handles imported by one AMDKFD_IOC_IPC_IMPORT_HANDLES */
+#define KFD_IPC_MAX_IMPORT_HANDLES	4096
+
+struct kfd_ioctl_ipc_import_handles_args {
+	__u64 import_array_ptr;	/* to KFD: struct kfd_ioctl_ipc_import_handle_args[] */
+	__u32 num_handles;	/* to KFD */
+	__u32 num_imported;	/* from KFD */
+};
+
+/* Packed topology snapshot returned by AMDKFD_IOC_GET_TOPOLOGY
+ *
+ * The blob starts with a kfd_topology_blob_header followed by num_nodes
+ * nodes in sysfs node order. Each node is a kfd_topology_blob_node followed
+ * by its num_mem_banks memory, num_caches cache and num_io_links IO link
+ * records. Records are placed at the stride given by the *_size fields of
+ * the header, so newer kernels may append fields without breaking older
+ * parsers.
+ */
+#define KFD_TOPOLOGY_BLOB_VERSION	1
+
+#define KFD_TOPOLOGY_BLOB_NAME_SIZE	128
+#define KFD_TOPOLOGY_BLOB_SIBLINGMAP_SIZE	32
+
+/* Caller is not allowed to access this node, only gpu_id is valid */
+#define KFD_TOPOLOGY_BLOB_NODE_NO_ACCESS	(1 << 0)
+
+struct kfd_topology_blob_header {
+	__u32 version;
+	__u32 size;		/* total size of the blob in bytes */
+	__u32 generation_id;
+	__u32 num_nodes;
+	__u64 platform_oem;
+	__u64 platform_id;
+	__u64 platform_rev;
+	__u16 header_size;
+	__u16 node_size;
+	__u16 mem_size;
+	__u16 cache_size;
+	__u16 iolink_size;
+	__u16 pad[3];
+};
+
+struct kfd_topology_blob_node {
+	__u32 gpu_id;
+	__u32 flags;		/* KFD_TOPOLOGY_BLOB_NODE_* */
+	__u32 num_mem_banks;
+	__u32 num_caches;
+	__u32 num_io_links;
+	__u32 cpu_cores_count;
+	__u32 simd_count;
+	__u32 mem_banks_count;
+	__u32 caches_count;
+	__u32 io_links_count;
+	__u32 cpu_core_id_base;
+	__u32 simd_id_base;
+	__u32 max_waves_per_simd;
+	__u32 lds_size_in_kb;
+	__u32 gds_size_in_kb;
+	__u32 wave_front_size;
+	__u32 array_count;
+	__u32 simd_arrays_per_engine;
+	__u32 cu_per_simd_array;
+	__u32 simd_per_cu;
+	__u32 max_slots_scratch_cu;
+	__u32 vendor_id;
+	__u32 device_id;
+	__u32 location_id;
+	__s32 drm_render_minor;
+	__u32 max_engine_clk_fcompute;
+	__u32 max_engine_clk_ccompute;
+	__u32 fw_version;
+	__u32 sdma_fw_version;
+	__u32 capability;
+	__u64 hive_id;
+	__u64 local_mem_size;
+	__u64 debug_prop;
+	char name[KFD_TOPOLOGY_BLOB_NAME_SIZE];
+};
+
+struct kfd_topology_blob_mem {
+	__u32 heap_type;
+	__u32 flags;
+	__u64 size_in_bytes;
+	__u32 width;
+	__u32 mem_clk_max;
+};
+
+struct kfd_topology_blob_cache {
+	__u32 processor_id_low;
+	__u32 level;
+	__u32 size;
+	__u32 cache_line_size;
+	__u32 cache_lines_per_tag;
+	__u32 association;
+	__u32 latency;
+	__u32 type;
+	__u8 sibling_map[KFD_TOPOLOGY_BLOB_SIBLINGMAP_SIZE];
+};
+
+struct kfd_topology_blob_iolink {
+	__u32 type;
+	__u32 version_major;
+	__u32 version_minor;
+	__u32 node_from;
+	__u32 node_to;
+	__u32 weight;
+	__u32 min_latency;
+	__u32 max_latency;
+	__u32 min_bandwidth;
+	__u32 max_bandwidth;
+	__u32 recommended_transfer_size;
+	__u32 flags;
+};
+
+/* If blob_size is 0 only the required size and generation are returned.
+ * If the buffer is too small -ENOSPC is returned and blob_size is updated
+ * to the required size.
+ */
+struct kfd_ioctl_get_topology_args {
+	__u64 blob_ptr;		/* to KFD */
+	__u32 blob_size;	/* to KFD: buffer size, from KFD: blob size */
+	__u32 generation_id;	/* from KFD */
+};
+
+/* Shared virtual memory (SVM)
+ *
+ * Any address in the process is accessible by the GPUs without prior
+ * registration; pages are faulted in on GPU access. This ioctl sets or
+ * queries per-range attributes that guide placement and mapping.
+ *
+ * Locations are KFD_IOCTL_SVM_LOCATION_SYSMEM, _UNDEFINED or a gpu_id.
+ * Only system memory residency is implemented: ranges are never migrated
+ * to VRAM, and setting a gpu_id as preferred or prefetch location fails
+ * with -EOPNOTSUPP. GPUs map system memory remotely instead.
+ */
+#define KFD_IOCTL_SVM_OP_SET_ATTR	0
+#define KFD_IOCTL_SVM_OP_GET_ATTR	1
+
+#define KFD_IOCTL_SVM_LOCATION_SYSMEM		0
+#define KFD_IOCTL_SVM_LOCATION_UNDEFINED	0xffffffff
+
+/* Preferred location of the range, see above */
+#define KFD_IOCTL_SVM_ATTR_PREFERRED_LOC	0
+/* Place the range at a location now, see above */
+#define KFD_IOCTL_SVM_ATTR_PREFETCH_LOC		1
+/* gpu_id may access the range, mapping it on access */
+#define KFD_IOCTL_SVM_ATTR_ACCESS		2
+/* gpu_id may access the range where it is */
+#define KFD_IOCTL_SVM_ATTR_ACCESS_IN_PLACE	3
+/* gpu_id may not access the range */
+#define KFD_IOCTL_SVM_ATTR_NO_ACCESS		4
+/* Set or clear KFD_IOCTL_SVM_FLAG_* flags */
+#define KFD_IOCTL_SVM_ATTR_SET_FLAGS		5
+#define KFD_IOCTL_SVM_ATTR_CLR_FLAGS		6
+/* log2 of the number of pages faulted in and mapped together */
+#define KFD_IOCTL_SVM_ATTR_GRANULARITY		7
+
+/* GPU mappings are read-only */
+#define KFD_IOCTL_SVM_FLAG_GPU_RO		(1 << 0)
+/* GPU mappings are executable */
+#define KFD_IOCTL_SVM_FLAG_GPU_EXEC		(1 << 1)
+/* Mostly read by the GPUs, reads don't migrate the range */
+#define KFD_IOCTL_SVM_FLAG_GPU_READ_MOSTLY	(1 << 2)
+
+struct kfd_ioctl_svm_attribute {
+	__u32 type;
+	__u32 value;
+};
+
+/* For GET_ATTR, ACCESS type attributes carry the gpu_id in value and
+ * return the access type in type. Other attributes return the value
+ * common to all pages in the range, or _UNDEFINED if they differ.
+ */
+struct kfd_ioctl_svm_args {
+	__u64 start_addr;	/* to KFD, page aligned */
+	__u64 size;		/* to KFD, page aligned */
+	__u32 op;		/* to KFD */
+	__u32 nattr;		/* to KFD */
+	__u64 attrs_ptr;	/* to KFD: array of kfd_ioctl_svm_attribute */
+};
+
 struct kfd_memory_range {
 	__u64 va_addr;
 	__u64 size;
@@ -637,7 +818,16 @@ struct kfd_ioctl_cross_memory_copy_args {
 #define AMDKFD_IOC_DBG_TRAP			\
 		AMDKFD_IOW(0x21, struct kfd_ioctl_dbg_trap_args)
 
+#define AMDKFD_IOC_IPC_IMPORT_HANDLES		\
+		AMDKFD_IOWR(0x22, struct kfd_ioctl_ipc_import_handles_args)
+
+#define AMDKFD_IOC_GET_TOPOLOGY			\
+		AMDKFD_IOWR(0x23, struct kfd_ioctl_get_topology_args)
+
+#define AMDKFD_IOC_SVM				\
+		AMDKFD_IOWR(0x24, struct kfd_ioctl_svm_args)
+
 #define AMDKFD_COMMAND_START		0x01
-#define AMDKFD_COMMAND_END		0x22
+#define AMDKFD_COMMAND_END		0x25
 
 #endif
@@ -425,6 +425,73 @@ static inline bool compact_should_abort(struct compact_control *cc)
 	return false;
 }
 
+/*
+ * The LRU lock variant of compact_unlock_should_abort(): the lock is the one
+ * of whichever lruvec the last isolated page was on, or NULL if none is held.
+ */
+static bool compact_unlock_lruvec_should_abort(struct lruvec **locked,
+		unsigned long flags, struct compact_control *cc)
+{
+	if (*locked) {
+		lruvec_unlock_irqrestore(*locked, flags);
+		*locked = NULL;
+	}
+
+	if (fatal_signal_pending(current)) {
+		cc->contended = true;
+		return true;
+	}
+
+	return compact_should_abort(cc);
+}
+
+/*
+ * Switch *@locked over to the lruvec of @page, which the caller holds a
+ * reference to. As with compact_trylock_irqsave(), async compaction backs
+ * out instead of spinning.
+ *
+ * Returns true if the lock of the page's lruvec is held
+ * Returns false if no lock is held and compaction should abort
+ */
+static bool compact_relock_page_lruvec(struct page *page,
+		struct lruvec **locked, unsigned long *flags,
+		struct compact_control *cc)
+{
+	struct lruvec *lruvec;
+
+	if (*locked) {
+		if (lruvec_holds_page_lru_lock(page, *locked))
+			return true;
+		lruvec_unlock_irqrestore(*locked, *flags);
+		*locked = NULL;
+	}
+
+	if (cc->mode != MIGRATE_ASYNC) {
+		*locked = lock_page_lruvec_irqsave(page, *flags);
+		return true;
+	}
+
+	/* Open-coded lock_page_lruvec() that never waits for the lock */
+	local_irq_save(*flags);
+	rcu_read_lock();
+	for (;;) {
+		lruvec = mem_cgroup_page_lruvec(page, page_pgdat(page));
+		if (!__lruvec_trylock(lruvec)) {
+			rcu_read_unlock();
+			local_irq_restore(*flags);
+			cc->contended = true;
+			return false;
+		}
+		if (lruvec_holds_page_lru_lock(page, lruvec))
+			break;
+		__lruvec_unlock(lruvec);
+	}
+	rcu_read_unlock();
+
+	*locked = lruvec;
+	return true;
+}
+
 /*
  * Isolate free pages onto a private freelist. If @strict is true, will abort
  * returning 0 on any invalid PFNs or non-free pages inside of the pageblock
@@ -694,9 +761,8 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 {
 	struct zone *zone = cc->zone;
 	unsigned long nr_scanned = 0, nr_isolated = 0;
-	struct lruvec *lruvec;
 	unsigned long flags = 0;
-	bool locked = false;
+	struct lruvec *locked = NULL;
 	struct page *page = NULL, *valid_page = NULL;
 	unsigned long start_pfn = low_pfn;
 	bool skip_on_failure = false;
@@ -757,8 +823,7 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		 * if contended.
 		 */
 		if (!(low_pfn % SWAP_CLUSTER_MAX)
-		    && compact_unlock_should_abort(zone_lru_lock(zone), flags,
-								&locked, cc))
+		    && compact_unlock_lruvec_should_abort(&locked, flags, cc))
 			break;
 
 		if (!pfn_valid_within(low_pfn))
@@ -817,9 +882,8 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 			if (unlikely(__PageMovable(page)) &&
 					!PageIsolated(page)) {
 				if (locked) {
-					spin_unlock_irqrestore(zone_lru_lock(zone),
-									flags);
-					locked = false;
+					lruvec_unlock_irqrestore(locked, flags);
+					locked = NULL;
 				}
 
 				if (!isolate_movable_page(page, isolate_mode))
@@ -845,16 +909,24 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		if (!(cc->gfp_mask & __GFP_FS) && page_mapping(page))
 			goto isolate_fail;
 
-		/* If we already hold the lock, we can skip some rechecking */
-		if (!locked) {
-			locked = compact_trylock_irqsave(zone_lru_lock(zone),
-								&flags, cc);
-			if (!locked)
+		/*
+		 * Pin the page so that it can't be freed and charged to
+		 * another memcg while its lruvec is being looked up.
+		 */
+		if (unlikely(!get_page_unless_zero(page)))
+			goto isolate_fail;
+
+		/* If we already hold the right lock, skip some rechecking */
+		if (!locked || !lruvec_holds_page_lru_lock(page, locked)) {
+			if (!compact_relock_page_lruvec(page, &locked, &flags,
+							cc)) {
+				put_page(page);
 				break;
+			}
 
 			/* Recheck PageLRU and PageCompound under lock */
 			if (!PageLRU(page))
-				goto isolate_fail;
+				goto isolate_fail_put;
 
 			/*
 			 * Page become compound since the non-locked check,
@@ -863,20 +935,19 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 			 */
 			if (unlikely(PageCompound(page))) {
 				low_pfn += (1UL << compound_order(page)) - 1;
-				goto isolate_fail;
+				goto isolate_fail_put;
 			}
 		}
 
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
-
 		/* Try isolate the page */
 		if (__isolate_lru_page(page, isolate_mode) != 0)
-			goto isolate_fail;
+			goto isolate_fail_put;
 
 		VM_BUG_ON_PAGE(PageCompound(page), page);
 
-		/* Successfully isolated */
-		del_page_from_lru_list(page, lruvec, page_lru(page));
+		/* Successfully isolated, which took a reference of its own */
+		put_page(page);
+		del_page_from_lru_list(page, locked, page_lru(page));
 		inc_node_page_state(page,
 				NR_ISOLATED_ANON + page_is_file_cache(page));
 
@@ -901,6 +972,13 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		}
 
 		continue;
+isolate_fail_put:
+		/* The reference may be the last one, which takes the lock */
+		if (locked) {
+			lruvec_unlock_irqrestore(locked, flags);
+			locked = NULL;
+		}
+		put_page(page);
 isolate_fail:
 		if (!skip_on_failure)
 			continue;
@@ -912,8 +990,8 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		 */
 		if (nr_isolated) {
 			if (locked) {
-				spin_unlock_irqrestore(zone_lru_lock(zone), flags);
-				locked = false;
+				lruvec_unlock_irqrestore(locked, flags);
+				locked = NULL;
 			}
 			putback_movable_pages(&cc->migratepages);
 			cc->nr_migratepages = 0;
@@ -939,7 +1017,7 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		low_pfn = end_pfn;
 
 	if (locked)
-		spin_unlock_irqrestore(zone_lru_lock(zone), flags);
+		lruvec_unlock_irqrestore(locked, flags);
 
 	/*
 	 * Update the pageblock-skip information and cached scanner pfn,
@@ -96,8 +96,8 @@
  *    ->swap_lock		(try_to_unmap_one)
  *    ->private_lock		(try_to_unmap_one)
  *    ->i_pages lock		(try_to_unmap_one)
- *    ->zone_lru_lock(zone)	(follow_page->mark_page_accessed)
- *    ->zone_lru_lock(zone)	(check_pte_range->isolate_lru_page)
+ *    ->lruvec->lru_lock	(follow_page->mark_page_accessed)
+ *    ->lruvec->lru_lock	(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->i_pages lock		(page_remove_rmap->set_page_dirty)
  *    bdi.wb->list_lock		(page_remove_rmap->set_page_dirty)
@@ -233,8 +233,9 @@ static void unaccount_page_cache_page(struct address_space *mapping,
 		__mod_node_page_state(page_pgdat(page), NR_SHMEM, -nr);
 		if (PageTransHuge(page))
 			__dec_node_page_state(page, NR_SHMEM_THPS);
-	} else {
-		VM_BUG_ON_PAGE(PageTransHuge(page), page);
+	} else if (PageTransHuge(page)) {
+		__dec_node_page_state(page, NR_FILE_THPS);
+		filemap_nr_thps_dec(mapping);
 	}
 
 	/*
@@ -927,6 +928,119 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/**
+ * add_to_page_cache_thp - add a new THP to the page cache of a regular file
+ * @page:	head page of the THP, prepared with prep_transhuge_page()
+ * @mapping:	the page's address_space
+ * @index:	index of the first subpage, aligned to HPAGE_PMD_NR
+ * @gfp_mask:	page allocation mode
+ *
+ * Like add_to_page_cache_lru(), but the THP takes HPAGE_PMD_NR slots.
+ * Shadow entries in the range are replaced; if any of the slots holds a
+ * page, -EEXIST is returned. The page cache of a file that is open for
+ * write must not hold THPs, so -ETXTBSY is returned if the file has been
+ * opened for write meanwhile. On success the page is locked and on its
+ * way to the LRU.
+ */
+int add_to_page_cache_thp(struct page *page, struct address_space *mapping,
+				pgoff_t index, gfp_t gfp_mask)
+{
+	struct mem_cgroup *memcg;
+	int i, error;
+
+	VM_BUG_ON_PAGE(!PageTransHuge(page), page);
+	VM_BUG_ON_PAGE(index & (HPAGE_PMD_NR - 1), page);
+
+	__SetPageLocked(page);
+	error = mem_cgroup_try_charge(page, current->mm, gfp_mask, &memcg, true);
+	if (error)
+		goto err_unlock;
+
+	error = radix_tree_maybe_preload_order(gfp_mask & GFP_RECLAIM_MASK,
+					       HPAGE_PMD_ORDER);
+	if (error)
+		goto err_uncharge;
+
+	page->mapping = mapping;
+	page->index = index;
+
+	xa_lock_irq(&mapping->i_pages);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		void *p = radix_tree_lookup(&mapping->i_pages, index + i);
+
+		if (p && !radix_tree_exceptional_entry(p)) {
+			error = -EEXIST;
+			goto err_insert;
+		}
+	}
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		struct radix_tree_node *node;
+		void **slot;
+
+		error = __radix_tree_create(&mapping->i_pages, index + i, 0,
+					    &node, &slot);
+		VM_BUG_ON(error);
+		if (*slot)
+			mapping->nrexceptional--;
+		__radix_tree_replace(&mapping->i_pages, node, slot, page + i,
+				     workingset_lookup_update(mapping));
+	}
+	radix_tree_preload_end();
+
+	page_ref_add(page, HPAGE_PMD_NR);
+	mapping->nrpages += HPAGE_PMD_NR;
+	__mod_node_page_state(page_pgdat(page), NR_FILE_PAGES, HPAGE_PMD_NR);
+	__inc_node_page_state(page, NR_FILE_THPS);
+	filemap_nr_thps_inc(mapping);
+	xa_unlock_irq(&mapping->i_pages);
+
+	mem_cgroup_commit_charge(page, memcg, false, true);
+	lru_cache_add(page);
+	count_vm_event(THP_FILE_ALLOC);
+	trace_mm_filemap_add_to_page_cache(page);
+
+	/*
+	 * Pairs with the barrier in do_dentry_open(): either the opener sees
+	 * nr_thps raised and drops the THPs, or we see the writer here.
+	 */
+	smp_mb();
+	if (inode_is_open_for_write(mapping->host)) {
+		delete_from_page_cache(page);
+		unlock_page(page);
+		return -ETXTBSY;
+	}
+	return 0;
+
+err_insert:
+	page->mapping = NULL;
+	xa_unlock_irq(&mapping->i_pages);
+	radix_tree_preload_end();
+err_uncharge:
+	mem_cgroup_cancel_charge(page, memcg, true);
+err_unlock:
+	__ClearPageLocked(page);
+	return error;
+}
+#endif
+
+/*
+ * A THP whose read failed can't be retried with ->readpage like a small
+ * page. Drop it, so that the range is read again into small pages, and
+ * stop using THPs for the file, which is likely to fail again. Called with
+ * the page locked, returns with it unlocked.
+ */
+static void filemap_drop_failed_thp(struct address_space *mapping,
+				    struct page *page)
+{
+	struct page *head = compound_head(page);
+
+	mapping_clear_thp_support(mapping);
+	if (head->mapping == mapping)
+		truncate_inode_page(mapping, head);
+	unlock_page(head);
+}
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -1555,12 +1669,12 @@ struct page *pagecache_get_page(struct address_space *mapping, pgoff_t offset,
 		}
 
 		/* Has the page been truncated? */
-		if (unlikely(page->mapping != mapping)) {
+		if (unlikely(compound_head(page)->mapping != mapping)) {
 			unlock_page(page);
 			put_page(page);
 			goto repeat;
 		}
-		VM_BUG_ON_PAGE(page->index != offset, page);
+		VM_BUG_ON_PAGE(page_to_index(page) != offset, page);
 	}
 
 	if (page && (fgp_flags & FGP_ACCESSED))
@@ -2096,7 +2210,9 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			if (unlikely(page == NULL))
 				goto no_cached_page;
 		}
-		if (PageReadahead(page)) {
+		if (PageTransCompound(page)) {
+			page_cache_thp_readahead(mapping, ra, filp, page);
+		} else if (PageReadahead(page)) {
 			page_cache_async_readahead(mapping,
 					ra, filp, page,
 					index, last_index - index);
@@ -2119,7 +2235,8 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 				goto page_ok;
 
 			if (inode->i_blkbits == PAGE_SHIFT ||
-					!mapping->a_ops->is_partially_uptodate)
+					!mapping->a_ops->is_partially_uptodate ||
+					PageTransCompound(page))
 				goto page_not_up_to_date;
 			/* pipes can't handle partially uptodate pages */
 			if (unlikely(iter->type & ITER_PIPE))
@@ -2151,10 +2268,19 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			goto out;
 		}
 
-		/* nr is the maximum number of bytes to copy from this page */
+		/*
+		 * nr is the maximum number of bytes to copy from this page.
+		 * Copy the rest of a THP in one go where it is mapped as a
+		 * whole; pipes want one page per buffer.
+		 */
 		nr = PAGE_SIZE;
-		if (index == end_index) {
-			nr = ((isize - 1) & ~PAGE_MASK) + 1;
+		if (PageTransCompound(page) && !PageHighMem(page) &&
+		    !(iter->type & ITER_PIPE))
+			nr = (HPAGE_PMD_NR - (index & (HPAGE_PMD_NR - 1)))
+				<< PAGE_SHIFT;
+		if (index + (nr >> PAGE_SHIFT) - 1 >= end_index) {
+			nr = ((end_index - index) << PAGE_SHIFT) +
+				((isize - 1) & ~PAGE_MASK) + 1;
 			if (nr <= offset) {
 				put_page(page);
 				goto out;
@@ -2206,7 +2332,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 page_not_up_to_date_locked:
 		/* Did it get truncated before we got the lock? */
-		if (!page->mapping) {
+		if (!compound_head(page)->mapping) {
 			unlock_page(page);
 			put_page(page);
 			continue;
@@ -2218,6 +2344,13 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 			goto page_ok;
 		}
 
+		/* A THP can only be read as a whole, by readahead */
+		if (PageTransCompound(page)) {
+			filemap_drop_failed_thp(mapping, page);
+			put_page(page);
+			goto find_page;
+		}
+
 readpage:
 		/*
 		 * A previous I/O error may have been due to temporary
@@ -2533,12 +2666,12 @@ vm_fault_t filemap_fault(struct vm_fault *vmf)
 	}
 
 	/* Did it get truncated? */
-	if (unlikely(page->mapping != mapping)) {
+	if (unlikely(compound_head(page)->mapping != mapping)) {
 		unlock_page(page);
 		put_page(page);
 		goto retry_find;
 	}
-	VM_BUG_ON_PAGE(page->index != offset, page);
+	VM_BUG_ON_PAGE(page_to_index(page) != offset, page);
 
 	/*
 	 * We have a locked page in the page cache, now we need to check
@@ -2586,6 +2719,13 @@ vm_fault_t filemap_fault(struct vm_fault *vmf)
 	return VM_FAULT_SIGBUS;
 
 page_not_uptodate:
+	/* A THP can only be read as a whole, by readahead */
+	if (PageTransCompound(page)) {
+		filemap_drop_failed_thp(mapping, page);
+		put_page(page);
+		goto retry_find;
+	}
+
 	/*
 	 * Umm, take care of errors if the page isn't up-to-date.
 	 * Try to re-read it _once_. We do this synchronously,
@@ -2660,11 +2800,11 @@ void filemap_map_pages(struct vm_fault *vmf,
 		if (!trylock_page(page))
 			goto skip;
 
-		if (page->mapping != mapping || !PageUptodate(page))
+		if (head->mapping != mapping || !PageUptodate(page))
 			goto unlock;
 
 		max_idx = DIV_ROUND_UP(i_size_read(mapping->host), PAGE_SIZE);
-		if (page->index >= max_idx)
+		if (page_to_index(page) >= max_idx)
 			goto unlock;
 
 		if (file->f_ra.mmap_miss > 0)
@@ -955,6 +955,33 @@ struct lruvec *mem_cgroup_page_lruvec(struct page *page, struct pglist_data *pgd
 	return lruvec;
 }
 
+/**
+ * lock_page_lruvec - lock the lruvec of a page
+ * @page: the page
+ *
+ * Interrupts must be disabled. page->mem_cgroup only changes under the
+ * lru_lock of the lruvec it points to, so the page is known to belong to
+ * the returned lruvec for as long as its lock is held. If the page moved
+ * to another memcg before the lock was taken, try again with the new one;
+ * RCU keeps the old memcg around until the lock has been dropped.
+ */
+struct lruvec *lock_page_lruvec(struct page *page)
+{
+	struct lruvec *lruvec;
+
+	rcu_read_lock();
+again:
+	lruvec = mem_cgroup_page_lruvec(page, page_pgdat(page));
+	__lruvec_lock(lruvec);
+	if (unlikely(!lruvec_holds_page_lru_lock(page, lruvec))) {
+		__lruvec_unlock(lruvec);
+		goto again;
+	}
+	rcu_read_unlock();
+
+	return lruvec;
+}
+
 /**
  * mem_cgroup_update_lru_size - account for adding or removing an lru page
  * @lruvec: mem_cgroup per zone lru vector
@@ -2054,40 +2081,37 @@ static void cancel_charge(struct mem_cgroup *memcg, unsigned int nr_pages)
 	css_put_many(&memcg->css, nr_pages);
 }
 
-static void lock_page_lru(struct page *page, int *isolated)
+static struct lruvec *lock_page_lru(struct page *page, int *isolated)
 {
-	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec = lock_page_lruvec_irq(page);
 
-	spin_lock_irq(zone_lru_lock(zone));
 	if (PageLRU(page)) {
-		struct lruvec *lruvec;
-
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
 		ClearPageLRU(page);
 		del_page_from_lru_list(page, lruvec, page_lru(page));
 		*isolated = 1;
 	} else
 		*isolated = 0;
+
+	return lruvec;
 }
 
-static void unlock_page_lru(struct page *page, int isolated)
+static void unlock_page_lru(struct page *page, struct lruvec *lruvec,
+			    int isolated)
 {
-	struct zone *zone = page_zone(page);
-
 	if (isolated) {
-		struct lruvec *lruvec;
-
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
+		/* page->mem_cgroup changed, so it goes on another lruvec */
+		lruvec = relock_page_lruvec_irq(page, lruvec);
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		SetPageLRU(page);
 		add_page_to_lru_list(page, lruvec, page_lru(page));
 	}
-	spin_unlock_irq(zone_lru_lock(zone));
+	lruvec_unlock_irq(lruvec);
 }
 
 static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 			  bool lrucare)
 {
+	struct lruvec *lruvec;
 	int isolated;
 
 	VM_BUG_ON_PAGE(page->mem_cgroup, page);
@@ -2097,7 +2121,7 @@ static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 	 * may already be on some other mem_cgroup's LRU.  Take care of it.
 	 */
 	if (lrucare)
-		lock_page_lru(page, &isolated);
+		lruvec = lock_page_lru(page, &isolated);
 
 	/*
 	 * Nobody should be changing or seriously looking at
@@ -2112,11 +2136,14 @@ static void commit_charge(struct page *page, struct mem_cgroup *memcg,
 	 *
 	 * - a page cache insertion, a swapin fault, or a migration
 	 *   have the page locked
+	 *
+	 * With @lrucare the page may be visible to LRU walkers, which is
+	 * why the lock of the lruvec it was on is still held here.
 	 */
 	page->mem_cgroup = memcg;
 
 	if (lrucare)
-		unlock_page_lru(page, isolated);
+		unlock_page_lru(page, lruvec, isolated);
 }
 
 #ifndef CONFIG_SLOB
@@ -2390,7 +2417,7 @@ void memcg_kmem_uncharge(struct page *page, int order)
 
 /*
  * Because tail pages are not marked as "used", set it. We're under
- * zone_lru_lock and migration entries setup in all page mappings.
+ * the lruvec lru_lock and migration entries setup in all page mappings.
  */
 void mem_cgroup_split_huge_fixup(struct page *head)
 {
@@ -3107,6 +3134,33 @@ static const char *const memcg1_event_names[] = {
 	"pgmajfault",
 };
 
+#ifdef CONFIG_LRU_LOCK_STAT
+static void memcg_lru_lock_stat_show(struct seq_file *m,
+				     struct mem_cgroup *memcg)
+{
+	u64 acquired = 0, contended = 0, wait_ns = 0, hold_ns = 0;
+	struct mem_cgroup_per_node *mz;
+	pg_data_t *pgdat;
+
+	for_each_online_pgdat(pgdat) {
+		mz = mem_cgroup_nodeinfo(memcg, pgdat->node_id);
+		acquired += READ_ONCE(mz->lruvec.lock_stat.acquired);
+		contended += READ_ONCE(mz->lruvec.lock_stat.contended);
+		wait_ns += READ_ONCE(mz->lruvec.lock_stat.wait_ns);
+		hold_ns += READ_ONCE(mz->lruvec.lock_stat.hold_ns);
+	}
+	seq_printf(m, "lru_lock_acquired %llu\n", acquired);
+	seq_printf(m, "lru_lock_contended %llu\n", contended);
+	seq_printf(m, "lru_lock_wait_ns %llu\n", wait_ns);
+	seq_printf(m, "lru_lock_hold_ns %llu\n", hold_ns);
+}
+#else
+static inline void memcg_lru_lock_stat_show(struct seq_file *m,
+					    struct mem_cgroup *memcg)
+{
+}
+#endif
+
 static int memcg_stat_show(struct seq_file *m, void *v)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_css(seq_css(m));
@@ -3196,6 +3250,8 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 	}
 #endif
 
+	memcg_lru_lock_stat_show(m, memcg);
+
 	return 0;
 }
 
@@ -4499,6 +4555,7 @@ static int mem_cgroup_move_account(struct page *page,
 {
 	unsigned long flags;
 	unsigned int nr_pages = compound ? hpage_nr_pages(page) : 1;
+	struct lruvec *lruvec;
 	int ret;
 	bool anon;
 
@@ -4549,11 +4606,16 @@ static int mem_cgroup_move_account(struct page *page,
 	/*
 	 * It is safe to change page->mem_cgroup here because the page
 	 * is referenced, charged, and isolated - we can't race with
-	 * uncharging, charging, migration, or LRU putback.
+	 * uncharging, charging, migration, or LRU putback. The lru_lock
+	 * of the old lruvec is still taken, since lock_page_lruvec() and
+	 * the batched LRU walks rely on page->mem_cgroup only changing
+	 * under it.
 	 */
+	lruvec = lock_page_lruvec(page);
 
 	/* caller should have done css_get */
 	page->mem_cgroup = to;
+	__lruvec_unlock(lruvec);
 	spin_unlock_irqrestore(&from->move_lock, flags);
 
 	ret = 0;
@@ -5332,6 +5394,8 @@ static int memory_stat_show(struct seq_file *m, void *v)
 	seq_printf(m, "workingset_nodereclaim %lu\n",
 		   stat[WORKINGSET_NODERECLAIM]);
 
+	memcg_lru_lock_stat_show(m, memcg);
+
 	return 0;
 }
 
@@ -2361,6 +2361,104 @@ static gfp_t __get_fault_gfp_mask(struct vm_area_struct *vma)
 	return GFP_KERNEL;
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * A speculative fault doesn't hold mmap_sem, so anything it read from the
+ * vma may be stale. Writers bump vm_sequence around changes and munmap
+ * clears vm_rb, both before touching the page tables, which they do under
+ * the PTL. So once the PTL is held, an unchanged vma means nothing the
+ * fault decided on was stale, and no writer can get in until it unlocks.
+ */
+static bool vma_has_changed(struct vm_fault *vmf)
+{
+	return RB_EMPTY_NODE(&vmf->vma->vm_rb) ||
+	       read_seqcount_retry(&vmf->vma->vm_sequence, vmf->sequence);
+}
+
+/*
+ * Take the PTL for a speculative fault. Interrupts stay disabled from the
+ * vma check until the lock is held: freeing a page table waits for a TLB
+ * flush IPI or an RCU-sched grace period, so the table the pmd pointed to
+ * can't go away meanwhile. That also means spinning on the lock could
+ * deadlock against a CPU waiting for our IPI, hence the trylock. The pmd
+ * is compared against the one walked so that a collapse into a huge pmd
+ * is caught as well.
+ */
+static bool __pte_map_lock_speculative(struct vm_fault *vmf, bool map)
+{
+	bool ret = false;
+	spinlock_t *ptl;
+	pte_t *pte = NULL;
+	pmd_t pmdval;
+
+	local_irq_disable();
+	if (vma_has_changed(vmf))
+		goto out;
+
+	pmdval = READ_ONCE(*vmf->pmd);
+	if (pmd_val(pmdval) != pmd_val(vmf->orig_pmd))
+		goto out;
+
+	ptl = pte_lockptr(vmf->vma->vm_mm, &pmdval);
+	if (map)
+		pte = pte_offset_map(&pmdval, vmf->address);
+	if (unlikely(!spin_trylock(ptl)))
+		goto out_unmap;
+
+	if (vma_has_changed(vmf)) {
+		spin_unlock(ptl);
+		goto out_unmap;
+	}
+
+	if (map)
+		vmf->pte = pte;
+	vmf->ptl = ptl;
+	ret = true;
+	goto out;
+
+out_unmap:
+	if (pte)
+		pte_unmap(pte);
+out:
+	local_irq_enable();
+	return ret;
+}
+
+static bool pte_spinlock(struct vm_fault *vmf)
+{
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+		return __pte_map_lock_speculative(vmf, false);
+
+	vmf->ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
+	spin_lock(vmf->ptl);
+	return true;
+}
+
+static bool pte_map_lock(struct vm_fault *vmf)
+{
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+		return __pte_map_lock_speculative(vmf, true);
+
+	vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd,
+				       vmf->address, &vmf->ptl);
+	return true;
+}
+#else
+static inline bool pte_spinlock(struct vm_fault *vmf)
+{
+	vmf->ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
+	spin_lock(vmf->ptl);
+	return true;
+}
+
+static inline bool pte_map_lock(struct vm_fault *vmf)
+{
+	vmf->pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd,
+				       vmf->address, &vmf->ptl);
+	return true;
+}
+#endif
+
 /*
  * Notify the address space that the page is about to become writable so that
  * it can prohibit this or wait for the page to get into an appropriate state.
@@ -2511,7 +2609,14 @@ static int wp_page_copy(struct vm_fault *vmf)
 	/*
 	 * Re-check the pte - we dropped the lock
 	 */
-	vmf->pte = pte_offset_map_lock(mm, vmf->pmd, vmf->address, &vmf->ptl);
+	if (!pte_map_lock(vmf)) {
+		mmu_notifier_invalidate_range_end(mm, mmun_start, mmun_end);
+		mem_cgroup_cancel_charge(new_page, memcg, false);
+		put_page(new_page);
+		if (old_page)
+			put_page(old_page);
+		return VM_FAULT_RETRY;
+	}
 	if (likely(pte_same(*vmf->pte, vmf->orig_pte))) {
 		if (old_page) {
 			if (!PageAnon(old_page)) {
@@ -2743,8 +2848,11 @@ static int do_wp_page(struct vm_fault *vmf)
 			get_page(vmf->page);
 			pte_unmap_unlock(vmf->pte, vmf->ptl);
 			lock_page(vmf->page);
-			vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd,
-					vmf->address, &vmf->ptl);
+			if (!pte_map_lock(vmf)) {
+				unlock_page(vmf->page);
+				put_page(vmf->page);
+				return VM_FAULT_RETRY;
+			}
 			if (!pte_same(*vmf->pte, vmf->orig_pte)) {
 				unlock_page(vmf->page);
 				pte_unmap_unlock(vmf->pte, vmf->ptl);
@@ -3127,22 +3235,26 @@ static int do_anonymous_page(struct vm_fault *vmf)
 	 * pte_alloc_map() is safe to use under down_write(mmap_sem) or when
 	 * parallel threads are excluded by other means.
 	 *
-	 * Here we only have down_read(mmap_sem).
+	 * Here we only have down_read(mmap_sem). A speculative fault holds
+	 * nothing, but it only gets here with the page table in place and
+	 * pte_map_lock() checks that it still is.
 	 */
-	if (pte_alloc(vma->vm_mm, vmf->pmd, vmf->address))
-		return VM_FAULT_OOM;
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
+		if (pte_alloc(vma->vm_mm, vmf->pmd, vmf->address))
+			return VM_FAULT_OOM;
 
-	/* See the comment in pte_alloc_one_map() */
-	if (unlikely(pmd_trans_unstable(vmf->pmd)))
-		return 0;
+		/* See the comment in pte_alloc_one_map() */
+		if (unlikely(pmd_trans_unstable(vmf->pmd)))
+			return 0;
+	}
 
 	/* Use the zero-page for reads */
 	if (!(vmf->flags & FAULT_FLAG_WRITE) &&
 			!mm_forbids_zeropage(vma->vm_mm)) {
 		entry = pte_mkspecial(pfn_pte(my_zero_pfn(vmf->address),
 						vma->vm_page_prot));
-		vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd,
-				vmf->address, &vmf->ptl);
+		if (!pte_map_lock(vmf))
+			return VM_FAULT_RETRY;
 		if (!pte_none(*vmf->pte))
 			goto unlock;
 		ret = check_stable_address_space(vma->vm_mm);
@@ -3151,6 +3263,8 @@ static int do_anonymous_page(struct vm_fault *vmf)
 		/* Deliver the page fault to userland, check inside PT lock */
 		if (userfaultfd_missing(vma)) {
 			pte_unmap_unlock(vmf->pte, vmf->ptl);
+			if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+				return VM_FAULT_RETRY;
 			return handle_userfault(vmf, VM_UFFD_MISSING);
 		}
 		goto setpte;
@@ -3177,8 +3291,11 @@ static int do_anonymous_page(struct vm_fault *vmf)
 	if (vma->vm_flags & VM_WRITE)
 		entry = pte_mkwrite(pte_mkdirty(entry));
 
-	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, vmf->address,
-			&vmf->ptl);
+	if (!pte_map_lock(vmf)) {
+		mem_cgroup_cancel_charge(page, memcg, false);
+		put_page(page);
+		return VM_FAULT_RETRY;
+	}
 	if (!pte_none(*vmf->pte))
 		goto release;
 
@@ -3191,6 +3308,8 @@ static int do_anonymous_page(struct vm_fault *vmf)
 		pte_unmap_unlock(vmf->pte, vmf->ptl);
 		mem_cgroup_cancel_charge(page, memcg, false);
 		put_page(page);
+		if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+			return VM_FAULT_RETRY;
 		return handle_userfault(vmf, VM_UFFD_MISSING);
 	}
 
@@ -3262,6 +3381,10 @@ static int pte_alloc_one_map(struct vm_fault *vmf)
 {
 	struct vm_area_struct *vma = vmf->vma;
 
+	/* The page table was there when the speculative walk went by */
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE)
+		return pte_map_lock(vmf) ? 0 : VM_FAULT_RETRY;
+
 	if (!pmd_none(*vmf->pmd))
 		goto map_pte;
 	if (vmf->prealloc_pte) {
@@ -3419,8 +3542,10 @@ int alloc_set_pte(struct vm_fault *vmf, struct mem_cgroup *memcg,
 	pte_t entry;
 	int ret;
 
-	if (pmd_none(*vmf->pmd) && PageTransCompound(page) &&
-			IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE)) {
+	/* Only shmem THPs are mapped by PMD, see page_add_file_rmap() */
+	if (!(vmf->flags & FAULT_FLAG_SPECULATIVE) && pmd_none(*vmf->pmd) &&
+	    PageTransCompound(page) && PageSwapBacked(page) &&
+	    IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE)) {
 		/* THP on COW? */
 		VM_BUG_ON_PAGE(memcg, page);
 
@@ -3628,9 +3753,11 @@ static int do_read_fault(struct vm_fault *vmf)
 	/*
 	 * Let's call ->map_pages() first and use ->fault() as fallback
 	 * if page by the offset is not ready to be mapped (cold cache or
-	 * something).
+	 * something). Fault-around may populate the page table, which a
+	 * speculative fault must not do.
 	 */
-	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1) {
+	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1 &&
+	    !(vmf->flags & FAULT_FLAG_SPECULATIVE)) {
 		ret = do_fault_around(vmf);
 		if (ret)
 			return ret;
@@ -3927,7 +4054,10 @@ static int handle_pte_fault(struct vm_fault *vmf)
 {
 	pte_t entry;
 
-	if (unlikely(pmd_none(*vmf->pmd))) {
+	if (vmf->flags & FAULT_FLAG_SPECULATIVE) {
+		/* Walked by handle_speculative_fault() */
+		VM_BUG_ON(vmf->pte && pte_none(vmf->orig_pte));
+	} else if (unlikely(pmd_none(*vmf->pmd))) {
 		/*
 		 * Leave __pte_alloc() until later: because vm_ops->fault may
 		 * want to allocate huge page, and if we expose page table
@@ -3970,14 +4100,23 @@ static int handle_pte_fault(struct vm_fault *vmf)
 			return do_fault(vmf);
 	}
 
+	/* Swap-ins and NUMA hinting faults are left to mmap_sem holders */
+	if ((vmf->flags & FAULT_FLAG_SPECULATIVE) &&
+	    (!pte_present(vmf->orig_pte) || pte_protnone(vmf->orig_pte))) {
+		pte_unmap(vmf->pte);
+		return VM_FAULT_RETRY;
+	}
+
 	if (!pte_present(vmf->orig_pte))
 		return do_swap_page(vmf);
 
 	if (pte_protnone(vmf->orig_pte) && vma_is_accessible(vmf->vma))
 		return do_numa_page(vmf);
 
-	vmf->ptl = pte_lockptr(vmf->vma->vm_mm, vmf->pmd);
-	spin_lock(vmf->ptl);
+	if (!pte_spinlock(vmf)) {
+		pte_unmap(vmf->pte);
+		return VM_FAULT_RETRY;
+	}
 	entry = vmf->orig_pte;
 	if (unlikely(!pte_same(*vmf->pte, entry)))
 		goto unlock;
@@ -4146,6 +4285,175 @@ int handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Which faults the speculative path takes on. Everything it reads here is
+ * rechecked against vm_sequence once the PTL is held.
+ */
+static bool vma_can_speculate(struct vm_area_struct *vma, unsigned int flags)
+{
+	/* Hugetlb, pfn maps, and stacks that may need expanding */
+	if (vma->vm_flags & (VM_HUGETLB | VM_PFNMAP | VM_MIXEDMAP | VM_IO |
+			     VM_GROWSDOWN | VM_GROWSUP))
+		return false;
+
+	/* Same checks as the architectures do before handle_mm_fault() */
+	if (!arch_vma_access_permitted(vma, flags & FAULT_FLAG_WRITE,
+				       flags & FAULT_FLAG_INSTRUCTION,
+				       flags & FAULT_FLAG_REMOTE))
+		return false;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vma->vm_flags & VM_WRITE))
+			return false;
+	} else if (flags & FAULT_FLAG_INSTRUCTION) {
+		if (!(vma->vm_flags & VM_EXEC))
+			return false;
+	} else if (!(vma->vm_flags & (VM_READ | VM_EXEC | VM_WRITE))) {
+		return false;
+	}
+
+	/* Userfaults are handed to user space with mmap_sem dropped */
+	if (userfaultfd_armed(vma))
+		return false;
+
+	/* A vma policy can be replaced and freed by mbind() */
+	if (vma_policy(vma))
+		return false;
+
+	/*
+	 * Setting up the anon_vma races with vma_merge() and split_vma(),
+	 * so it is left to the first write fault under mmap_sem.
+	 */
+	if ((flags & FAULT_FLAG_WRITE) && !(vma->vm_flags & VM_SHARED) &&
+	    !vma->anon_vma)
+		return false;
+
+	if (vma_is_anonymous(vma))
+		return true;
+
+	/*
+	 * File faults only for the page cache, whose ->fault() copes without
+	 * mmap_sem once it may not drop it. Shared write faults go through
+	 * ->page_mkwrite(), and khugepaged retracts shmem page tables with
+	 * only mmap_sem to exclude faults, so those are left out.
+	 */
+	if (vma->vm_ops->map_pages != filemap_map_pages || vma_is_shmem(vma))
+		return false;
+	if ((flags & FAULT_FLAG_WRITE) && (vma->vm_flags & VM_SHARED))
+		return false;
+
+	return true;
+}
+
+/*
+ * Try to handle a page fault without mmap_sem, so that faults don't queue
+ * up behind mmap(), munmap() or mprotect() in other threads.
+ *
+ * The vma is looked up under mm->mm_rb_lock and pinned by a reference, and
+ * its vm_sequence sampled. The page tables are walked with interrupts
+ * disabled, see __pte_map_lock_speculative(), and only faults on an
+ * existing page table are handled: pte_none faults on anonymous and page
+ * cache mappings, and write-protect faults on private mappings. Swap-ins,
+ * NUMA hinting faults and anything needing a page table, a huge page or
+ * the anon_vma to be set up are left to the regular path.
+ *
+ * Returns VM_FAULT_RETRY if the fault wasn't handled, in which case the
+ * caller must redo it under mmap_sem, errors included.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_fault vmf = {
+		.address = address & PAGE_MASK,
+	};
+	struct vm_area_struct *vma;
+	pgd_t *pgd;
+	p4d_t *p4d;
+	pud_t *pud;
+	int ret;
+
+	/* There is no mmap_sem for ->fault() to drop */
+	flags &= ~(FAULT_FLAG_ALLOW_RETRY | FAULT_FLAG_RETRY_NOWAIT);
+	flags |= FAULT_FLAG_SPECULATIVE;
+
+	vma = get_vma(mm, address);
+	if (!vma)
+		goto out_skip;
+
+	vmf.sequence = raw_read_seqcount(&vma->vm_sequence);
+	if (vmf.sequence & 1) {
+		put_vma(vma);
+		goto out_abort;
+	}
+
+	/* Below the vma, or stack growth: not for us */
+	if (address < vma->vm_start || !vma_can_speculate(vma, flags))
+		goto out_put;
+
+	vmf.vma = vma;
+	vmf.flags = flags;
+	vmf.pgoff = linear_page_index(vma, address);
+	vmf.gfp_mask = __get_fault_gfp_mask(vma);
+
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	p4d = p4d_offset(pgd, address);
+	if (p4d_none(*p4d) || unlikely(p4d_bad(*p4d)))
+		goto out_walk;
+	pud = pud_offset(p4d, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+
+	/* Page table must be there; huge and migrating pmds aren't handled */
+	vmf.pmd = pmd_offset(pud, address);
+	vmf.orig_pmd = READ_ONCE(*vmf.pmd);
+	if (pmd_none(vmf.orig_pmd) || !pmd_present(vmf.orig_pmd) ||
+	    pmd_trans_huge(vmf.orig_pmd) || pmd_devmap(vmf.orig_pmd) ||
+	    unlikely(pmd_bad(vmf.orig_pmd)))
+		goto out_walk;
+
+	vmf.pte = pte_offset_map(&vmf.orig_pmd, address);
+	vmf.orig_pte = READ_ONCE(*vmf.pte);
+	if (pte_none(vmf.orig_pte)) {
+		pte_unmap(vmf.pte);
+		vmf.pte = NULL;
+	}
+	local_irq_enable();
+
+	__set_current_state(TASK_RUNNING);
+	check_sync_rss_stat(current);
+
+	/*
+	 * No memcg OOM handling here: a failed charge falls back, and the
+	 * regular path deals with it.
+	 */
+	ret = handle_pte_fault(&vmf);
+	put_vma(vma);
+
+	if (ret & (VM_FAULT_RETRY | VM_FAULT_ERROR))
+		goto out_abort;
+
+	count_vm_event(PGFAULT);
+	count_memcg_event_mm(mm, PGFAULT);
+	count_vm_event(SPF_HANDLED);
+	return ret;
+
+out_abort:
+	count_vm_event(SPF_ABORT);
+	return VM_FAULT_RETRY;
+
+out_walk:
+	local_irq_enable();
+out_put:
+	put_vma(vma);
+out_skip:
+	count_vm_event(SPF_SKIP);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_P4D_FOLDED
 /*
  * Allocate p4d page table.
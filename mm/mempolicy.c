@@ -663,8 +663,10 @@ static int vma_replace_policy(struct vm_area_struct *vma,
 			goto err_out;
 	}
 
+	vm_write_begin(vma);
 	old = vma->vm_policy;
 	vma->vm_policy = new; /* protected by mmap_sem */
+	vm_write_end(vma);
 	mpol_put(old);
 
 	return 0;
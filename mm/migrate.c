@@ -47,6 +47,8 @@
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
 #include <linux/ptrace.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include <asm/tlbflush.h>
 
@@ -1138,47 +1140,15 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 #endif
 
 /*
- * Obtain the lock on page, remove all ptes and migrate the page
- * to the newly allocated page in newpage.
+ * Dispose of page and newpage according to the outcome of migrating one
+ * into the other: on success the old page is released, on a permanent
+ * failure it is restored and on -EAGAIN it stays on the list to be retried.
  */
-static ICE_noinline int unmap_and_move(new_page_t get_new_page,
-				   free_page_t put_new_page,
-				   unsigned long private, struct page *page,
-				   int force, enum migrate_mode mode,
-				   enum migrate_reason reason)
+static void unmap_and_move_finish(struct page *page, struct page *newpage,
+				  int rc, free_page_t put_new_page,
+				  unsigned long private,
+				  enum migrate_reason reason)
 {
-	int rc = MIGRATEPAGE_SUCCESS;
-	struct page *newpage;
-
-	if (!thp_migration_supported() && PageTransHuge(page))
-		return -ENOMEM;
-
-	newpage = get_new_page(page, private);
-	if (!newpage)
-		return -ENOMEM;
-
-	if (page_count(page) == 1) {
-		/* page was freed from under us. So we are done. */
-		ClearPageActive(page);
-		ClearPageUnevictable(page);
-		if (unlikely(__PageMovable(page))) {
-			lock_page(page);
-			if (!PageMovable(page))
-				__ClearPageIsolated(page);
-			unlock_page(page);
-		}
-		if (put_new_page)
-			put_new_page(newpage, private);
-		else
-			put_page(newpage);
-		goto out;
-	}
-
-	rc = __unmap_and_move(page, newpage, force, mode);
-	if (rc == MIGRATEPAGE_SUCCESS)
-		set_page_owner_migrate_reason(newpage, reason);
-
-out:
 	if (rc != -EAGAIN) {
 		/*
 		 * A page that has been migrated has all references
@@ -1235,6 +1205,51 @@ static ICE_noinline int unmap_and_move(new_page_t get_new_page,
 		else
 			put_page(newpage);
 	}
+}
+
+/*
+ * Obtain the lock on page, remove all ptes and migrate the page
+ * to the newly allocated page in newpage.
+ */
+static ICE_noinline int unmap_and_move(new_page_t get_new_page,
+				   free_page_t put_new_page,
+				   unsigned long private, struct page *page,
+				   int force, enum migrate_mode mode,
+				   enum migrate_reason reason)
+{
+	int rc = MIGRATEPAGE_SUCCESS;
+	struct page *newpage;
+
+	if (!thp_migration_supported() && PageTransHuge(page))
+		return -ENOMEM;
+
+	newpage = get_new_page(page, private);
+	if (!newpage)
+		return -ENOMEM;
+
+	if (page_count(page) == 1) {
+		/* page was freed from under us. So we are done. */
+		ClearPageActive(page);
+		ClearPageUnevictable(page);
+		if (unlikely(__PageMovable(page))) {
+			lock_page(page);
+			if (!PageMovable(page))
+				__ClearPageIsolated(page);
+			unlock_page(page);
+		}
+		if (put_new_page)
+			put_new_page(newpage, private);
+		else
+			put_page(newpage);
+		goto out;
+	}
+
+	rc = __unmap_and_move(page, newpage, force, mode);
+	if (rc == MIGRATEPAGE_SUCCESS)
+		set_page_owner_migrate_reason(newpage, reason);
+
+out:
+	unmap_and_move_finish(page, newpage, rc, put_new_page, private, reason);
 
 	return rc;
 }
@@ -1346,6 +1361,291 @@ static int unmap_and_move_huge_page(new_page_t get_new_page,
 	return rc;
 }
 
+/*
+ * Most pages migrate_pages_batch() unmaps before flushing the TLB and moving
+ * them. All of them stay locked until then.
+ */
+#define MIGRATE_BATCH_NR	512
+
+/* Fewest pages worth handing to another copy thread */
+#define MIGRATE_COPY_MIN_PAGES	32
+
+int sysctl_migrate_copy_threads __read_mostly = 4;
+
+/*
+ * While its page is in a batch, newpage carries the anon_vma reference in
+ * ->mapping and these flags in ->private. Neither is used by a freshly
+ * allocated page until move_to_new_page().
+ */
+#define MIGRATE_PAGE_WAS_MAPPED	0x1
+#define MIGRATE_PAGE_COPIED	0x2
+
+static void migrate_page_record(struct page *newpage, unsigned long flags,
+				struct anon_vma *anon_vma)
+{
+	newpage->mapping = (struct address_space *)anon_vma;
+	set_page_private(newpage, flags);
+}
+
+static unsigned long migrate_page_extract(struct page *newpage,
+					  struct anon_vma **anon_vma)
+{
+	unsigned long flags = page_private(newpage);
+
+	*anon_vma = (struct anon_vma *)newpage->mapping;
+	newpage->mapping = NULL;
+	set_page_private(newpage, 0);
+
+	return flags;
+}
+
+/*
+ * Lock page and newpage and replace the ptes of page by migration entries,
+ * leaving the TLB flush to the caller. Only what __unmap_and_move() does
+ * without blocking or special casing is done here; otherwise nothing is
+ * and false is returned.
+ */
+static bool migrate_page_unmap_batched(struct page *page, struct page *newpage)
+{
+	struct anon_vma *anon_vma = NULL;
+	unsigned long flags = 0;
+
+	if (!trylock_page(page))
+		return false;
+
+	if (PageWriteback(page) || !page->mapping)
+		goto out_unlock;
+
+	/* See __unmap_and_move() */
+	if (PageAnon(page) && !PageKsm(page))
+		anon_vma = page_get_anon_vma(page);
+
+	if (unlikely(!trylock_page(newpage)))
+		goto out_put;
+
+	if (page_mapped(page)) {
+		VM_BUG_ON_PAGE(PageAnon(page) && !PageKsm(page) && !anon_vma,
+				page);
+		try_to_unmap(page, TTU_MIGRATION | TTU_IGNORE_MLOCK |
+			     TTU_IGNORE_ACCESS | TTU_BATCH_FLUSH);
+		flags |= MIGRATE_PAGE_WAS_MAPPED;
+	}
+
+	migrate_page_record(newpage, flags, anon_vma);
+	return true;
+
+out_put:
+	if (anon_vma)
+		put_anon_vma(anon_vma);
+out_unlock:
+	unlock_page(page);
+	return false;
+}
+
+struct migrate_copy_work {
+	struct work_struct work;
+	struct page *page;
+	struct page *newpage;
+	int nr;
+};
+
+/* Copy nr pairs of the batch lists starting at page and newpage */
+static void migrate_copy_chunk(struct page *page, struct page *newpage, int nr)
+{
+	while (nr--) {
+		if (page_private(newpage) & MIGRATE_PAGE_COPIED) {
+			copy_highpage(newpage, page);
+			cond_resched();
+		}
+		page = list_next_entry(page, lru);
+		newpage = list_next_entry(newpage, lru);
+	}
+}
+
+static void migrate_copy_work_fn(struct work_struct *work)
+{
+	struct migrate_copy_work *mcw =
+		container_of(work, struct migrate_copy_work, work);
+
+	migrate_copy_chunk(mcw->page, mcw->newpage, mcw->nr);
+}
+
+/*
+ * Copy the nr_copy pages marked MIGRATE_PAGE_COPIED out of the nr in the
+ * batch, splitting them between up to vm.migrate_copy_threads threads, the
+ * caller included.
+ */
+static void migrate_copy_pages(struct list_head *pages,
+			       struct list_head *newpages, int nr, int nr_copy)
+{
+	struct migrate_copy_work *works = NULL;
+	struct page *page = list_first_entry(pages, struct page, lru);
+	struct page *newpage = list_first_entry(newpages, struct page, lru);
+	int nr_threads, chunk, i, j;
+
+	nr_threads = min(READ_ONCE(sysctl_migrate_copy_threads),
+			 nr_copy / MIGRATE_COPY_MIN_PAGES);
+	if (nr_threads > 1)
+		works = kmalloc_array(nr_threads - 1, sizeof(*works),
+				      GFP_NOWAIT | __GFP_NOWARN);
+	if (!works) {
+		migrate_copy_chunk(page, newpage, nr);
+		return;
+	}
+
+	chunk = DIV_ROUND_UP(nr, nr_threads);
+	for (i = 0; i < nr_threads - 1; i++) {
+		INIT_WORK(&works[i].work, migrate_copy_work_fn);
+		works[i].page = page;
+		works[i].newpage = newpage;
+		works[i].nr = chunk;
+		queue_work(system_unbound_wq, &works[i].work);
+
+		for (j = 0; j < chunk; j++) {
+			page = list_next_entry(page, lru);
+			newpage = list_next_entry(newpage, lru);
+		}
+	}
+
+	migrate_copy_chunk(page, newpage, nr - chunk * (nr_threads - 1));
+
+	for (i = 0; i < nr_threads - 1; i++)
+		flush_work(&works[i].work);
+	kfree(works);
+}
+
+/*
+ * Migrate the pages on from MIGRATE_BATCH_NR at a time: lock and unmap all
+ * of a batch, flush the TLB once for all of them, copy the anonymous ones
+ * in parallel and then move and remap each. Pages that can't be locked
+ * without blocking, or need the care of unmap_and_move(), such as huge,
+ * non-LRU and writeback pages, are left on from for the page at a time
+ * passes of migrate_pages(), as are those that failed with -EAGAIN.
+ *
+ * The copy of a page can only be done up front while nothing but its
+ * isolation holds a reference and no mapping can find it, as for anonymous
+ * pages out of the swap cache. Others are copied by move_to_new_page() as
+ * usual, after the mapping has been frozen.
+ *
+ * A whole batch of pages is locked while they are moved, so the move must
+ * not block on anything else: a sync ->migratepage() may write the page out
+ * or lock its buffers, while whoever holds those may be waiting for one of
+ * our pages. The pages are therefore moved in MIGRATE_ASYNC mode, and for a
+ * sync caller any that fail are left on from so that the page at a time
+ * passes retry them in the caller's mode once the batch is unlocked.
+ */
+static void migrate_pages_batch(struct list_head *from,
+		new_page_t get_new_page, free_page_t put_new_page,
+		unsigned long private, enum migrate_mode mode,
+		enum migrate_reason reason, int *nr_succeeded, int *nr_failed)
+{
+	LIST_HEAD(skipped);
+	LIST_HEAD(pages);
+	LIST_HEAD(newpages);
+	struct page *page, *page2, *newpage, *newpage2;
+	struct anon_vma *anon_vma;
+	unsigned long flags;
+	bool more = true;
+	int nr, nr_copy, rc;
+
+	while (more && !list_empty(from)) {
+		nr = 0;
+		list_for_each_entry_safe(page, page2, from, lru) {
+			if (nr == MIGRATE_BATCH_NR)
+				break;
+
+			if (PageHuge(page) || PageTransHuge(page) ||
+			    __PageMovable(page) || page_count(page) == 1) {
+				list_move_tail(&page->lru, &skipped);
+				continue;
+			}
+
+			newpage = get_new_page(page, private);
+			if (!newpage) {
+				more = false;
+				break;
+			}
+
+			if (!migrate_page_unmap_batched(page, newpage)) {
+				if (put_new_page)
+					put_new_page(newpage, private);
+				else
+					put_page(newpage);
+				list_move_tail(&page->lru, &skipped);
+				continue;
+			}
+
+			list_move_tail(&page->lru, &pages);
+			list_add_tail(&newpage->lru, &newpages);
+			nr++;
+		}
+		if (list_empty(from))
+			more = false;
+		if (!nr)
+			break;
+
+		/* The ptes are gone, make sure no CPU can write the pages */
+		try_to_unmap_flush();
+
+		nr_copy = 0;
+		newpage = list_first_entry(&newpages, struct page, lru);
+		list_for_each_entry(page, &pages, lru) {
+			if (!page_mapped(page) && !page_mapping(page) &&
+			    page_count(page) == 1) {
+				set_page_private(newpage, page_private(newpage) |
+						 MIGRATE_PAGE_COPIED);
+				nr_copy++;
+			}
+			newpage = list_next_entry(newpage, lru);
+		}
+		if (nr_copy)
+			migrate_copy_pages(&pages, &newpages, nr, nr_copy);
+
+		newpage = list_first_entry(&newpages, struct page, lru);
+		list_for_each_entry_safe(page, page2, &pages, lru) {
+			newpage2 = list_next_entry(newpage, lru);
+			list_del(&newpage->lru);
+			flags = migrate_page_extract(newpage, &anon_vma);
+
+			rc = -EAGAIN;
+			if (!page_mapped(page))
+				rc = move_to_new_page(newpage, page,
+						flags & MIGRATE_PAGE_COPIED ?
+						MIGRATE_SYNC_NO_COPY :
+						MIGRATE_ASYNC);
+			if (rc != MIGRATEPAGE_SUCCESS && mode != MIGRATE_ASYNC)
+				rc = -EAGAIN;
+
+			if (flags & MIGRATE_PAGE_WAS_MAPPED)
+				remove_migration_ptes(page,
+					rc == MIGRATEPAGE_SUCCESS ? newpage : page,
+					false);
+
+			unlock_page(newpage);
+			if (anon_vma)
+				put_anon_vma(anon_vma);
+			unlock_page(page);
+
+			if (rc == MIGRATEPAGE_SUCCESS) {
+				putback_lru_page(newpage);
+				set_page_owner_migrate_reason(newpage, reason);
+				(*nr_succeeded)++;
+			} else if (rc != -EAGAIN) {
+				(*nr_failed)++;
+			}
+
+			list_move_tail(&page->lru, &skipped);
+			unmap_and_move_finish(page, newpage, rc, put_new_page,
+					      private, reason);
+
+			newpage = newpage2;
+			cond_resched();
+		}
+	}
+
+	list_splice(&skipped, from);
+}
+
 /*
  * migrate_pages - migrate the pages specified in a list, to the free pages
  *		   supplied as the target for the page migration
@@ -1360,6 +1660,9 @@ static int unmap_and_move_huge_page(new_page_t get_new_page,
  *			page migration, if any.
  * @reason:		The reason for page migration.
  *
+ * Base pages are first migrated in batches sharing a TLB flush, see
+ * migrate_pages_batch(), then whatever is left a page at a time.
+ *
  * The function returns after 10 attempts or if no pages are movable any more
  * because the list has become empty or no retryable pages exist any more.
  * The caller should call putback_movable_pages() to return pages to the LRU
@@ -1383,6 +1686,10 @@ int migrate_pages(struct list_head *from, new_page_t get_new_page,
 	if (!swapwrite)
 		current->flags |= PF_SWAPWRITE;
 
+	if (mode != MIGRATE_SYNC_NO_COPY && !list_is_singular(from))
+		migrate_pages_batch(from, get_new_page, put_new_page, private,
+				    mode, reason, &nr_succeeded, &nr_failed);
+
 	for(pass = 0; pass < 10 && retry; pass++) {
 		retry = 0;
 
@@ -9,6 +9,8 @@
 #include <linux/stddef.h>
 #include <linux/mm.h>
 #include <linux/mmzone.h>
+#include <linux/memcontrol.h>
+#include <linux/sched/clock.h>
 
 struct pglist_data *first_online_pgdat(void)
 {
@@ -91,10 +93,52 @@ void lruvec_init(struct lruvec *lruvec)
 	enum lru_list lru;
 
 	memset(lruvec, 0, sizeof(struct lruvec));
+	spin_lock_init(&lruvec->lru_lock);
 
 	for_each_lru(lru)
 		INIT_LIST_HEAD(&lruvec->lists[lru]);
+
+	lru_gen_init_lruvec(lruvec);
+}
+
+#ifdef CONFIG_LRU_LOCK_STAT
+void __lruvec_lock(struct lruvec *lruvec)
+{
+	struct lru_lock_stat *stat = &lruvec->lock_stat;
+	u64 now;
+
+	if (likely(spin_trylock(&lruvec->lru_lock))) {
+		now = local_clock();
+	} else {
+		u64 wait = local_clock();
+
+		spin_lock(&lruvec->lru_lock);
+		now = local_clock();
+		stat->contended++;
+		stat->wait_ns += now - wait;
+	}
+	stat->acquired++;
+	stat->locked_at = now;
+}
+
+bool __lruvec_trylock(struct lruvec *lruvec)
+{
+	if (!spin_trylock(&lruvec->lru_lock))
+		return false;
+
+	lruvec->lock_stat.acquired++;
+	lruvec->lock_stat.locked_at = local_clock();
+	return true;
+}
+
+void __lruvec_unlock(struct lruvec *lruvec)
+{
+	struct lru_lock_stat *stat = &lruvec->lock_stat;
+
+	stat->hold_ns += local_clock() - stat->locked_at;
+	spin_unlock(&lruvec->lru_lock);
 }
+#endif
 
 #if defined(CONFIG_NUMA_BALANCING) && !defined(LAST_CPUPID_NOT_IN_PAGE_FLAGS)
 int page_cpupid_xchg_last(struct page *page, int cpupid)
@@ -298,6 +298,14 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/*
+	 * Keep speculative faults out of both ranges until the ptes have
+	 * settled, including a move back on error.
+	 */
+	vm_write_begin(vma);
+	if (new_vma != vma)
+		vm_write_begin(new_vma);
+
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
 	if (moved_len < old_len) {
@@ -314,6 +322,13 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		 */
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len,
 				 true);
+	}
+
+	if (new_vma != vma)
+		vm_write_end(new_vma);
+	vm_write_end(vma);
+
+	if (unlikely(err)) {
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
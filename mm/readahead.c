@@ -139,12 +139,82 @@ static int read_pages(struct address_space *mapping, struct file *filp,
 	return ret;
 }
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/*
+ * Whether readahead may put @mapping's pages into THPs. The page cache of
+ * a file that is open for write must not hold THPs: opening a file for
+ * write drops them, see do_dentry_open().
+ */
+static bool thp_readahead_allowed(struct address_space *mapping,
+				  struct file *filp)
+{
+	if (!mapping_thp_support(mapping) ||
+	    !transparent_hugepage_file_readahead())
+		return false;
+	/* Random readers don't want 2MB of I/O for every miss */
+	if (filp && (filp->f_mode & FMODE_RANDOM))
+		return false;
+	/* THP disabled with enabled=never */
+	if (!(transparent_hugepage_flags &
+	      ((1 << TRANSPARENT_HUGEPAGE_FLAG) |
+	       (1 << TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG))))
+		return false;
+	return !inode_is_open_for_write(mapping->host);
+}
+
+/*
+ * Add a THP at @index to the page cache and start ->readpage on it.
+ * Returns 0 on success; otherwise the range is left to small pages.
+ */
+static int read_thp(struct address_space *mapping, struct file *filp,
+		    pgoff_t index, gfp_t gfp_mask)
+{
+	struct blk_plug plug;
+	struct page *page;
+	int ret;
+
+	/* Don't stall readahead on compaction, small pages will do */
+	page = alloc_pages((gfp_mask | __GFP_COMP) & ~__GFP_DIRECT_RECLAIM,
+			   HPAGE_PMD_ORDER);
+	if (!page) {
+		count_vm_event(THP_FILE_FALLBACK);
+		return -ENOMEM;
+	}
+	prep_transhuge_page(page);
+
+	ret = add_to_page_cache_thp(page, mapping, index, gfp_mask);
+	if (!ret) {
+		blk_start_plug(&plug);
+		mapping->a_ops->readpage(filp, page);
+		blk_finish_plug(&plug);
+	}
+	put_page(page);
+	return ret;
+}
+#else
+static inline bool thp_readahead_allowed(struct address_space *mapping,
+					 struct file *filp)
+{
+	return false;
+}
+
+static inline int read_thp(struct address_space *mapping, struct file *filp,
+			   pgoff_t index, gfp_t gfp_mask)
+{
+	return -EINVAL;
+}
+#endif
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates
  * the pages first, then submits them for I/O. This avoids the very bad
  * behaviour which would occur if page allocations are causing VM writeback.
  * We really don't want to intermingle reads and writes like that.
  *
+ * Where the file allows it, a whole THP is read at each THP-aligned index
+ * in the chunk, even if that goes past @nr_to_read. The pages before it are
+ * started first so that I/O is still submitted in file order.
+ *
  * Returns the number of pages requested, or the maximum amount of I/O allowed.
  */
 unsigned int __do_page_cache_readahead(struct address_space *mapping,
@@ -156,14 +226,16 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
 	int page_idx;
-	unsigned int nr_pages = 0;
+	unsigned int nr_pages = 0, nr_thp_pages = 0;
 	loff_t isize = i_size_read(inode);
 	gfp_t gfp_mask = readahead_gfp_mask(mapping);
+	bool thp;
 
 	if (isize == 0)
 		goto out;
 
 	end_index = ((isize - 1) >> PAGE_SHIFT);
+	thp = thp_readahead_allowed(mapping, filp);
 
 	/*
 	 * Preallocate as many pages as we will need.
@@ -190,6 +262,19 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 			continue;
 		}
 
+		if (thp && !(page_offset & (HPAGE_PMD_NR - 1)) &&
+		    page_offset + HPAGE_PMD_NR - 1 <= end_index) {
+			if (nr_pages)
+				read_pages(mapping, filp, &page_pool, nr_pages,
+						gfp_mask);
+			nr_pages = 0;
+			if (!read_thp(mapping, filp, page_offset, gfp_mask)) {
+				nr_thp_pages += HPAGE_PMD_NR;
+				page_idx += HPAGE_PMD_NR - 1;
+				continue;
+			}
+		}
+
 		page = __page_cache_alloc(gfp_mask);
 		if (!page)
 			break;
@@ -209,7 +294,7 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 		read_pages(mapping, filp, &page_pool, nr_pages, gfp_mask);
 	BUG_ON(!list_empty(&page_pool));
 out:
-	return nr_pages;
+	return nr_pages + nr_thp_pages;
 }
 
 /*
@@ -560,6 +645,45 @@ page_cache_async_readahead(struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(page_cache_async_readahead);
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/**
+ * page_cache_thp_readahead - file readahead for THPs
+ * @mapping: address_space which holds the pagecache and I/O vectors
+ * @ra: file_ra_state which holds the readahead state
+ * @filp: passed on to ->readpage() and ->readpages()
+ * @page: the page the reader got to, part of a THP
+ *
+ * THPs can't carry PG_readahead. Instead, the first time a reader gets to
+ * a THP, page_cache_thp_readahead() reads ahead the range of the next one,
+ * which keeps a THP worth of I/O in flight ahead of sequential readers.
+ */
+void page_cache_thp_readahead(struct address_space *mapping,
+			      struct file_ra_state *ra, struct file *filp,
+			      struct page *page)
+{
+	pgoff_t next = compound_head(page)->index + HPAGE_PMD_NR;
+
+	/* no read-ahead, or already done from this THP */
+	if (!ra->ra_pages || ra->start >= next)
+		return;
+
+	/* be dumb */
+	if (filp && (filp->f_mode & FMODE_RANDOM))
+		return;
+
+	/*
+	 * Defer asynchronous read-ahead on IO congestion.
+	 */
+	if (inode_read_congested(mapping->host))
+		return;
+
+	ra->start = next;
+	ra->size = HPAGE_PMD_NR;
+	ra->async_size = 0;
+	__do_page_cache_readahead(mapping, filp, next, HPAGE_PMD_NR, 0);
+}
+#endif
+
 static ssize_t
 do_readahead(struct address_space *mapping, struct file *filp,
 	     pgoff_t index, unsigned long nr)
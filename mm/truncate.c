@@ -266,6 +266,49 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/**
+ * filemap_drop_thps - remove all THPs from an address_space
+ * @mapping: the address_space
+ *
+ * THPs in the page cache of regular files are read-only: they are never
+ * dirty and can't be partly truncated or invalidated. Truncation and
+ * invalidation drop them all beforehand, as does opening the file for
+ * write.
+ */
+void filemap_drop_thps(struct address_space *mapping)
+{
+	pgoff_t indices[PAGEVEC_SIZE];
+	struct pagevec pvec;
+	pgoff_t index = 0;
+	int i;
+
+	pagevec_init(&pvec);
+	while (filemap_nr_thps(mapping) &&
+	       pagevec_lookup_entries(&pvec, mapping, index, PAGEVEC_SIZE,
+				      indices)) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			index = indices[i];
+			if (radix_tree_exceptional_entry(page) ||
+			    !PageTransCompound(page))
+				continue;
+
+			page = compound_head(page);
+			lock_page(page);
+			truncate_inode_page(mapping, page);
+			unlock_page(page);
+			index = page->index + HPAGE_PMD_NR - 1;
+		}
+		pagevec_remove_exceptionals(&pvec);
+		pagevec_release(&pvec);
+		cond_resched();
+		index++;
+	}
+}
+#endif
+
 /**
  * truncate_inode_pages_range - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -305,6 +348,9 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	if (mapping->nrpages == 0 && mapping->nrexceptional == 0)
 		goto out;
 
+	if (filemap_nr_thps(mapping))
+		filemap_drop_thps(mapping);
+
 	/* Offsets within partial pages */
 	partial_start = lstart & (PAGE_SIZE - 1);
 	partial_end = (lend + 1) & (PAGE_SIZE - 1);
@@ -679,6 +725,9 @@ int invalidate_inode_pages2_range(struct address_space *mapping,
 	if (mapping->nrpages == 0 && mapping->nrexceptional == 0)
 		goto out;
 
+	if (filemap_nr_thps(mapping))
+		filemap_drop_thps(mapping);
+
 	pagevec_init(&pvec);
 	index = start;
 	while (index <= end && pagevec_lookup_entries(&pvec, mapping, index,
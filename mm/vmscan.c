@@ -21,6 +21,7 @@
 #include <linux/kernel_stat.h>
 #include <linux/swap.h>
 #include <linux/pagemap.h>
+#include <linux/pagevec.h>
 #include <linux/init.h>
 #include <linux/highmem.h>
 #include <linux/vmpressure.h>
@@ -1464,7 +1465,7 @@ static __always_inline void update_lru_sizes(struct lruvec *lruvec,
 }
 
 /*
- * zone_lru_lock is heavily contended.  Some of the functions that
+ * The lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
  * and working on them outside the LRU lock.
  *
@@ -1564,6 +1565,105 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
+#ifdef CONFIG_LRU_GEN
+/* How many pages to move between lists before dropping the lru_lock */
+#define LRU_GEN_BATCH	64
+
+/*
+ * Retires the oldest generation of @type by moving what is left on it to
+ * the next one. Returns false if that was cut short after LRU_GEN_BATCH
+ * pages, so the caller can drop the lock and retry.
+ */
+static bool inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	int zone, batch = 0;
+
+	lockdep_assert_held(&lruvec->lru_lock);
+	VM_BUG_ON(lrugen->min_seq[type] + MIN_NR_GENS > lrugen->max_seq);
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		struct list_head *head = &lrugen->lists[old_gen][type][zone];
+
+		/* From the youngest end, so the order is kept on the new tail */
+		while (!list_empty(head)) {
+			struct page *page = list_first_entry(head, struct page,
+							     lru);
+
+			if (batch++ == LRU_GEN_BATCH)
+				return false;
+
+			set_mask_bits(&page->flags, LRU_GEN_MASK,
+				      (new_gen + 1UL) << LRU_GEN_PGOFF);
+			lru_gen_update_size(lruvec, page, old_gen, new_gen);
+			list_move_tail(&page->lru,
+				       &lrugen->lists[new_gen][type][zone]);
+		}
+	}
+
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+	return true;
+}
+
+/*
+ * The multi-gen LRU counterpart of isolate_lru_pages(): takes pages from the
+ * tail of the oldest generation of @type. Pages that can't be isolated are
+ * moved on to the next generation. Once the eligible zones of the oldest
+ * generation run dry, it is retired, unless that would leave fewer than
+ * MIN_NR_GENS generations, in which case the caller has to age first.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int next = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	unsigned long nr_taken = 0;
+	unsigned long scan = 0;
+	int zone;
+
+	for (zone = 0; zone <= sc->reclaim_idx && scan < nr_to_scan; zone++) {
+		struct list_head *src = &lrugen->lists[gen][type][zone];
+
+		while (scan < nr_to_scan && !list_empty(src)) {
+			struct page *page = lru_to_page(src);
+
+			VM_BUG_ON_PAGE(!PageLRU(page), page);
+			VM_BUG_ON_PAGE(page_lru_gen(page) != gen, page);
+
+			scan++;
+			if (__isolate_lru_page(page, mode)) {
+				lru_gen_move_page(lruvec, page, next);
+				continue;
+			}
+
+			nr_taken += hpage_nr_pages(page);
+			lru_gen_del_page(lruvec, page);
+			list_add(&page->lru, dst);
+		}
+	}
+
+	if (scan < nr_to_scan &&
+	    lrugen->min_seq[type] + MIN_NR_GENS <= lrugen->max_seq)
+		inc_min_seq(lruvec, type);
+
+	*nr_scanned = scan;
+	return nr_taken;
+}
+#else
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	return 0;
+}
+#endif /* CONFIG_LRU_GEN */
+
 /**
  * isolate_lru_page - tries to isolate a page from its LRU list
  * @page: page to isolate from its LRU list
@@ -1598,11 +1698,9 @@ int isolate_lru_page(struct page *page)
 	WARN_RATELIMIT(PageTail(page), "trying to isolate tail page");
 
 	if (PageLRU(page)) {
-		struct zone *zone = page_zone(page);
 		struct lruvec *lruvec;
 
-		spin_lock_irq(zone_lru_lock(zone));
-		lruvec = mem_cgroup_page_lruvec(page, zone->zone_pgdat);
+		lruvec = lock_page_lruvec_irq(page);
 		if (PageLRU(page)) {
 			int lru = page_lru(page);
 			get_page(page);
@@ -1610,7 +1708,7 @@ int isolate_lru_page(struct page *page)
 			del_page_from_lru_list(page, lruvec, lru);
 			ret = 0;
 		}
-		spin_unlock_irq(zone_lru_lock(zone));
+		lruvec_unlock_irq(lruvec);
 	}
 	return ret;
 }
@@ -1652,15 +1750,29 @@ static int too_many_isolated(struct pglist_data *pgdat, int file,
 	return isolated > inactive;
 }
 
+/*
+ * Switch back to the lru_lock of @lruvec, which the putback functions below
+ * are entered and left with, after they locked whichever lruvec each page
+ * belonged to.
+ */
+static void relock_lruvec_irq(struct lruvec *lruvec, struct lruvec *locked)
+{
+	if (locked == lruvec)
+		return;
+	if (locked)
+		lruvec_unlock_irq(locked);
+	lruvec_lock_irq(lruvec);
+}
+
 static noinline_for_stack void
 putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 {
-	struct zone_reclaim_stat *reclaim_stat = &lruvec->reclaim_stat;
-	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lruvec *locked = lruvec;
 	LIST_HEAD(pages_to_free);
 
 	/*
-	 * Put back any unfreeable pages.
+	 * Put back any unfreeable pages. Their memcg may have changed since
+	 * isolation, so each goes back under the lock of its own lruvec.
 	 */
 	while (!list_empty(page_list)) {
 		struct page *page = lru_to_page(page_list);
@@ -1669,37 +1781,40 @@ putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		list_del(&page->lru);
 		if (unlikely(!page_evictable(page))) {
-			spin_unlock_irq(&pgdat->lru_lock);
+			if (locked) {
+				lruvec_unlock_irq(locked);
+				locked = NULL;
+			}
 			putback_lru_page(page);
-			spin_lock_irq(&pgdat->lru_lock);
 			continue;
 		}
 
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		locked = relock_page_lruvec_irq(page, locked);
 
 		SetPageLRU(page);
 		lru = page_lru(page);
-		add_page_to_lru_list(page, lruvec, lru);
+		add_page_to_lru_list(page, locked, lru);
 
 		if (is_active_lru(lru)) {
 			int file = is_file_lru(lru);
 			int numpages = hpage_nr_pages(page);
-			reclaim_stat->recent_rotated[file] += numpages;
+			locked->reclaim_stat.recent_rotated[file] += numpages;
 		}
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
 			__ClearPageActive(page);
-			del_page_from_lru_list(page, lruvec, lru);
+			del_page_from_lru_list(page, locked, lru);
 
 			if (unlikely(PageCompound(page))) {
-				spin_unlock_irq(&pgdat->lru_lock);
+				lruvec_unlock_irq(locked);
+				locked = NULL;
 				mem_cgroup_uncharge(page);
 				(*get_compound_page_dtor(page))(page);
-				spin_lock_irq(&pgdat->lru_lock);
 			} else
 				list_add(&page->lru, &pages_to_free);
 		}
 	}
+	relock_lruvec_irq(lruvec, locked);
 
 	/*
 	 * To save our caller's stack, now use input list for pages to free.
@@ -1757,10 +1872,15 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	if (!sc->may_unmap)
 		isolate_mode |= ISOLATE_UNMAPPED;
 
-	spin_lock_irq(&pgdat->lru_lock);
+	lruvec_lock_irq(lruvec);
 
-	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
-				     &nr_scanned, sc, isolate_mode, lru);
+	if (lru_gen_enabled(lruvec))
+		nr_taken = lru_gen_isolate_pages(nr_to_scan, lruvec, &page_list,
+						 &nr_scanned, sc, isolate_mode,
+						 file);
+	else
+		nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
+					     &nr_scanned, sc, isolate_mode, lru);
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, nr_taken);
 	reclaim_stat->recent_scanned[file] += nr_taken;
@@ -1776,7 +1896,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 		count_memcg_events(lruvec_memcg(lruvec), PGSCAN_DIRECT,
 				   nr_scanned);
 	}
-	spin_unlock_irq(&pgdat->lru_lock);
+	lruvec_unlock_irq(lruvec);
 
 	if (nr_taken == 0)
 		return 0;
@@ -1784,7 +1904,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, 0,
 				&stat, false);
 
-	spin_lock_irq(&pgdat->lru_lock);
+	lruvec_lock_irq(lruvec);
 
 	if (current_is_kswapd()) {
 		if (global_reclaim(sc))
@@ -1802,7 +1922,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, -nr_taken);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	lruvec_unlock_irq(lruvec);
 
 	mem_cgroup_uncharge_list(&page_list);
 	free_unref_page_list(&page_list);
@@ -1842,9 +1962,9 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
  * processes, from rmap.
  *
  * If the pages are mostly unmapped, the processing is fast and it is
- * appropriate to hold zone_lru_lock across the whole operation.  But if
+ * appropriate to hold the lru_lock across the whole operation.  But if
  * the pages are mapped, the processing is slow (page_referenced()) so we
- * should drop zone_lru_lock around each page.  It's impossible to balance
+ * should drop the lru_lock around each page.  It's impossible to balance
  * this, so instead we remove the pages from the LRU while processing them.
  * It is safe to rely on PG_active against the non-LRU pages in here because
  * nobody will play with that bit on a non-LRU page.
@@ -1860,38 +1980,39 @@ static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
 				     struct list_head *pages_to_free,
 				     enum lru_list lru)
 {
-	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lruvec *locked = lruvec;
 	struct page *page;
 	int nr_pages;
 	int nr_moved = 0;
 
 	while (!list_empty(list)) {
 		page = lru_to_page(list);
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		locked = relock_page_lruvec_irq(page, locked);
 
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		SetPageLRU(page);
 
 		nr_pages = hpage_nr_pages(page);
-		update_lru_size(lruvec, lru, page_zonenum(page), nr_pages);
-		list_move(&page->lru, &lruvec->lists[lru]);
+		list_del(&page->lru);
+		add_page_to_lru_list(page, locked, lru);
 
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
 			__ClearPageActive(page);
-			del_page_from_lru_list(page, lruvec, lru);
+			del_page_from_lru_list(page, locked, lru);
 
 			if (unlikely(PageCompound(page))) {
-				spin_unlock_irq(&pgdat->lru_lock);
+				lruvec_unlock_irq(locked);
+				locked = NULL;
 				mem_cgroup_uncharge(page);
 				(*get_compound_page_dtor(page))(page);
-				spin_lock_irq(&pgdat->lru_lock);
 			} else
 				list_add(&page->lru, pages_to_free);
 		} else {
 			nr_moved += nr_pages;
 		}
 	}
+	relock_lruvec_irq(lruvec, locked);
 
 	if (!is_active_lru(lru)) {
 		__count_vm_events(PGDEACTIVATE, nr_moved);
@@ -1926,7 +2047,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	if (!sc->may_unmap)
 		isolate_mode |= ISOLATE_UNMAPPED;
 
-	spin_lock_irq(&pgdat->lru_lock);
+	lruvec_lock_irq(lruvec);
 
 	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &l_hold,
 				     &nr_scanned, sc, isolate_mode, lru);
@@ -1937,7 +2058,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	__count_vm_events(PGREFILL, nr_scanned);
 	count_memcg_events(lruvec_memcg(lruvec), PGREFILL, nr_scanned);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	lruvec_unlock_irq(lruvec);
 
 	while (!list_empty(&l_hold)) {
 		cond_resched();
@@ -1982,7 +2103,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	/*
 	 * Move pages back to the lru list.
 	 */
-	spin_lock_irq(&pgdat->lru_lock);
+	lruvec_lock_irq(lruvec);
 	/*
 	 * Count referenced pages from currently used mappings as rotated,
 	 * even though only some of them are actually re-activated.  This
@@ -1994,7 +2115,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	nr_activate = move_active_pages_to_lru(lruvec, &l_active, &l_hold, lru);
 	nr_deactivate = move_active_pages_to_lru(lruvec, &l_inactive, &l_hold, lru - LRU_ACTIVE);
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, -nr_taken);
-	spin_unlock_irq(&pgdat->lru_lock);
+	lruvec_unlock_irq(lruvec);
 
 	mem_cgroup_uncharge_list(&l_hold);
 	free_unref_page_list(&l_hold);
@@ -2237,7 +2358,7 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	file  = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES) +
 		lruvec_lru_size(lruvec, LRU_INACTIVE_FILE, MAX_NR_ZONES);
 
-	spin_lock_irq(&pgdat->lru_lock);
+	lruvec_lock_irq(lruvec);
 	if (unlikely(reclaim_stat->recent_scanned[0] > anon / 4)) {
 		reclaim_stat->recent_scanned[0] /= 2;
 		reclaim_stat->recent_rotated[0] /= 2;
@@ -2258,7 +2379,7 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 
 	fp = file_prio * (reclaim_stat->recent_scanned[1] + 1);
 	fp /= reclaim_stat->recent_rotated[1] + 1;
-	spin_unlock_irq(&pgdat->lru_lock);
+	lruvec_unlock_irq(lruvec);
 
 	fraction[0] = ap;
 	fraction[1] = fp;
@@ -2309,6 +2430,507 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+static DEFINE_MUTEX(lru_gen_state_mutex);
+static bool lru_gen_default = IS_ENABLED(CONFIG_LRU_GEN_ENABLED);
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int gen, type, zone;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++)
+		for (type = 0; type < 2; type++)
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+
+	/* Start with one inactive generation to evict from */
+	lrugen->max_seq = MIN_NR_GENS;
+	lrugen->enabled = READ_ONCE(lru_gen_default);
+}
+
+/*
+ * Starts a new youngest generation. The one that was second youngest stops
+ * counting as active, so its pages move to the inactive list sizes.
+ */
+static void inc_max_seq(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	int next = lru_gen_from_seq(lrugen->max_seq + 1);
+	int type, zone;
+
+	lockdep_assert_held(&lruvec->lru_lock);
+
+	for (type = 0; type < 2; type++) {
+		VM_BUG_ON(lrugen->max_seq - lrugen->min_seq[type] + 1 >=
+			  MAX_NR_GENS);
+
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			long delta = lrugen->nr_pages[prev][type][zone];
+
+			VM_WARN_ON_ONCE(!list_empty(&lrugen->lists[next][type][zone]));
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, type * LRU_FILE + LRU_ACTIVE,
+					zone, -delta);
+			update_lru_size(lruvec, type * LRU_FILE, zone, delta);
+		}
+	}
+
+	WRITE_ONCE(lrugen->max_seq, lrugen->max_seq + 1);
+}
+
+struct lru_gen_walk {
+	struct lruvec *lruvec;
+	/* Accessed pages found, to be moved into the youngest generation */
+	struct pagevec pvec;
+};
+
+static void lru_gen_walk_flush(struct lru_gen_walk *walk)
+{
+	struct lruvec *lruvec = walk->lruvec;
+	struct pagevec *pvec = &walk->pvec;
+	int i, gen;
+
+	if (!pagevec_count(pvec))
+		return;
+
+	lruvec_lock_irq(lruvec);
+	gen = lru_gen_from_seq(lruvec->lrugen.max_seq);
+	for (i = 0; i < pagevec_count(pvec); i++) {
+		struct page *page = pvec->pages[i];
+
+		/* Isolated, freed or moved to another memcg since */
+		if (!lruvec->lrugen.enabled || page_lru_gen(page) < 0 ||
+		    !lruvec_holds_page_lru_lock(page, lruvec))
+			continue;
+
+		if (page_lru_gen(page) != gen)
+			lru_gen_move_page(lruvec, page, gen);
+	}
+	lruvec_unlock_irq(lruvec);
+
+	release_pages(pvec->pages, pagevec_count(pvec));
+	pagevec_reinit(pvec);
+}
+
+static void lru_gen_walk_add(struct lru_gen_walk *walk, struct page *page)
+{
+	/* Mapped by the page table we hold the lock of, so it can't be freed */
+	get_page(page);
+	if (!pagevec_add(&walk->pvec, page))
+		lru_gen_walk_flush(walk);
+}
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *mm_walk)
+{
+	struct vm_area_struct *vma = mm_walk->vma;
+
+	/* Not on the evictable lists, or no struct pages to age */
+	if (vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_HUGETLB))
+		return 1;
+
+	return 0;
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr, unsigned long end,
+			    struct mm_walk *mm_walk)
+{
+	struct lru_gen_walk *walk = mm_walk->private;
+	struct vm_area_struct *vma = mm_walk->vma;
+	pte_t *orig_pte, *pte;
+	struct page *page;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		if (pmd_present(*pmd) && pmd_young(*pmd) &&
+		    !is_huge_zero_pmd(*pmd)) {
+			page = pmd_page(*pmd);
+			if (PageLRU(page) &&
+			    lruvec_holds_page_lru_lock(page, walk->lruvec) &&
+			    pmdp_test_and_clear_young(vma, addr, pmd))
+				lru_gen_walk_add(walk, page);
+		}
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+
+		if (!pte_present(ptent) || !pte_young(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		page = compound_head(page);
+		if (!PageLRU(page) ||
+		    !lruvec_holds_page_lru_lock(page, walk->lruvec))
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_walk_add(walk, page);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	cond_resched();
+	return 0;
+}
+
+static bool lru_gen_mm_matches(struct mm_struct *mm, struct lruvec *lruvec)
+{
+#ifdef CONFIG_MEMCG
+	bool ret;
+
+	if (mem_cgroup_disabled())
+		return true;
+
+	rcu_read_lock();
+	ret = mem_cgroup_from_task(rcu_dereference(mm->owner)) ==
+	      lruvec_memcg(lruvec);
+	rcu_read_unlock();
+	return ret;
+#else
+	return true;
+#endif
+}
+
+/*
+ * Harvests the accessed bits from the page tables of every process that
+ * charges to the memcg of the lruvec, instead of following the rmap of each
+ * page. Processes whose mmap_sem is contended are skipped this round.
+ */
+static void lru_gen_walk_mms(struct lru_gen_walk *walk)
+{
+	struct mm_walk mm_walk = {
+		.pmd_entry = lru_gen_walk_pmd,
+		.test_walk = lru_gen_walk_test,
+		.private = walk,
+	};
+	struct task_struct *task;
+	struct mm_struct *mm;
+	struct pid *pid;
+	int nr = 1;
+
+	for (;;) {
+		mm = NULL;
+
+		rcu_read_lock();
+		pid = find_ge_pid(nr, &init_pid_ns);
+		if (pid) {
+			nr = pid_nr(pid) + 1;
+			task = pid_task(pid, PIDTYPE_PID);
+			if (task && thread_group_leader(task))
+				mm = get_task_mm(task);
+		}
+		rcu_read_unlock();
+
+		if (!pid)
+			break;
+		if (!mm)
+			continue;
+
+		if (lru_gen_mm_matches(mm, walk->lruvec) &&
+		    down_read_trylock(&mm->mmap_sem)) {
+			mm_walk.mm = mm;
+			walk_page_range(0, mm->highest_vm_end, &mm_walk);
+			up_read(&mm->mmap_sem);
+		}
+		mmput(mm);
+
+		lru_gen_walk_flush(walk);
+		cond_resched();
+
+		if (fatal_signal_pending(current))
+			break;
+	}
+
+	lru_gen_walk_flush(walk);
+}
+
+/*
+ * Moves the pages accessed since the last round into the youngest generation
+ * and starts a new one. Returns false if another reclaimer is already aging
+ * @lruvec.
+ */
+static bool lru_gen_age(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	struct lru_gen_walk walk = { .lruvec = lruvec };
+	int type;
+
+	if (test_and_set_bit_lock(0, &lrugen->aging))
+		return false;
+
+	pagevec_init(&walk.pvec);
+	lru_gen_walk_mms(&walk);
+
+	lruvec_lock_irq(lruvec);
+	for (type = 0; type < 2; type++) {
+		/* Make room for the new generation */
+		while (lrugen->enabled &&
+		       lrugen->max_seq - lrugen->min_seq[type] + 1 >= MAX_NR_GENS) {
+			if (inc_min_seq(lruvec, type))
+				continue;
+			lruvec_unlock_irq(lruvec);
+			cond_resched();
+			lruvec_lock_irq(lruvec);
+		}
+	}
+	if (lrugen->enabled)
+		inc_max_seq(lruvec);
+	lruvec_unlock_irq(lruvec);
+
+	clear_bit_unlock(0, &lrugen->aging);
+	return true;
+}
+
+static bool lru_gen_can_evict(struct lruvec *lruvec, int type)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+
+	return READ_ONCE(lrugen->min_seq[type]) + MIN_NR_GENS <=
+	       READ_ONCE(lrugen->max_seq);
+}
+
+/* Evicts from the type with the older oldest generation first */
+static int lru_gen_pick_type(struct lruvec *lruvec, unsigned long *nr_to_scan)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	unsigned long anon_seq = READ_ONCE(lrugen->min_seq[0]);
+	unsigned long file_seq = READ_ONCE(lrugen->min_seq[1]);
+
+	if (!nr_to_scan[0])
+		return 1;
+	if (!nr_to_scan[1])
+		return 0;
+	if (anon_seq != file_seq)
+		return file_seq < anon_seq;
+	return nr_to_scan[1] >= nr_to_scan[0];
+}
+
+/*
+ * The multi-gen LRU counterpart of shrink_node_memcg(). get_scan_count()
+ * still decides how much of each type to scan, but the pages all come from
+ * the oldest generations, and there are no active lists to rebalance.
+ */
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+	unsigned long nr[NR_LRU_LISTS];
+	unsigned long nr_to_scan[2];
+	unsigned long nr_reclaimed = 0;
+	struct blk_plug plug;
+	bool aged = false;
+
+	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
+	nr_to_scan[0] = nr[LRU_INACTIVE_ANON] + nr[LRU_ACTIVE_ANON];
+	nr_to_scan[1] = nr[LRU_INACTIVE_FILE] + nr[LRU_ACTIVE_FILE];
+
+	blk_start_plug(&plug);
+	while (nr_to_scan[0] || nr_to_scan[1]) {
+		int type = lru_gen_pick_type(lruvec, nr_to_scan);
+		unsigned long batch;
+
+		if (!lru_gen_can_evict(lruvec, type)) {
+			/* Aging walks every mm of the memcg, so only once */
+			if (aged || !lru_gen_age(lruvec))
+				break;
+			aged = true;
+			continue;
+		}
+
+		batch = min(nr_to_scan[type], SWAP_CLUSTER_MAX);
+		nr_to_scan[type] -= batch;
+		nr_reclaimed += shrink_inactive_list(batch, lruvec, sc,
+						     type * LRU_FILE);
+
+		cond_resched();
+
+		if (nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+	}
+	blk_finish_plug(&plug);
+	sc->nr_reclaimed += nr_reclaimed;
+}
+
+/*
+ * Switching moves every evictable page of an lruvec between the classic
+ * lists and the generations. The flag flips first, so pages added while
+ * the lock is dropped between batches already go to the new side.
+ */
+static void lru_gen_fill(struct lruvec *lruvec)
+{
+	enum lru_list lru;
+	int batch = 0;
+
+	lruvec_lock_irq(lruvec);
+	lruvec->lrugen.enabled = true;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			VM_BUG_ON_PAGE(PageActive(page) != is_active_lru(lru),
+				       page);
+
+			list_del(&page->lru);
+			update_lru_size(lruvec, lru, page_zonenum(page),
+					-hpage_nr_pages(page));
+			/* Active pages go to the youngest generation */
+			lru_gen_add_page(lruvec, page, !is_active_lru(lru));
+
+			if (++batch % LRU_GEN_BATCH == 0) {
+				lruvec_unlock_irq(lruvec);
+				cond_resched();
+				lruvec_lock_irq(lruvec);
+			}
+		}
+	}
+
+	lruvec_unlock_irq(lruvec);
+}
+
+static void lru_gen_drain(struct lruvec *lruvec)
+{
+	struct lru_gen *lrugen = &lruvec->lrugen;
+	int batch = 0;
+	int type, zone;
+	unsigned long seq;
+
+	lruvec_lock_irq(lruvec);
+	lrugen->enabled = false;
+
+	/* Youngest first, each onto the tail, to keep the order */
+	for (type = 0; type < 2; type++) {
+		for (seq = lrugen->max_seq + 1; seq-- > lrugen->min_seq[type];) {
+			int gen = lru_gen_from_seq(seq);
+
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				struct list_head *head =
+					&lrugen->lists[gen][type][zone];
+
+				while (!list_empty(head)) {
+					struct page *page = list_first_entry(head,
+							struct page, lru);
+					bool active = lru_gen_is_active(lruvec, gen);
+
+					lru_gen_del_page(lruvec, page);
+					if (active)
+						SetPageActive(page);
+					add_page_to_lru_list_tail(page, lruvec,
+								  page_lru(page));
+
+					if (++batch % LRU_GEN_BATCH == 0) {
+						lruvec_unlock_irq(lruvec);
+						cond_resched();
+						lruvec_lock_irq(lruvec);
+					}
+				}
+			}
+		}
+	}
+
+	lruvec_unlock_irq(lruvec);
+}
+
+static void lru_gen_change_state(bool enable)
+{
+	struct pglist_data *pgdat;
+	struct mem_cgroup *memcg;
+
+	mutex_lock(&lru_gen_state_mutex);
+
+	if (enable == READ_ONCE(lru_gen_default))
+		goto unlock;
+
+	WRITE_ONCE(lru_gen_default, enable);
+
+	for_each_online_pgdat(pgdat) {
+		memcg = mem_cgroup_iter(NULL, NULL, NULL);
+		do {
+			struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
+
+			if (enable)
+				lru_gen_fill(lruvec);
+			else
+				lru_gen_drain(lruvec);
+
+			memcg = mem_cgroup_iter(NULL, memcg, NULL);
+		} while (memcg);
+	}
+unlock:
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", READ_ONCE(lru_gen_default));
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t len)
+{
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	lru_gen_change_state(enable);
+	return len;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+static int __init lru_gen_init(void)
+{
+	BUILD_BUG_ON(MAX_NR_GENS + 1 > 1U << LRU_GEN_WIDTH);
+	BUILD_BUG_ON(MIN_NR_GENS + 1 >= MAX_NR_GENS);
+
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+	return 0;
+}
+late_initcall(lru_gen_init);
+#else
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct mem_cgroup *memcg,
+				  struct scan_control *sc,
+				  unsigned long *lru_pages)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-node page freer.  Used by both kswapd and direct reclaim.
  */
@@ -2325,6 +2947,11 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	if (lru_gen_enabled(lruvec)) {
+		lru_gen_shrink_lruvec(lruvec, memcg, sc, lru_pages);
+		return;
+	}
+
 	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -3180,7 +3807,9 @@ static void age_active_anon(struct pglist_data *pgdat,
 	do {
 		struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
 
-		if (inactive_list_is_low(lruvec, false, memcg, sc, true))
+		/* The multi-gen LRU ages from reclaim, on demand */
+		if (!lru_gen_enabled(lruvec) &&
+		    inactive_list_is_low(lruvec, false, memcg, sc, true))
 			shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
 					   sc, LRU_ACTIVE_ANON);
 
@@ -4001,24 +4630,16 @@ int page_evictable(struct page *page)
  */
 void check_move_unevictable_pages(struct page **pages, int nr_pages)
 {
-	struct lruvec *lruvec;
-	struct pglist_data *pgdat = NULL;
+	struct lruvec *lruvec = NULL;
 	int pgscanned = 0;
 	int pgrescued = 0;
 	int i;
 
 	for (i = 0; i < nr_pages; i++) {
 		struct page *page = pages[i];
-		struct pglist_data *pagepgdat = page_pgdat(page);
 
 		pgscanned++;
-		if (pagepgdat != pgdat) {
-			if (pgdat)
-				spin_unlock_irq(&pgdat->lru_lock);
-			pgdat = pagepgdat;
-			spin_lock_irq(&pgdat->lru_lock);
-		}
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
+		lruvec = relock_page_lruvec_irq(page, lruvec);
 
 		if (!PageLRU(page) || !PageUnevictable(page))
 			continue;
@@ -4034,10 +4655,10 @@ void check_move_unevictable_pages(struct page **pages, int nr_pages)
 		}
 	}
 
-	if (pgdat) {
+	if (lruvec) {
 		__count_vm_events(UNEVICTABLE_PGRESCUED, pgrescued);
 		__count_vm_events(UNEVICTABLE_PGSCANNED, pgscanned);
-		spin_unlock_irq(&pgdat->lru_lock);
+		lruvec_unlock_irq(lruvec);
 	}
 }
 #endif /* CONFIG_SHMEM */
@@ -0,0 +1,339 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Reclaim under many memory cgroups at once.
+ *
+ * A number of cgroup v2 groups are created, each with a memory.max well
+ * below the size of a file its workers keep streaming through, so every
+ * group reclaims its own page cache all the time. With per-lruvec LRU locks
+ * the groups shouldn't contend with each other. The test checks that the
+ * workers survive and the limits hold, and prints the lru_lock_* counters
+ * from memory.stat when the kernel has CONFIG_LRU_LOCK_STAT.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+#include <sys/wait.h>
+
+#define CGROUP2_SUPER_MAGIC	0x63677270
+#define MAX_GROUPS		256
+#define CHUNK			(1UL << 20)
+#define KSFT_SKIP		4
+
+static const char *cgroup_root = "/sys/fs/cgroup";
+static const char *data_dir = "/tmp";
+static int nr_groups = 8;
+static int nr_workers = 2;
+static size_t limit = 32UL << 20;
+static int seconds = 10;
+
+static const char * const counters[] = {
+	"lru_lock_acquired",
+	"lru_lock_contended",
+	"lru_lock_wait_ns",
+	"lru_lock_hold_ns",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+struct group {
+	char path[256];
+	char file[256];
+	pid_t workers[64];
+	unsigned long long peak;
+};
+
+static struct group groups[MAX_GROUPS];
+
+static int write_file(const char *dir, const char *name, const char *val)
+{
+	char path[512];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val, strlen(val)) == strlen(val) ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+static unsigned long long read_u64(const char *dir, const char *name)
+{
+	unsigned long long val = 0;
+	char path[512];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%llu", &val) != 1)
+		val = 0;
+	fclose(f);
+	return val;
+}
+
+/* Returns how many of the counters memory.stat has */
+static int read_counters(const char *dir, unsigned long long *val)
+{
+	unsigned long long v;
+	char path[512], name[64];
+	int i, found = 0;
+	FILE *f;
+
+	for (i = 0; i < NR_COUNTERS; i++)
+		val[i] = 0;
+
+	snprintf(path, sizeof(path), "%s/memory.stat", dir);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%63s %llu", name, &v) == 2) {
+		for (i = 0; i < NR_COUNTERS; i++) {
+			if (!strcmp(name, counters[i])) {
+				val[i] = v;
+				found++;
+			}
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+static int create_file(const char *path, size_t size)
+{
+	static char buf[CHUNK];
+	size_t off;
+	int fd;
+
+	memset(buf, 0x5a, sizeof(buf));
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+	for (off = 0; off < size; off += CHUNK) {
+		if (write(fd, buf, CHUNK) != CHUNK) {
+			close(fd);
+			return -1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	return 0;
+}
+
+static void worker(struct group *g)
+{
+	static char buf[CHUNK];
+	time_t end = time(NULL) + seconds;
+	char pid[32];
+	off_t off;
+	int fd;
+
+	snprintf(pid, sizeof(pid), "%d", getpid());
+	if (write_file(g->path, "cgroup.procs", pid))
+		exit(2);
+
+	fd = open(g->file, O_RDONLY);
+	if (fd < 0)
+		exit(3);
+
+	while (time(NULL) < end) {
+		for (off = 0; off < 2 * limit; off += CHUNK)
+			if (pread(fd, buf, CHUNK, off) < 0)
+				exit(3);
+	}
+
+	close(fd);
+	exit(0);
+}
+
+static void cleanup(void)
+{
+	int i;
+
+	for (i = 0; i < nr_groups; i++) {
+		if (groups[i].file[0])
+			unlink(groups[i].file);
+		if (groups[i].path[0])
+			rmdir(groups[i].path);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-g groups] [-w workers per group] [-m memory.max MB]\n"
+		"          [-s seconds] [-d data dir] [-c cgroup2 mount]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long val[NR_COUNTERS], total[NR_COUNTERS] = { 0 };
+	bool have_stat = false, failed = false;
+	char max[32];
+	struct statfs sfs;
+	time_t end;
+	int opt, i, j, status;
+
+	while ((opt = getopt(argc, argv, "g:w:m:s:d:c:h")) != -1) {
+		switch (opt) {
+		case 'g':
+			nr_groups = atoi(optarg);
+			break;
+		case 'w':
+			nr_workers = atoi(optarg);
+			break;
+		case 'm':
+			limit = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'd':
+			data_dir = optarg;
+			break;
+		case 'c':
+			cgroup_root = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (nr_groups < 1 || nr_groups > MAX_GROUPS || nr_workers < 1 ||
+	    nr_workers > 64 || !limit || seconds < 1)
+		usage(argv[0]);
+
+	if (geteuid()) {
+		printf("Needs root to create cgroups, skipping\n");
+		return KSFT_SKIP;
+	}
+	if (statfs(cgroup_root, &sfs) || sfs.f_type != CGROUP2_SUPER_MAGIC) {
+		printf("No cgroup2 mount at %s, skipping\n", cgroup_root);
+		return KSFT_SKIP;
+	}
+	if (write_file(cgroup_root, "cgroup.subtree_control", "+memory")) {
+		printf("Cannot enable the memory controller, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	snprintf(max, sizeof(max), "%zu", limit);
+	for (i = 0; i < nr_groups; i++) {
+		struct group *g = &groups[i];
+
+		snprintf(g->path, sizeof(g->path), "%s/lru_lock_stress.%d.%d",
+			 cgroup_root, getpid(), i);
+		if (mkdir(g->path, 0755)) {
+			perror(g->path);
+			g->path[0] = 0;
+			cleanup();
+			return 1;
+		}
+		if (write_file(g->path, "memory.max", max)) {
+			perror("memory.max");
+			cleanup();
+			return 1;
+		}
+
+		snprintf(g->file, sizeof(g->file), "%s/lru_lock_stress.%d.%d",
+			 data_dir, getpid(), i);
+		if (create_file(g->file, 2 * limit)) {
+			perror(g->file);
+			cleanup();
+			return 1;
+		}
+	}
+
+	printf("%d group(s) of %d worker(s), memory.max %zu MB, %ds\n",
+	       nr_groups, nr_workers, limit >> 20, seconds);
+
+	for (i = 0; i < nr_groups; i++) {
+		for (j = 0; j < nr_workers; j++) {
+			pid_t pid = fork();
+
+			if (pid < 0) {
+				perror("fork");
+				failed = true;
+				break;
+			}
+			if (!pid)
+				worker(&groups[i]);
+			groups[i].workers[j] = pid;
+		}
+	}
+
+	/* Sample memory.current while the workers run */
+	end = time(NULL) + seconds;
+	while (time(NULL) < end) {
+		for (i = 0; i < nr_groups; i++) {
+			unsigned long long cur;
+
+			cur = read_u64(groups[i].path, "memory.current");
+			if (cur > groups[i].peak)
+				groups[i].peak = cur;
+		}
+		usleep(100000);
+	}
+
+	for (i = 0; i < nr_groups; i++) {
+		for (j = 0; j < nr_workers; j++) {
+			if (!groups[i].workers[j])
+				continue;
+			if (waitpid(groups[i].workers[j], &status, 0) < 0 ||
+			    !WIFEXITED(status) || WEXITSTATUS(status)) {
+				printf("group %d worker %d failed (status %#x)\n",
+				       i, j, status);
+				failed = true;
+			}
+		}
+	}
+
+	printf("%6s %12s", "group", "peak MB");
+	for (i = 0; i < NR_COUNTERS; i++)
+		printf(" %20s", counters[i]);
+	printf("\n");
+
+	for (i = 0; i < nr_groups; i++) {
+		struct group *g = &groups[i];
+
+		if (g->peak > limit) {
+			printf("group %d went over memory.max: %llu\n",
+			       i, g->peak);
+			failed = true;
+		}
+
+		printf("%6d %12llu", i, g->peak >> 20);
+		if (read_counters(g->path, val) == NR_COUNTERS) {
+			have_stat = true;
+			for (j = 0; j < NR_COUNTERS; j++) {
+				printf(" %20llu", val[j]);
+				total[j] += val[j];
+			}
+		}
+		printf("\n");
+	}
+
+	if (have_stat && total[0])
+		printf("contended %.2f%%, average wait %.0f ns, average hold %.0f ns\n",
+		       100.0 * total[1] / total[0],
+		       total[1] ? (double)total[2] / total[1] : 0,
+		       (double)total[3] / total[0]);
+	else if (!have_stat)
+		printf("No lru_lock stats, kernel built without CONFIG_LRU_LOCK_STAT\n");
+
+	cleanup();
+
+	printf("%s\n", failed ? "FAIL" : "PASS");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page migration throughput with move_pages(2).
+ *
+ * A region is moved back and forth between two NUMA nodes while reader
+ * threads keep it mapped in their TLBs, so that every unmap has to shoot
+ * down remote TLB entries. The run is repeated for each given value of
+ * vm.migrate_copy_threads, which needs root to be changed; otherwise the
+ * current setting is measured.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define MPOL_MF_MOVE	(1 << 1)
+#define MAX_READERS	256
+#define COPY_THREADS	"/proc/sys/vm/migrate_copy_threads"
+
+static unsigned long page_size;
+static size_t region_size = 1024UL << 20;
+static char *region;
+
+static volatile bool stop;
+
+static long move_pages(unsigned long count, void **pages, const int *nodes,
+		       int *status)
+{
+	return syscall(__NR_move_pages, 0, count, pages, nodes, status,
+		       MPOL_MF_MOVE);
+}
+
+static void *reader(void *arg)
+{
+	unsigned long sum = 0;
+	size_t off;
+
+	while (!stop)
+		for (off = 0; off < region_size && !stop; off += page_size)
+			sum += *(volatile char *)(region + off);
+
+	return (void *)sum;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int set_copy_threads(int threads)
+{
+	FILE *f = fopen(COPY_THREADS, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%d\n", threads) < 0;
+	return fclose(f) || ret ? -1 : 0;
+}
+
+static int get_copy_threads(void)
+{
+	FILE *f = fopen(COPY_THREADS, "r");
+	int threads = 0;
+
+	if (!f)
+		return 0;
+	if (fscanf(f, "%d", &threads) != 1)
+		threads = 0;
+	fclose(f);
+	return threads;
+}
+
+/* Move all pages to node, returning how many didn't end up there */
+static unsigned long move_all(void **pages, int *nodes, int *status,
+			      unsigned long nr, int node)
+{
+	unsigned long i, failed = 0;
+
+	for (i = 0; i < nr; i++)
+		nodes[i] = node;
+
+	if (move_pages(nr, pages, nodes, status) < 0) {
+		perror("move_pages");
+		exit(1);
+	}
+
+	for (i = 0; i < nr; i++)
+		if (status[i] != node)
+			failed++;
+	return failed;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-m region MB] [-r reader threads] [-i iterations]\n"
+		"          [-a node] [-b node] [copy threads...]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t readers[MAX_READERS];
+	int nr_readers = 4, iterations = 5;
+	int node_a = 0, node_b = 1;
+	unsigned long nr, i, failed;
+	void **pages;
+	int *nodes, *status;
+	int opt, arg, it, threads;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	while ((opt = getopt(argc, argv, "m:r:i:a:b:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			region_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'r':
+			nr_readers = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'a':
+			node_a = atoi(optarg);
+			break;
+		case 'b':
+			node_b = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!region_size || nr_readers < 0 || nr_readers > MAX_READERS ||
+	    iterations < 1 || node_a == node_b)
+		usage(argv[0]);
+
+	nr = region_size / page_size;
+	pages = malloc(nr * sizeof(*pages));
+	nodes = malloc(nr * sizeof(*nodes));
+	status = malloc(nr * sizeof(*status));
+	if (!pages || !nodes || !status) {
+		perror("malloc");
+		return 1;
+	}
+
+	region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	memset(region, 1, region_size);
+	for (i = 0; i < nr; i++)
+		pages[i] = region + i * page_size;
+
+	/* Check that there are two nodes to move between */
+	nodes[0] = node_b;
+	if (move_pages(1, pages, nodes, status) || status[0] != node_b) {
+		printf("Cannot move pages between nodes %d and %d, skipping\n",
+		       node_a, node_b);
+		return 4;
+	}
+	move_all(pages, nodes, status, nr, node_a);
+
+	for (i = 0; i < nr_readers; i++) {
+		if (pthread_create(&readers[i], NULL, reader, NULL)) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	printf("%zu MB between nodes %d and %d, %d reader(s), %d round trip(s)\n",
+	       region_size >> 20, node_a, node_b, nr_readers, iterations);
+	printf("%14s %12s %10s\n", "copy threads", "MB/s", "failed");
+
+	arg = optind;
+	do {
+		double start, elapsed;
+
+		if (arg < argc) {
+			threads = atoi(argv[arg]);
+			if (set_copy_threads(threads)) {
+				perror(COPY_THREADS);
+				return 1;
+			}
+		}
+		threads = get_copy_threads();
+
+		failed = 0;
+		start = now();
+		for (it = 0; it < iterations; it++) {
+			failed += move_all(pages, nodes, status, nr, node_b);
+			failed += move_all(pages, nodes, status, nr, node_a);
+		}
+		elapsed = now() - start;
+
+		printf("%14d %12.0f %10lu\n", threads,
+		       2.0 * iterations * (region_size >> 20) / elapsed, failed);
+	} while (++arg < argc);
+
+	stop = true;
+	for (i = 0; i < nr_readers; i++)
+		pthread_join(readers[i], NULL);
+
+	munmap(region, region_size);
+	return 0;
+}
@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page cache read throughput and CPU cost per GB.
+ *
+ * A file is streamed with read(2) twice per iteration: once cold, after
+ * POSIX_FADV_DONTNEED dropped its page cache, which measures readahead, and
+ * once warm, which measures page cache lookups and copies. The run is
+ * repeated for each given value of transparent_hugepage/file_readahead,
+ * which needs root to be changed; otherwise the current setting is
+ * measured. The thp_file_* counters and nr_file_hugepages from /proc/vmstat
+ * show whether readahead actually used huge pages.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#define FILE_READAHEAD	"/sys/kernel/mm/transparent_hugepage/file_readahead"
+#define CHUNK		(1UL << 20)
+#define KSFT_SKIP	4
+
+static size_t file_size = 1024UL << 20;
+static size_t buf_size = 1UL << 20;
+static char *buf;
+
+static const char * const counters[] = {
+	"thp_file_alloc",
+	"thp_file_fallback",
+	"nr_file_hugepages",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+struct result {
+	double secs;
+	double cpu;
+};
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	FILE *f;
+	int i;
+
+	for (i = 0; i < NR_COUNTERS; i++)
+		val[i] = 0;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+
+	while (fscanf(f, "%63s %llu", name, &v) == 2) {
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	}
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static int set_file_readahead(const char *val)
+{
+	FILE *f = fopen(FILE_READAHEAD, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%s\n", val) < 0;
+	return fclose(f) || ret ? -1 : 0;
+}
+
+static int get_file_readahead(void)
+{
+	FILE *f = fopen(FILE_READAHEAD, "r");
+	int val = -1;
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static int create_file(const char *path, size_t size)
+{
+	static char chunk[CHUNK];
+	size_t off;
+	int fd;
+
+	memset(chunk, 0x5a, sizeof(chunk));
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+	for (off = 0; off < size; off += CHUNK) {
+		if (write(fd, chunk, CHUNK) != CHUNK) {
+			close(fd);
+			return -1;
+		}
+	}
+	fsync(fd);
+	close(fd);
+	return 0;
+}
+
+/* Read the whole file, returning the wall clock and CPU seconds taken */
+static struct result stream(int fd)
+{
+	struct result r;
+	double start = now(), cpu = cpu_time();
+	size_t total = 0;
+	ssize_t ret;
+
+	if (lseek(fd, 0, SEEK_SET)) {
+		perror("lseek");
+		exit(1);
+	}
+	while ((ret = read(fd, buf, buf_size)) > 0)
+		total += ret;
+	if (ret < 0 || total != file_size) {
+		perror("read");
+		exit(1);
+	}
+
+	r.secs = now() - start;
+	r.cpu = cpu_time() - cpu;
+	return r;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-f file] [-m file MB] [-b read size KB] [-i iterations]\n"
+		"          [file_readahead values...]\n"
+		"  -f reads the given file, which is created if it doesn't exist;\n"
+		"     by default a temporary file is created in the current\n"
+		"     directory, which should be on a filesystem supporting\n"
+		"     read-only THPs (ext4)\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	char tmp[64], *file = NULL;
+	int iterations = 3;
+	bool created = false;
+	struct stat st;
+	int opt, arg, it, i, fd, mode;
+
+	while ((opt = getopt(argc, argv, "f:m:b:i:h")) != -1) {
+		switch (opt) {
+		case 'f':
+			file = optarg;
+			break;
+		case 'm':
+			file_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			buf_size = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!file_size || !buf_size || iterations < 1)
+		usage(argv[0]);
+
+	if (optind < argc && get_file_readahead() < 0) {
+		printf("No %s, kernel built without CONFIG_READ_ONLY_THP_FOR_FS, skipping\n",
+		       FILE_READAHEAD);
+		return KSFT_SKIP;
+	}
+
+	if (!file) {
+		snprintf(tmp, sizeof(tmp), "pagecache_read_bench.%d", getpid());
+		file = tmp;
+	}
+	if (stat(file, &st)) {
+		if (create_file(file, file_size)) {
+			perror(file);
+			unlink(file);
+			return 1;
+		}
+		created = true;
+	} else {
+		file_size = st.st_size;
+	}
+
+	buf = malloc(buf_size);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+
+	/* Huge pages are only used while nobody has the file open for write */
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		perror(file);
+		return 1;
+	}
+
+	printf("%zu MB file, %zu KB reads, %d iteration(s)\n",
+	       file_size >> 20, buf_size >> 10, iterations);
+	printf("%14s %10s %13s %10s %13s %12s %12s %12s\n", "file_readahead",
+	       "cold MB/s", "cold CPU s/GB", "warm MB/s", "warm CPU s/GB",
+	       "thp_alloc", "thp_fallback", "file_thps");
+
+	arg = optind;
+	do {
+		struct result cold = { 0 }, warm = { 0 }, r;
+		double gb = (double)file_size * iterations / (1UL << 30);
+
+		if (arg < argc && set_file_readahead(argv[arg])) {
+			perror(FILE_READAHEAD);
+			return 1;
+		}
+		mode = get_file_readahead();
+
+		read_vmstat(before);
+		for (it = 0; it < iterations; it++) {
+			if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) {
+				perror("posix_fadvise");
+				return 1;
+			}
+			r = stream(fd);
+			cold.secs += r.secs;
+			cold.cpu += r.cpu;
+			/* Sample while the file is still fully cached */
+			read_vmstat(after);
+
+			r = stream(fd);
+			warm.secs += r.secs;
+			warm.cpu += r.cpu;
+		}
+
+		if (mode < 0)
+			printf("%14s", "-");
+		else
+			printf("%14d", mode);
+		printf(" %10.0f %13.3f %10.0f %13.3f",
+		       gb * 1024 / cold.secs, cold.cpu / gb,
+		       gb * 1024 / warm.secs, warm.cpu / gb);
+		for (i = 0; i < NR_COUNTERS - 1; i++)
+			printf(" %12llu", after[i] - before[i]);
+		printf(" %12llu\n", after[NR_COUNTERS - 1]);
+	} while (++arg < argc);
+
+	close(fd);
+	if (created)
+		unlink(file);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page fault scaling under mmap_sem writers, in the style of will-it-scale's
+ * page_fault tests.
+ *
+ * Each worker thread repeatedly write faults a private region and zaps it
+ * again with MADV_DONTNEED, which keeps the vma and its page tables. A
+ * number of churn threads meanwhile mmap() and munmap() small areas, which
+ * takes mmap_sem for write. The run is repeated for 1, 2, 4... workers and
+ * the faults per second are reported along with how the speculative fault
+ * counters in /proc/vmstat moved.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_THREADS	1024
+
+static unsigned long page_size;
+static size_t region_size = 16UL << 20;
+static int seconds = 5;
+static int file_fd = -1;
+
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long faults;
+} __attribute__((aligned(64)));
+
+static struct worker workers[MAX_THREADS];
+
+static const char * const counters[] = {
+	"speculative_pgfault",
+	"speculative_pgfault_skip",
+	"speculative_pgfault_abort",
+};
+#define NR_COUNTERS	(sizeof(counters) / sizeof(counters[0]))
+
+static void read_vmstat(unsigned long long *val)
+{
+	char name[64];
+	unsigned long long v;
+	FILE *f;
+	int i;
+
+	for (i = 0; i < NR_COUNTERS; i++)
+		val[i] = 0;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+
+	while (fscanf(f, "%63s %llu", name, &v) == 2) {
+		for (i = 0; i < NR_COUNTERS; i++)
+			if (!strcmp(name, counters[i]))
+				val[i] = v;
+	}
+	fclose(f);
+}
+
+static void *map_region(void)
+{
+	void *p;
+
+	if (file_fd >= 0)
+		p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE, file_fd, 0);
+	else
+		p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return p;
+}
+
+static void *fault_worker(void *arg)
+{
+	struct worker *w = arg;
+	char *p = map_region();
+	unsigned long faults = 0;
+	size_t off;
+
+	while (!stop) {
+		for (off = 0; off < region_size; off += page_size)
+			p[off] = 1;
+		faults += region_size / page_size;
+		madvise(p, region_size, MADV_DONTNEED);
+	}
+
+	munmap(p, region_size);
+	w->faults = faults;
+	return NULL;
+}
+
+static void *churn_worker(void *arg)
+{
+	size_t len = 16 * page_size;
+	void *p;
+
+	while (!stop) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			continue;
+		/* Split and merge the vma like an allocator trimming */
+		mprotect(p, page_size, PROT_NONE);
+		munmap(p, len);
+	}
+	return NULL;
+}
+
+static double run(int nr_workers, int nr_churn)
+{
+	pthread_t churn[MAX_THREADS];
+	unsigned long total = 0;
+	int i;
+
+	stop = false;
+	for (i = 0; i < nr_workers; i++) {
+		workers[i].faults = 0;
+		if (pthread_create(&workers[i].thread, NULL, fault_worker,
+				   &workers[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nr_churn; i++) {
+		if (pthread_create(&churn[i], NULL, churn_worker, NULL)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	sleep(seconds);
+	stop = true;
+
+	for (i = 0; i < nr_churn; i++)
+		pthread_join(churn[i], NULL);
+	for (i = 0; i < nr_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total += workers[i].faults;
+	}
+
+	return (double)total / seconds;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t max threads] [-c churn threads] [-s seconds]\n"
+		"          [-m region MB per thread] [-f file]\n"
+		"  -f faults a private mapping of the given file instead of\n"
+		"     anonymous memory; the file is extended to the region size\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_COUNTERS], after[NR_COUNTERS];
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *file = NULL;
+	int nr_churn = 1;
+	double base = 0;
+	int opt, n, i;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	while ((opt = getopt(argc, argv, "t:c:s:m:f:h")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'c':
+			nr_churn = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			region_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (max_threads < 1 || max_threads > MAX_THREADS ||
+	    nr_churn < 0 || nr_churn > MAX_THREADS ||
+	    seconds < 1 || !region_size)
+		usage(argv[0]);
+
+	if (file) {
+		file_fd = open(file, O_RDWR | O_CREAT, 0600);
+		if (file_fd < 0 || ftruncate(file_fd, region_size)) {
+			perror(file);
+			return 1;
+		}
+	}
+
+	printf("%s faults, %zu MB per thread, %d churn thread(s), %ds per run\n",
+	       file ? "file" : "anon", region_size >> 20, nr_churn, seconds);
+	printf("%8s %14s %8s %12s %12s %12s\n", "threads", "faults/s",
+	       "scaling", "spf", "spf_skip", "spf_abort");
+
+	for (n = 1; ; n = n * 2 > max_threads ? max_threads : n * 2) {
+		double rate;
+
+		read_vmstat(before);
+		rate = run(n, nr_churn);
+		read_vmstat(after);
+		if (n == 1)
+			base = rate;
+
+		printf("%8d %14.0f %7.2fx", n, rate, base ? rate / base : 0);
+		for (i = 0; i < NR_COUNTERS; i++)
+			printf(" %12llu", after[i] - before[i]);
+		printf("\n");
+
+		if (n == max_threads)
+			break;
+	}
+
+	if (file_fd >= 0)
+		close(file_fd);
+
+	return 0;
+}